@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "buffer_pool.h"
+
+// Threads allocating messages, fanning each out to several queues and
+// releasing them again as the queues drain, through the buffer pool and
+// through malloc() with a reference count of its own. Each thread keeps a
+// window of messages alive, so buffers are released some time after they
+// were allocated.
+#define MESSAGE_SIZE 200
+#define FANOUT 4
+#define WINDOW 256
+#define ROUNDS 200000
+
+typedef struct
+{
+  _Atomic uint32_t refs;
+  char data[MESSAGE_SIZE];
+} malloc_msg;
+
+typedef struct
+{
+  buffer_pool *pool;   // NULL to use malloc()
+  uint64_t failures;
+} worker_arg;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *pool_worker(void *p)
+{
+  worker_arg *arg = p;
+  void *window[WINDOW] = {NULL};
+
+  for (int i = 0; i < ROUNDS; i++)
+  {
+    int slot = i % WINDOW;
+    if (window[slot] != NULL)
+    {
+      for (int q = 0; q < FANOUT; q++)
+      {
+        buffer_release(window[slot]);
+      }
+    }
+
+    char *buf = buffer_alloc(arg->pool);
+    window[slot] = buf;
+    if (buf == NULL)
+    {
+      arg->failures++;
+      continue;
+    }
+    memset(buf, i, 16);
+    for (int q = 1; q < FANOUT; q++)
+    {
+      buffer_retain(buf);
+    }
+  }
+
+  for (int slot = 0; slot < WINDOW; slot++)
+  {
+    for (int q = 0; window[slot] != NULL && q < FANOUT; q++)
+    {
+      buffer_release(window[slot]);
+    }
+  }
+  return NULL;
+}
+
+static void *malloc_worker(void *p)
+{
+  worker_arg *arg = p;
+  malloc_msg *window[WINDOW] = {NULL};
+
+  for (int i = 0; i < ROUNDS; i++)
+  {
+    int slot = i % WINDOW;
+    if (window[slot] != NULL)
+    {
+      for (int q = 0; q < FANOUT; q++)
+      {
+        if (atomic_fetch_sub_explicit(&window[slot]->refs, 1, memory_order_acq_rel) == 1)
+        {
+          free(window[slot]);
+        }
+      }
+    }
+
+    malloc_msg *msg = malloc(sizeof(malloc_msg));
+    window[slot] = msg;
+    if (msg == NULL)
+    {
+      arg->failures++;
+      continue;
+    }
+    atomic_store_explicit(&msg->refs, 1, memory_order_relaxed);
+    memset(msg->data, i, 16);
+    for (int q = 1; q < FANOUT; q++)
+    {
+      atomic_fetch_add_explicit(&msg->refs, 1, memory_order_relaxed);
+    }
+  }
+
+  for (int slot = 0; slot < WINDOW; slot++)
+  {
+    if (window[slot] != NULL)
+    {
+      free(window[slot]);
+    }
+  }
+  return NULL;
+}
+
+// Messages per second over all threads
+static double run(int threads, buffer_pool *pool)
+{
+  pthread_t ids[16];
+  worker_arg args[16];
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < threads; i++)
+  {
+    args[i].pool = pool;
+    args[i].failures = 0;
+    pthread_create(&ids[i], NULL, pool != NULL ? pool_worker : malloc_worker, &args[i]);
+  }
+  for (int i = 0; i < threads; i++)
+  {
+    pthread_join(ids[i], NULL);
+    if (args[i].failures > 0)
+    {
+      printf("%llu allocations failed\n", (unsigned long long)args[i].failures);
+    }
+  }
+  return (double)threads * ROUNDS / ((now_ns() - start) / 1e9);
+}
+
+int main()
+{
+  const int thread_counts[] = {1, 2, 4, 8};
+
+  for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+  {
+    int threads = thread_counts[t];
+    buffer_pool pool;
+    buffer_pool_stats stats;
+    if (buffer_pool_init(&pool, MESSAGE_SIZE, BUFFER_POOL_HUGE_PAGES) < 0)
+    {
+      printf("Could not create the pool\n");
+      return 1;
+    }
+
+    double pooled = run(threads, &pool);
+    double malloced = run(threads, NULL);
+    buffer_pool_get_stats(&pool, &stats);
+    printf("%d threads: %.2f M messages/s pooled, %.2f M messages/s with malloc(); "
+           "%zu slabs (%zu huge), %llu refills, %llu spills, %llu in use\n",
+           threads, pooled / 1e6, malloced / 1e6, stats.slabs, stats.huge_slabs,
+           (unsigned long long)stats.refills, (unsigned long long)stats.spills,
+           (unsigned long long)stats.in_use);
+    buffer_pool_destroy(&pool);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chatroom.h"
+
+// Broadcast latency from one sender to rooms of 1 to 10,000 members. Only
+// the fan-out is timed, the members have no connections to flush to.
+#define MAX_RECIPIENTS 10000
+#define ROUNDS 200
+#define TEXT_SIZE 512
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Shared fan-out: encode once, queue a pointer per recipient
+static uint64_t bench_shared(chat_directory *dir, chat_room *room, chat_member *members, int count,
+                             const char *text)
+{
+  uint64_t total = 0;
+
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    uint64_t start = now_ns();
+    chat_msg *msg = chat_msg_encode(room->name, "sender", text, TEXT_SIZE);
+    chat_room_broadcast(dir, room, msg, NULL);
+    chat_msg_release(msg);
+    total += now_ns() - start;
+
+    for (int i = 0; i < count; i++)
+    {
+      chat_member_clear(&members[i]);
+    }
+  }
+
+  return total / ROUNDS;
+}
+
+// What the fan-out costs with one encoded copy per recipient
+static uint64_t bench_copied(chat_directory *dir, chat_room *room, chat_member *members, int count,
+                             const char *text)
+{
+  const slot_set *set = room_index_members(&dir->index, room->id);
+  uint64_t total = 0;
+
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    uint64_t start = now_ns();
+    for (int64_t slot = slot_set_next(set, 0); slot >= 0; slot = slot_set_next(set, slot + 1))
+    {
+      chat_msg *msg = chat_msg_encode(room->name, "sender", text, TEXT_SIZE);
+      chat_member_enqueue(dir->slots[slot], msg);
+      chat_msg_release(msg);
+    }
+    total += now_ns() - start;
+
+    for (int i = 0; i < count; i++)
+    {
+      chat_member_clear(&members[i]);
+    }
+  }
+
+  return total / ROUNDS;
+}
+
+int main()
+{
+  static char text[TEXT_SIZE];
+  chat_member *members = calloc(MAX_RECIPIENTS, sizeof(chat_member));
+  if (members == NULL)
+  {
+    perror("calloc failed for members");
+    return 1;
+  }
+  memset(text, 'x', sizeof(text));
+
+  printf("Broadcast of a %d byte message, mean of %d rounds\n", TEXT_SIZE, ROUNDS);
+  printf("%10s %8s %14s %14s %14s\n", "recipients", "spread", "shared (us)", "ns/recipient",
+         "copied (us)");
+
+  // Rooms filling the connection table, then rooms whose members are
+  // spread over it one slot in every spread
+  for (int spread = 1; spread <= 100; spread *= 10)
+  {
+    for (int count = 1; count * spread <= MAX_RECIPIENTS; count *= 10)
+    {
+      chat_directory dir;
+      chat_directory_init(&dir, NULL);
+      chat_room *room = chat_directory_room(&dir, "lobby");
+      for (int i = 0; i < count * spread; i++)
+      {
+        chat_member_init(&members[i], NULL, "member");
+        chat_directory_add(&dir, &members[i]);
+        if (i % spread == 0)
+        {
+          chat_room_join(&dir, room, &members[i]);
+        }
+      }
+
+      uint64_t shared = bench_shared(&dir, room, members, count * spread, text);
+      uint64_t copied = bench_copied(&dir, room, members, count * spread, text);
+      printf("%10d %8d %14.2f %14.1f %14.2f\n", count, spread, shared / 1000.0,
+             (double)shared / count, copied / 1000.0);
+
+      chat_directory_free(&dir);
+    }
+  }
+
+  free(members);
+  return 0;
+}
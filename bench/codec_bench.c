@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "codec.h"
+#include "framing.h"
+#include "packet.h"
+
+// Bytes and segments on the wire for chat messages framed as they are and
+// compressed, and the codec's speed. The corpus is typical chat lines as
+// the chat server relays them, with the room and sender in front.
+#define ROUNDS 2000
+
+static const char *corpus[] = {
+  "[lobby] alice: good morning everyone",
+  "[lobby] bob: morning! anyone know if the server update went out last night?",
+  "[lobby] carol: yeah it did, I think there was a problem with the version check though",
+  "[lobby] alice: ok thanks, I'll have a look after the meeting",
+  "[dev] dave: can you send me the link to the build logs?",
+  "[dev] erin: https://github.com/example/chat/actions/runs/4812",
+  "[dev] dave: thx",
+  "[dev] frank: the client keeps dropping the connection when I switch networks, is that expected?",
+  "[dev] erin: it should resume with the token, which version are you on?",
+  "[dev] frank: the one from yesterday afternoon, I'll update and try again",
+  "[random] grace: lol did you see that video",
+  "[random] heidi: haha yes, sending it to everyone I know",
+  "[random] ivan: happy birthday mallory!! hope you have a great day",
+  "[random] mallory: thank you so much everyone :)",
+  "[lobby] bob: is anyone going to be online this weekend? I could use some help with the migration",
+  "[lobby] carol: I should be around on Saturday morning, let me know what time works for you",
+  "[lobby] bob: perfect, how about 10 o'clock?",
+  "[lobby] carol: sure",
+  "[dev] erin: to be honest I don't think we need the extra queue, the ring already covers it",
+  "[dev] dave: probably right, but what happens when a room gets really busy?",
+  "[dev] erin: then the oldest messages are evicted and new members read them from the log instead",
+  "[dev] frank: makes sense. btw the tests are failing on my machine, something about a port in use",
+  "[dev] dave: another test run still had it open, just wait a few seconds",
+  "[random] grace: brb, getting coffee",
+  "[random] heidi: np",
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t segments(size_t bytes)
+{
+  return (bytes + MAX_PAYLOAD_SIZE - 1) / MAX_PAYLOAD_SIZE;
+}
+
+int main()
+{
+  static char frame[FRAME_COMPRESSED_HEADER_SIZE + FRAME_MAX_MESSAGE];
+  static char packed[CODEC_BOUND(FRAME_MAX_MESSAGE)];
+  static char unpacked[FRAME_MAX_MESSAGE];
+  const int count = sizeof(corpus) / sizeof(corpus[0]);
+
+  // Each message in its own frame and segments, as ct_send_message()
+  // sends it with nothing else queued
+  size_t text_bytes = 0, plain_bytes = 0, sent_bytes = 0;
+  size_t plain_segments = 0, sent_segments = 0;
+  int compressed = 0;
+  for (int i = 0; i < count; i++)
+  {
+    size_t len = strlen(corpus[i]);
+    size_t frame_len = frame_encode_compressed(corpus[i], len, frame, sizeof(frame));
+    compressed += frame_len > 0;
+    if (frame_len == 0)
+    {
+      frame_len = FRAME_HEADER_SIZE + len;
+    }
+    text_bytes += len;
+    plain_bytes += FRAME_HEADER_SIZE + len;
+    sent_bytes += frame_len;
+    plain_segments += segments(FRAME_HEADER_SIZE + len);
+    sent_segments += segments(frame_len);
+  }
+
+  printf("%d messages, %zu bytes of text, %d compressed\n", count, text_bytes, compressed);
+  printf("%12s %10s %10s\n", "", "bytes", "segments");
+  printf("%12s %10zu %10zu\n", "plain", plain_bytes, plain_segments);
+  printf("%12s %10zu %10zu\n", "compressed", sent_bytes, sent_segments);
+  printf("Ratio %.2fx in bytes, %.2fx in segments\n", (double)plain_bytes / sent_bytes,
+         (double)plain_segments / sent_segments);
+
+  // Speed over the whole corpus, message by message
+  uint64_t packed_ns = 0, unpacked_ns = 0;
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      size_t len = strlen(corpus[i]);
+      uint64_t start = now_ns();
+      size_t packed_len = codec_compress(corpus[i], len, packed, sizeof(packed));
+      uint64_t middle = now_ns();
+      if (codec_decompress(packed, packed_len, unpacked, len) != (int)len)
+      {
+        fprintf(stderr, "Round trip failed for message %d\n", i);
+        return 1;
+      }
+      packed_ns += middle - start;
+      unpacked_ns += now_ns() - middle;
+    }
+  }
+
+  double total = (double)text_bytes * ROUNDS;
+  printf("Compress   %8.1f MB/s, %6.0f ns/message\n", total / packed_ns * 1000.0,
+         (double)packed_ns / ROUNDS / count);
+  printf("Decompress %8.1f MB/s, %6.0f ns/message\n", total / unpacked_ns * 1000.0,
+         (double)unpacked_ns / ROUNDS / count);
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "drr.h"
+
+// Cost of picking the next sender among 10 to 10,000 busy flows, by
+// deficit round robin and by scanning for the flow that has sent the
+// fewest bytes. A flow in every 16 goes idle after its turn and another
+// one comes back, as members drain their queues and new messages arrive.
+#define MAX_FLOWS 10000
+#define DECISIONS 1000000
+#define SCAN_DECISIONS 20000 // Fewer, scanning 10,000 flows each time is slow
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t message_size(uint32_t i)
+{
+  return 40 + (i * 2654435761u) % 960;
+}
+
+static uint64_t bench_drr(int count)
+{
+  static drr_flow flows[MAX_FLOWS];
+  drr_sched sched;
+
+  drr_init(&sched);
+  for (int i = 0; i < count; i++)
+  {
+    drr_flow_init(&flows[i], i % 4 == 0 ? DRR_BULK : DRR_INTERACTIVE, 1);
+    drr_activate(&sched, &flows[i]);
+  }
+
+  int idle = -1;
+  uint64_t start = now_ns();
+  for (uint32_t i = 0; i < DECISIONS; i++)
+  {
+    drr_flow *flow = drr_next(&sched);
+    drr_charge(&sched, flow, message_size(i));
+    if (i % 16 == 0)
+    {
+      drr_remove(&sched, flow);
+      if (idle >= 0)
+      {
+        drr_activate(&sched, &flows[idle]);
+      }
+      idle = flow - flows;
+    }
+  }
+  return (now_ns() - start) * 1000 / DECISIONS;
+}
+
+static uint64_t bench_scan(int count)
+{
+  static uint64_t sent[MAX_FLOWS];
+  static int active[MAX_FLOWS];
+
+  for (int i = 0; i < count; i++)
+  {
+    sent[i] = 0;
+    active[i] = 1;
+  }
+
+  int idle = -1;
+  uint64_t start = now_ns();
+  for (uint32_t i = 0; i < SCAN_DECISIONS; i++)
+  {
+    int best = -1;
+    for (int f = 0; f < count; f++)
+    {
+      if (active[f] && (best < 0 || sent[f] < sent[best]))
+      {
+        best = f;
+      }
+    }
+    sent[best] += message_size(i);
+    if (i % 16 == 0)
+    {
+      active[best] = 0;
+      if (idle >= 0)
+      {
+        active[idle] = 1;
+      }
+      idle = best;
+    }
+  }
+  return (now_ns() - start) * 1000 / SCAN_DECISIONS;
+}
+
+int main()
+{
+  const int flow_counts[] = {10, 100, 1000, 10000};
+
+  for (size_t i = 0; i < sizeof(flow_counts) / sizeof(flow_counts[0]); i++)
+  {
+    int count = flow_counts[i];
+    uint64_t drr = bench_drr(count);
+    uint64_t scan = bench_scan(count);
+    printf("%5d flows: %6.1f ns per decision with deficit round robin, %8.1f ns scanning\n", count,
+           drr / 1000.0, scan / 1000.0);
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fec.h"
+#include "gf256.h"
+#include "packet.h"
+
+// Speed of the GF(2^8) multiply, one byte at a time and through
+// gf256_mul_add(), and of coding and rebuilding the largest block: 16 full
+// segments with 4 parity segments, 4 of the segments lost
+#define MUL_BYTES (64 * 1024)
+#define MUL_ROUNDS 200
+#define BLOCK_ROUNDS 20000
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main()
+{
+  static uint8_t src[MUL_BYTES], dst[MUL_BYTES];
+  for (size_t i = 0; i < MUL_BYTES; i++)
+  {
+    src[i] = rand();
+  }
+
+  uint64_t start = now_ns();
+  for (int r = 0; r < MUL_ROUNDS; r++)
+  {
+    uint8_t c = r % 254 + 2;
+    for (size_t i = 0; i < MUL_BYTES; i++)
+    {
+      dst[i] ^= gf256_mul(c, src[i]);
+    }
+  }
+  double bytewise = (double)MUL_BYTES * MUL_ROUNDS / ((now_ns() - start) / 1e9) / 1e6;
+
+  start = now_ns();
+  for (int r = 0; r < MUL_ROUNDS; r++)
+  {
+    gf256_mul_add(dst, src, r % 254 + 2, MUL_BYTES);
+  }
+  double vector = (double)MUL_BYTES * MUL_ROUNDS / ((now_ns() - start) / 1e9) / 1e6;
+  printf("GF(2^8) multiply-add: %.0f MB/s a byte at a time, %.0f MB/s with gf256_mul_add()\n",
+         bytewise, vector);
+
+  packet segments[FEC_MAX_DATA];
+  packet parity[FEC_MAX_PARITY];
+  packet rebuilt[FEC_MAX_PARITY];
+  for (int i = 0; i < FEC_MAX_DATA; i++)
+  {
+    memset(&segments[i], 0, sizeof(packet));
+    segments[i].seq_num = 1000 + i * MAX_PAYLOAD_SIZE;
+    segments[i].data_offset = STREAM_DATA_OFFSET;
+    segments[i].payload_len = MAX_PAYLOAD_SIZE;
+    for (int j = 0; j < MAX_PAYLOAD_SIZE; j++)
+    {
+      segments[i].payload[j] = rand();
+    }
+  }
+
+  // Coding the block
+  fec_encoder enc;
+  fec_encoder_init(&enc);
+  start = now_ns();
+  for (int r = 0; r < BLOCK_ROUNDS; r++)
+  {
+    enc.loss_rate = FEC_LOSS_ONE / 16;
+    for (int i = 0; i < FEC_MAX_DATA; i++)
+    {
+      fec_encoder_add(&enc, &segments[i]);
+    }
+    for (int j = 0; j < fec_encoder_pending(&enc); j++)
+    {
+      fec_encoder_parity(&enc, j, &parity[j]);
+    }
+    fec_encoder_close(&enc);
+  }
+  uint64_t encode_ns = (now_ns() - start) / BLOCK_ROUNDS;
+
+  // Rebuilding 4 segments of it
+  static fec_decoder dec;
+  fec_decoder_init(&dec);
+  uint64_t decode_total = 0;
+  int failed = 0;
+  for (int r = 0; r < BLOCK_ROUNDS; r++)
+  {
+    for (int i = 0; i < FEC_MAX_DATA; i++)
+    {
+      if (i % 4 != 1)
+      {
+        fec_decoder_add_data(&dec, &segments[i], MAX_PAYLOAD_SIZE);
+      }
+    }
+    start = now_ns();
+    int block = -1;
+    for (int j = 0; j < FEC_MAX_PARITY; j++)
+    {
+      block = fec_decoder_add_parity(&dec, &parity[j]);
+    }
+    failed += fec_decoder_recover(&dec, block, rebuilt) != 4;
+    decode_total += now_ns() - start;
+  }
+  uint64_t decode_ns = decode_total / BLOCK_ROUNDS;
+
+  size_t block_bytes = FEC_MAX_DATA * MAX_PAYLOAD_SIZE;
+  printf("Reed-Solomon 16+4: coding %llu ns per block (%.0f MB/s), rebuilding 4 segments %llu ns "
+         "per block\n",
+         (unsigned long long)encode_ns, block_bytes / (encode_ns / 1e9) / 1e6,
+         (unsigned long long)decode_ns);
+  if (failed > 0)
+  {
+    printf("%d blocks failed to rebuild\n", failed);
+    return 1;
+  }
+  return 0;
+}
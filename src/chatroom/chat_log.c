@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chat_log.h"
+
+#define RECORD_ALIGN 8
+
+// Space a record of len message bytes takes
+static uint32_t record_size(uint32_t len)
+{
+  return sizeof(chat_log_record) + ((len + RECORD_ALIGN - 1) & ~(uint32_t)(RECORD_ALIGN - 1));
+}
+
+// FNV-1a over the header fields and the message, enough to tell a record
+// that was written completely from a torn one
+static uint32_t record_check(uint64_t id, uint32_t len, const char *data)
+{
+  uint32_t hash = 2166136261u;
+  uint8_t header[12];
+
+  memcpy(header, &id, 8);
+  memcpy(header + 8, &len, 4);
+  for (int i = 0; i < 12; i++)
+  {
+    hash = (hash ^ header[i]) * 16777619u;
+  }
+  for (uint32_t i = 0; i < len; i++)
+  {
+    hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+// Room for the log's directory and a segment file name
+#define SEGMENT_PATH_MAX (PATH_MAX + 32)
+
+static void segment_path(chat_log *log, uint64_t base_id, char *path)
+{
+  snprintf(path, SEGMENT_PATH_MAX, "%s/%020llu.log", log->path, (unsigned long long)base_id);
+}
+
+// Remember where a record starts if it is due for the sparse index
+static int index_record(chat_log_segment *seg, uint64_t id, uint32_t offset)
+{
+  if ((id - seg->base_id) % CHAT_LOG_INDEX_INTERVAL != 0)
+  {
+    return 0;
+  }
+
+  if (seg->index_count == seg->index_capacity)
+  {
+    uint32_t capacity = seg->index_capacity ? 2 * seg->index_capacity : 64;
+    chat_log_index_entry *index = realloc(seg->index, capacity * sizeof(chat_log_index_entry));
+    if (index == NULL)
+    {
+      return -1;
+    }
+    seg->index = index;
+    seg->index_capacity = capacity;
+  }
+
+  seg->index[seg->index_count].id = id;
+  seg->index[seg->index_count].offset = offset;
+  seg->index_count++;
+  return 0;
+}
+
+// Give a segment file blocks for all of its bytes. Records are written
+// through a shared mapping, and a store to a page the file system cannot
+// back raises SIGBUS, so a full disk has to show up here instead.
+static int reserve_segment(int fd)
+{
+  int err = posix_fallocate(fd, 0, CHAT_LOG_SEGMENT_SIZE);
+  if (err != 0)
+  {
+    errno = err;
+    perror("posix_fallocate(3) failed for chat log segment");
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+// Map a segment file, creating it at full size if needed
+static int map_segment(chat_log *log, chat_log_segment *seg, uint64_t base_id, int create)
+{
+  char path[SEGMENT_PATH_MAX];
+  segment_path(log, base_id, path);
+
+  memset(seg, 0, sizeof(chat_log_segment));
+  seg->base_id = base_id;
+  seg->fd = open(path, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+  if (seg->fd < 0)
+  {
+    perror("open(2) failed for chat log segment");
+    return -1;
+  }
+  if (create && reserve_segment(seg->fd) < 0)
+  {
+    // Not left behind at the wrong size for the next open to trip over
+    int err = errno;
+    close(seg->fd);
+    unlink(path);
+    errno = err;
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(seg->fd, &st) < 0 || st.st_size != CHAT_LOG_SEGMENT_SIZE)
+  {
+    printf("Chat log segment %s has the wrong size\n", path);
+    close(seg->fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  seg->map = mmap(NULL, CHAT_LOG_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+  if (seg->map == MAP_FAILED)
+  {
+    perror("mmap(2) failed for chat log segment");
+    close(seg->fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void unmap_segment(chat_log_segment *seg)
+{
+  munmap(seg->map, CHAT_LOG_SEGMENT_SIZE);
+  close(seg->fd);
+  free(seg->index);
+}
+
+// Walk a segment's records and index them. Sealed segments were synced
+// in full before the next one was started; the last one may end in a
+// record that was only partly written when the process died, so its
+// checksums are verified and it is cut at the first bad record.
+static int scan_segment(chat_log_segment *seg, int verify)
+{
+  uint32_t offset = 0;
+  uint64_t id = seg->base_id;
+
+  while (offset + sizeof(chat_log_record) <= CHAT_LOG_SEGMENT_SIZE)
+  {
+    const chat_log_record *rec = (const chat_log_record *)(seg->map + offset);
+    if (rec->len == 0 || rec->len > CHAT_LOG_MAX_RECORD || rec->id != id ||
+        offset + record_size(rec->len) > CHAT_LOG_SEGMENT_SIZE)
+    {
+      break;
+    }
+    if (verify && rec->check != record_check(rec->id, rec->len, (const char *)(rec + 1)))
+    {
+      printf("Chat log record %llu is torn, cutting the log there\n", (unsigned long long)id);
+      break;
+    }
+    if (index_record(seg, id, offset) < 0)
+    {
+      return -1;
+    }
+
+    offset += record_size(rec->len);
+    id++;
+  }
+
+  seg->used = offset;
+  if (!verify)
+  {
+    return 0;
+  }
+
+  // Whatever follows the last good record must not be read as records
+  // once new ones are appended in front of it. Untouched pages read as
+  // zero and are left alone.
+  uint32_t end = CHAT_LOG_SEGMENT_SIZE;
+  while (end > offset && seg->map[end - 1] == 0)
+  {
+    end--;
+  }
+  if (end > offset)
+  {
+    memset(seg->map + offset, 0, end - offset);
+    msync(seg->map, CHAT_LOG_SEGMENT_SIZE, MS_SYNC);
+  }
+  return 0;
+}
+
+// ID following the last record of a scanned segment
+static uint64_t segment_end_id(chat_log_segment *seg)
+{
+  uint64_t id = seg->base_id;
+  uint32_t offset = 0;
+
+  if (seg->index_count > 0)
+  {
+    id = seg->index[seg->index_count - 1].id;
+    offset = seg->index[seg->index_count - 1].offset;
+  }
+  while (offset < seg->used)
+  {
+    offset += record_size(((const chat_log_record *)(seg->map + offset))->len);
+    id++;
+  }
+
+  return id;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Start a segment for records from next_id on, deleting the oldest if
+// the log holds its maximum
+static int add_segment(chat_log *log)
+{
+  if (log->segment_count == CHAT_LOG_MAX_SEGMENTS)
+  {
+    char path[SEGMENT_PATH_MAX];
+    segment_path(log, log->segments[0].base_id, path);
+    unmap_segment(&log->segments[0]);
+    unlink(path);
+    log->segment_count--;
+    memmove(&log->segments[0], &log->segments[1], log->segment_count * sizeof(chat_log_segment));
+  }
+
+  if (log->segment_count == log->segment_capacity)
+  {
+    int capacity = log->segment_capacity ? 2 * log->segment_capacity : 4;
+    chat_log_segment *segments = realloc(log->segments, capacity * sizeof(chat_log_segment));
+    if (segments == NULL)
+    {
+      return -1;
+    }
+    log->segments = segments;
+    log->segment_capacity = capacity;
+  }
+
+  if (map_segment(log, &log->segments[log->segment_count], log->next_id, 1) < 0)
+  {
+    return -1;
+  }
+  log->segment_count++;
+  log->dirty_start = 0;
+  log->dirty_end = 0;
+  return 0;
+}
+
+// Open the log in directory path, creating it if needed
+int chat_log_open(chat_log *log, const char *path)
+{
+  memset(log, 0, sizeof(chat_log));
+  snprintf(log->path, PATH_MAX, "%s", path);
+  log->next_id = 1;
+
+  if (mkdir(path, 0755) < 0 && errno != EEXIST)
+  {
+    perror("mkdir(2) failed for chat log");
+    return -1;
+  }
+
+  DIR *dir = opendir(path);
+  if (dir == NULL)
+  {
+    perror("opendir(3) failed for chat log");
+    return -1;
+  }
+
+  // Segment names are their base IDs
+  uint64_t bases[CHAT_LOG_MAX_SEGMENTS * 2];
+  int count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    unsigned long long base;
+    char suffix[8];
+    if (sscanf(entry->d_name, "%20llu.%4s", &base, suffix) == 2 && strcmp(suffix, "log") == 0 &&
+        count < CHAT_LOG_MAX_SEGMENTS * 2)
+    {
+      bases[count++] = base;
+    }
+  }
+  closedir(dir);
+  qsort(bases, count, sizeof(uint64_t), compare_ids);
+
+  log->segments = calloc(count > 0 ? count : 1, sizeof(chat_log_segment));
+  if (log->segments == NULL)
+  {
+    return -1;
+  }
+  log->segment_capacity = count > 0 ? count : 1;
+
+  for (int i = 0; i < count; i++)
+  {
+    chat_log_segment *seg = &log->segments[log->segment_count];
+    if (map_segment(log, seg, bases[i], 0) < 0)
+    {
+      chat_log_close(log);
+      return -1;
+    }
+    log->segment_count++;
+
+    // The last segment is appended to. Segments of older versions were
+    // created sparse.
+    if ((i == count - 1 && reserve_segment(seg->fd) < 0) || scan_segment(seg, i == count - 1) < 0)
+    {
+      int err = errno;
+      chat_log_close(log);
+      errno = err;
+      return -1;
+    }
+    log->next_id = segment_end_id(seg);
+  }
+
+  if (log->segment_count == 0 && add_segment(log) < 0)
+  {
+    int err = errno;
+    chat_log_close(log);
+    errno = err;
+    return -1;
+  }
+
+  printf("Opened chat log %s, next message %llu\n", path, (unsigned long long)log->next_id);
+  return 0;
+}
+
+// Append a message, starting a new segment when the last one is full
+uint64_t chat_log_append(chat_log *log, const void *data, uint32_t len, uint64_t now_us)
+{
+  if (len == 0 || len > CHAT_LOG_MAX_RECORD)
+  {
+    errno = EINVAL;
+    return 0;
+  }
+
+  chat_log_segment *seg = &log->segments[log->segment_count - 1];
+  if (seg->used + record_size(len) > CHAT_LOG_SEGMENT_SIZE)
+  {
+    // A sealed segment is complete on disk, recovery only checks the last
+    if (chat_log_sync(log, now_us, 1) < 0 || add_segment(log) < 0)
+    {
+      return 0;
+    }
+    seg = &log->segments[log->segment_count - 1];
+  }
+
+  // The message goes in before the header that makes it visible
+  uint32_t offset = seg->used;
+  chat_log_record *rec = (chat_log_record *)(seg->map + offset);
+  memcpy(rec + 1, data, len);
+  rec->check = record_check(log->next_id, len, data);
+  rec->id = log->next_id;
+  rec->len = len;
+
+  if (index_record(seg, rec->id, offset) < 0)
+  {
+    errno = ENOMEM;
+    return 0;
+  }
+  seg->used += record_size(len);
+  if (log->dirty_since_us == 0)
+  {
+    log->dirty_start = offset;
+    log->dirty_since_us = now_us;
+  }
+  log->dirty_end = seg->used;
+
+  return log->next_id++;
+}
+
+// Write appended records to disk once enough accumulated, or if forced
+int chat_log_sync(chat_log *log, uint64_t now_us, int force)
+{
+  if (log->dirty_since_us == 0)
+  {
+    return 0;
+  }
+  if (!force && log->dirty_end - log->dirty_start < CHAT_LOG_SYNC_BYTES &&
+      now_us < log->dirty_since_us + CHAT_LOG_SYNC_INTERVAL_US)
+  {
+    return 0;
+  }
+
+  // msync(2) wants a page-aligned start
+  chat_log_segment *seg = &log->segments[log->segment_count - 1];
+  long page = sysconf(_SC_PAGESIZE);
+  uint32_t start = log->dirty_start & ~(uint32_t)(page - 1);
+  if (msync(seg->map + start, log->dirty_end - start, MS_SYNC) < 0)
+  {
+    perror("msync(2) failed for chat log");
+    return -1;
+  }
+
+  log->dirty_since_us = 0;
+  log->dirty_start = log->dirty_end;
+  return 0;
+}
+
+// When chat_log_sync() will next have work
+uint64_t chat_log_sync_deadline(chat_log *log)
+{
+  return log->dirty_since_us != 0 ? log->dirty_since_us + CHAT_LOG_SYNC_INTERVAL_US : 0;
+}
+
+// Offset of the record with ID id in a segment, via the closest index
+// entry before it
+static uint32_t find_offset(chat_log_segment *seg, uint64_t id)
+{
+  uint32_t lo = 0;
+  uint32_t hi = seg->index_count;
+  while (hi - lo > 1)
+  {
+    uint32_t mid = (lo + hi) / 2;
+    if (seg->index[mid].id <= id)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  uint32_t offset = seg->index[lo].offset;
+  const chat_log_record *rec = (const chat_log_record *)(seg->map + offset);
+  while (rec->id < id)
+  {
+    offset += record_size(rec->len);
+    rec = (const chat_log_record *)(seg->map + offset);
+  }
+  return offset;
+}
+
+// Messages from ID from on, oldest first, up to max
+int chat_log_read(chat_log *log, uint64_t from, chat_log_entry *entries, int max)
+{
+  if (from >= log->next_id || max <= 0)
+  {
+    return 0;
+  }
+
+  // The last segment starting at or before from, older IDs were deleted
+  int s = 0;
+  while (s + 1 < log->segment_count && log->segments[s + 1].base_id <= from)
+  {
+    s++;
+  }
+  if (from < log->segments[s].base_id)
+  {
+    from = log->segments[s].base_id;
+  }
+
+  int count = 0;
+  uint32_t offset = log->segments[s].used > 0 ? find_offset(&log->segments[s], from) : 0;
+  while (count < max && s < log->segment_count)
+  {
+    chat_log_segment *seg = &log->segments[s];
+    if (offset >= seg->used)
+    {
+      s++;
+      offset = 0;
+      continue;
+    }
+
+    const chat_log_record *rec = (const chat_log_record *)(seg->map + offset);
+    entries[count].id = rec->id;
+    entries[count].data = (const char *)(rec + 1);
+    entries[count].len = rec->len;
+    count++;
+    offset += record_size(rec->len);
+  }
+
+  return count;
+}
+
+// The last n messages, oldest first, up to max
+int chat_log_last(chat_log *log, uint32_t n, chat_log_entry *entries, int max)
+{
+  uint64_t from = log->next_id > n ? log->next_id - n : 1;
+  return chat_log_read(log, from, entries, max);
+}
+
+// Sync and unmap the log
+void chat_log_close(chat_log *log)
+{
+  if (log->segment_count > 0)
+  {
+    chat_log_sync(log, 0, 1);
+  }
+  for (int i = 0; i < log->segment_count; i++)
+  {
+    unmap_segment(&log->segments[i]);
+  }
+  free(log->segments);
+  log->segments = NULL;
+  log->segment_count = 0;
+}
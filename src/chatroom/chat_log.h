@@ -0,0 +1,98 @@
+#ifndef CHAT_LOG_H
+#define CHAT_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+
+// Chat log constants
+#define CHAT_LOG_SEGMENT_SIZE (1 << 20) // Bytes per segment file
+#define CHAT_LOG_MAX_SEGMENTS 8         // Older segments are deleted
+#define CHAT_LOG_INDEX_INTERVAL 32      // Records between sparse index entries
+#define CHAT_LOG_MAX_RECORD 16384       // Largest message a record may hold
+#define CHAT_LOG_SYNC_BYTES 65536       // Appended bytes that force a sync
+#define CHAT_LOG_SYNC_INTERVAL_US 10000 // Longest an append waits for its sync
+
+// Record header, the message follows and is padded to 8 bytes. Records
+// are written in place in the mapped segment and read from there.
+typedef struct
+{
+  uint64_t id;    // Message ID, consecutive from 1 within a room
+  uint32_t len;   // Message bytes, 0 marks the end of the segment's records
+  uint32_t check; // Checksum of id, len and the message
+} chat_log_record;
+
+// Every CHAT_LOG_INDEX_INTERVAL-th record of a segment
+typedef struct
+{
+  uint64_t id;
+  uint32_t offset;
+} chat_log_index_entry;
+
+// One mapped segment file, named after the ID of its first record
+typedef struct
+{
+  uint64_t base_id;
+  int fd;
+  char *map;
+  uint32_t used;                 // Bytes holding records
+  chat_log_index_entry *index;
+  uint32_t index_count;
+  uint32_t index_capacity;
+} chat_log_segment;
+
+// A message served from the log, data points into the mapped segment
+typedef struct
+{
+  uint64_t id;
+  const char *data;
+  uint32_t len;
+} chat_log_entry;
+
+// Append-only message log of one room, a directory of segment files. Only
+// the last segment is written to.
+typedef struct
+{
+  char path[PATH_MAX];
+  chat_log_segment *segments;    // Oldest first
+  int segment_count;
+  int segment_capacity;
+  uint64_t next_id;              // ID of the next message appended
+  uint32_t dirty_start;          // Range of the last segment not yet synced
+  uint32_t dirty_end;
+  uint64_t dirty_since_us;       // When the oldest unsynced append happened, 0 if none
+} chat_log;
+
+// Open the log in directory path, creating it if needed. The last
+// segment is scanned and cut at the first record that was not written
+// completely. Segments get all their disk blocks when they are created,
+// so a full disk fails the open or the append that starts a segment
+// instead of a later store through the mapping. Returns -1 with errno set
+// on failure.
+int chat_log_open(chat_log *log, const char *path);
+
+// Append a message, starting a new segment when the last one is full.
+// Returns its ID, or 0 with errno set on failure, ENOSPC if the disk has
+// no room for a new segment.
+uint64_t chat_log_append(chat_log *log, const void *data, uint32_t len, uint64_t now_us);
+
+// Write appended records to disk once enough bytes or time accumulated
+// since the last sync, or right away if force is set. Appends between two
+// syncs share one. Returns -1 with errno set if the sync failed.
+int chat_log_sync(chat_log *log, uint64_t now_us, int force);
+
+// When chat_log_sync() will next have work, 0 if nothing is waiting
+uint64_t chat_log_sync_deadline(chat_log *log);
+
+// Messages from ID from on, oldest first, up to max. The entries point
+// into the log and stay valid until the next append. Returns the number
+// of entries.
+int chat_log_read(chat_log *log, uint64_t from, chat_log_entry *entries, int max);
+
+// The last n messages, oldest first, up to max
+int chat_log_last(chat_log *log, uint32_t n, chat_log_entry *entries, int max);
+
+// Sync and unmap the log
+void chat_log_close(chat_log *log);
+
+#endif
@@ -0,0 +1,982 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "chatroom.h"
+
+// Messages are allocated from two pools of fixed-size buffers, a chat line
+// fits the small ones. Each buffer counts the queues holding it.
+static buffer_pool msg_pools[2];
+static pthread_once_t msg_pools_once = PTHREAD_ONCE_INIT;
+
+static void init_msg_pools(void)
+{
+  buffer_pool_init(&msg_pools[0], CHAT_MSG_SMALL, BUFFER_POOL_HUGE_PAGES);
+  buffer_pool_init(&msg_pools[1], sizeof(chat_msg) + CT_MAX_MESSAGE + 1, BUFFER_POOL_HUGE_PAGES);
+}
+
+// A message of len bytes holding one reference, NULL if out of memory
+static chat_msg *msg_alloc(size_t len)
+{
+  pthread_once(&msg_pools_once, init_msg_pools);
+  chat_msg *msg = buffer_alloc(&msg_pools[sizeof(chat_msg) + len <= CHAT_MSG_SMALL ? 0 : 1]);
+  if (msg == NULL)
+  {
+    fprintf(stderr, "No buffer for a chat message of %zu bytes\n", len);
+  }
+  return msg;
+}
+
+// Counters of the message pools
+void chat_msg_pool_stats(buffer_pool_stats *small, buffer_pool_stats *full)
+{
+  pthread_once(&msg_pools_once, init_msg_pools);
+  buffer_pool_get_stats(&msg_pools[0], small);
+  buffer_pool_get_stats(&msg_pools[1], full);
+}
+
+// Encode "[room] nick: text" into a message holding one reference
+chat_msg *chat_msg_encode(const char *room, const char *nick, const char *text, size_t len)
+{
+  size_t prefix = strlen(room) + strlen(nick) + 5;
+  if (prefix + len > CT_MAX_MESSAGE)
+  {
+    len = CT_MAX_MESSAGE > prefix ? CT_MAX_MESSAGE - prefix : 0;
+  }
+
+  // One byte more for the terminator snprintf writes
+  chat_msg *msg = msg_alloc(prefix + len + 1);
+  if (msg == NULL)
+  {
+    return NULL;
+  }
+
+  snprintf(msg->data, prefix + 1, "[%s] %s: ", room, nick);
+  memcpy(msg->data + prefix, text, len);
+  msg->len = prefix + len;
+  return msg;
+}
+
+// Take another reference to a message
+chat_msg *chat_msg_retain(chat_msg *msg)
+{
+  return buffer_retain(msg);
+}
+
+// Drop a reference, freeing the message with the last one
+void chat_msg_release(chat_msg *msg)
+{
+  buffer_release(msg);
+}
+
+// Initialize a member for a connection, not in any room
+void chat_member_init(chat_member *member, ct_conn *conn, const char *nick)
+{
+  memset(member, 0, sizeof(chat_member));
+  member->conn = conn;
+  member->active_room = -1;
+  snprintf(member->nick, CHAT_NAME_MAX, "%s", nick);
+  drr_flow_init(&member->flow, DRR_INTERACTIVE, 1);
+}
+
+// Queue a message for the member, taking a reference
+int chat_member_enqueue(chat_member *member, chat_msg *msg)
+{
+  if (member->queue_count == CHAT_QUEUE_SIZE)
+  {
+    member->dropped++;
+    return -1;
+  }
+
+  int tail = (member->queue_head + member->queue_count) % CHAT_QUEUE_SIZE;
+  member->queue[tail] = chat_msg_retain(msg);
+  member->queue_count++;
+  return 0;
+}
+
+// Move the next replayed or queued message into the send buffer
+ssize_t chat_member_send_next(chat_member *member)
+{
+  // Members are accepted before the handshake completes, what they are
+  // sent waits for it
+  if (ct_get_state(member->conn) == CT_SYN_RECEIVED)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  // A replay is sent straight from the log, ahead of the queue
+  if (member->replay_log != NULL)
+  {
+    chat_log_entry entry;
+    if (chat_log_read(member->replay_log, member->replay_next, &entry, 1) == 0 ||
+        entry.id >= member->replay_end)
+    {
+      member->replay_log = NULL;
+    }
+    else
+    {
+      if (ct_send_message(member->conn, CHAT_STREAM, entry.data, entry.len) < 0)
+      {
+        return -1;
+      }
+      member->replay_next = entry.id + 1;
+      return entry.len;
+    }
+  }
+
+  if (member->queue_count == 0)
+  {
+    return 0;
+  }
+
+  chat_msg *msg = member->queue[member->queue_head];
+  if (ct_send_message(member->conn, CHAT_STREAM, msg->data, msg->len) < 0)
+  {
+    return -1;
+  }
+
+  ssize_t len = msg->len;
+  member->queue_head = (member->queue_head + 1) % CHAT_QUEUE_SIZE;
+  member->queue_count--;
+  chat_msg_release(msg);
+  return len;
+}
+
+// Move a pending replay, then queued messages into the connection's send
+// buffer while it has room
+int chat_member_flush(chat_member *member)
+{
+  int sent = 0;
+  ssize_t len;
+
+  while ((len = chat_member_send_next(member)) > 0)
+  {
+    sent++;
+  }
+
+  return len < 0 && errno != EAGAIN ? -1 : sent;
+}
+
+// Release all queued messages and drop a pending replay
+void chat_member_clear(chat_member *member)
+{
+  member->replay_log = NULL;
+  while (member->queue_count > 0)
+  {
+    chat_msg_release(member->queue[member->queue_head]);
+    member->queue_head = (member->queue_head + 1) % CHAT_QUEUE_SIZE;
+    member->queue_count--;
+  }
+}
+
+// Queue copies of the last count messages in the room's ring. Returns -1
+// without queueing anything if the ring does not hold all of them.
+static int replay_recent(chat_member *member, chat_room *room, uint32_t count)
+{
+  if (!room->cached)
+  {
+    return -1;
+  }
+
+  uint64_t written = atomic_load(&room->recent.head);
+  uint32_t wanted = count < written ? count : written;
+  // One more so an empty room does not ask for 0 bytes
+  recent_entry *entries = malloc((wanted + 1) * sizeof(recent_entry));
+  char *buf = malloc(room->recent.max_bytes);
+  if (entries == NULL || buf == NULL)
+  {
+    free(entries);
+    free(buf);
+    return -1;
+  }
+
+  int n = recent_ring_snapshot(&room->recent, wanted, entries, wanted, buf, room->recent.max_bytes);
+  if ((uint32_t)n < wanted && room->log != NULL)
+  {
+    free(entries);
+    free(buf);
+    return -1;
+  }
+
+  for (int i = 0; i < n; i++)
+  {
+    chat_msg *msg = msg_alloc(entries[i].len);
+    if (msg == NULL)
+    {
+      break;
+    }
+    msg->len = entries[i].len;
+    memcpy(msg->data, entries[i].data, entries[i].len);
+    chat_member_enqueue(member, msg);
+    chat_msg_release(msg);
+  }
+
+  free(entries);
+  free(buf);
+  return 0;
+}
+
+// Send the member the last count messages of a room
+void chat_member_replay(chat_member *member, chat_room *room, uint32_t count)
+{
+  if (replay_recent(member, room, count) == 0 || room->log == NULL)
+  {
+    return;
+  }
+
+  member->replay_log = room->log;
+  member->replay_end = room->log->next_id;
+  member->replay_next = member->replay_end > count ? member->replay_end - count : 1;
+}
+
+// Initialize an empty directory
+void chat_directory_init(chat_directory *dir, const char *log_dir)
+{
+  memset(dir, 0, sizeof(chat_directory));
+  room_index_init(&dir->index);
+  dir->recent_messages = CHAT_RECENT_MESSAGES;
+  dir->recent_bytes = CHAT_RECENT_BYTES;
+  dir->max_rooms = CHAT_MAX_ROOMS;
+  if (log_dir != NULL)
+  {
+    dir->log_dir = strdup(log_dir);
+  }
+}
+
+// Give a member a slot in the connection table
+int chat_directory_add(chat_directory *dir, chat_member *member)
+{
+  if (dir->free_count > 0)
+  {
+    member->slot = dir->free_slots[--dir->free_count];
+  }
+  else
+  {
+    if (dir->slot_count == dir->slot_capacity)
+    {
+      uint32_t capacity = dir->slot_capacity ? 2 * dir->slot_capacity : 64;
+      chat_member **slots = realloc(dir->slots, capacity * sizeof(chat_member *));
+      if (slots == NULL)
+      {
+        perror("realloc failed for connection table");
+        return -1;
+      }
+      dir->slots = slots;
+      uint32_t *free_slots = realloc(dir->free_slots, capacity * sizeof(uint32_t));
+      if (free_slots == NULL)
+      {
+        perror("realloc failed for connection table");
+        return -1;
+      }
+      dir->free_slots = free_slots;
+      dir->slot_capacity = capacity;
+    }
+    member->slot = dir->slot_count++;
+  }
+
+  dir->slots[member->slot] = member;
+  dir->member_count++;
+  return 0;
+}
+
+// Take a member out of all rooms and free its slot
+void chat_directory_remove(chat_directory *dir, chat_member *member)
+{
+  room_index_leave_all(&dir->index, member->slot);
+  member->active_room = -1;
+  dir->slots[member->slot] = NULL;
+  dir->free_slots[dir->free_count++] = member->slot;
+  dir->member_count--;
+}
+
+// Load the end of a room's log into its ring
+static void fill_recent(chat_room *room)
+{
+  uint32_t max = room->recent.max_messages;
+  chat_log_entry *entries = malloc(max * sizeof(chat_log_entry));
+  if (entries == NULL)
+  {
+    return;
+  }
+
+  int n = chat_log_last(room->log, max, entries, max);
+  recent_ring_skip(&room->recent, room->log->next_id - 1 - n);
+  for (int i = 0; i < n; i++)
+  {
+    recent_ring_push(&room->recent, entries[i].data, entries[i].len);
+  }
+  free(entries);
+}
+
+// Find a room by name, creating it on first use
+chat_room *chat_directory_room(chat_directory *dir, const char *name)
+{
+  chat_room *room = chat_directory_find(dir, name);
+  if (room != NULL)
+  {
+    return room;
+  }
+
+  // Each room holds a ring and maybe a log segment on disk for good
+  if (dir->room_count >= dir->max_rooms)
+  {
+    printf("Room limit of %u reached, not creating %s\n", dir->max_rooms, name);
+    return NULL;
+  }
+
+  if (dir->room_count == dir->room_capacity)
+  {
+    uint32_t capacity = dir->room_capacity ? 2 * dir->room_capacity : 16;
+    chat_room **rooms = realloc(dir->rooms, capacity * sizeof(chat_room *));
+    if (rooms == NULL)
+    {
+      perror("realloc failed for rooms");
+      return NULL;
+    }
+    dir->rooms = rooms;
+    dir->room_capacity = capacity;
+  }
+
+  room = malloc(sizeof(chat_room));
+  if (room == NULL)
+  {
+    perror("malloc failed for room");
+    return NULL;
+  }
+  snprintf(room->name, CHAT_NAME_MAX, "%s", name);
+  room->id = dir->room_count;
+  room->log = NULL;
+  room->typist = -1;
+
+  // A room without its history still works
+  if (dir->log_dir != NULL)
+  {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir->log_dir, room->name);
+    room->log = malloc(sizeof(chat_log));
+    if (room->log != NULL && (mkdir(dir->log_dir, 0755) < 0 && errno != EEXIST))
+    {
+      perror("mkdir(2) failed for chat history");
+      free(room->log);
+      room->log = NULL;
+    }
+    else if (room->log != NULL && chat_log_open(room->log, path) < 0)
+    {
+      free(room->log);
+      room->log = NULL;
+    }
+  }
+
+  room->cached = recent_ring_init(&room->recent, dir->recent_messages, dir->recent_bytes) == 0;
+  if (room->cached && room->log != NULL)
+  {
+    fill_recent(room);
+  }
+
+  dir->rooms[dir->room_count++] = room;
+  return room;
+}
+
+// Find a room by name
+chat_room *chat_directory_find(chat_directory *dir, const char *name)
+{
+  for (uint32_t i = 0; i < dir->room_count; i++)
+  {
+    if (strcmp(dir->rooms[i]->name, name) == 0)
+    {
+      return dir->rooms[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Release the rooms and the index
+void chat_directory_free(chat_directory *dir)
+{
+  for (uint32_t i = 0; i < dir->room_count; i++)
+  {
+    if (dir->rooms[i]->log != NULL)
+    {
+      chat_log_close(dir->rooms[i]->log);
+      free(dir->rooms[i]->log);
+    }
+    if (dir->rooms[i]->cached)
+    {
+      recent_ring_free(&dir->rooms[i]->recent);
+    }
+    free(dir->rooms[i]);
+  }
+  free(dir->rooms);
+  free(dir->log_dir);
+  free(dir->slots);
+  free(dir->free_slots);
+  room_index_free(&dir->index);
+  memset(dir, 0, sizeof(chat_directory));
+}
+
+// Print each room's ring use and hit rate
+void chat_directory_report(chat_directory *dir)
+{
+  for (uint32_t i = 0; i < dir->room_count; i++)
+  {
+    chat_room *room = dir->rooms[i];
+    if (!room->cached)
+    {
+      continue;
+    }
+
+    recent_ring_stats stats;
+    recent_ring_get_stats(&room->recent, &stats);
+    uint64_t lookups = stats.hits + stats.misses;
+    printf("Room %s: %u recent messages in %u bytes, %zu bytes allocated, %llu/%llu joins served "
+           "from memory (%.1f%%)\n",
+           room->name, stats.messages, stats.bytes, stats.memory, (unsigned long long)stats.hits,
+           (unsigned long long)lookups, lookups ? 100.0 * stats.hits / lookups : 0.0);
+  }
+
+  buffer_pool_stats pools[2];
+  chat_msg_pool_stats(&pools[0], &pools[1]);
+  for (int i = 0; i < 2; i++)
+  {
+    printf("Message buffers of %zu bytes: %llu in use of %llu in %zu slabs (%zu on huge pages), "
+           "%llu allocated, %llu pool refills, %llu failures\n",
+           pools[i].buffer_size, (unsigned long long)pools[i].in_use,
+           (unsigned long long)pools[i].buffers, pools[i].slabs, pools[i].huge_slabs,
+           (unsigned long long)pools[i].allocs, (unsigned long long)pools[i].refills,
+           (unsigned long long)pools[i].failures);
+  }
+}
+
+// Add a member to a room, which becomes the room its text goes to
+int chat_room_join(chat_directory *dir, chat_room *room, chat_member *member)
+{
+  if (room_index_join(&dir->index, room->id, member->slot) < 0)
+  {
+    return -1;
+  }
+
+  member->active_room = room->id;
+  return 0;
+}
+
+// Remove a member from a room
+void chat_room_leave(chat_directory *dir, chat_room *room, chat_member *member)
+{
+  room_index_leave(&dir->index, room->id, member->slot);
+
+  if (member->active_room == room->id)
+  {
+    const slot_set *rooms = room_index_rooms(&dir->index, member->slot);
+    member->active_room = rooms != NULL ? slot_set_next(rooms, 0) : -1;
+  }
+}
+
+// Members in a room
+uint32_t chat_room_size(chat_directory *dir, chat_room *room)
+{
+  const slot_set *members = room_index_members(&dir->index, room->id);
+  return members != NULL ? members->count : 0;
+}
+
+// Queue msg for every member of room but except. The room's occupied
+// words are found through the summary and their bits index the
+// connection table, which is walked in slot order.
+int chat_room_broadcast(chat_directory *dir, chat_room *room, chat_msg *msg,
+                        const chat_member *except)
+{
+  const slot_set *members = room_index_members(&dir->index, room->id);
+  int recipients = 0;
+
+  if (members == NULL)
+  {
+    return 0;
+  }
+
+  for (uint32_t s = 0; s < members->word_capacity / 64; s++)
+  {
+    for (uint64_t occupied = members->summary[s]; occupied != 0; occupied &= occupied - 1)
+    {
+      uint32_t w = s * 64 + __builtin_ctzll(occupied);
+      for (uint64_t bits = members->words[w]; bits != 0; bits &= bits - 1)
+      {
+        chat_member *member = dir->slots[w * 64 + __builtin_ctzll(bits)];
+        if (member != except && chat_member_enqueue(member, msg) == 0)
+        {
+          recipients++;
+        }
+      }
+    }
+  }
+
+  return recipients;
+}
+
+static uint64_t now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Set a room indicator for every member but except
+int chat_room_indicate(chat_directory *dir, chat_room *room, int kind, const char *value,
+                       size_t len, const chat_member *except)
+{
+  const slot_set *members = room_index_members(&dir->index, room->id);
+  uint16_t key = 2 * room->id + kind;
+  int recipients = 0;
+
+  for (int64_t slot = members ? slot_set_next(members, 0) : -1; slot >= 0;
+       slot = slot_set_next(members, slot + 1))
+  {
+    chat_member *member = dir->slots[slot];
+    if (member != except && member->conn != NULL && !member->closing &&
+        ct_send_state(member->conn, key, value, len) == 0)
+    {
+      recipients++;
+    }
+  }
+
+  return recipients;
+}
+
+// Log a message posted to a room and keep it in its ring, then queue it
+// for every member but except
+int chat_room_post(chat_directory *dir, chat_room *room, chat_msg *msg, const chat_member *except)
+{
+  if (room->log != NULL && chat_log_append(room->log, msg->data, msg->len, now_us()) == 0)
+  {
+    perror("Could not log chat message");
+  }
+  if (room->cached)
+  {
+    recent_ring_push(&room->recent, msg->data, msg->len);
+  }
+
+  return chat_room_broadcast(dir, room, msg, except);
+}
+
+// Listen for chat clients on addr
+int chat_server_init(chat_server *server, const struct sockaddr_in *addr, const char *log_dir)
+{
+  memset(server, 0, sizeof(chat_server));
+  chat_directory_init(&server->dir, log_dir);
+  drr_init(&server->sched);
+  server->send_budget = CHAT_SEND_BUDGET;
+
+  server->listener = ct_socket();
+  if (server->listener == NULL)
+  {
+    return -1;
+  }
+  // Chat text compresses well, and its one-line messages are small next to
+  // a full header. Clients that offer them get compressed messages and
+  // compact headers, and on lossy paths parity to rebuild lost segments.
+  if (ct_bind(server->listener, addr) < 0 || ct_set_compression(server->listener, 1) < 0 ||
+      ct_set_compact_headers(server->listener, 1) < 0 || ct_set_fec(server->listener, 1) < 0 ||
+      ct_listen(server->listener) < 0)
+  {
+    ct_free(server->listener);
+    server->listener = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+// Tell a room's members how many they are
+static void announce_presence(chat_directory *dir, chat_room *room)
+{
+  char value[CT_MAX_STATE + 1];
+  int len = snprintf(value, sizeof(value), "[%s] %u online", room->name, chat_room_size(dir, room));
+  chat_room_indicate(dir, room, CHAT_STATE_PRESENCE, value, len < CT_MAX_STATE ? len : CT_MAX_STATE,
+                     NULL);
+}
+
+// Show a member typing in a room, or stop showing it. Only the latest
+// typist is shown.
+static void set_typing(chat_directory *dir, chat_room *room, chat_member *member, int typing)
+{
+  if (typing)
+  {
+    char value[CT_MAX_STATE + 1];
+    int len = snprintf(value, sizeof(value), "[%s] %s is typing", room->name, member->nick);
+    room->typist = member->slot;
+    chat_room_indicate(dir, room, CHAT_STATE_TYPING, value, len < CT_MAX_STATE ? len : CT_MAX_STATE,
+                       member);
+  }
+  else if (room->typist == member->slot)
+  {
+    room->typist = -1;
+    chat_room_indicate(dir, room, CHAT_STATE_TYPING, "", 0, member);
+  }
+}
+
+// Take a member out of a room, updating its indicators
+static void leave_room(chat_directory *dir, chat_room *room, chat_member *member)
+{
+  set_typing(dir, room, member, 0);
+  chat_room_leave(dir, room, member);
+  announce_presence(dir, room);
+}
+
+// Take a member out of all its rooms, updating their indicators
+static void leave_all_rooms(chat_directory *dir, chat_member *member)
+{
+  const slot_set *rooms = room_index_rooms(&dir->index, member->slot);
+  for (int64_t id = rooms ? slot_set_next(rooms, 0) : -1; id >= 0; id = slot_set_next(rooms, id + 1))
+  {
+    leave_room(dir, dir->rooms[id], member);
+  }
+}
+
+// Take a new client into the default room
+static void add_member(chat_server *server, ct_conn *conn)
+{
+  char nick[CHAT_NAME_MAX];
+  snprintf(nick, sizeof(nick), "user%u", ++server->next_id);
+
+  chat_member *member = malloc(sizeof(chat_member));
+  chat_room *lobby = chat_directory_room(&server->dir, CHAT_DEFAULT_ROOM);
+  if (member == NULL || lobby == NULL)
+  {
+    printf("Out of memory, refusing client\n");
+    free(member);
+    ct_free(conn);
+    return;
+  }
+
+  chat_member_init(member, conn, nick);
+  if (chat_directory_add(&server->dir, member) < 0)
+  {
+    free(member);
+    ct_free(conn);
+    return;
+  }
+  if (chat_room_join(&server->dir, lobby, member) < 0)
+  {
+    chat_directory_remove(&server->dir, member);
+    free(member);
+    ct_free(conn);
+    return;
+  }
+  chat_member_replay(member, lobby, CHAT_REPLAY_COUNT);
+  announce_presence(&server->dir, lobby);
+  printf("%s joined %s\n", member->nick, lobby->name);
+}
+
+// Copy a command argument into a name, up to the first whitespace. Names
+// double as directory names, so only letters, digits, '-' and '_' are
+// allowed.
+static int parse_name(const char *arg, size_t len, char *name)
+{
+  size_t n = 0;
+  while (n < len && n < CHAT_NAME_MAX - 1 && arg[n] != ' ' && arg[n] != '\n')
+  {
+    char c = arg[n];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+          c == '-' || c == '_'))
+    {
+      return -1;
+    }
+    name[n] = c;
+    n++;
+  }
+  name[n] = '\0';
+  return n > 0 ? 0 : -1;
+}
+
+// A message from a member: "/nick name", "/join room", "/leave room",
+// "/typing" or text for its active room
+static void handle_message(chat_server *server, chat_member *member, const char *data, size_t len)
+{
+  chat_directory *dir = &server->dir;
+  char name[CHAT_NAME_MAX];
+  chat_room *room;
+
+  if (len > 6 && strncmp(data, "/nick ", 6) == 0)
+  {
+    if (parse_name(data + 6, len - 6, name) == 0)
+    {
+      printf("%s is now %s\n", member->nick, name);
+      memcpy(member->nick, name, CHAT_NAME_MAX);
+    }
+    return;
+  }
+
+  if (len > 6 && strncmp(data, "/join ", 6) == 0)
+  {
+    if (parse_name(data + 6, len - 6, name) < 0)
+    {
+      return;
+    }
+
+    // Only so many new rooms per member, or one looping over names could
+    // fill memory and the disk
+    room = chat_directory_find(dir, name);
+    if (room == NULL && member->rooms_created >= CHAT_MEMBER_ROOMS)
+    {
+      printf("%s created %u rooms already, not creating %s\n", member->nick, member->rooms_created,
+             name);
+      return;
+    }
+    if (room == NULL && (room = chat_directory_room(dir, name)) != NULL)
+    {
+      member->rooms_created++;
+    }
+
+    if (room != NULL && chat_room_join(dir, room, member) == 0)
+    {
+      chat_member_replay(member, room, CHAT_REPLAY_COUNT);
+      announce_presence(dir, room);
+      printf("%s joined %s\n", member->nick, room->name);
+    }
+    return;
+  }
+
+  if (len > 7 && strncmp(data, "/leave ", 7) == 0)
+  {
+    if (parse_name(data + 7, len - 7, name) == 0 && (room = chat_directory_find(dir, name)) != NULL)
+    {
+      leave_room(dir, room, member);
+      printf("%s left %s\n", member->nick, room->name);
+    }
+    return;
+  }
+
+  if (member->active_room < 0)
+  {
+    return;
+  }
+  room = dir->rooms[member->active_room];
+
+  if (len == 7 && strncmp(data, "/typing", 7) == 0)
+  {
+    set_typing(dir, room, member, 1);
+    return;
+  }
+
+  // Encoded once, every recipient's queue points at the same bytes
+  set_typing(dir, room, member, 0);
+  chat_msg *msg = chat_msg_encode(room->name, member->nick, data, len);
+  if (msg == NULL)
+  {
+    return;
+  }
+  chat_room_post(dir, room, msg, member);
+  chat_msg_release(msg);
+}
+
+// Read what a member sent. Returns -1 once the member is gone.
+static int serve_member(chat_server *server, chat_member *member)
+{
+  ct_message msgs[16];
+
+  if (ct_process(member->conn) < 0)
+  {
+    return -1;
+  }
+
+  while (!member->closing)
+  {
+    int count = ct_recv_messages(member->conn, CHAT_STREAM, msgs, 16);
+    if (count == 0 || (count < 0 && errno != EAGAIN))
+    {
+      // The client left or sent garbage, nothing more goes to it
+      printf("%s left\n", member->nick);
+      leave_all_rooms(&server->dir, member);
+      member->active_room = -1;
+      chat_member_clear(member);
+      ct_close(member->conn);
+      member->closing = 1;
+      break;
+    }
+    if (count < 0)
+    {
+      break;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      handle_message(server, member, msgs[i].data, msgs[i].len);
+    }
+  }
+
+  ct_state state = ct_get_state(member->conn);
+  return state == CT_CLOSED || state == CT_TIME_WAIT ? -1 : 0;
+}
+
+static void free_member(chat_server *server, chat_member *member)
+{
+  leave_all_rooms(&server->dir, member);
+  chat_directory_remove(&server->dir, member);
+  drr_remove(&server->sched, &member->flow);
+  chat_member_clear(member);
+  ct_free(member->conn);
+  free(member);
+}
+
+// Send what the members have waiting, a message per turn. Members that
+// cannot take more leave the scheduler until the next round, the others
+// keep their place in it when the budget runs out.
+static void send_round(chat_server *server)
+{
+  chat_directory *dir = &server->dir;
+
+  // Replays are bulk, so a member catching up on history goes at the pace
+  // of everyone else's live messages
+  for (uint32_t i = 0; i < dir->slot_count; i++)
+  {
+    chat_member *member = dir->slots[i];
+    if (member != NULL && (member->queue_count > 0 || member->replay_log != NULL))
+    {
+      drr_set_class(&server->sched, &member->flow,
+                    member->replay_log != NULL ? DRR_BULK : DRR_INTERACTIVE);
+      drr_activate(&server->sched, &member->flow);
+    }
+  }
+
+  size_t sent = 0;
+  drr_flow *flow;
+  while (sent < server->send_budget && (flow = drr_next(&server->sched)) != NULL)
+  {
+    chat_member *member = (chat_member *)((char *)flow - offsetof(chat_member, flow));
+    ssize_t len = chat_member_send_next(member);
+    if (len > 0)
+    {
+      drr_charge(&server->sched, flow, len);
+      sent += len;
+      if (member->replay_log == NULL && flow->cls == DRR_BULK)
+      {
+        drr_set_class(&server->sched, flow, DRR_INTERACTIVE);
+      }
+      continue;
+    }
+
+    drr_remove(&server->sched, flow);
+    if (len < 0 && errno != EAGAIN)
+    {
+      chat_member_clear(member);
+    }
+  }
+}
+
+// Wait up to timeout_ms for traffic, then serve the listener and members
+int chat_server_run_once(chat_server *server, int timeout_ms)
+{
+  chat_directory *dir = &server->dir;
+
+  if ((int)dir->slot_count + 1 > server->poll_capacity)
+  {
+    int capacity = 2 * (dir->slot_count + 1);
+    struct pollfd *pfds = realloc(server->pfds, capacity * sizeof(struct pollfd));
+    if (pfds == NULL)
+    {
+      perror("realloc failed for poll set");
+      return -1;
+    }
+    server->pfds = pfds;
+    server->poll_capacity = capacity;
+  }
+
+  // Free slots get a negative descriptor, which poll() skips
+  server->pfds[0].fd = ct_fd(server->listener);
+  server->pfds[0].events = POLLIN;
+  for (uint32_t i = 0; i < dir->slot_count; i++)
+  {
+    chat_member *member = dir->slots[i];
+    server->pfds[i + 1].fd = member != NULL ? ct_fd(member->conn) : -1;
+    server->pfds[i + 1].events = POLLIN;
+    if (member == NULL)
+    {
+      continue;
+    }
+
+    int wait = ct_timeout(member->conn);
+    if (wait >= 0 && (timeout_ms < 0 || wait < timeout_ms))
+    {
+      timeout_ms = wait;
+    }
+  }
+
+  // Members left waiting by the last round's budget go on right away
+  if (server->sched.active > 0)
+  {
+    timeout_ms = 0;
+  }
+
+  // Logged messages wait at most until their group is synced
+  uint64_t now = now_us();
+  for (uint32_t i = 0; i < dir->room_count; i++)
+  {
+    uint64_t deadline = dir->rooms[i]->log != NULL ? chat_log_sync_deadline(dir->rooms[i]->log) : 0;
+    if (deadline != 0)
+    {
+      int wait = deadline > now ? (int)((deadline - now + 999) / 1000) : 0;
+      if (timeout_ms < 0 || wait < timeout_ms)
+      {
+        timeout_ms = wait;
+      }
+    }
+  }
+  poll(server->pfds, dir->slot_count + 1, timeout_ms);
+
+  if (ct_process(server->listener) < 0)
+  {
+    return -1;
+  }
+  ct_conn *conn;
+  while ((conn = ct_accept(server->listener)) != NULL)
+  {
+    add_member(server, conn);
+  }
+
+  for (uint32_t i = 0; i < dir->slot_count; i++)
+  {
+    chat_member *member = dir->slots[i];
+    if (member != NULL && serve_member(server, member) < 0)
+    {
+      free_member(server, member);
+    }
+  }
+
+  // Whatever was broadcast this round goes out, as far as the budget
+  // allows. Members are served every round as ct_process() also runs their
+  // timers.
+  send_round(server);
+
+  // One sync covers everything logged since the last
+  now = now_us();
+  for (uint32_t i = 0; i < dir->room_count; i++)
+  {
+    if (dir->rooms[i]->log != NULL)
+    {
+      chat_log_sync(dir->rooms[i]->log, now, 0);
+    }
+  }
+
+  return 0;
+}
+
+// Close every connection and release the server
+void chat_server_free(chat_server *server)
+{
+  for (uint32_t i = 0; i < server->dir.slot_count; i++)
+  {
+    if (server->dir.slots[i] != NULL)
+    {
+      free_member(server, server->dir.slots[i]);
+    }
+  }
+  chat_directory_free(&server->dir);
+  free(server->pfds);
+  ct_free(server->listener);
+  memset(server, 0, sizeof(chat_server));
+}
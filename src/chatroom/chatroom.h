@@ -0,0 +1,211 @@
+#ifndef CHATROOM_H
+#define CHATROOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include "chattcp.h"
+#include "buffer_pool.h"
+#include "drr.h"
+#include "room_index.h"
+#include "chat_log.h"
+#include "recent_ring.h"
+
+// Chatroom constants
+#define CHAT_NAME_MAX 32      // Room names and nicknames, terminator included
+#define CHAT_QUEUE_SIZE 256   // Messages a member may have waiting for its send buffer
+#define CHAT_STREAM 0         // Stream chat messages travel on
+#define CHAT_DEFAULT_ROOM "lobby"
+#define CHAT_REPLAY_COUNT 20  // Recent messages a member gets on joining a room
+#define CHAT_RECENT_MESSAGES 64   // Default number of messages a room keeps in memory
+#define CHAT_MSG_SMALL 256        // Pooled buffers most messages fit in, larger ones take a full one
+#define CHAT_RECENT_BYTES 32768   // Default bytes a room keeps in memory
+#define CHAT_SEND_BUDGET 65536    // Bytes the server sends per round before it polls again
+#define CHAT_MAX_ROOMS 1024       // Default number of rooms a directory may hold
+#define CHAT_MEMBER_ROOMS 8       // Rooms a member may create by joining them
+
+// Room indicators, set as latest-value state on key 2 * room ID + kind of
+// each member's connection. A newer one replaces an older one the member
+// has not received yet, they are never queued behind messages.
+#define CHAT_STATE_PRESENCE 0 // "[room] N online"
+#define CHAT_STATE_TYPING 1   // "[room] nick is typing", empty once nobody is
+
+// A message encoded once and shared by the send queues of all its
+// recipients. It lives in a pooled buffer, which holds the references and
+// goes back to the pool when the last one is released.
+typedef struct
+{
+  uint32_t len;
+  char data[];
+} chat_msg;
+
+// A connected client
+typedef struct
+{
+  ct_conn *conn;
+  char nick[CHAT_NAME_MAX];
+  uint32_t slot;                 // Position in the directory's connection table
+  int64_t active_room;           // Room the member's text goes to, -1 if none
+  chat_msg *queue[CHAT_QUEUE_SIZE]; // Messages waiting for room in the send buffer
+  int queue_head;
+  int queue_count;
+  chat_log *replay_log;          // Log of a room being replayed to the member, NULL if none
+  uint64_t replay_next;          // Next logged message to send
+  uint64_t replay_end;           // Messages from here on arrive through the queue
+  uint32_t dropped;              // Messages lost because the queue was full
+  uint32_t rooms_created;        // Rooms that did not exist before the member joined them
+  int closing;                   // The client closed, waiting for our FIN to be acknowledged
+  drr_flow flow;                 // Its turn in the server's send scheduler, bulk while replaying
+} chat_member;
+
+// Members who see each other's messages, kept in the directory's index
+typedef struct
+{
+  char name[CHAT_NAME_MAX];
+  uint32_t id;
+  chat_log *log;                 // Message history, NULL if not kept
+  recent_ring recent;            // Latest messages, served to joining members
+  int cached;                    // The ring could be allocated
+  int64_t typist;                // Slot of the member shown typing, -1 if none
+} chat_room;
+
+// Members and rooms. Members sit in a dense connection table and rooms
+// are sets of table slots, so a broadcast walks the set bits of its room
+// straight into the table.
+typedef struct
+{
+  chat_member **slots;           // Connection table, NULL where a slot is free
+  uint32_t slot_count;           // Slots handed out so far, free ones included
+  uint32_t slot_capacity;
+  uint32_t *free_slots;          // Freed slots, reused before the table grows
+  uint32_t free_count;
+  uint32_t member_count;
+  chat_room **rooms;             // By room ID
+  uint32_t room_count;
+  uint32_t room_capacity;
+  uint32_t max_rooms;            // Rooms are never freed, none are created past this
+  room_index index;
+  char *log_dir;                 // Rooms keep their history below it, NULL for none
+  uint32_t recent_messages;      // Size of the rings of rooms created from now on
+  uint32_t recent_bytes;
+} chat_directory;
+
+// Chat server on one listening endpoint
+typedef struct
+{
+  ct_conn *listener;
+  chat_directory dir;
+  uint32_t next_id;              // Numbers default nicknames
+  struct pollfd *pfds;           // Poll set, the listener then every member
+  int poll_capacity;
+  drr_sched sched;               // Members with something to send take turns
+  size_t send_budget;            // Bytes sent per round, CHAT_SEND_BUDGET by default
+} chat_server;
+
+// Encode "[room] nick: text" into a message holding one reference.
+// Returns NULL if out of memory.
+chat_msg *chat_msg_encode(const char *room, const char *nick, const char *text, size_t len);
+
+// Take another reference to a message
+chat_msg *chat_msg_retain(chat_msg *msg);
+
+// Drop a reference, freeing the message with the last one
+void chat_msg_release(chat_msg *msg);
+
+// Initialize a member for a connection, not in any room
+void chat_member_init(chat_member *member, ct_conn *conn, const char *nick);
+
+// Queue a message for the member, taking a reference. Returns -1 and
+// counts the message as dropped if the queue is full.
+int chat_member_enqueue(chat_member *member, chat_msg *msg);
+
+// Move a pending replay, then queued messages into the connection's send
+// buffer while it has room. Replayed messages are sent straight from the
+// log's mapped pages. Returns the number sent, or -1 if the connection
+// failed.
+int chat_member_flush(chat_member *member);
+
+// Move the next replayed or queued message into the connection's send
+// buffer. Returns its length, 0 if nothing is left to send, or -1 with
+// errno set to EAGAIN if the buffer has no room for it.
+ssize_t chat_member_send_next(chat_member *member);
+
+// Release all queued messages and drop a pending replay
+void chat_member_clear(chat_member *member);
+
+// Send the member the last count messages of a room ahead of what is
+// queued for it from now on. They are copied from the room's ring if it
+// holds them all and sent from its log otherwise.
+void chat_member_replay(chat_member *member, chat_room *room, uint32_t count);
+
+// Initialize an empty directory. With log_dir set every room logs its
+// messages to a directory of the same name below it. Rooms keep their
+// latest messages in rings of the default size.
+void chat_directory_init(chat_directory *dir, const char *log_dir);
+
+// Print each room's ring use and hit rate, and the message pools' use
+void chat_directory_report(chat_directory *dir);
+
+// Counters of the pools of small and of full size message buffers
+void chat_msg_pool_stats(buffer_pool_stats *small, buffer_pool_stats *full);
+
+// Give a member a slot in the connection table. Returns -1 if out of memory.
+int chat_directory_add(chat_directory *dir, chat_member *member);
+
+// Take a member out of all rooms and free its slot
+void chat_directory_remove(chat_directory *dir, chat_member *member);
+
+// Find a room by name, creating it on first use. Returns NULL if out of
+// memory or if the directory holds max_rooms rooms already.
+chat_room *chat_directory_room(chat_directory *dir, const char *name);
+
+// Find a room by name, NULL if there is none
+chat_room *chat_directory_find(chat_directory *dir, const char *name);
+
+// Release the rooms and the index, members belong to the caller
+void chat_directory_free(chat_directory *dir);
+
+// Add a member to a room, which becomes the room its text goes to.
+// Members may be in many rooms. Returns -1 if out of memory.
+int chat_room_join(chat_directory *dir, chat_room *room, chat_member *member);
+
+// Remove a member from a room. If its text went there, it goes to another
+// of its rooms now, if any.
+void chat_room_leave(chat_directory *dir, chat_room *room, chat_member *member);
+
+// Members in a room
+uint32_t chat_room_size(chat_directory *dir, chat_room *room);
+
+// Queue msg for every member of room but except, which may be NULL. Only
+// pointers are queued, the message is shared. Returns the number of
+// recipients.
+int chat_room_broadcast(chat_directory *dir, chat_room *room, chat_msg *msg,
+                        const chat_member *except);
+
+// Set a room indicator on the connection of every member but except.
+// Members that cannot take it now miss it, a later one supersedes it
+// anyway. Returns the number of members it was set for.
+int chat_room_indicate(chat_directory *dir, chat_room *room, int kind, const char *value,
+                       size_t len, const chat_member *except);
+
+// Log a message posted to a room and keep it in its ring, then queue it
+// for every member but except. Returns the number of recipients.
+int chat_room_post(chat_directory *dir, chat_room *room, chat_msg *msg, const chat_member *except);
+
+// Listen for chat clients on addr, keeping room history below log_dir
+// unless it is NULL. Returns -1 with errno set on failure.
+int chat_server_init(chat_server *server, const struct sockaddr_in *addr, const char *log_dir);
+
+// Wait up to timeout_ms for traffic, then accept clients, handle their
+// messages and flush the send queues. Members with something to send take
+// turns by deficit round robin, a message at a time, replays as bulk and
+// everything else as interactive, so one member's backlog cannot hold up
+// the others. Once send_budget bytes went out the rest waits for the next
+// round. Returns -1 if the listener failed.
+int chat_server_run_once(chat_server *server, int timeout_ms);
+
+// Close every connection and release the server
+void chat_server_free(chat_server *server);
+
+#endif
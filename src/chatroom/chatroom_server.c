@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "chatroom.h"
+
+#define PORT 12346
+#define LOG_DIR "chat_history"
+#define REPORT_INTERVAL 60 // Seconds between ring reports
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int sig)
+{
+  (void)sig;
+  running = 0;
+}
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_in addr;
+  chat_server server;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(argc > 1 ? atoi(argv[1]) : PORT);
+  addr.sin_addr.s_addr = INADDR_ANY;
+
+  // Room history goes below the directory given after the port
+  const char *log_dir = argc > 2 ? argv[2] : LOG_DIR;
+  if (chat_server_init(&server, &addr, log_dir) < 0)
+  {
+    perror("Could not start chat server");
+    return 1;
+  }
+
+  // Then how many recent messages and bytes each room keeps in memory
+  if (argc > 3)
+  {
+    server.dir.recent_messages = atoi(argv[3]);
+  }
+  if (argc > 4)
+  {
+    server.dir.recent_bytes = atoi(argv[4]);
+  }
+  printf("Chat server listening on port %u, history in %s\n", ntohs(addr.sin_port), log_dir);
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  time_t last_report = time(NULL);
+  while (running && chat_server_run_once(&server, 1000) == 0)
+  {
+    if (time(NULL) - last_report >= REPORT_INTERVAL)
+    {
+      chat_directory_report(&server.dir);
+      last_report = time(NULL);
+    }
+  }
+
+  printf("Shutting down chat server\n");
+  chat_directory_report(&server.dir);
+  chat_server_free(&server);
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "recent_ring.h"
+
+// Allocate a ring for max_messages messages of max_bytes bytes in all
+int recent_ring_init(recent_ring *ring, uint32_t max_messages, uint32_t max_bytes)
+{
+  memset(ring, 0, sizeof(recent_ring));
+  ring->slots = calloc(max_messages, sizeof(recent_slot));
+  ring->bytes = malloc(max_bytes);
+  if (ring->slots == NULL || ring->bytes == NULL || max_messages == 0 || max_bytes == 0)
+  {
+    perror("malloc failed for recent message ring");
+    free(ring->slots);
+    free(ring->bytes);
+    ring->slots = NULL;
+    ring->bytes = NULL;
+    return -1;
+  }
+
+  ring->max_messages = max_messages;
+  ring->max_bytes = max_bytes;
+  return 0;
+}
+
+// Release the ring's memory
+void recent_ring_free(recent_ring *ring)
+{
+  free(ring->slots);
+  free(ring->bytes);
+  memset(ring, 0, sizeof(recent_ring));
+}
+
+// Count messages the ring never held
+void recent_ring_skip(recent_ring *ring, uint64_t count)
+{
+  atomic_store_explicit(&ring->tail, count, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, count, memory_order_release);
+}
+
+// Copy len bytes to position pos of the byte stream, wrapping at the end
+static void write_bytes(recent_ring *ring, uint64_t pos, const char *data, uint32_t len)
+{
+  uint32_t offset = pos % ring->max_bytes;
+  uint32_t first = ring->max_bytes - offset < len ? ring->max_bytes - offset : len;
+  memcpy(ring->bytes + offset, data, first);
+  memcpy(ring->bytes, data + first, len - first);
+}
+
+static void read_bytes(recent_ring *ring, uint64_t pos, char *data, uint32_t len)
+{
+  uint32_t offset = pos % ring->max_bytes;
+  uint32_t first = ring->max_bytes - offset < len ? ring->max_bytes - offset : len;
+  memcpy(data, ring->bytes + offset, first);
+  memcpy(data + first, ring->bytes, len - first);
+}
+
+// Append a message, evicting the oldest ones as needed
+int recent_ring_push(recent_ring *ring, const void *data, uint32_t len)
+{
+  if (len > ring->max_bytes)
+  {
+    return -1;
+  }
+
+  // Only this thread changes the positions, so relaxed loads see its own stores
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint64_t head_bytes = atomic_load_explicit(&ring->head_bytes, memory_order_relaxed);
+  uint64_t tail_bytes = atomic_load_explicit(&ring->tail_bytes, memory_order_relaxed);
+
+  uint64_t evicted = tail;
+  while (head - evicted >= ring->max_messages || head_bytes + len - tail_bytes > ring->max_bytes)
+  {
+    recent_slot *slot = &ring->slots[evicted % ring->max_messages];
+    tail_bytes = atomic_load_explicit(&slot->start, memory_order_relaxed) +
+                 atomic_load_explicit(&slot->len, memory_order_relaxed);
+    evicted++;
+  }
+
+  // Readers must see the tail move before the bytes and the slot it
+  // freed are overwritten
+  if (evicted != tail)
+  {
+    atomic_store_explicit(&ring->tail_bytes, tail_bytes, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, evicted, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+  }
+
+  write_bytes(ring, head_bytes, data, len);
+  recent_slot *slot = &ring->slots[head % ring->max_messages];
+  atomic_store_explicit(&slot->id, head, memory_order_relaxed);
+  atomic_store_explicit(&slot->start, head_bytes, memory_order_relaxed);
+  atomic_store_explicit(&slot->len, len, memory_order_relaxed);
+
+  // Publishing the head makes the message readable
+  atomic_store_explicit(&ring->head_bytes, head_bytes + len, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+// Copy up to the last n messages into buf
+int recent_ring_snapshot(recent_ring *ring, uint32_t n, recent_entry *entries, int max, char *buf,
+                         size_t buf_len)
+{
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (tail > head)
+  {
+    // The writer moved on since the head was read
+    tail = head;
+  }
+  uint64_t wanted = n < head ? n : head;
+  uint64_t first = head - wanted > tail ? head - wanted : tail;
+  if (head - first > (uint64_t)max)
+  {
+    first = head - max;
+  }
+
+  // Walk back from the newest message while the bytes fit
+  size_t used = 0;
+  uint64_t id = head;
+  while (id > first)
+  {
+    uint32_t len = atomic_load_explicit(&ring->slots[(id - 1) % ring->max_messages].len,
+                                        memory_order_relaxed);
+    if (used + len > buf_len)
+    {
+      break;
+    }
+    used += len;
+    id--;
+  }
+  first = id;
+
+  // Copy oldest first. What the writer overwrites meanwhile is caught below.
+  int count = 0;
+  used = 0;
+  for (id = first; id < head; id++)
+  {
+    recent_slot *slot = &ring->slots[id % ring->max_messages];
+    uint64_t start = atomic_load_explicit(&slot->start, memory_order_relaxed);
+    uint32_t len = atomic_load_explicit(&slot->len, memory_order_relaxed);
+    if (atomic_load_explicit(&slot->id, memory_order_relaxed) != id || used + len > buf_len)
+    {
+      break;
+    }
+
+    read_bytes(ring, start, buf + used, len);
+    entries[count].id = id;
+    entries[count].data = buf + used;
+    entries[count].len = len;
+    used += len;
+    count++;
+  }
+
+  // Messages the tail has moved past may have been overwritten while they
+  // were copied
+  atomic_thread_fence(memory_order_acquire);
+  tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  int stale = 0;
+  while (stale < count && entries[stale].id < tail)
+  {
+    stale++;
+  }
+  if (stale > 0)
+  {
+    memmove(entries, entries + stale, (count - stale) * sizeof(recent_entry));
+    count -= stale;
+  }
+
+  if ((uint64_t)count == wanted)
+  {
+    atomic_fetch_add_explicit(&ring->hits, 1, memory_order_relaxed);
+  }
+  else
+  {
+    atomic_fetch_add_explicit(&ring->misses, 1, memory_order_relaxed);
+  }
+
+  return count;
+}
+
+// Current counters
+void recent_ring_get_stats(recent_ring *ring, recent_ring_stats *stats)
+{
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint64_t tail_bytes = atomic_load_explicit(&ring->tail_bytes, memory_order_acquire);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint64_t head_bytes = atomic_load_explicit(&ring->head_bytes, memory_order_acquire);
+
+  stats->messages = head - tail;
+  stats->bytes = head_bytes - tail_bytes;
+  stats->memory = sizeof(recent_ring) + ring->max_messages * sizeof(recent_slot) + ring->max_bytes;
+  stats->hits = atomic_load_explicit(&ring->hits, memory_order_relaxed);
+  stats->misses = atomic_load_explicit(&ring->misses, memory_order_relaxed);
+}
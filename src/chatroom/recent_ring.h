@@ -0,0 +1,79 @@
+#ifndef RECENT_RING_H
+#define RECENT_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Where a cached message sits in the ring's byte stream
+typedef struct
+{
+  _Atomic uint64_t id;    // Message number, from 0 in order of writing
+  _Atomic uint64_t start; // Position of its first byte among all bytes written
+  _Atomic uint32_t len;
+} recent_slot;
+
+// Most recent messages of a room, evicted by count and by bytes. One
+// writer appends while any number of readers take snapshots without
+// locks: the writer moves the tail past what it is about to overwrite
+// before overwriting it, and a reader keeps only what is still at or
+// after the tail once it has copied it.
+typedef struct
+{
+  recent_slot *slots;            // Message i is in slots[i % max_messages]
+  uint32_t max_messages;
+  char *bytes;                   // Position p is at bytes[p % max_bytes]
+  uint32_t max_bytes;
+  _Atomic uint64_t head;         // Number of the next message written
+  _Atomic uint64_t tail;         // Oldest message that may be read
+  _Atomic uint64_t head_bytes;   // Bytes written so far
+  _Atomic uint64_t tail_bytes;   // Position of the tail's first byte
+  _Atomic uint64_t hits;         // Snapshots that found every message asked for
+  _Atomic uint64_t misses;
+} recent_ring;
+
+// A message copied out of the ring
+typedef struct
+{
+  uint64_t id;
+  const char *data;              // Into the reader's buffer
+  uint32_t len;
+} recent_entry;
+
+// Counters for reporting
+typedef struct
+{
+  uint32_t messages;             // Messages held
+  uint32_t bytes;                // Their bytes
+  size_t memory;                 // Bytes allocated for the ring
+  uint64_t hits;
+  uint64_t misses;
+} recent_ring_stats;
+
+// Allocate a ring holding up to max_messages messages and max_bytes bytes
+// of them. Returns -1 if out of memory.
+int recent_ring_init(recent_ring *ring, uint32_t max_messages, uint32_t max_bytes);
+
+// Release the ring's memory, no reader may be using it
+void recent_ring_free(recent_ring *ring);
+
+// Count messages written before the ring was filled, which it does not
+// hold, so that snapshots know more exist. Only valid while it is empty.
+void recent_ring_skip(recent_ring *ring, uint64_t count);
+
+// Append a message, evicting the oldest ones as needed. Only one thread
+// may write. Returns -1 if the message is larger than the whole ring.
+int recent_ring_push(recent_ring *ring, const void *data, uint32_t len);
+
+// Copy up to the last n messages, oldest first, into buf and describe
+// them in entries. Fewer are returned if buf or entries is too small or if
+// the writer overwrote some meanwhile. Counts a hit if all of the last n
+// messages written, or all there are, were returned. Returns the number of
+// entries.
+int recent_ring_snapshot(recent_ring *ring, uint32_t n, recent_entry *entries, int max, char *buf,
+                         size_t buf_len);
+
+// Current counters
+void recent_ring_get_stats(recent_ring *ring, recent_ring_stats *stats);
+
+#endif
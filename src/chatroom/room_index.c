@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "room_index.h"
+
+// Initialize an empty set
+void slot_set_init(slot_set *set)
+{
+  memset(set, 0, sizeof(slot_set));
+}
+
+// Release the set's memory
+void slot_set_free(slot_set *set)
+{
+  free(set->words);
+  free(set->summary);
+  slot_set_init(set);
+}
+
+// Make room for the word holding id, zeroing what is added
+static int reserve(slot_set *set, uint32_t id)
+{
+  uint32_t needed = id / 64 + 1;
+  if (needed <= set->word_capacity)
+  {
+    return 0;
+  }
+
+  uint32_t capacity = set->word_capacity ? set->word_capacity : 64;
+  while (capacity < needed)
+  {
+    capacity *= 2;
+  }
+
+  uint64_t *words = realloc(set->words, capacity * sizeof(uint64_t));
+  if (words == NULL)
+  {
+    perror("realloc failed for slot set");
+    return -1;
+  }
+  set->words = words;
+  uint64_t *summary = realloc(set->summary, capacity / 64 * sizeof(uint64_t));
+  if (summary == NULL)
+  {
+    perror("realloc failed for slot set");
+    return -1;
+  }
+  set->summary = summary;
+
+  memset(set->words + set->word_capacity, 0, (capacity - set->word_capacity) * sizeof(uint64_t));
+  memset(set->summary + set->word_capacity / 64, 0,
+         (capacity - set->word_capacity) / 64 * sizeof(uint64_t));
+  set->word_capacity = capacity;
+  return 0;
+}
+
+// Add an ID, growing the set as needed
+int slot_set_add(slot_set *set, uint32_t id)
+{
+  if (reserve(set, id) < 0)
+  {
+    return -1;
+  }
+
+  uint32_t w = id / 64;
+  uint64_t bit = 1ULL << (id % 64);
+  if (set->words[w] & bit)
+  {
+    return 0;
+  }
+
+  set->words[w] |= bit;
+  set->summary[w / 64] |= 1ULL << (w % 64);
+  set->count++;
+  return 1;
+}
+
+// Remove an ID
+int slot_set_remove(slot_set *set, uint32_t id)
+{
+  if (!slot_set_contains(set, id))
+  {
+    return 0;
+  }
+
+  uint32_t w = id / 64;
+  set->words[w] &= ~(1ULL << (id % 64));
+  if (set->words[w] == 0)
+  {
+    set->summary[w / 64] &= ~(1ULL << (w % 64));
+  }
+  set->count--;
+  return 1;
+}
+
+// Whether the set holds an ID
+int slot_set_contains(const slot_set *set, uint32_t id)
+{
+  uint32_t w = id / 64;
+  return w < set->word_capacity && (set->words[w] >> (id % 64)) & 1;
+}
+
+// Smallest ID in the set that is at least from
+int64_t slot_set_next(const slot_set *set, uint32_t from)
+{
+  uint32_t w = from / 64;
+  if (w >= set->word_capacity)
+  {
+    return -1;
+  }
+
+  uint64_t bits = set->words[w] & (~0ULL << (from % 64));
+  if (bits != 0)
+  {
+    return (int64_t)w * 64 + __builtin_ctzll(bits);
+  }
+
+  // The summary finds the next non-empty word
+  w++;
+  uint32_t s = w / 64;
+  uint32_t summary_words = set->word_capacity / 64;
+  if (s >= summary_words)
+  {
+    return -1;
+  }
+  uint64_t occupied = set->summary[s] & (~0ULL << (w % 64));
+  while (occupied == 0)
+  {
+    if (++s >= summary_words)
+    {
+      return -1;
+    }
+    occupied = set->summary[s];
+  }
+
+  w = s * 64 + __builtin_ctzll(occupied);
+  return (int64_t)w * 64 + __builtin_ctzll(set->words[w]);
+}
+
+// Initialize an empty index
+void room_index_init(room_index *index)
+{
+  memset(index, 0, sizeof(room_index));
+}
+
+// Release the index's memory
+void room_index_free(room_index *index)
+{
+  for (uint32_t i = 0; i < index->room_capacity; i++)
+  {
+    slot_set_free(&index->members[i]);
+  }
+  for (uint32_t i = 0; i < index->slot_capacity; i++)
+  {
+    slot_set_free(&index->rooms[i]);
+  }
+  free(index->members);
+  free(index->rooms);
+  room_index_init(index);
+}
+
+// Grow an array of sets to hold id, the new sets are empty
+static int reserve_sets(slot_set **sets, uint32_t *capacity, uint32_t id)
+{
+  if (id < *capacity)
+  {
+    return 0;
+  }
+
+  uint32_t new_capacity = *capacity ? *capacity : 16;
+  while (new_capacity <= id)
+  {
+    new_capacity *= 2;
+  }
+
+  slot_set *grown = realloc(*sets, new_capacity * sizeof(slot_set));
+  if (grown == NULL)
+  {
+    perror("realloc failed for room index");
+    return -1;
+  }
+  for (uint32_t i = *capacity; i < new_capacity; i++)
+  {
+    slot_set_init(&grown[i]);
+  }
+  *sets = grown;
+  *capacity = new_capacity;
+  return 0;
+}
+
+// Put a slot in a room
+int room_index_join(room_index *index, uint32_t room, uint32_t slot)
+{
+  if (reserve_sets(&index->members, &index->room_capacity, room) < 0 ||
+      reserve_sets(&index->rooms, &index->slot_capacity, slot) < 0)
+  {
+    return -1;
+  }
+
+  int added = slot_set_add(&index->members[room], slot);
+  if (added <= 0)
+  {
+    return added;
+  }
+  if (slot_set_add(&index->rooms[slot], room) < 0)
+  {
+    slot_set_remove(&index->members[room], slot);
+    return -1;
+  }
+
+  return 1;
+}
+
+// Take a slot out of a room
+int room_index_leave(room_index *index, uint32_t room, uint32_t slot)
+{
+  if (room >= index->room_capacity || !slot_set_remove(&index->members[room], slot))
+  {
+    return 0;
+  }
+
+  slot_set_remove(&index->rooms[slot], room);
+  return 1;
+}
+
+// Take a slot out of every room it is in
+void room_index_leave_all(room_index *index, uint32_t slot)
+{
+  if (slot >= index->slot_capacity)
+  {
+    return;
+  }
+
+  slot_set *rooms = &index->rooms[slot];
+  for (int64_t room = slot_set_next(rooms, 0); room >= 0; room = slot_set_next(rooms, room + 1))
+  {
+    slot_set_remove(&index->members[room], slot);
+    slot_set_remove(rooms, room);
+  }
+}
+
+// Members of a room, NULL if it never had any
+const slot_set *room_index_members(const room_index *index, uint32_t room)
+{
+  return room < index->room_capacity ? &index->members[room] : NULL;
+}
+
+// Rooms of a slot, NULL if it never joined any
+const slot_set *room_index_rooms(const room_index *index, uint32_t slot)
+{
+  return slot < index->slot_capacity ? &index->rooms[slot] : NULL;
+}
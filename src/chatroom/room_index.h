@@ -0,0 +1,69 @@
+#ifndef ROOM_INDEX_H
+#define ROOM_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Set of small integer IDs as a bitset. A summary bit per 64-bit word
+// marks the words that have any bit set, so walking a sparse set skips
+// its empty stretches 4096 IDs at a time.
+typedef struct
+{
+  uint64_t *words;        // Bit i % 64 of words[i / 64] is set if i is in the set
+  uint64_t *summary;      // Bit w % 64 of summary[w / 64] is set if words[w] is non-zero
+  uint32_t word_capacity; // Allocated words, a multiple of 64
+  uint32_t count;         // IDs in the set
+} slot_set;
+
+// Initialize an empty set
+void slot_set_init(slot_set *set);
+
+// Release the set's memory
+void slot_set_free(slot_set *set);
+
+// Add an ID, growing the set as needed. Returns 1 if added, 0 if it was
+// present already, -1 if out of memory.
+int slot_set_add(slot_set *set, uint32_t id);
+
+// Remove an ID. Returns 1 if removed, 0 if it was not in the set.
+int slot_set_remove(slot_set *set, uint32_t id);
+
+// Whether the set holds an ID
+int slot_set_contains(const slot_set *set, uint32_t id);
+
+// Smallest ID in the set that is at least from, -1 if none
+int64_t slot_set_next(const slot_set *set, uint32_t from);
+
+// Which connection slots are in which rooms, both ways. Rooms and
+// connections are numbered densely by their owner.
+typedef struct
+{
+  slot_set *members;      // Connection slots of each room
+  uint32_t room_capacity;
+  slot_set *rooms;        // Rooms of each connection slot
+  uint32_t slot_capacity;
+} room_index;
+
+// Initialize an empty index
+void room_index_init(room_index *index);
+
+// Release the index's memory
+void room_index_free(room_index *index);
+
+// Put a slot in a room. Returns 1 if it joined, 0 if it was a member
+// already, -1 if out of memory.
+int room_index_join(room_index *index, uint32_t room, uint32_t slot);
+
+// Take a slot out of a room. Returns 1 if it left, 0 if it was not a member.
+int room_index_leave(room_index *index, uint32_t room, uint32_t slot);
+
+// Take a slot out of every room it is in
+void room_index_leave_all(room_index *index, uint32_t slot);
+
+// Members of a room, NULL if it never had any
+const slot_set *room_index_members(const room_index *index, uint32_t room);
+
+// Rooms of a slot, NULL if it never joined any
+const slot_set *room_index_rooms(const room_index *index, uint32_t slot);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef BBR_H
+#define BBR_H
+
+#include <stdint.h>
+
+// BBR modes
+#define BBR_STARTUP 0
+#define BBR_DRAIN 1
+#define BBR_PROBE_BW 2
+#define BBR_PROBE_RTT 3
+
+// Gains are fixed point values where BBR_UNIT == 1.0
+#define BBR_UNIT 256
+#define BBR_HIGH_GAIN 739  // 2/ln(2) ~= 2.885, fills the pipe in log2(BDP) rounds
+#define BBR_DRAIN_GAIN 88  // 1/2.885, drains the queue built during startup
+#define BBR_CWND_GAIN 512  // 2.0, inflight cap as a multiple of the BDP
+
+// BBR constants
+#define BBR_BW_FILTER_ROUNDS 10            // Max bandwidth filter window in round trips
+#define BBR_MIN_RTT_WINDOW_US 10000000     // Min RTT filter window (10 s)
+#define BBR_PROBE_RTT_DURATION_US 200000   // Time spent in PROBE_RTT (200 ms)
+#define BBR_DEFAULT_RTT_US 1000            // RTT assumed before the first sample
+#define BBR_INITIAL_CWND_SEGMENTS 10
+#define BBR_MIN_CWND_SEGMENTS 4
+#define BBR_GAIN_CYCLE_LEN 8
+#define BBR_FULL_BW_THRESHOLD 320          // 1.25, growth needed to keep startup going
+#define BBR_FULL_BW_ROUNDS 3
+#define BBR_MAX_CWND 65535
+
+// Delivery rate sample taken when an ACK arrives
+typedef struct
+{
+  uint64_t now_us;          // Time the ACK was processed
+  uint32_t delivered;       // Bytes delivered over the sample interval
+  uint64_t prior_delivered; // Total delivered when the acked segment was sent
+  uint64_t interval_us;     // Interval over which the bytes were delivered
+  uint32_t rtt_us;          // RTT sample, 0 if not available
+  uint32_t acked;           // Bytes newly acknowledged by this ACK
+  uint32_t in_flight;       // Bytes still in flight after this ACK
+  uint32_t delay_us;        // One-way delay echoed by the receiver
+  int has_delay;            // delay_us carries a sample
+  int is_app_limited;       // Sample was taken while the sender ran out of data
+} rate_sample;
+
+// BBR state structure
+typedef struct
+{
+  int mode;                                   // Current mode (BBR_STARTUP, BBR_DRAIN, ...)
+  uint16_t mss;                               // Maximum segment size
+  uint64_t bw_samples[BBR_BW_FILTER_ROUNDS];  // Max delivery rate per round, bytes/sec
+  uint64_t max_bw;                            // Bottleneck bandwidth estimate, bytes/sec
+  uint32_t min_rtt_us;                        // Min RTT estimate, 0 until the first sample
+  uint64_t min_rtt_stamp_us;                  // When min_rtt_us was last refreshed
+  uint64_t delivered;                         // Total bytes delivered so far
+  uint64_t round_count;                       // Packet-timed round trips elapsed
+  uint64_t next_round_delivered;              // Delivered count that ends the current round
+  int round_start;                            // The last ACK started a new round
+  uint64_t full_bw;                           // Bandwidth at the last significant growth
+  int full_bw_count;                          // Rounds without significant growth
+  int filled_pipe;                            // Startup has found the bottleneck bandwidth
+  int cycle_index;                            // Position in the PROBE_BW gain cycle
+  uint64_t cycle_stamp_us;                    // When the current gain cycle phase started
+  uint64_t probe_rtt_done_us;                 // When PROBE_RTT may end, 0 if not yet armed
+  int probe_rtt_round_done;                   // A full round has passed in PROBE_RTT
+  uint32_t prior_cwnd;                        // cwnd saved on entering PROBE_RTT
+  uint32_t pacing_gain;                       // Current pacing gain (BBR_UNIT based)
+  uint32_t cwnd_gain;                         // Current cwnd gain (BBR_UNIT based)
+  uint64_t pacing_rate;                       // Pacing rate in bytes/sec
+  uint32_t cwnd;                              // Congestion window in bytes
+} bbr_state;
+
+// Initialize BBR state
+void bbr_init(bbr_state *bbr, uint16_t mss);
+
+// Update the path model, mode, pacing rate and cwnd from a delivery rate sample
+void bbr_on_ack(bbr_state *bbr, const rate_sample *rs);
+
+// Handle a retransmission timeout
+void bbr_on_timeout(bbr_state *bbr);
+
+// Estimated bandwidth-delay product scaled by gain, in bytes
+uint32_t bbr_inflight(bbr_state *bbr, uint32_t gain);
+
+// Name of a BBR mode for logging
+const char *bbr_mode_name(int mode);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define BUFFER_CACHE_LINE 64
+#define BUFFER_SLAB_SIZE (2 * 1024 * 1024) // Slabs are carved from this much memory, one huge page
+#define BUFFER_CACHE_SIZE 64               // Free buffers a thread keeps to itself
+#define BUFFER_CACHE_BATCH 32              // Buffers a thread takes from or returns to the pool at once
+
+// Flags for buffer_pool_init()
+#define BUFFER_POOL_HUGE_PAGES 0x1 // Back slabs by huge pages where the system has them reserved
+
+typedef struct buffer_pool buffer_pool;
+
+// A thread's own free buffers of a pool, taken and returned without the
+// pool's lock
+typedef struct buffer_cache
+{
+  buffer_pool *pool;
+  struct buffer_cache *next;         // In the pool's list of caches
+  int count;
+  void *buffers[BUFFER_CACHE_SIZE];
+  _Atomic uint64_t allocs;           // Written by the owning thread only
+  _Atomic uint64_t frees;
+} buffer_cache;
+
+// Fixed-size, cache line aligned buffers carved from slabs. A buffer
+// carries a reference count, so one can sit in several queues and is only
+// returned to the pool with its last reference. Any thread may allocate
+// and release buffers.
+struct buffer_pool
+{
+  size_t buffer_size;                // Usable bytes of a buffer
+  size_t stride;                     // Its header and bytes, a multiple of BUFFER_CACHE_LINE
+  size_t slab_size;
+  int flags;
+  pthread_mutex_t lock;              // Guards everything below
+  pthread_key_t cache_key;           // The calling thread's buffer_cache
+  void *free_list;                   // Buffers no thread holds
+  void **slabs;
+  size_t slab_count;
+  size_t slab_capacity;
+  size_t huge_slabs;                 // Slabs backed by huge pages
+  buffer_cache *caches;
+  uint64_t retired_allocs;           // Counts of caches whose threads exited, and of
+  uint64_t retired_frees;            // buffers allocated or released without a cache
+  uint64_t refills;                  // Batches taken from the free list
+  uint64_t spills;                   // Batches returned to it
+  uint64_t failures;                 // Allocations that found no memory
+};
+
+// Counters for reporting
+typedef struct
+{
+  size_t buffer_size;
+  size_t slabs;
+  size_t huge_slabs;
+  size_t memory;                     // Bytes of slabs
+  uint64_t buffers;                  // Buffers carved from the slabs
+  uint64_t in_use;                   // Allocated and not yet released
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t refills;
+  uint64_t spills;
+  uint64_t failures;
+} buffer_pool_stats;
+
+// Initialize a pool of buffers of buffer_size bytes. No memory is taken
+// until the first allocation. Returns -1 if buffer_size is 0 or larger
+// than a slab.
+int buffer_pool_init(buffer_pool *pool, size_t buffer_size, int flags);
+
+// Unmap all slabs. Every buffer must have been released, and no other
+// thread may use the pool any more.
+void buffer_pool_destroy(buffer_pool *pool);
+
+// A buffer holding one reference, aligned to BUFFER_CACHE_LINE. Returns
+// NULL if out of memory.
+void *buffer_alloc(buffer_pool *pool);
+
+// Take another reference to a buffer
+void *buffer_retain(void *buf);
+
+// Drop a reference, returning the buffer to its pool with the last one
+void buffer_release(void *buf);
+
+// References held to a buffer
+uint32_t buffer_refs(const void *buf);
+
+// Return the calling thread's cached buffers to the pool. Threads exiting
+// do so on their own.
+void buffer_pool_flush(buffer_pool *pool);
+
+// Current counters. Those of other threads are read without stopping
+// them, and may be slightly behind.
+void buffer_pool_get_stats(buffer_pool *pool, buffer_pool_stats *stats);
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef CHATTCP_H
+#define CHATTCP_H
+
+// Public API of libchattcp. Everything else in the library is internal and
+// hidden from the shared object.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#if defined(__GNUC__)
+#define CT_API __attribute__((visibility("default")))
+#else
+#define CT_API
+#endif
+
+// Connection states
+typedef enum
+{
+  CT_CLOSED,
+  CT_LISTEN,       // Waiting for a SYN
+  CT_SYN_SENT,     // SYN sent, waiting for the SYN-ACK
+  CT_SYN_RECEIVED, // SYN-ACK sent, waiting for the final ACK
+  CT_ESTABLISHED,
+  CT_FIN_WAIT,     // Closing, our FIN goes out once queued data is acknowledged
+  CT_CLOSE_WAIT,   // The peer closed, we may still send
+  CT_LAST_ACK,     // Both closed, waiting for the ACK of our FIN
+  CT_TIME_WAIT     // Both FINs acknowledged, lingering for retransmitted ones
+} ct_state;
+
+typedef struct ct_conn ct_conn;
+
+// Readiness and state change notification
+typedef void (*ct_callback)(ct_conn *conn, void *arg);
+
+// Create an unconnected endpoint with its own non-blocking UDP socket.
+// Returns NULL if no socket could be set up.
+CT_API ct_conn *ct_socket(void);
+
+// Bind the endpoint to a local address. Returns -1 with errno set on failure.
+CT_API int ct_bind(ct_conn *conn, const struct sockaddr_in *addr);
+
+// Accept incoming connections on a bound endpoint. Returns -1 with errno
+// set to EINVAL if the endpoint is not bound or already in use.
+CT_API int ct_listen(ct_conn *conn);
+
+// Take the next pending connection from a listening endpoint. The new
+// connection has its own socket and starts in CT_SYN_RECEIVED. Returns
+// NULL with errno set to EAGAIN if no SYN is waiting.
+CT_API ct_conn *ct_accept(ct_conn *listener);
+
+// Open a connection to addr, binding to any local port first if needed.
+// Returns immediately in CT_SYN_SENT, the handshake completes in ct_process().
+CT_API int ct_connect(ct_conn *conn, const struct sockaddr_in *addr);
+
+// Offer to compress messages sent with ct_send_message(), before
+// ct_connect() or ct_listen(). The handshake turns it on if both sides
+// offered it with the same dictionary, connections accepted from a
+// listener inherit its offer. Messages shorter than a few words, or that
+// start like an already compressed file, are sent as they are. Returns 0,
+// or -1 with errno set to EISCONN if the endpoint is in use.
+CT_API int ct_set_compression(ct_conn *conn, int enable);
+
+// Whether the handshake agreed to compress messages
+CT_API int ct_compressed(ct_conn *conn);
+
+// Offer compact headers, before ct_connect() or ct_listen(). If both sides
+// offered them, packets after the handshake leave out what the peer can
+// infer: ports, the high bytes of sequence numbers and timestamps, an
+// unchanged window and the unused part of the payload. Connections
+// accepted from a listener inherit its offer. Returns 0, or -1 with errno
+// set to EISCONN if the endpoint is in use.
+CT_API int ct_set_compact_headers(ct_conn *conn, int enable);
+
+// Offer forward error correction, before ct_connect() or ct_listen(). If
+// both sides offered it, each follows its data with parity segments once
+// it sees loss, as many as the loss rate calls for, and the receiver
+// rebuilds lost segments from them instead of waiting a round trip for
+// the retransmission. Connections accepted from a listener inherit its
+// offer. Returns 0, or -1 with errno set to EISCONN if the endpoint is in
+// use.
+CT_API int ct_set_fec(ct_conn *conn, int enable);
+
+// Resumption tokens of CT_TOKEN_SIZE bytes. A server issues them to its
+// clients, ct_get_token() takes the latest one. Handing it to
+// ct_connect_token() for the next connection to the same server lets data
+// queued with ct_send() right after the call reach the server together
+// with the SYN, and the connection start from the previous one's RTT and
+// window. A token the server refuses costs the early data one
+// retransmission, the connection is set up as by ct_connect().
+#define CT_TOKEN_SIZE 32
+CT_API int ct_connect_token(ct_conn *conn, const struct sockaddr_in *addr,
+                            const void *token, size_t len);
+
+// Copy the latest token the server issued on this connection into buffer.
+// Returns CT_TOKEN_SIZE, or -1 with errno set to ENOENT if there is none
+// or EINVAL if buffer is too small.
+CT_API ssize_t ct_get_token(ct_conn *conn, void *buffer, size_t len);
+
+// Whether an accepted connection was resumed from a valid token
+CT_API int ct_resumed(ct_conn *conn);
+
+// Queue data for sending. Returns the bytes queued, which may be fewer
+// than len, or -1 with errno set to EAGAIN if the send buffer is full,
+// ENOTCONN before the handshake completed or EPIPE after ct_close().
+CT_API ssize_t ct_send(ct_conn *conn, const void *data, size_t len);
+
+// Read received data. Returns the bytes read, 0 at the end of the stream,
+// or -1 with errno set to EAGAIN if nothing has arrived yet.
+CT_API ssize_t ct_recv(ct_conn *conn, void *buffer, size_t len);
+
+// Streams of a connection, IDs from 0 to CT_MAX_STREAMS - 1. Each is
+// delivered in its own order, a loss on one stream does not hold back the
+// others. Using a stream ID opens the stream, ct_send() and ct_recv() use
+// stream 0. Both return -1 with errno set to EINVAL for an ID out of range.
+#define CT_MAX_STREAMS 64
+CT_API ssize_t ct_send_stream(ct_conn *conn, uint16_t stream_id, const void *data, size_t len);
+CT_API ssize_t ct_recv_stream(ct_conn *conn, uint16_t stream_id, void *buffer, size_t len);
+
+// A stream with data to read, -1 if none
+CT_API int ct_next_stream(ct_conn *conn);
+
+// Messages of up to CT_MAX_MESSAGE bytes, framed on a stream so their
+// boundaries survive segmentation. Do not mix them with ct_send_stream()
+// on the same stream.
+#define CT_MAX_MESSAGE 8192
+
+typedef struct
+{
+  const char *data;
+  size_t len;
+} ct_message;
+
+// Queue one message on stream_id, all of it or nothing. Returns len, or -1
+// with errno set as for ct_send(), or EMSGSIZE if len exceeds CT_MAX_MESSAGE.
+CT_API ssize_t ct_send_message(ct_conn *conn, uint16_t stream_id, const void *data, size_t len);
+
+// Take up to max complete messages received on stream_id. They point into
+// the connection's receive buffer and stay valid until the next call for
+// the same stream. Returns the number of messages, 0 at the end of the
+// stream, or -1 with errno set to EAGAIN if no message is complete yet or
+// EBADMSG if the stream is not framed.
+CT_API int ct_recv_messages(ct_conn *conn, uint16_t stream_id, ct_message *msgs, int max);
+
+// Latest-value state such as presence or typing indicators, outside the
+// data stream. Setting a key replaces a value of it the peer has not
+// acknowledged yet, and a lost value is not retransmitted: the key's
+// latest value goes out in its place. Values hold up to CT_MAX_STATE
+// bytes, those set during the handshake go out once it completes. Returns
+// 0, or -1 with errno set to ENOTCONN before ct_connect(), EPIPE after
+// ct_close(), EMSGSIZE if the value is too large or ENOSPC if
+// CT_MAX_STATE_KEYS keys are all waiting for acknowledgments.
+#define CT_MAX_STATE 44
+#define CT_MAX_STATE_KEYS 32
+CT_API int ct_send_state(ct_conn *conn, uint16_t key, const void *data, size_t len);
+
+// Copy the latest value of a key that changed since it was last read.
+// Only the newest of several updates arriving meanwhile is seen. Returns
+// the value's length, or -1 with errno set to EAGAIN if no key changed or
+// EINVAL if buffer is too small.
+CT_API ssize_t ct_recv_state(ct_conn *conn, uint16_t *key, void *buffer, size_t len);
+
+// Close our direction once queued data has been delivered. Keep running
+// ct_process() until the state reaches CT_CLOSED or CT_TIME_WAIT.
+CT_API void ct_close(ct_conn *conn);
+
+// Release the endpoint and its socket
+CT_API void ct_free(ct_conn *conn);
+
+// Handle incoming packets and expired timers, send what can be sent and
+// run the callbacks. Returns -1 once the connection has failed.
+CT_API int ct_process(ct_conn *conn);
+
+// Descriptor to poll for readability
+CT_API int ct_fd(ct_conn *conn);
+
+// Milliseconds until ct_process() must run even without incoming
+// packets, -1 if it only needs to run when ct_fd() is readable
+CT_API int ct_timeout(ct_conn *conn);
+
+// Current state, and the errno value the connection failed with (0 if none)
+CT_API ct_state ct_get_state(ct_conn *conn);
+CT_API int ct_get_error(ct_conn *conn);
+
+// Set the readiness callbacks. Both are level-triggered, they run at the
+// end of every ct_process() while their condition holds. On a listening
+// endpoint on_readable runs while connections are waiting for ct_accept().
+CT_API void ct_set_callbacks(ct_conn *conn, ct_callback on_readable, ct_callback on_writable,
+                             ct_callback on_state_change, void *arg);
+
+// Name of a connection state for logging
+CT_API const char *ct_state_name(ct_state state);
+
+#endif
@@ -4,6 +4,7 @@
 #include <netinet/in.h>
 #include <time.h>
 #include "flow_control.h"
+#include "framing.h"
 
 typedef struct
 {
@@ -11,6 +12,7 @@ typedef struct
   time_t last_heartbeat;
   uint32_t current_seq_num;
   flow_control_state *fc_state; // Flow control state for this client
+  frame_decoder *decoder;       // Splits the client's data into messages
 } client_info;
 
 // Initialize client table
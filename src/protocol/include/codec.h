@@ -0,0 +1,31 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fast LZ77 block codec in the LZ4 mould: sequences of a token byte
+// holding literal and match lengths, the literals, and a 2-byte offset to
+// a match of at least 4 bytes. Both ends start from a shared dictionary
+// of common chat text, so even a short message finds matches. A changed
+// dictionary gets a new version, which the handshake negotiates.
+#define CODEC_DICT_VERSION 1
+#define CODEC_MAX_INPUT 8192     // Largest block, a whole message
+#define CODEC_MIN_MATCH 4
+
+// Worst-case compressed size of len bytes
+#define CODEC_BOUND(len) ((len) + (len) / 255 + 16)
+
+// Compress len bytes of src into dst. Returns the compressed size, or 0 if
+// src is larger than CODEC_MAX_INPUT or the result does not fit in cap.
+size_t codec_compress(const char *src, size_t len, char *dst, size_t cap);
+
+// Decompress a block that must come to exactly dst_len bytes. Returns
+// dst_len, or -1 if the block is malformed.
+int codec_decompress(const char *src, size_t len, char *dst, size_t dst_len);
+
+// Whether data starts like an already compressed format (gzip, zip, PNG,
+// JPEG, ...), which a second pass cannot shrink
+int codec_precompressed(const char *data, size_t len);
+
+#endif
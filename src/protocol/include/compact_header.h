@@ -0,0 +1,85 @@
+#ifndef COMPACT_HEADER_H
+#define COMPACT_HEADER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "packet.h"
+
+// Compact wire format for the packets of one connection. A full packet is
+// sizeof(packet) bytes whatever it carries, which for a one-line chat
+// message is mostly header. Here the ports are implied by the connection,
+// seq, ack and timestamps are zigzag varint deltas from a reference, the
+// window only travels when it differs from the reference's, and the
+// payload is only as long as it is.
+//
+// Each side picks its references. The first packets after picking one
+// carry it in full, tagged with the connection ID and a generation, until
+// the peer echoes that generation back in one of its own packets. Deltas
+// from a reference survive any loss, and a peer that misses a reference,
+// or whose decode fails the checksum, echoes the wrong generation and gets
+// it resent. A new reference is picked once the deltas outgrow
+// COMPACT_MAX_DELTA.
+//
+// Compact datagrams are always shorter than sizeof(packet), so full
+// packets can still be told apart. SYNs always travel in full.
+//
+// Layout: fields, generation << 4 | echo, flags, data_offset << 4 |
+// reserved, checksum (2 bytes), the reference if COMPACT_REF (connection
+// ID, seq, ack, ts_val, ts_ecr, all 4 bytes, and window, 2 bytes), the
+// deltas of seq, ack, ts_val and ts_ecr, the optional fields in flag
+// order as varints, then the payload.
+#define COMPACT_REF 0x80      // The reference follows
+#define COMPACT_WINDOW 0x40   // Window differs from the reference's
+#define COMPACT_DELAY 0x20    // delay_echo is not 0
+#define COMPACT_SACK 0x10     // SACK block, from ack_num
+#define COMPACT_STREAM 0x08   // stream_id and stream_offset are not 0
+#define COMPACT_URGENT 0x04   // urgent_pointer is not 0
+
+#define COMPACT_GENERATIONS 16       // Generation numbers, 0 means none
+#define COMPACT_MAX_DELTA (1 << 20)  // Largest delta before a new reference, 3 varint bytes
+
+// Fields the deltas are taken from
+typedef struct
+{
+  uint32_t seq_num;
+  uint32_t ack_num;
+  uint32_t ts_val;
+  uint32_t ts_ecr;
+  uint16_t window_size;
+} compact_ref;
+
+typedef struct
+{
+  int enabled;             // Compact datagrams are decoded
+  int sending;             // and sent
+  uint32_t conn_id;        // Carried with references, others are refused
+  uint16_t local_port;     // Ports the decoder fills in
+  uint16_t remote_port;
+
+  compact_ref tx;          // Our reference
+  uint8_t tx_generation;   // 0 until we picked one
+  uint8_t peer_echo;       // Generation of ours the peer last said it holds
+  compact_ref rx;          // The peer's reference
+  uint8_t rx_generation;   // 0 until one arrived
+
+  uint64_t packets;        // Sent compact
+  uint64_t full_bytes;     // What they would have cost in full
+  uint64_t wire_bytes;     // What they did cost
+} compact_context;
+
+// Start decoding compact datagrams of connection conn_id. Sending starts
+// with compact_start_sending(), once the peer is known to decode them.
+void compact_init(compact_context *ctx, uint32_t conn_id, uint16_t local_port,
+                  uint16_t remote_port);
+
+void compact_start_sending(compact_context *ctx);
+
+// Encode pkt, whose checksum is set, into out of sizeof(packet) bytes.
+// Returns the compact size, or 0 if it must go out in full.
+size_t compact_encode(compact_context *ctx, const packet *pkt, uint8_t *out);
+
+// Decode a compact datagram into pkt. Returns 0, or -1 if it is malformed,
+// was encoded from a reference we do not hold or fails the checksum.
+int compact_decode(compact_context *ctx, const uint8_t *in, size_t len, packet *pkt);
+
+#endif
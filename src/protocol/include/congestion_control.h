@@ -2,27 +2,56 @@
 #define CONGESTION_CONTROL_H
 
 #include <stdint.h>
-#include "flow_control.h"
+#include <stddef.h>
+#include "bbr.h"
+#include "ledbat.h"
+
+typedef struct flow_control_state flow_control_state;
 
 // Congestion control states
 #define SLOW_START 0
 #define CONGESTION_AVOIDANCE 1
 #define FAST_RECOVERY 2
 
+// Congestion control algorithms
+#define CC_RENO 0
+#define CC_BBR 1
+#define CC_LEDBAT 2
+
 // Congestion control constants
 #define INITIAL_CWND_MSS 1
 #define SSTHRESH_INITIAL 65535
 #define DUPLICATE_ACK_THRESHOLD 3
 
+// Window-based algorithms are paced at gain * cwnd / SRTT, gains are
+// fixed point values where PACING_GAIN_UNIT == 1.0
+#define PACING_GAIN_UNIT 256
+#define PACING_GAIN_SLOW_START 512          // 2.0, keeps up with the window doubling
+#define PACING_GAIN_CONGESTION_AVOIDANCE 307 // 1.2, leaves headroom for ACK jitter
+
 // Congestion control state structure
 typedef struct
 {
-  uint16_t cwnd;      // Congestion window in bytes
-  uint16_t ssthresh;  // Slow start threshold
-  int state;          // Current state (SLOW_START, CONGESTION_AVOIDANCE, FAST_RECOVERY)
-  uint32_t last_ack;  // Last acknowledged sequence number
-  int duplicate_acks; // Count of duplicate ACKs
-  uint16_t mss;       // Maximum segment size
+  uint16_t cwnd;        // Congestion window in bytes
+  uint16_t ssthresh;    // Slow start threshold
+  int state;            // Current state (SLOW_START, CONGESTION_AVOIDANCE, FAST_RECOVERY)
+  uint32_t last_ack;    // Last acknowledged sequence number
+  int duplicate_acks;   // Count of duplicate ACKs
+  uint16_t mss;         // Maximum segment size
+  int algorithm;        // Active algorithm (CC_RENO, CC_BBR, CC_LEDBAT)
+  uint64_t pacing_rate; // Pacing rate in bytes/sec, 0 when sends are not paced
+  bbr_state bbr;        // Path model used when algorithm is CC_BBR
+
+  // Proportional Rate Reduction (RFC 6937) during FAST_RECOVERY
+  uint32_t recovery_point; // Recovery ends once this sequence number is acknowledged
+  uint32_t recover_fs;     // Flight size when recovery started
+  uint32_t prr_delivered;  // Bytes delivered to the receiver since recovery started
+  uint32_t prr_out;        // Bytes sent since recovery started
+
+  // ECN response, at most once per window of data
+  int ecn_reacted;             // An ECN echo has reduced cwnd
+  uint32_t ecn_recovery_point; // Further echoes are ignored until this is acknowledged
+  ledbat_state ledbat;  // Delay state used when algorithm is CC_LEDBAT
 } congestion_control_state;
 
 // Initialize congestion control state
@@ -37,6 +66,39 @@ void update_congestion_window(congestion_control_state *cc_state,
 // Handle packet loss (timeout)
 void handle_timeout(congestion_control_state *cc_state);
 
+// Handle packet loss detected before the timeout, once per recovery episode
+void handle_loss(congestion_control_state *cc_state, flow_control_state *fc_state);
+
+// React to an ECN echo without waiting for a loss. Returns 1 if the sender
+// reduced cwnd and must signal ECN_CWR, 0 if the echo was ignored.
+int handle_ecn_echo(congestion_control_state *cc_state, flow_control_state *fc_state);
+
+// Set cwnd during recovery from the bytes an ACK reported delivered and
+// the bytes still in the network, see Proportional Rate Reduction
+void prr_on_ack(congestion_control_state *cc_state, uint32_t delivered, uint32_t pipe);
+
+// Account for bytes sent during recovery
+void prr_on_send(congestion_control_state *cc_state, uint32_t len);
+
+// Select the congestion control algorithm for a connection
+void set_congestion_algorithm(congestion_control_state *cc_state, int algorithm);
+
+// Start from the window a previous connection on the same path reached
+// instead of the initial window
+void resume_congestion_control(congestion_control_state *cc_state, uint16_t cwnd,
+                               uint32_t srtt_us);
+
+// Feed a delivery rate sample to the active algorithm
+void on_rate_sample(congestion_control_state *cc_state,
+                    flow_control_state *fc_state,
+                    const rate_sample *rs);
+
+// Recompute the pacing rate of window-based algorithms from cwnd and SRTT
+void update_pacing_rate(congestion_control_state *cc_state, uint32_t srtt_us);
+
+// Get current pacing rate in bytes/sec, 0 if sends are not paced
+uint64_t get_pacing_rate(congestion_control_state *cc_state);
+
 // Get current congestion window size
 uint16_t get_congestion_window(congestion_control_state *cc_state);
 
@@ -0,0 +1,78 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include "chattcp.h"
+#include "flow_control.h"
+#include "framing.h"
+#include "resumption.h"
+#include "state_channel.h"
+
+// Connection constants
+#define CT_CONTROL_TIMEOUT_US 1000000 // First SYN/FIN retransmission timeout, doubles per retry
+#define CT_MAX_CONTROL_RETRIES 5
+#define CT_TIME_WAIT_US 1000000       // Time to answer a retransmitted FIN before closing
+#define CT_BACKLOG 16                 // SYNs a listener holds for ct_accept()
+
+// A SYN waiting for ct_accept()
+typedef struct
+{
+  struct sockaddr_in addr; // Where the SYN came from
+  uint32_t seq;            // The peer's initial sequence number
+  uint16_t port;           // Source port from the header
+  int has_token;           // The SYN presented a resumption token
+  uint8_t token[RESUME_TOKEN_SIZE];
+  packet early[RESUME_EARLY_SEGMENTS]; // Data that followed a SYN with a token
+  int early_count;
+  uint16_t features;       // FEATURE_ bits the SYN offered
+  uint32_t dict_version;   // Compression dictionary it offered
+} ct_pending;
+
+// Non-blocking connection. All work happens in ct_process(), which the
+// caller runs whenever ct_fd() is readable or ct_timeout() has passed.
+struct ct_conn
+{
+  ct_state state;
+  flow_control_state fc;        // Data transfer, owns the socket
+  uint32_t iss;                 // Our initial sequence number
+  uint32_t irs;                 // The peer's initial sequence number
+  uint32_t fin_seq;             // Sequence number of our FIN
+  int close_requested;          // ct_close() was called
+  int fin_sent;                 // Our FIN is out
+  int fin_acked;                // The peer acknowledged our FIN
+  int fin_received;             // The peer closed its direction
+  uint64_t control_timeout_us;  // SYN/FIN retransmission or TIME_WAIT expiry, 0 if not armed
+  int control_retries;          // Retransmissions of the current SYN/FIN
+  int error;                    // errno value the connection failed with, 0 if none
+
+  ct_pending backlog[CT_BACKLOG]; // Listener only, SYNs not yet accepted
+  int backlog_count;
+  ct_pending accepted[CT_BACKLOG]; // Listener only, recently accepted, to ignore their retransmitted SYNs
+  int accepted_next;
+
+  resume_issuer resume;         // Listener only, issues and redeems tokens
+  uint8_t token_key[RESUME_KEY_SIZE]; // Accepted connections, key to issue tokens with
+  int issues_tokens;            // Accepted connection of a listener
+  int resumed;                  // Started from a valid token, data flows before the handshake completes
+  int resuming;                 // Client, our SYN carries resume_token and data may follow it
+  uint8_t resume_token[RESUME_TOKEN_SIZE];
+  int has_token;                // Client, the server issued token
+  uint8_t token[RESUME_TOKEN_SIZE];
+  int compress_offered;         // ct_set_compression() enabled it, accepted connections inherit it
+  int compress;                 // Both sides agreed, messages go out compressed
+  int compact_offered;          // ct_set_compact_headers() enabled it, accepted connections inherit it
+  int fec_offered;              // ct_set_fec() enabled it, accepted connections inherit it
+
+  frame_decoder *decoders[MAX_STREAMS]; // Message reassembly, allocated on first ct_recv_messages()
+  state_channel states;         // Latest-value keys, both ways
+
+  ct_callback on_readable;      // Data or end of stream can be read
+  ct_callback on_writable;      // The send buffer has room
+  ct_callback on_state_change;  // state changed
+  void *callback_arg;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef DRR_H
+#define DRR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Deficit round robin constants
+#define DRR_QUANTUM 1024 // Bytes of credit a flow of weight 1 gets per turn
+
+// Priority classes. Classes take turns like flows do, a class's weight
+// sets how much it sends per turn, so a busy class delays another by at
+// most one of its turns and never starves it.
+typedef enum
+{
+  DRR_CONTROL,     // Small and urgent, e.g. replies to commands
+  DRR_INTERACTIVE, // Messages someone is waiting to read
+  DRR_BULK,        // History and other transfers that may take a while
+  DRR_CLASSES
+} drr_class;
+
+#define DRR_CONTROL_WEIGHT 8
+#define DRR_INTERACTIVE_WEIGHT 4
+#define DRR_BULK_WEIGHT 1
+
+// One sender's place in the scheduler, embedded in whatever owns the
+// send queue. A flow is active while it sits in its class's list.
+typedef struct drr_flow
+{
+  struct drr_flow *prev;
+  struct drr_flow *next;
+  int64_t deficit;           // Bytes it may still send this turn, negative once overdrawn
+  uint32_t quantum;          // Credit added per turn, its weight times DRR_QUANTUM
+  uint8_t cls;               // drr_class
+  uint8_t active;
+} drr_flow;
+
+// Active flows of one class, in turn order
+typedef struct
+{
+  drr_flow *head;
+  drr_flow *tail;
+  uint32_t count;
+  int64_t deficit;           // Bytes the class may still send this turn
+  uint32_t quantum;          // Credit added per turn
+  uint64_t bytes;            // Sent so far
+  uint64_t sends;
+} drr_queue;
+
+// Deficit round robin over flows in priority classes. Picking the next
+// flow to send, charging what it sent and activating or removing a flow
+// are all O(1), however many flows are active.
+typedef struct
+{
+  drr_queue classes[DRR_CLASSES];
+  int current;               // Class whose turn it is
+  uint32_t active;           // Active flows in all classes
+  uint64_t decisions;        // Flows picked so far
+} drr_sched;
+
+// Initialize a scheduler with no active flows and the default class weights
+void drr_init(drr_sched *sched);
+
+// Set a class's weight, the multiple of DRR_QUANTUM it sends per turn
+void drr_set_class_weight(drr_sched *sched, int cls, uint32_t weight);
+
+// Initialize an inactive flow of class cls and weight, at least 1
+void drr_flow_init(drr_flow *flow, int cls, uint32_t weight);
+
+// Queue a flow that has something to send behind the active flows of its
+// class. Does nothing if it is active already.
+void drr_activate(drr_sched *sched, drr_flow *flow);
+
+// Take a flow out of the scheduler, because it has nothing left to send
+// or cannot send now. Unused credit is forfeited, an overdraft is kept.
+// Does nothing if it is not active.
+void drr_remove(drr_sched *sched, drr_flow *flow);
+
+// Move a flow to another class. An active flow queues behind that class's
+// flows.
+void drr_set_class(drr_sched *sched, drr_flow *flow, int cls);
+
+// The flow that sends next, NULL if none is active. It stays active, the
+// caller sends and charges it, or removes it.
+drr_flow *drr_next(drr_sched *sched);
+
+// Charge a flow len bytes it sent
+void drr_charge(drr_sched *sched, drr_flow *flow, size_t len);
+
+#endif
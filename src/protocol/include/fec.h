@@ -0,0 +1,126 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "packet.h"
+
+// Forward error correction for the data stream. The sender codes runs of
+// consecutive new segments into blocks and follows each block with parity
+// segments, from which the receiver rebuilds lost segments without waiting
+// for a retransmission. A symbol is a segment's payload, zero padded,
+// followed by its length and stream option. Parity segment j of a block
+// is the sum over its data segments i of 2^(i*j) times their symbols in
+// GF(2^8): the first is their XOR, and any e of them recover e lost
+// segments as a systematic Reed-Solomon code.
+//
+// How many parity segments follow how many data segments depends on the
+// loss rate: none at low loss, one XOR segment over small groups as it
+// rises, and Reed-Solomon over larger blocks beyond that. A block is also
+// closed early when the sender runs out of data, so that the last
+// segments of a message are covered without waiting for more.
+//
+// A parity segment has FEC_PARITY in its reserved bits, the block's first
+// sequence number in seq_num and its length in stream_offset, data count
+// << 8 | parity count << 4 | its index in stream_id, and the parity of the
+// payloads in its payload. The parity of the lengths and stream options
+// is in sack_left and sack_right. Its ack_num is an ordinary one.
+#define FEC_SYMBOL_SIZE (MAX_PAYLOAD_SIZE + 7)
+#define FEC_META_SIZE 7        // Length, stream_id and stream_offset
+#define FEC_MAX_DATA 16        // Data segments in a block
+#define FEC_MAX_PARITY 4       // Parity segments of a block
+#define FEC_HISTORY 64         // Received segments kept to rebuild others from
+#define FEC_MAX_BLOCKS 8       // Blocks the receiver holds parity for
+#define FEC_LOSS_SHIFT 7       // Loss rate averages over about 2^7 segments
+#define FEC_LOSS_ONE 65536     // Loss rate of 1
+
+// Sending side
+typedef struct
+{
+  uint32_t loss_rate;          // Lost fraction of segments, of FEC_LOSS_ONE
+  uint16_t peer_recovered;     // Segments the peer reported rebuilding
+  int data_count;              // Shape of the current block, 0 if none is open
+  int parity_count;
+  int count;                   // Data segments in it so far
+  uint32_t first_seq;
+  uint32_t end_seq;
+  uint8_t parity[FEC_MAX_PARITY][FEC_SYMBOL_SIZE];
+  uint64_t blocks;             // Blocks closed
+  uint64_t parity_sent;        // Parity segments sent
+} fec_encoder;
+
+// A segment the receiver got, kept to rebuild others
+typedef struct
+{
+  int used;
+  uint32_t seq_num;
+  uint16_t len;
+  uint8_t symbol[FEC_SYMBOL_SIZE];
+} fec_held;
+
+// Parity received for a block
+typedef struct
+{
+  int used;
+  uint32_t first_seq;
+  uint32_t end_seq;
+  int data_count;
+  int parity_count;
+  uint8_t have;                // Bit j set if parity segment j arrived
+  uint8_t parity[FEC_MAX_PARITY][FEC_SYMBOL_SIZE];
+} fec_block;
+
+// Receiving side
+typedef struct
+{
+  fec_held history[FEC_HISTORY];
+  int history_next;
+  fec_block blocks[FEC_MAX_BLOCKS];
+  int blocks_next;
+  uint16_t recovered;          // Segments rebuilt, reported to the sender
+} fec_decoder;
+
+void fec_encoder_init(fec_encoder *enc);
+
+// Account for a new segment sent, or lost segments: detected by the
+// sender, or rebuilt by the receiver, which would otherwise go unseen
+void fec_on_sent(fec_encoder *enc);
+void fec_on_lost(fec_encoder *enc, int count);
+
+// The peer reports rebuilding recovered segments in all. Counts the new
+// ones as lost.
+void fec_on_recovered(fec_encoder *enc, uint16_t recovered);
+
+// Code a new data segment into the open block, opening one at the current
+// loss rate if needed. Returns 1 if the block is full and its parity due,
+// 0 if not, or if the loss rate needs no parity.
+int fec_encoder_add(fec_encoder *enc, const packet *pkt);
+
+// Number of parity segments of the open block, 0 if none is open, and no
+// more than it has data segments. Fill them in with fec_encoder_parity()
+// and close the block.
+int fec_encoder_pending(const fec_encoder *enc);
+void fec_encoder_parity(const fec_encoder *enc, int index, packet *pkt);
+void fec_encoder_close(fec_encoder *enc);
+
+void fec_decoder_init(fec_decoder *dec);
+
+// Keep a received data segment
+void fec_decoder_add_data(fec_decoder *dec, const packet *pkt, size_t len);
+
+// Keep a parity segment. Returns the index of its block, -1 if it is
+// malformed.
+int fec_decoder_add_parity(fec_decoder *dec, const packet *pkt);
+
+// The block holding seq_num, -1 if none
+int fec_decoder_find(const fec_decoder *dec, uint32_t seq_num);
+
+// Rebuild what a block is missing into out, which holds FEC_MAX_PARITY
+// packets. Returns the number rebuilt and forgets the block, or 0 if it
+// cannot be rebuilt yet, or -1 if it never will.
+int fec_decoder_recover(fec_decoder *dec, int block, packet *out);
+
+// Forget a block
+void fec_decoder_drop(fec_decoder *dec, int block);
+
+#endif
@@ -5,6 +5,14 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include "packet.h"
+#include "compact_header.h"
+#include "congestion_control.h"
+#include "fec.h"
+#include "pacer.h"
+#include "rack.h"
+#include "recv_buffer.h"
+#include "send_buffer.h"
+#include "stream.h"
 
 // Flow control constants
 #define INITIAL_WINDOW_SIZE 1024
@@ -13,9 +21,57 @@
 #define MAX_RETRANSMISSIONS 5
 #define FLOW_CONTROL_TIMEOUT_SEC 2
 #define FLOW_CONTROL_TIMEOUT_USEC 0
+#define MAX_INFLIGHT_SEGMENTS 256
+#define MAX_REASSEMBLY_SEGMENTS 64
 
-// Flow control state structure
+// Persist timer for a closed peer window: the first probe goes out after
+// one RTO, no sooner than PERSIST_MIN_US, and the interval doubles for each
+// probe that finds the window still closed
+#define PERSIST_MIN_US 200000
+#define PERSIST_MAX_US 60000000
+
+// Receive windows of all connections together may not exceed this by
+// default. Above three quarters of it, windows shrink to what their
+// application actually drains.
+#define RCV_MEMORY_LIMIT (4 * 1024 * 1024)
+
+// Timestamps tick in microseconds and wrap after about 71 minutes. PAWS
+// stops trusting ts_recent well before half of that has passed.
+#define PAWS_IDLE_LIMIT_US 1800000000ULL
+
+// Sequence number comparison that tolerates wrap-around
+#define SEQ_LT(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+// Transmitted segment awaiting acknowledgement
 typedef struct {
+  uint32_t seq_num;            // First sequence number of the segment
+  uint16_t len;                // Payload length
+  int retransmitted;           // Segment has been sent more than once
+  int sacked;                  // Selectively acknowledged by the receiver
+  int lost;                    // Marked lost and awaiting retransmission
+  int is_app_limited;          // Sent while the sender had no more data queued
+  uint64_t sent_time_us;       // Time of the last transmission
+  uint64_t delivered;          // Connection delivered count when sent
+  uint64_t delivered_time_us;  // Connection delivered time when sent
+  uint64_t first_sent_time_us; // Send time of the first segment of the flight
+} segment_info;
+
+// Segment received ahead of a gap, held until the gap is filled and it
+// moves to the receive buffer. Stream data may be read before that, the
+// segment then stays behind without its data to mark the sequence numbers
+// as received.
+typedef struct {
+  uint32_t seq_num;            // First sequence number of the segment
+  uint16_t len;                // Payload length
+  uint16_t consumed;           // Bytes already read by the application
+  int has_stream;              // Carried the stream option
+  uint16_t stream_id;          // Stream the payload belongs to, 0 without the option
+  uint32_t stream_offset;      // Offset of the first payload byte in the stream
+  char data[MAX_PAYLOAD_SIZE]; // Payload
+} reassembly_segment;
+
+// Flow control state structure
+typedef struct flow_control_state {
   uint32_t base_seq_num;        // Base sequence number for this connection
   uint32_t next_seq_num;        // Next sequence number to be sent
   uint32_t last_ack_received;   // Last ACK number received
@@ -26,6 +82,81 @@ typedef struct {
   socklen_t addr_len;           // Length of address structure
   uint16_t local_port;          // Local port number
   uint16_t remote_port;         // Remote port number
+  congestion_control_state cc;  // Congestion control state for this connection
+
+  // Data queued by the application. The sender works through it in the
+  // background of later calls, see process_flow_control().
+  send_buffer sndbuf;
+  stream_map streams;           // Which stream each queued byte belongs to
+  uint32_t highest_sent;        // Highest sequence number transmitted so far
+  int retransmissions;          // Consecutive retransmission timeouts
+  int tlp_due;                  // The tail loss probe timer fired, probe on the next send
+  uint64_t pacing_wake_us;      // When the pacer releases the next segment, 0 if not waiting
+
+  // Sender scoreboard, oldest unacknowledged segment first
+  segment_info segments[MAX_INFLIGHT_SEGMENTS];
+  int segment_head;             // Index of the oldest unacknowledged segment
+  int segment_count;            // Number of unacknowledged segments
+  uint32_t sacked_bytes;        // Bytes in the scoreboard that were selectively acknowledged
+  uint32_t lost_bytes;          // Bytes in the scoreboard marked lost and not yet resent
+
+  // Delivery rate sampling
+  uint64_t delivered;           // Total bytes acknowledged by the peer
+  uint64_t delivered_time_us;   // When delivered last changed
+  uint64_t first_sent_time_us;  // Send time of the segment that started the flight
+  uint64_t app_limited;         // Samples are app-limited until delivered passes this, 0 if not
+
+  // RTT estimation and pacing
+  uint32_t srtt_us;             // Smoothed RTT, 0 until the first sample
+  uint32_t rttvar_us;           // RTT variation
+  pacer_state pacer;            // Spreads transmissions over the RTT
+
+  // Loss detection (RACK-TLP)
+  rack_state rack;
+  uint64_t reo_timeout_us;      // When the reordering timer fires, 0 if not armed
+  uint64_t tlp_timeout_us;      // When the tail loss probe fires, 0 if not armed
+  int tlp_in_flight;            // A probe is outstanding
+  int tlp_retransmitted;        // The outstanding probe resent data
+  uint32_t tlp_end_seq;         // Data up to here must be acked to end the probe
+
+  // Zero window probing
+  uint64_t persist_timeout_us;  // When the next window probe is due, 0 if not armed
+  int persist_backoff;          // Probes sent without the window opening
+
+  // Timestamps (RFC 7323)
+  uint32_t ts_recent;           // Peer timestamp echoed in ts_ecr
+  uint64_t ts_recent_time_us;   // When ts_recent was taken, 0 if never
+
+  // Receiver
+  uint32_t rcv_nxt;             // Next sequence number expected, 0 until the first segment
+  int rcv_queued;               // In-order data is held for flow_control_read() too
+  recv_buffer rcvbuf;           // Data acknowledged in order and not yet read
+  uint32_t rcv_stream_offset[MAX_STREAMS]; // Next offset the application reads on each stream
+
+  // Receive window autotuning
+  uint16_t rcv_window;          // Receive buffer size, held data is advertised out of it
+  uint16_t rcv_wnd_advertised;  // Window carried by the last ACK sent
+  uint32_t rcv_copied;          // Bytes handed to the application in this measurement
+  uint64_t rcv_measure_start_us;// Start of the current measurement, 0 if not started
+  uint32_t rcv_rtt_us;          // Receiver-side RTT from echoed timestamps, 0 if unknown
+
+  // Explicit Congestion Notification (RFC 3168)
+  int ecn_enabled;              // Datagrams are sent ECT(0) and CE marks are read
+  int ece_pending;              // Receiver: echo ECN_ECE until the sender signals ECN_CWR
+  int cwr_pending;              // Sender: flag ECN_CWR on the next data segment
+
+  // Compact headers, when the connection negotiated them
+  compact_context compact;
+
+  // Forward error correction, when the connection negotiated it. Rebuilt
+  // segments are only taken in with rcv_queued set.
+  int fec_enabled;
+  fec_encoder fec_tx;           // Parity for the segments we send
+  fec_decoder fec_rx;           // Rebuilds segments of the peer's that went missing
+
+  // Receive reassembly of segments beyond a gap, ordered by sequence number
+  reassembly_segment reassembly[MAX_REASSEMBLY_SEGMENTS];
+  int reassembly_count;
 } flow_control_state;
 
 // Initialize flow control state
@@ -33,15 +164,97 @@ void init_flow_control(flow_control_state *state, int socket_fd,
                        struct sockaddr_in *peer_addr,
                        uint16_t local_port, uint16_t remote_port);
 
-// Send data with flow control
+// Queue data for sending and transmit what the windows allow. Returns once
+// all of it is queued, which only waits for ACKs while the send buffer is
+// full. Returns data_len, or -1 if the connection failed.
 int send_data_with_flow_control(flow_control_state *state,
                                 const char *data, size_t data_len);
 
+// Transmit queued data as the windows allow, then wait up to max_wait_us
+// for an ACK or a sender timer and handle it. Returns -1 if the
+// connection failed.
+int process_flow_control(flow_control_state *state, uint64_t max_wait_us);
+
+// Wait until all queued data has been acknowledged. Returns -1 if the
+// connection failed.
+int flush_flow_control(flow_control_state *state);
+
+// Non-blocking building blocks of the calls above, for callers that
+// multiplex connections with their own event loop
+
+// Queue as much of data in the send buffer as fits, returns the bytes queued
+size_t flow_control_queue(flow_control_state *state, const char *data, size_t data_len);
+
+// Queue data on stream_id, see flow_control_queue(). Returns 0 if the
+// stream ID is out of range.
+size_t flow_control_queue_stream(flow_control_state *state, uint16_t stream_id,
+                                 const char *data, size_t data_len);
+
+// Transmit queued data as the windows allow, lost segments and probes first
+int flow_control_transmit(flow_control_state *state);
+
+// Earliest sender timer, 0 if none is armed
+uint64_t flow_control_next_timer(flow_control_state *state);
+
+// Handle the sender timer that has expired by now, if any. Returns -1 once
+// the retransmission limit is reached.
+int flow_control_on_timer(flow_control_state *state, uint64_t now);
+
+// Handle an ACK from the peer
+void flow_control_on_ack(flow_control_state *state, packet *ack_packet);
+
+// Handle a data segment from the peer. In-order data is copied to buffer,
+// or held for flow_control_read() when rcv_queued is set. Returns the
+// payload bytes accepted, or -1 if the ACK could not be sent.
+int flow_control_on_data(flow_control_state *state, packet *received_packet,
+                         int congestion_experienced, char *buffer, size_t buffer_size,
+                         size_t *bytes_received);
+
+// Handle a forward error correction parity segment from the peer. The
+// segments it rebuilds are taken in like flow_control_on_data() and held
+// for flow_control_read(). Returns the payload bytes accepted, or -1 if
+// the ACK could not be sent.
+int flow_control_on_parity(flow_control_state *state, packet *parity_packet);
+
+// Copy acknowledged data held in order into buffer, returns the bytes copied
+int flow_control_read(flow_control_state *state, char *buffer, size_t buffer_size);
+
+// Copy data of stream_id that is in order within its stream into buffer,
+// even if other streams still wait for a retransmission. Returns the
+// bytes copied.
+int flow_control_read_stream(flow_control_state *state, uint16_t stream_id,
+                             char *buffer, size_t buffer_size);
+
+// A stream with data to read, -1 if none
+int flow_control_next_stream(flow_control_state *state);
+
+// Bytes acknowledged in order and held for flow_control_read()
+uint32_t flow_control_readable(flow_control_state *state);
+
+// Receive a datagram from the peer, reporting whether it carried a
+// Congestion Experienced mark. With compact headers, datagrams that do not
+// decode are dropped and the next one is read, so the socket must be
+// non-blocking.
+int receive_flow_control_packet(flow_control_state *state, packet *pkt,
+                                int *congestion_experienced);
+
+// Send a packet whose checksum is set, in compact form if negotiated
+ssize_t flow_control_send_packet(flow_control_state *state, packet *pkt);
+
 // Receive data with flow control
 int receive_data_with_flow_control(flow_control_state *state,
                                    char *buffer, size_t buffer_size,
                                    size_t *bytes_received);
 
+// Return the receive window of a connection to the global memory budget
+void release_flow_control(flow_control_state *state);
+
+// Set the budget for the receive windows of all connections together
+void set_receive_memory_limit(uint32_t limit);
+
+// Receive window bytes committed by all connections
+uint32_t get_receive_memory(void);
+
 // Update flow control state based on received ACK
 void update_flow_control(flow_control_state *state, packet *ack_packet);
 
@@ -51,4 +264,7 @@ uint16_t get_available_window(flow_control_state *state);
 // Adjust window size based on network conditions
 void adjust_window_size(flow_control_state *state, int ack_received);
 
+// Monotonic clock in microseconds
+uint64_t get_time_us(void);
+
 #endif
\ No newline at end of file
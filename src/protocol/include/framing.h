@@ -0,0 +1,61 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Messages travel as a 4-byte length in network byte order followed by
+// the message bytes, so boundaries survive segmentation. A compressed
+// message has the top bit of its length set, and its body starts with the
+// original length in 2 bytes.
+#define FRAME_HEADER_SIZE 4
+#define FRAME_MAX_MESSAGE 8192
+#define FRAME_COMPRESSED 0x80000000u
+#define FRAME_COMPRESSED_HEADER_SIZE (FRAME_HEADER_SIZE + 2)
+#define FRAME_COMPRESS_MIN 24          // Shorter messages are not worth compressing
+
+// Room for one message of the largest size plus the partial one after it
+#define FRAME_BUFFER_SIZE (2 * (FRAME_HEADER_SIZE + FRAME_MAX_MESSAGE))
+
+// Splits a received byte stream back into messages. The stream is read
+// straight into the decoder's buffer, and complete messages are handed out
+// as pointers into it. Compressed messages are expanded into a second
+// buffer and handed out from there.
+typedef struct
+{
+  uint32_t start;               // First byte not yet handed out
+  uint32_t end;                 // One past the last byte received
+  uint32_t expanded;            // Bytes of expanded_data handed out since the last frame_decoder_space()
+  char data[FRAME_BUFFER_SIZE];
+  char expanded_data[FRAME_BUFFER_SIZE];
+} frame_decoder;
+
+// Write the header for a message of len bytes, returns FRAME_HEADER_SIZE
+size_t frame_encode_header(uint32_t len, char *out);
+
+// Write a whole compressed frame for a message, header included, to out.
+// Returns its size, or 0 if the message is too short, already compressed
+// or does not shrink, and should be sent as it is.
+size_t frame_encode_compressed(const char *msg, uint32_t len, char *out, size_t cap);
+
+// Initialize an empty decoder
+void frame_decoder_init(frame_decoder *dec);
+
+// Where to receive the next bytes, and how many fit. Moves a partial
+// message to the front of the buffer, which ends the lifetime of the
+// messages handed out so far.
+char *frame_decoder_space(frame_decoder *dec, size_t *space);
+
+// Account for len bytes received into the space
+void frame_decoder_commit(frame_decoder *dec, size_t len);
+
+// Take the next complete message. Returns 1 and points msg into the
+// buffer, 0 if the next message is still partial, or -1 if the stream
+// announced a message larger than FRAME_MAX_MESSAGE or a compressed one
+// that does not expand.
+int frame_decoder_next(frame_decoder *dec, const char **msg, uint32_t *len);
+
+// Bytes received and not handed out, a partial message included
+uint32_t frame_decoder_pending(frame_decoder *dec);
+
+#endif
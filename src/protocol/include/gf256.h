@@ -0,0 +1,23 @@
+#ifndef GF256_H
+#define GF256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Arithmetic in GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1
+// (0x11d), whose generator is 2. Addition is XOR.
+
+// Product of a and b
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+
+// Inverse of a, which must not be 0
+uint8_t gf256_inv(uint8_t a);
+
+// 2 to the power n
+uint8_t gf256_exp(unsigned n);
+
+// dst[i] ^= c * src[i] for len bytes. Uses SSSE3 where the CPU has it,
+// multiplying 16 bytes at a time by table lookups on each nibble.
+void gf256_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+#endif
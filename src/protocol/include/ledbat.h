@@ -0,0 +1,46 @@
+#ifndef LEDBAT_H
+#define LEDBAT_H
+
+#include <stdint.h>
+
+// LEDBAT constants (RFC 6817)
+#define LEDBAT_TARGET_US 25000                // Queueing delay target, well under the 100 ms ceiling
+#define LEDBAT_GAIN 1                         // cwnd gain per RTT at full off-target
+#define LEDBAT_BASE_HISTORY 10                // Base delay minima kept, one per interval
+#define LEDBAT_BASE_INTERVAL_US 60000000      // Base delay bucket length (1 minute)
+#define LEDBAT_CURRENT_FILTER 4               // Samples in the current delay min filter
+#define LEDBAT_ALLOWED_INCREASE 1             // cwnd may exceed flight size by this many MSS
+#define LEDBAT_INIT_CWND 2                    // Initial cwnd in MSS
+#define LEDBAT_MIN_CWND 2                     // Minimum cwnd in MSS
+#define LEDBAT_MAX_CWND 65535
+
+// LEDBAT state structure
+typedef struct
+{
+  uint16_t mss;                                  // Maximum segment size
+  uint32_t cwnd;                                 // Congestion window in bytes
+  uint32_t target_us;                            // Queueing delay target
+  uint32_t base_history[LEDBAT_BASE_HISTORY];    // Per-interval minimum one-way delay
+  int base_index;                                // Bucket for the current interval
+  int base_count;                                // Buckets in use
+  uint64_t base_interval_start_us;               // When the current bucket was opened
+  uint32_t current_samples[LEDBAT_CURRENT_FILTER]; // Most recent one-way delays
+  int current_index;                             // Next slot in current_samples
+  int current_count;                             // Samples in use
+  uint32_t queuing_delay_us;                     // Last queueing delay estimate
+} ledbat_state;
+
+// Initialize LEDBAT state
+void ledbat_init(ledbat_state *ledbat, uint16_t mss);
+
+// Update cwnd from a one-way delay sample carried by an ACK
+void ledbat_on_ack(ledbat_state *ledbat, uint64_t now_us, uint32_t delay_us,
+                   uint32_t acked, uint32_t flight_size);
+
+// Halve cwnd on packet loss
+void ledbat_on_loss(ledbat_state *ledbat);
+
+// Collapse cwnd on a retransmission timeout
+void ledbat_on_timeout(ledbat_state *ledbat);
+
+#endif
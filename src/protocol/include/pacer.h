@@ -0,0 +1,41 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Pacer constants
+#define PACER_BURST_SEGMENTS 2        // Bucket depth, segments that may leave back-to-back
+#define PACER_TXTIME_HORIZON_US 10000 // How far ahead segments are handed to the kernel
+
+// Token bucket pacer state
+typedef struct
+{
+  uint64_t rate;           // Release rate in bytes/sec, 0 disables pacing
+  int64_t tokens;          // Credit in millionths of a byte, negative when scheduled ahead
+  uint32_t burst;          // Bucket depth in bytes
+  uint64_t last_update_us; // Time up to which tokens have been accounted
+  int use_txtime;          // Release times are enforced by the kernel (SO_TXTIME with fq)
+} pacer_state;
+
+// Initialize pacer state with a full bucket
+void pacer_init(pacer_state *pacer, uint16_t mss);
+
+// Set the release rate in bytes/sec
+void pacer_set_rate(pacer_state *pacer, uint64_t rate);
+
+// Earliest time a segment of len bytes may be released
+uint64_t pacer_release_time(pacer_state *pacer, size_t len, uint64_t now_us);
+
+// Charge a segment of len bytes released at release_us
+void pacer_on_send(pacer_state *pacer, size_t len, uint64_t release_us);
+
+// How far before its release time a segment may be handed to the socket
+uint64_t pacer_lookahead(pacer_state *pacer);
+
+// Let the kernel enforce release times via SO_TXTIME. Only worth enabling
+// when the egress interface runs the fq (or etf) qdisc, other qdiscs ignore
+// the release time. Returns 1 if enabled.
+int pacer_enable_txtime(pacer_state *pacer, int socket_fd);
+
+#endif
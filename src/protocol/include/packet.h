@@ -2,6 +2,7 @@
 #define PACKET_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 // TCP Control Flags
 #define URG 0x20
@@ -11,8 +12,43 @@
 #define SYN 0x02
 #define FIN 0x01
 
+// The payload is a resumption token: on a SYN the client presents one, on
+// an unsequenced packet from the server it is issued
+#define TOKEN 0x40
+
+// The payload is the latest value of a state key, outside the data stream.
+// The stream option holds the key in stream_id and the value's version in
+// stream_offset. With ACK and no payload the packet acknowledges a version.
+#define STATE 0x80
+
+// ECN flags, carried in the reserved bits
+#define ECN_ECE 0x1 // ECN-Echo: the receiver saw a Congestion Experienced mark
+#define ECN_CWR 0x2 // Congestion Window Reduced: the sender reacted to ECN_ECE
+
+// Also in the reserved bits: the packet carries forward error correction
+// parity for a block of data segments, see fec.h. On connections that use
+// it, an ACK's urgent_pointer holds how many segments the receiver rebuilt
+// from parity, modulo 65536.
+#define FEC_PARITY 0x4
+
 #define MAX_PAYLOAD_SIZE 44
 
+// Header length in 32-bit words when the timestamp option is present
+#define TIMESTAMP_DATA_OFFSET 8
+
+// Header length in 32-bit words when the SACK option follows the timestamp
+#define SACK_DATA_OFFSET 10
+
+// Header length in 32-bit words when the stream option follows the SACK option
+#define STREAM_DATA_OFFSET 12
+
+// On a SYN or SYN-ACK the stream option offers optional features instead:
+// stream_id holds FEATURE_ bits and stream_offset the version of the
+// compression dictionary. The SYN-ACK echoes the offers the server takes.
+#define FEATURE_COMPRESS 0x1
+#define FEATURE_COMPACT_HEADERS 0x2 // See compact_header.h
+#define FEATURE_FEC 0x4             // See fec.h
+
 typedef struct {
   // Standard TCP Header (20 bytes)
   uint16_t source_port;    // 2 bytes
@@ -20,12 +56,26 @@ typedef struct {
   uint32_t seq_num;        // 4 bytes
   uint32_t ack_num;        // 4 bytes
   uint8_t data_offset : 4; // Header length in 32-bit words
-  uint8_t reserved : 4;    // Reserved for future use
+  uint8_t reserved : 4;    // ECN flags (ECN_ECE, ECN_CWR) and FEC_PARITY
   uint8_t flags;           // Control flags
   uint16_t window_size;    // 2 bytes
   uint16_t checksum;       // 2 bytes
   uint16_t urgent_pointer; // 2 bytes
 
+  // Timestamp option (12 bytes)
+  uint32_t ts_val;         // Sender clock in microseconds when the segment was sent
+  uint32_t ts_ecr;         // Most recent ts_val received from the peer, 0 if none
+  uint32_t delay_echo;     // One-way delay the receiver measured for the acked segment
+
+  // SACK option (8 bytes), a single block of data held beyond a gap
+  uint32_t sack_left;      // First sequence number of the block
+  uint32_t sack_right;     // Sequence number following the block
+
+  // Stream option (8 bytes), where the payload belongs within its stream
+  uint32_t stream_offset;  // Offset of the first payload byte in the stream
+  uint16_t stream_id;      // Stream the payload belongs to
+  uint16_t payload_len;    // Payload bytes, which may include NULs
+
   // Payload (44 bytes)
   char payload[MAX_PAYLOAD_SIZE];
 } packet;
@@ -33,4 +83,8 @@ typedef struct {
 // Calculate TCP checksum
 uint16_t calculate_checksum(packet *pkt);
 
+// Payload length. Without the stream option the payload is NUL-terminated
+// unless it fills the whole payload area.
+size_t packet_payload_len(const packet *pkt);
+
 #endif
\ No newline at end of file
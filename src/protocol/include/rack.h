@@ -0,0 +1,42 @@
+#ifndef RACK_H
+#define RACK_H
+
+#include <stdint.h>
+
+// RACK-TLP constants (RFC 8985)
+#define RACK_DEFAULT_PTO_US 1000000 // Probe timeout before the first RTT sample (1 s)
+#define RACK_MIN_PTO_US 10000       // Floor for the probe timeout (10 ms)
+#define RACK_REO_WND_DIVISOR 4      // Reordering window is min_rtt / 4
+
+// RACK loss detection state
+typedef struct
+{
+  uint64_t xmit_ts_us;  // Send time of the most recently sent delivered segment
+  uint32_t end_seq;     // End sequence number of that segment
+  uint32_t rtt_us;      // RTT measured for that segment
+  uint32_t min_rtt_us;  // Min RTT seen, 0 until the first sample
+  uint32_t fack;        // Highest end sequence number delivered so far
+  uint32_t reo_wnd_us;  // Reordering window
+  int reordering_seen;  // A segment was delivered after a later-sent one
+  int has_delivered;    // xmit_ts_us and end_seq describe a delivered segment
+} rack_state;
+
+// Initialize RACK state
+void rack_init(rack_state *rack);
+
+// Record that a segment was delivered, by a cumulative or a selective ACK
+void rack_on_delivered(rack_state *rack, uint64_t xmit_ts_us, uint32_t end_seq,
+                       int retransmitted, uint64_t now_us);
+
+// Recompute the reordering window. dup_thresh_hit is set while in recovery
+// or once DUPLICATE_ACK_THRESHOLD segments have been selectively acknowledged.
+void rack_update_reo_wnd(rack_state *rack, int dup_thresh_hit, uint32_t srtt_us);
+
+// Time at which an outstanding segment is deemed lost, 0 if it was not sent
+// before the most recently delivered segment and cannot be judged yet
+uint64_t rack_loss_time(rack_state *rack, uint64_t xmit_ts_us, uint32_t end_seq);
+
+// Probe timeout for a tail loss probe
+uint32_t rack_probe_timeout(uint32_t srtt_us);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef RECV_BUFFER_H
+#define RECV_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Receive buffer capacity. A power of two, and larger than any window we
+// can advertise, so everything acknowledged in order always fits.
+#define RECV_BUFFER_SIZE 65536
+
+// Runs of buffered bytes from different streams. Consecutive data of one
+// stream shares a run, so this only runs out when many small segments of
+// different streams interleave.
+#define RECV_BUFFER_CHUNKS 2048
+
+// A run of buffered bytes that belongs to one stream
+typedef struct
+{
+  uint32_t start;         // Position of the first byte
+  uint32_t len;           // Bytes in the run
+  uint32_t consumed;      // Bytes already read by the application
+  uint32_t stream_offset; // Stream offset of the first byte
+  uint16_t stream_id;     // 0 for data without the stream option
+  uint8_t has_stream;     // Carried the stream option
+} recv_chunk;
+
+// Per-connection ring of bytes acknowledged in order and not yet read by
+// the application. Streams are read independently, so bytes of one stream
+// may be read while older bytes of another are still waiting. Space is
+// released once everything before it has been read.
+typedef struct
+{
+  uint32_t head;                          // Position of the oldest byte not yet released
+  uint32_t tail;                          // One past the last buffered byte
+  uint32_t unread;                        // Bytes not yet read
+  recv_chunk chunks[RECV_BUFFER_CHUNKS];  // Oldest first
+  int chunk_head;                         // Index of the oldest chunk
+  int chunk_count;
+  char data[RECV_BUFFER_SIZE];            // Ring storage
+} recv_buffer;
+
+// Initialize an empty buffer
+void recv_buffer_init(recv_buffer *buf);
+
+// Append len bytes of stream_id starting at stream_offset. Returns 0, or
+// -1 without taking any of them if they do not fit.
+int recv_buffer_write(recv_buffer *buf, int has_stream, uint16_t stream_id,
+                      uint32_t stream_offset, const char *data, size_t len);
+
+// Copy up to len bytes of the oldest unread run of stream_id into out and
+// release what is no longer needed. has_stream is set from the run. Returns
+// the bytes copied, 0 if the stream has nothing buffered.
+size_t recv_buffer_read(recv_buffer *buf, uint16_t stream_id, char *out, size_t len,
+                        int *has_stream);
+
+// The stream of the oldest unread byte, -1 if everything was read
+int recv_buffer_next_stream(recv_buffer *buf);
+
+// Bytes taking up space, including those read already but not released
+uint32_t recv_buffer_used(recv_buffer *buf);
+
+// Bytes not yet read
+uint32_t recv_buffer_unread(recv_buffer *buf);
+
+// Runs that can still be started
+int recv_buffer_chunks_free(recv_buffer *buf);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef RESUMPTION_H
+#define RESUMPTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "siphash.h"
+
+// A server hands its clients resumption tokens carrying what it learned
+// about the path. A client presents the token in the SYN of its next
+// connection and sends data right behind it; the server accepts that data
+// before the handshake completes and starts from the saved state instead
+// of probing the path again.
+#define RESUME_TOKEN_SIZE 32
+#define RESUME_KEY_SIZE SIPHASH_KEY_SIZE
+#define RESUME_LIFETIME_US 600000000ULL // Tokens older than 10 minutes are refused
+#define RESUME_REPLAY_SLOTS 64          // Redeemed tokens remembered one by one
+#define RESUME_EARLY_SEGMENTS 4         // Data segments a listener holds behind a resuming SYN
+
+// Path state saved in a token
+typedef struct
+{
+  uint16_t mss;       // Segment size in use
+  uint16_t window;    // Receive window the client advertised
+  uint16_t cwnd;      // Congestion window
+  uint32_t srtt_us;   // Smoothed RTT
+  uint32_t rttvar_us; // RTT variation
+} resume_params;
+
+// A redeemed token
+typedef struct
+{
+  uint64_t mac;
+  uint64_t issued_us;
+} resume_redeemed;
+
+// Issues tokens and redeems each at most once. The latest redeemed
+// tokens are remembered; one that is forgotten raises the floor below
+// which tokens are refused outright, so a token stays unredeemable for
+// all of its lifetime however many others are redeemed after it.
+typedef struct
+{
+  uint8_t key[RESUME_KEY_SIZE];        // MAC key, tokens only verify with the key that issued them
+  resume_redeemed used[RESUME_REPLAY_SLOTS]; // Recently redeemed tokens
+  int used_next;
+  int used_count;
+  uint64_t floor_us;                   // Tokens issued at or before it are refused
+} resume_issuer;
+
+// Initialize an issuer with a random key
+void resume_issuer_init(resume_issuer *issuer);
+
+// Write a token for a client at client_ip (network byte order) to out
+void resume_token_issue(const uint8_t key[RESUME_KEY_SIZE], uint32_t client_ip,
+                        const resume_params *params, uint64_t now_us,
+                        uint8_t out[RESUME_TOKEN_SIZE]);
+
+// Check a token's MAC, address and age. Returns 0 and fills params if it
+// is valid, -1 if not.
+int resume_token_verify(const uint8_t key[RESUME_KEY_SIZE], uint32_t client_ip,
+                        const uint8_t token[RESUME_TOKEN_SIZE], uint64_t now_us,
+                        resume_params *params);
+
+// Verify a token and refuse it if it was redeemed before, so a replayed
+// SYN cannot deliver its early data twice. Tokens issued no later than one
+// that was forgotten are refused too, redeemed or not, and the client
+// falls back to a full handshake. Returns 0 if valid, -1 if not.
+int resume_token_redeem(resume_issuer *issuer, uint32_t client_ip,
+                        const uint8_t token[RESUME_TOKEN_SIZE], uint64_t now_us,
+                        resume_params *params);
+
+#endif
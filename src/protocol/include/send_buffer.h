@@ -0,0 +1,42 @@
+#ifndef SEND_BUFFER_H
+#define SEND_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Send buffer capacity. A power of two, so the byte with sequence number
+// seq lives at data[seq & (SEND_BUFFER_SIZE - 1)], and larger than any
+// window the peer can advertise.
+#define SEND_BUFFER_SIZE 65536
+
+// Per-connection ring of bytes queued by the application. Bytes from head
+// up to the connection's next_seq_num are in flight, bytes from there up
+// to tail have not been sent yet. Acknowledged bytes are released by
+// moving head forward.
+typedef struct
+{
+  uint32_t head;               // Oldest unacknowledged byte
+  uint32_t tail;               // One past the last queued byte
+  char data[SEND_BUFFER_SIZE]; // Ring storage
+} send_buffer;
+
+// Initialize an empty buffer whose first byte will carry sequence number seq
+void send_buffer_init(send_buffer *buf, uint32_t seq);
+
+// Queue up to len bytes at the tail. Returns the number of bytes queued,
+// less than len when the buffer fills up.
+size_t send_buffer_write(send_buffer *buf, const char *data, size_t len);
+
+// Copy len queued bytes starting at sequence number seq
+void send_buffer_read(send_buffer *buf, uint32_t seq, char *out, size_t len);
+
+// Release the bytes acknowledged up to, not including, ack
+void send_buffer_ack(send_buffer *buf, uint32_t ack);
+
+// Bytes queued and not yet acknowledged
+uint32_t send_buffer_used(send_buffer *buf);
+
+// Bytes that can still be queued
+uint32_t send_buffer_space(send_buffer *buf);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIPHASH_KEY_SIZE 16
+
+// SipHash-2-4 of len bytes under a 128-bit key. A keyed MAC that is short
+// and fast enough to authenticate small tokens.
+uint64_t siphash24(const uint8_t key[SIPHASH_KEY_SIZE], const void *data, size_t len);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef STATE_CHANNEL_H
+#define STATE_CHANNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "packet.h"
+
+// Latest-value state, such as presence or typing indicators, carried
+// outside the data stream. Each key holds one value. Setting it replaces
+// a value the peer has not acknowledged yet, and a lost value is never
+// retransmitted as it was: the key's latest value goes out in its place.
+// Values are numbered in the order they were set, so the receiver ignores
+// one overtaken by a newer value of its key, and only the newest of a burst of updates costs bandwidth.
+#define STATE_MAX_KEYS 32              // Must match CT_MAX_STATE_KEYS in chattcp.h
+#define STATE_MAX_VALUE MAX_PAYLOAD_SIZE // Must match CT_MAX_STATE in chattcp.h
+#define STATE_MIN_RESEND_US 20000      // Shortest wait for an acknowledgment
+#define STATE_MAX_RETRIES 6            // Unacknowledged sends before a value is dropped
+
+// A key's value on the sending side
+typedef struct
+{
+  int used;
+  uint16_t key;
+  uint32_t version;    // Of the latest value
+  uint32_t sent;       // Version last sent, 0 if none
+  uint32_t acked;      // Highest version the peer acknowledged
+  uint64_t sent_us;    // When the last send happened
+  int retries;         // Resends since the first send that went unacknowledged
+  uint16_t len;
+  char value[STATE_MAX_VALUE];
+} state_out;
+
+// A key's value on the receiving side
+typedef struct
+{
+  int used;
+  uint16_t key;
+  uint32_t version;    // Of the value held
+  int fresh;           // Changed since the application last took it
+  uint16_t len;
+  char value[STATE_MAX_VALUE];
+} state_in;
+
+typedef struct
+{
+  state_out out[STATE_MAX_KEYS];
+  state_in in[STATE_MAX_KEYS];
+  uint32_t next_version; // Shared by all keys, so a key that leaves the table and
+                         // comes back still counts up from where the peer saw it
+} state_channel;
+
+// Initialize a channel with no keys
+void state_channel_init(state_channel *ch);
+
+// Set a key's latest value. Returns 0, or -1 with errno set to EMSGSIZE if
+// the value is too large or ENOSPC if every key is still waiting for an
+// acknowledgment.
+int state_channel_set(state_channel *ch, uint16_t key, const void *data, size_t len);
+
+// A value due to be sent at now, NULL if none. A key is due when its
+// latest value has not gone out yet and nothing of it is in flight, or
+// when the last send went unacknowledged for resend_us, doubled per retry.
+// The caller sends it and reports that with state_channel_sent().
+state_out *state_channel_due(state_channel *ch, uint64_t now, uint64_t resend_us);
+
+// Record that a key's latest value was sent
+void state_channel_sent(state_out *slot, uint64_t now);
+
+// The peer acknowledged version of a key
+void state_channel_on_ack(state_channel *ch, uint16_t key, uint32_t version);
+
+// A value arrived. Returns 1 if it is the newest seen for its key, 0 if
+// it was overtaken, -1 if there is no room to keep it. The first two are
+// acknowledged, the last is not.
+int state_channel_on_value(state_channel *ch, uint16_t key, uint32_t version, const void *data,
+                           size_t len);
+
+// Whether any received key changed since it was last taken
+int state_channel_readable(const state_channel *ch);
+
+// Copy the value of a key that changed since it was last taken. Returns
+// its length, or -1 with errno set to EAGAIN if no key changed or EINVAL
+// if buffer is too small.
+ssize_t state_channel_take(state_channel *ch, uint16_t *key, void *buffer, size_t len);
+
+// When state_channel_due() will next have a value, 0 if only
+// state_channel_set() or an acknowledgment can make one due
+uint64_t state_channel_next_timer(const state_channel *ch, uint64_t resend_us);
+
+#endif
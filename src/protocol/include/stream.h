@@ -0,0 +1,51 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Streams share a connection's sequence space, congestion control and
+// loss recovery, but each is delivered in its own order, so a loss on one
+// stream never holds back another. Stream IDs index fixed tables and need
+// no setup, the first segment of a stream opens it on both sides.
+#define MAX_STREAMS 64 // Must match CT_MAX_STREAMS in chattcp.h
+#define MAX_STREAM_CHUNKS 256 // Runs of queued bytes from different streams
+
+// A run of bytes in the send buffer that belongs to one stream
+typedef struct
+{
+  uint32_t seq_num;       // Connection sequence number of the first byte
+  uint32_t len;           // Bytes in the run
+  uint32_t stream_offset; // Stream offset of the first byte
+  uint16_t stream_id;
+} stream_chunk;
+
+// Maps the send buffer's sequence numbers to stream offsets. Segments are
+// cut at chunk boundaries, so each carries bytes of a single stream.
+typedef struct
+{
+  stream_chunk chunks[MAX_STREAM_CHUNKS]; // Oldest first
+  int head;                               // Index of the oldest chunk
+  int count;
+  uint32_t snd_offset[MAX_STREAMS];       // Next offset queued on each stream
+} stream_map;
+
+// Initialize an empty map, all streams at offset 0
+void stream_map_init(stream_map *map);
+
+// Forget the queued chunks, stream offsets carry on
+void stream_map_clear(stream_map *map);
+
+// Record len bytes of stream_id queued at seq_num. Returns how many of
+// them the map took, 0 if it is full.
+size_t stream_map_add(stream_map *map, uint16_t stream_id, uint32_t seq_num, size_t len);
+
+// Look up the stream of the byte at seq_num. Returns the bytes left in its
+// chunk from there, 0 if no chunk holds it.
+uint32_t stream_map_lookup(stream_map *map, uint32_t seq_num, uint16_t *stream_id,
+                           uint32_t *stream_offset);
+
+// Drop chunks acknowledged up to, not including, ack
+void stream_map_ack(stream_map *map, uint32_t ack);
+
+#endif
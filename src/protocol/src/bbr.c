@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <string.h>
+#include "bbr.h"
+
+// Pacing gains cycled through in PROBE_BW: probe up, drain the probe, cruise
+static const uint32_t pacing_gain_cycle[BBR_GAIN_CYCLE_LEN] = {
+    BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4, BBR_UNIT, BBR_UNIT,
+    BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT};
+
+// Name of a BBR mode for logging
+const char *bbr_mode_name(int mode)
+{
+  switch (mode)
+  {
+  case BBR_STARTUP:
+    return "STARTUP";
+  case BBR_DRAIN:
+    return "DRAIN";
+  case BBR_PROBE_BW:
+    return "PROBE_BW";
+  case BBR_PROBE_RTT:
+    return "PROBE_RTT";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+static uint32_t min_cwnd(bbr_state *bbr)
+{
+  return BBR_MIN_CWND_SEGMENTS * bbr->mss;
+}
+
+static void enter_startup(bbr_state *bbr)
+{
+  bbr->mode = BBR_STARTUP;
+  bbr->pacing_gain = BBR_HIGH_GAIN;
+  bbr->cwnd_gain = BBR_HIGH_GAIN;
+}
+
+static void enter_probe_bw(bbr_state *bbr, uint64_t now_us)
+{
+  bbr->mode = BBR_PROBE_BW;
+  bbr->cwnd_gain = BBR_CWND_GAIN;
+
+  // Start cruising; the next phase advance probes for more bandwidth
+  bbr->cycle_index = BBR_GAIN_CYCLE_LEN - 1;
+  bbr->pacing_gain = pacing_gain_cycle[bbr->cycle_index];
+  bbr->cycle_stamp_us = now_us;
+
+  printf("BBR: entering PROBE_BW, max_bw=%llu B/s, min_rtt=%u us\n",
+         (unsigned long long)bbr->max_bw, bbr->min_rtt_us);
+}
+
+// Initialize BBR state
+void bbr_init(bbr_state *bbr, uint16_t mss)
+{
+  memset(bbr, 0, sizeof(bbr_state));
+  bbr->mss = mss;
+  bbr->cwnd = BBR_INITIAL_CWND_SEGMENTS * mss;
+  enter_startup(bbr);
+
+  // Until the first sample, pace the initial window over the default RTT
+  bbr->pacing_rate = (uint64_t)bbr->cwnd * BBR_HIGH_GAIN / BBR_UNIT *
+                     1000000 / BBR_DEFAULT_RTT_US;
+}
+
+// Estimated bandwidth-delay product scaled by gain, in bytes
+uint32_t bbr_inflight(bbr_state *bbr, uint32_t gain)
+{
+  uint64_t bdp;
+
+  if (bbr->max_bw == 0 || bbr->min_rtt_us == 0)
+  {
+    // No model yet, use the initial window as the BDP
+    bdp = BBR_INITIAL_CWND_SEGMENTS * bbr->mss;
+  }
+  else
+  {
+    bdp = bbr->max_bw * bbr->min_rtt_us / 1000000;
+  }
+
+  bdp = bdp * gain / BBR_UNIT;
+  return bdp > BBR_MAX_CWND ? BBR_MAX_CWND : (uint32_t)bdp;
+}
+
+// Track packet-timed round trips: a round ends when a segment sent after
+// the start of the round is acknowledged
+static void update_round(bbr_state *bbr, const rate_sample *rs)
+{
+  bbr->delivered += rs->acked;
+  bbr->round_start = 0;
+
+  if (rs->acked > 0 && rs->prior_delivered >= bbr->next_round_delivered)
+  {
+    bbr->next_round_delivered = bbr->delivered;
+    bbr->round_count++;
+    bbr->round_start = 1;
+    bbr->bw_samples[bbr->round_count % BBR_BW_FILTER_ROUNDS] = 0;
+  }
+}
+
+// Feed the delivery rate into the windowed max filter
+static void update_bw(bbr_state *bbr, const rate_sample *rs)
+{
+  // Intervals shorter than min RTT come from ACK compression and overstate bandwidth
+  if (rs->delivered == 0 || rs->interval_us == 0 || rs->interval_us < bbr->min_rtt_us)
+  {
+    return;
+  }
+
+  uint64_t bw = (uint64_t)rs->delivered * 1000000 / rs->interval_us;
+
+  // App-limited samples understate the path, only take them if they raise the estimate
+  if (rs->is_app_limited && bw < bbr->max_bw)
+  {
+    return;
+  }
+
+  uint64_t *slot = &bbr->bw_samples[bbr->round_count % BBR_BW_FILTER_ROUNDS];
+  if (bw > *slot)
+  {
+    *slot = bw;
+  }
+
+  bbr->max_bw = 0;
+  for (int i = 0; i < BBR_BW_FILTER_ROUNDS; i++)
+  {
+    if (bbr->bw_samples[i] > bbr->max_bw)
+    {
+      bbr->max_bw = bbr->bw_samples[i];
+    }
+  }
+}
+
+// Startup ends once bandwidth stops growing by 25% for several rounds
+static void check_full_pipe(bbr_state *bbr, const rate_sample *rs)
+{
+  if (bbr->filled_pipe || !bbr->round_start || rs->is_app_limited)
+  {
+    return;
+  }
+
+  if (bbr->max_bw >= bbr->full_bw * BBR_FULL_BW_THRESHOLD / BBR_UNIT)
+  {
+    bbr->full_bw = bbr->max_bw;
+    bbr->full_bw_count = 0;
+    return;
+  }
+
+  if (++bbr->full_bw_count >= BBR_FULL_BW_ROUNDS)
+  {
+    bbr->filled_pipe = 1;
+    printf("BBR: pipe filled at %llu B/s\n", (unsigned long long)bbr->max_bw);
+  }
+}
+
+static void check_drain(bbr_state *bbr, const rate_sample *rs)
+{
+  if (bbr->mode == BBR_STARTUP && bbr->filled_pipe)
+  {
+    bbr->mode = BBR_DRAIN;
+    bbr->pacing_gain = BBR_DRAIN_GAIN;
+    bbr->cwnd_gain = BBR_HIGH_GAIN;
+    printf("BBR: entering DRAIN\n");
+  }
+
+  if (bbr->mode == BBR_DRAIN && rs->in_flight <= bbr_inflight(bbr, BBR_UNIT))
+  {
+    enter_probe_bw(bbr, rs->now_us);
+  }
+}
+
+static int is_next_cycle_phase(bbr_state *bbr, const rate_sample *rs)
+{
+  int is_full_length = rs->now_us - bbr->cycle_stamp_us > bbr->min_rtt_us;
+
+  if (bbr->pacing_gain > BBR_UNIT)
+  {
+    // Keep probing until the extra inflight has actually been put on the path
+    return is_full_length && rs->in_flight >= bbr_inflight(bbr, bbr->pacing_gain);
+  }
+
+  if (bbr->pacing_gain < BBR_UNIT)
+  {
+    // Stop draining early once the queue from the probe is gone
+    return is_full_length || rs->in_flight <= bbr_inflight(bbr, BBR_UNIT);
+  }
+
+  return is_full_length;
+}
+
+static void update_gain_cycle(bbr_state *bbr, const rate_sample *rs)
+{
+  if (bbr->mode == BBR_PROBE_BW && is_next_cycle_phase(bbr, rs))
+  {
+    bbr->cycle_index = (bbr->cycle_index + 1) % BBR_GAIN_CYCLE_LEN;
+    bbr->pacing_gain = pacing_gain_cycle[bbr->cycle_index];
+    bbr->cycle_stamp_us = rs->now_us;
+  }
+}
+
+// Refresh min RTT and run PROBE_RTT when the estimate has gone stale
+static void update_min_rtt(bbr_state *bbr, const rate_sample *rs)
+{
+  int expired = bbr->min_rtt_us != 0 &&
+                rs->now_us > bbr->min_rtt_stamp_us + BBR_MIN_RTT_WINDOW_US;
+
+  if (rs->rtt_us != 0 && (bbr->min_rtt_us == 0 || rs->rtt_us <= bbr->min_rtt_us || expired))
+  {
+    bbr->min_rtt_us = rs->rtt_us;
+    bbr->min_rtt_stamp_us = rs->now_us;
+  }
+
+  if (expired && bbr->mode != BBR_PROBE_RTT)
+  {
+    bbr->mode = BBR_PROBE_RTT;
+    bbr->pacing_gain = BBR_UNIT;
+    bbr->cwnd_gain = BBR_UNIT;
+    bbr->prior_cwnd = bbr->cwnd;
+    bbr->probe_rtt_done_us = 0;
+    printf("BBR: entering PROBE_RTT, saved cwnd=%u\n", bbr->prior_cwnd);
+  }
+
+  if (bbr->mode != BBR_PROBE_RTT)
+  {
+    return;
+  }
+
+  if (bbr->probe_rtt_done_us == 0 && rs->in_flight <= min_cwnd(bbr))
+  {
+    // Inflight has drained, hold it there for the probe duration and one round
+    bbr->probe_rtt_done_us = rs->now_us + BBR_PROBE_RTT_DURATION_US;
+    bbr->probe_rtt_round_done = 0;
+    bbr->next_round_delivered = bbr->delivered;
+  }
+  else if (bbr->probe_rtt_done_us != 0)
+  {
+    if (bbr->round_start)
+    {
+      bbr->probe_rtt_round_done = 1;
+    }
+
+    if (bbr->probe_rtt_round_done && rs->now_us >= bbr->probe_rtt_done_us)
+    {
+      bbr->min_rtt_stamp_us = rs->now_us;
+      if (bbr->cwnd < bbr->prior_cwnd)
+      {
+        bbr->cwnd = bbr->prior_cwnd;
+      }
+
+      if (bbr->filled_pipe)
+      {
+        enter_probe_bw(bbr, rs->now_us);
+      }
+      else
+      {
+        enter_startup(bbr);
+      }
+    }
+  }
+}
+
+static void set_pacing_rate(bbr_state *bbr)
+{
+  if (bbr->max_bw == 0)
+  {
+    return;
+  }
+
+  uint64_t rate = bbr->max_bw * bbr->pacing_gain / BBR_UNIT;
+
+  // Never slow down during startup, the filter may still be catching up
+  if (bbr->filled_pipe || rate > bbr->pacing_rate)
+  {
+    bbr->pacing_rate = rate;
+  }
+}
+
+static void set_cwnd(bbr_state *bbr, const rate_sample *rs)
+{
+  // Allow for a few segments of ACK aggregation on top of the BDP
+  uint32_t target = bbr_inflight(bbr, bbr->cwnd_gain) + 3 * bbr->mss;
+
+  if (bbr->filled_pipe)
+  {
+    uint32_t grown = bbr->cwnd + rs->acked;
+    bbr->cwnd = grown < target ? grown : target;
+  }
+  else if (bbr->cwnd < target || bbr->delivered < BBR_INITIAL_CWND_SEGMENTS * bbr->mss)
+  {
+    bbr->cwnd += rs->acked;
+  }
+
+  if (bbr->cwnd < min_cwnd(bbr))
+  {
+    bbr->cwnd = min_cwnd(bbr);
+  }
+
+  if (bbr->mode == BBR_PROBE_RTT && bbr->cwnd > min_cwnd(bbr))
+  {
+    bbr->cwnd = min_cwnd(bbr);
+  }
+
+  if (bbr->cwnd > BBR_MAX_CWND)
+  {
+    bbr->cwnd = BBR_MAX_CWND;
+  }
+}
+
+// Update the path model, mode, pacing rate and cwnd from a delivery rate sample
+void bbr_on_ack(bbr_state *bbr, const rate_sample *rs)
+{
+  update_round(bbr, rs);
+  update_bw(bbr, rs);
+  check_full_pipe(bbr, rs);
+  check_drain(bbr, rs);
+  update_gain_cycle(bbr, rs);
+  update_min_rtt(bbr, rs);
+  set_pacing_rate(bbr);
+  set_cwnd(bbr, rs);
+}
+
+// Handle a retransmission timeout
+void bbr_on_timeout(bbr_state *bbr)
+{
+  // Keep the path model, restart the window from the minimum and regrow it on ACKs
+  bbr->cwnd = min_cwnd(bbr);
+  printf("BBR: timeout in %s, cwnd=%u\n", bbr_mode_name(bbr->mode), bbr->cwnd);
+}
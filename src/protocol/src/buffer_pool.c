@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "buffer_pool.h"
+
+// Kept in the cache line in front of a buffer's bytes
+typedef struct
+{
+  buffer_pool *pool;
+  void *next;                  // Next buffer on a free list
+  _Atomic uint32_t refs;
+} buffer_header;
+
+_Static_assert(sizeof(buffer_header) <= BUFFER_CACHE_LINE, "buffer header exceeds a cache line");
+
+static buffer_header *header_of(const void *buf)
+{
+  return (buffer_header *)((char *)buf - BUFFER_CACHE_LINE);
+}
+
+static void count(_Atomic uint64_t *counter)
+{
+  // Only the owning thread writes it, the read-modify-write need not be atomic
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+}
+
+// Put a cache's buffers from index keep on on the free list, the lock is held
+static void return_buffers(buffer_pool *pool, buffer_cache *cache, int keep)
+{
+  while (cache->count > keep)
+  {
+    void *buf = cache->buffers[--cache->count];
+    header_of(buf)->next = pool->free_list;
+    pool->free_list = buf;
+  }
+}
+
+// A thread exiting gives its buffers back and leaves its counts behind
+static void cache_exit(void *arg)
+{
+  buffer_cache *cache = arg;
+  buffer_pool *pool = cache->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  return_buffers(pool, cache, 0);
+  pool->retired_allocs += atomic_load_explicit(&cache->allocs, memory_order_relaxed);
+  pool->retired_frees += atomic_load_explicit(&cache->frees, memory_order_relaxed);
+  for (buffer_cache **p = &pool->caches; *p != NULL; p = &(*p)->next)
+  {
+    if (*p == cache)
+    {
+      *p = cache->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  free(cache);
+}
+
+// Initialize a pool of buffers of buffer_size bytes
+int buffer_pool_init(buffer_pool *pool, size_t buffer_size, int flags)
+{
+  memset(pool, 0, sizeof(buffer_pool));
+  size_t stride = BUFFER_CACHE_LINE +
+                  (buffer_size + BUFFER_CACHE_LINE - 1) / BUFFER_CACHE_LINE * BUFFER_CACHE_LINE;
+  if (buffer_size == 0 || stride > BUFFER_SLAB_SIZE)
+  {
+    return -1;
+  }
+
+  pool->buffer_size = buffer_size;
+  pool->stride = stride;
+  pool->slab_size = BUFFER_SLAB_SIZE;
+  pool->flags = flags;
+  if (pthread_key_create(&pool->cache_key, cache_exit) != 0)
+  {
+    return -1;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  return 0;
+}
+
+// Unmap all slabs
+void buffer_pool_destroy(buffer_pool *pool)
+{
+  pthread_key_delete(pool->cache_key);
+  while (pool->caches != NULL)
+  {
+    buffer_cache *cache = pool->caches;
+    pool->caches = cache->next;
+    free(cache);
+  }
+  for (size_t i = 0; i < pool->slab_count; i++)
+  {
+    munmap(pool->slabs[i], pool->slab_size);
+  }
+  free(pool->slabs);
+  pthread_mutex_destroy(&pool->lock);
+  memset(pool, 0, sizeof(buffer_pool));
+}
+
+// Map a slab and put its buffers on the free list, the lock is held.
+// Returns -1 if out of memory.
+static int add_slab(buffer_pool *pool)
+{
+  if (pool->slab_count == pool->slab_capacity)
+  {
+    size_t capacity = pool->slab_capacity ? 2 * pool->slab_capacity : 8;
+    void **slabs = realloc(pool->slabs, capacity * sizeof(void *));
+    if (slabs == NULL)
+    {
+      return -1;
+    }
+    pool->slabs = slabs;
+    pool->slab_capacity = capacity;
+  }
+
+  // Huge pages need reserving by the administrator, without them the
+  // kernel may still back the slab with a transparent huge page
+  void *slab = MAP_FAILED;
+  int huge = 0;
+#ifdef MAP_HUGETLB
+  if (pool->flags & BUFFER_POOL_HUGE_PAGES)
+  {
+    slab = mmap(NULL, pool->slab_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    huge = slab != MAP_FAILED;
+  }
+#endif
+  if (slab == MAP_FAILED)
+  {
+    slab = mmap(NULL, pool->slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED)
+    {
+      perror("mmap failed for buffer slab");
+      return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    if (pool->flags & BUFFER_POOL_HUGE_PAGES)
+    {
+      madvise(slab, pool->slab_size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+
+  pool->slabs[pool->slab_count++] = slab;
+  pool->huge_slabs += huge;
+
+  // Lowest addresses first off the free list
+  size_t count = pool->slab_size / pool->stride;
+  for (size_t i = count; i-- > 0;)
+  {
+    void *buf = (char *)slab + i * pool->stride + BUFFER_CACHE_LINE;
+    buffer_header *header = header_of(buf);
+    header->pool = pool;
+    header->next = pool->free_list;
+    pool->free_list = buf;
+  }
+  return 0;
+}
+
+// The calling thread's cache, created on first use. NULL if out of memory,
+// the thread then goes to the free list every time.
+static buffer_cache *get_cache(buffer_pool *pool)
+{
+  buffer_cache *cache = pthread_getspecific(pool->cache_key);
+  if (cache != NULL)
+  {
+    return cache;
+  }
+
+  size_t size = (sizeof(buffer_cache) + BUFFER_CACHE_LINE - 1) / BUFFER_CACHE_LINE *
+                BUFFER_CACHE_LINE;
+  cache = aligned_alloc(BUFFER_CACHE_LINE, size);
+  if (cache == NULL)
+  {
+    return NULL;
+  }
+  memset(cache, 0, sizeof(buffer_cache));
+  cache->pool = pool;
+  if (pthread_setspecific(pool->cache_key, cache) != 0)
+  {
+    free(cache);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  cache->next = pool->caches;
+  pool->caches = cache;
+  pthread_mutex_unlock(&pool->lock);
+  return cache;
+}
+
+// Take a buffer off the free list, mapping a slab if it is empty. The lock
+// is held.
+static void *pop_free(buffer_pool *pool)
+{
+  if (pool->free_list == NULL && add_slab(pool) < 0)
+  {
+    return NULL;
+  }
+  void *buf = pool->free_list;
+  pool->free_list = header_of(buf)->next;
+  return buf;
+}
+
+// A buffer holding one reference
+void *buffer_alloc(buffer_pool *pool)
+{
+  buffer_cache *cache = get_cache(pool);
+  void *buf = NULL;
+
+  if (cache == NULL)
+  {
+    pthread_mutex_lock(&pool->lock);
+    buf = pop_free(pool);
+    if (buf != NULL)
+    {
+      pool->retired_allocs++;
+    }
+    else
+    {
+      pool->failures++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  else
+  {
+    if (cache->count == 0)
+    {
+      // A new slab only once the free list has nothing left at all
+      pthread_mutex_lock(&pool->lock);
+      if (pool->free_list != NULL || add_slab(pool) == 0)
+      {
+        while (cache->count < BUFFER_CACHE_BATCH && pool->free_list != NULL)
+        {
+          cache->buffers[cache->count++] = pop_free(pool);
+        }
+      }
+      if (cache->count > 0)
+      {
+        pool->refills++;
+      }
+      else
+      {
+        pool->failures++;
+      }
+      pthread_mutex_unlock(&pool->lock);
+    }
+    if (cache->count > 0)
+    {
+      buf = cache->buffers[--cache->count];
+      count(&cache->allocs);
+    }
+  }
+
+  if (buf == NULL)
+  {
+    return NULL;
+  }
+  atomic_store_explicit(&header_of(buf)->refs, 1, memory_order_relaxed);
+  return buf;
+}
+
+// Take another reference to a buffer
+void *buffer_retain(void *buf)
+{
+  atomic_fetch_add_explicit(&header_of(buf)->refs, 1, memory_order_relaxed);
+  return buf;
+}
+
+// Drop a reference, returning the buffer to its pool with the last one
+void buffer_release(void *buf)
+{
+  buffer_header *header = header_of(buf);
+  if (atomic_fetch_sub_explicit(&header->refs, 1, memory_order_acq_rel) != 1)
+  {
+    return;
+  }
+
+  buffer_pool *pool = header->pool;
+  buffer_cache *cache = get_cache(pool);
+  if (cache == NULL)
+  {
+    pthread_mutex_lock(&pool->lock);
+    header->next = pool->free_list;
+    pool->free_list = buf;
+    pool->retired_frees++;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+
+  // A full cache keeps half, so alternating allocations and releases do
+  // not go to the free list every time
+  if (cache->count == BUFFER_CACHE_SIZE)
+  {
+    pthread_mutex_lock(&pool->lock);
+    return_buffers(pool, cache, BUFFER_CACHE_SIZE - BUFFER_CACHE_BATCH);
+    pool->spills++;
+    pthread_mutex_unlock(&pool->lock);
+  }
+  cache->buffers[cache->count++] = buf;
+  count(&cache->frees);
+}
+
+// References held to a buffer
+uint32_t buffer_refs(const void *buf)
+{
+  return atomic_load_explicit(&header_of(buf)->refs, memory_order_relaxed);
+}
+
+// Return the calling thread's cached buffers to the pool
+void buffer_pool_flush(buffer_pool *pool)
+{
+  buffer_cache *cache = pthread_getspecific(pool->cache_key);
+  if (cache == NULL || cache->count == 0)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  return_buffers(pool, cache, 0);
+  pool->spills++;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Current counters
+void buffer_pool_get_stats(buffer_pool *pool, buffer_pool_stats *stats)
+{
+  memset(stats, 0, sizeof(buffer_pool_stats));
+  pthread_mutex_lock(&pool->lock);
+  stats->buffer_size = pool->buffer_size;
+  stats->slabs = pool->slab_count;
+  stats->huge_slabs = pool->huge_slabs;
+  stats->memory = pool->slab_count * pool->slab_size;
+  stats->buffers = pool->slab_count * (pool->slab_size / pool->stride);
+  stats->allocs = pool->retired_allocs;
+  stats->frees = pool->retired_frees;
+  for (buffer_cache *cache = pool->caches; cache != NULL; cache = cache->next)
+  {
+    stats->allocs += atomic_load_explicit(&cache->allocs, memory_order_relaxed);
+    stats->frees += atomic_load_explicit(&cache->frees, memory_order_relaxed);
+  }
+  stats->refills = pool->refills;
+  stats->spills = pool->spills;
+  stats->failures = pool->failures;
+  pthread_mutex_unlock(&pool->lock);
+  stats->in_use = stats->allocs > stats->frees ? stats->allocs - stats->frees : 0;
+}
@@ -50,6 +50,7 @@ client_info *add_client(struct sockaddr_in *address)
   client->last_heartbeat = time(NULL);
   client->current_seq_num = 0;
   client->fc_state = NULL; // Initialize flow control state as NULL
+  client->decoder = NULL;
 
   char ip_str[INET_ADDRSTRLEN];
   inet_ntop(AF_INET, &(address->sin_addr), ip_str, INET_ADDRSTRLEN);
@@ -69,8 +70,11 @@ void remove_client(struct sockaddr_in *address)
       // Free flow control state if allocated
       if (clients[i].fc_state != NULL)
       {
+        release_flow_control(clients[i].fc_state);
         free(clients[i].fc_state);
         clients[i].fc_state = NULL;
+        free(clients[i].decoder);
+        clients[i].decoder = NULL;
       }
 
       char ip_str[INET_ADDRSTRLEN];
@@ -103,8 +107,11 @@ void check_client_timeouts(time_t current_time)
       // Free flow control state if allocated
       if (clients[i].fc_state != NULL)
       {
+        release_flow_control(clients[i].fc_state);
         free(clients[i].fc_state);
         clients[i].fc_state = NULL;
+        free(clients[i].decoder);
+        clients[i].decoder = NULL;
       }
 
       // Shift remaining clients
@@ -7,9 +7,11 @@
 #include <unistd.h>
 #include <sys/select.h>
 #include <errno.h>
+#include <time.h>
 
 #include "packet.h"
 #include "flow_control.h"
+#include "framing.h"
 
 #define SERVER_IP "127.0.0.1"
 #define PORT 12345
@@ -17,7 +19,7 @@
 #define TIMEOUT_SEC 2
 
 // Initialize socket and set up server address
-int init(const char *server_ip, int server_port, int *client_socket, struct sockaddr_in *server_address, int *local_port)
+int init_client(const char *server_ip, int server_port, int *client_socket, struct sockaddr_in *server_address, int *local_port)
 {
   if ((*client_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
   {
@@ -65,7 +67,7 @@ void init_packet(packet *pkt, uint16_t src_port, uint16_t dst_port)
 }
 
 // Perform three-way handshake with server
-int connect(int client_socket, struct sockaddr_in *server_address, int local_port, int server_port)
+int connect_to_server(int client_socket, struct sockaddr_in *server_address, int local_port, int server_port)
 {
   // Create a SYN packet to initiate the handshake.
   packet syn_packet;
@@ -179,7 +181,7 @@ int connect(int client_socket, struct sockaddr_in *server_address, int local_por
 }
 
 // Perform four-way handshake to terminate connection
-int terminate(int client_socket, struct sockaddr_in *server_address, int local_port, int server_port)
+int terminate_connection(int client_socket, struct sockaddr_in *server_address, int local_port, int server_port)
 {
   int termination_complete = 0;
   int retries = 0;
@@ -302,9 +304,13 @@ int exchange_data(int client_socket, struct sockaddr_in *server_address,
   init_flow_control(&fc_state, client_socket, server_address,
                     local_port, server_port);
 
-  // simple test message
+  // simple test message, framed with its length
   const char *test_message = "TEST_MESSAGE";
-  if (send_data_with_flow_control(&fc_state, test_message, strlen(test_message)) < 0)
+  char header[FRAME_HEADER_SIZE];
+  frame_encode_header(strlen(test_message), header);
+  if (send_data_with_flow_control(&fc_state, header, FRAME_HEADER_SIZE) < 0 ||
+      send_data_with_flow_control(&fc_state, test_message, strlen(test_message)) < 0 ||
+      flush_flow_control(&fc_state) < 0)
   {
     printf("Failed to send test message.\n");
     return 0;
@@ -336,12 +342,12 @@ int main(int argc, char *argv[])
     printf("No arguments provided. Using default values: %s:%d\n", server_ip, server_port);
   }
 
-  if (!init(server_ip, server_port, &client_socket, &server_address, &local_port))
+  if (!init_client(server_ip, server_port, &client_socket, &server_address, &local_port))
   {
     return 1;
   }
 
-  if (!connect(client_socket, &server_address, local_port, server_port))
+  if (!connect_to_server(client_socket, &server_address, local_port, server_port))
   {
     close(client_socket);
     return 1;
@@ -351,7 +357,7 @@ int main(int argc, char *argv[])
   exchange_data(client_socket, &server_address, local_port, server_port);
 
   // Close the connection:
-  if (!terminate(client_socket, &server_address, local_port, server_port))
+  if (!terminate_connection(client_socket, &server_address, local_port, server_port))
   {
     printf("Failed to gracefully terminate the connection.\n");
   }
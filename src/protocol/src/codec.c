@@ -0,0 +1,297 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "codec.h"
+
+#define HASH_BITS 12
+#define MAX_OFFSET 65535
+
+// Version 1 of the shared dictionary: frequent chat words and phrases.
+// Matches reach back from the end, so the most common text comes last.
+// Never edit it in place, add a new version.
+static const char dictionary[] =
+  "https://www.youtube.com/watch?v= https://github.com/ .html .png .jpg "
+  "Monday Tuesday Wednesday Thursday Friday Saturday Sunday tomorrow tonight yesterday "
+  "morning afternoon evening weekend meeting minutes hours seconds o'clock "
+  "could you please can you send me the link anyone know how to does anybody "
+  "happy birthday congratulations good morning good night see you later talk to you "
+  "by the way in my opinion to be honest as far as I know let me know "
+  "something anything everything nothing someone everyone because though although "
+  "probably actually basically literally definitely seriously exactly "
+  "should would could might must will shall have been being having "
+  "about above after again against before below between during under until "
+  "people person thing things time year work world life day way man woman "
+  "problem question answer issue error message server client update version "
+  "thanks thank you thx np no problem sorry sure okay ok yes yeah nope maybe "
+  "lol lmao haha hahaha omg wtf idk imo tbh btw brb afk gtg ttyl "
+  "what where when which while who why how this that these those there their they "
+  "with from into over then than them were what's that's it's I'm I'll I've don't "
+  "can't won't didn't doesn't isn't wasn't aren't "
+  "just like know think really going want good time well much more some "
+  " is typing [lobby] online: the and you for are not but all has had him her "
+  "the ";
+
+static uint32_t hash4(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Hash table over the dictionary, the starting point of every compression.
+// Positions are stored plus one, 0 marks an empty bucket.
+static uint16_t dictionary_table[1 << HASH_BITS];
+static pthread_once_t dictionary_once = PTHREAD_ONCE_INIT;
+
+static void hash_dictionary(void)
+{
+  const uint8_t *dict = (const uint8_t *)dictionary;
+  for (size_t i = 0; i + CODEC_MIN_MATCH <= sizeof(dictionary) - 1; i++)
+  {
+    dictionary_table[hash4(dict + i)] = i + 1;
+  }
+}
+
+// Write a length's continuation bytes after its nibble in the token
+static int put_length(uint8_t **op, const uint8_t *end, size_t len)
+{
+  for (; len >= 255; len -= 255)
+  {
+    if (*op >= end)
+    {
+      return -1;
+    }
+    *(*op)++ = 255;
+  }
+  if (*op >= end)
+  {
+    return -1;
+  }
+  *(*op)++ = (uint8_t)len;
+  return 0;
+}
+
+// Write one sequence: literals, then a match unless it is the last
+static int put_sequence(uint8_t **op, const uint8_t *end, const uint8_t *literals,
+                        size_t literal_len, size_t offset, size_t match_len)
+{
+  if (*op >= end)
+  {
+    return -1;
+  }
+
+  size_t match_code = match_len ? match_len - CODEC_MIN_MATCH : 0;
+  uint8_t *token = (*op)++;
+  *token = (literal_len < 15 ? literal_len : 15) << 4 | (match_code < 15 ? match_code : 15);
+  if (literal_len >= 15 && put_length(op, end, literal_len - 15) < 0)
+  {
+    return -1;
+  }
+  if ((size_t)(end - *op) < literal_len)
+  {
+    return -1;
+  }
+  memcpy(*op, literals, literal_len);
+  *op += literal_len;
+
+  if (match_len == 0)
+  {
+    return 0;
+  }
+  if (end - *op < 2)
+  {
+    return -1;
+  }
+  *(*op)++ = offset & 0xff;
+  *(*op)++ = offset >> 8;
+  if (match_code >= 15 && put_length(op, end, match_code - 15) < 0)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+// Compress src into dst, the dictionary counting as text just before it
+size_t codec_compress(const char *src, size_t len, char *dst, size_t cap)
+{
+  const size_t dict_len = sizeof(dictionary) - 1;
+  uint8_t buf[sizeof(dictionary) - 1 + CODEC_MAX_INPUT];
+  uint16_t table[1 << HASH_BITS];
+
+  if (len > CODEC_MAX_INPUT)
+  {
+    return 0;
+  }
+  memcpy(buf, dictionary, dict_len);
+  memcpy(buf + dict_len, src, len);
+  pthread_once(&dictionary_once, hash_dictionary);
+  memcpy(table, dictionary_table, sizeof(table));
+
+  uint8_t *op = (uint8_t *)dst;
+  const uint8_t *op_end = op + cap;
+  size_t end = dict_len + len;
+  size_t anchor = dict_len;
+  size_t ip = dict_len;
+
+  // Greedy: take the first match the hash finds
+  while (ip + CODEC_MIN_MATCH <= end)
+  {
+    uint32_t h = hash4(buf + ip);
+    size_t ref = table[h];
+    table[h] = ip + 1;
+    if (ref == 0 || ip - (ref - 1) > MAX_OFFSET ||
+        memcmp(buf + ref - 1, buf + ip, CODEC_MIN_MATCH) != 0)
+    {
+      ip++;
+      continue;
+    }
+
+    ref--;
+    size_t match_len = CODEC_MIN_MATCH;
+    while (ip + match_len < end && buf[ref + match_len] == buf[ip + match_len])
+    {
+      match_len++;
+    }
+    if (put_sequence(&op, op_end, buf + anchor, ip - anchor, ip - ref, match_len) < 0)
+    {
+      return 0;
+    }
+
+    for (size_t i = ip + 1; i < ip + match_len && i + CODEC_MIN_MATCH <= end; i++)
+    {
+      table[hash4(buf + i)] = i + 1;
+    }
+    ip += match_len;
+    anchor = ip;
+  }
+
+  if (put_sequence(&op, op_end, buf + anchor, end - anchor, 0, 0) < 0)
+  {
+    return 0;
+  }
+  return op - (uint8_t *)dst;
+}
+
+// Read a length's continuation bytes
+static int get_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+  uint8_t byte;
+  do
+  {
+    if (*ip >= end)
+    {
+      return -1;
+    }
+    byte = *(*ip)++;
+    *len += byte;
+  } while (byte == 255);
+  return 0;
+}
+
+// Decompress a block of exactly dst_len bytes
+int codec_decompress(const char *src, size_t len, char *dst, size_t dst_len)
+{
+  const size_t dict_len = sizeof(dictionary) - 1;
+  uint8_t buf[sizeof(dictionary) - 1 + CODEC_MAX_INPUT];
+
+  if (dst_len > CODEC_MAX_INPUT)
+  {
+    return -1;
+  }
+  memcpy(buf, dictionary, dict_len);
+
+  const uint8_t *ip = (const uint8_t *)src;
+  const uint8_t *ip_end = ip + len;
+  size_t op = dict_len;
+  size_t op_end = dict_len + dst_len;
+
+  while (ip < ip_end)
+  {
+    uint8_t token = *ip++;
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && get_length(&ip, ip_end, &literal_len) < 0)
+    {
+      return -1;
+    }
+    if ((size_t)(ip_end - ip) < literal_len || op_end - op < literal_len)
+    {
+      return -1;
+    }
+    memcpy(buf + op, ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+
+    // The last sequence has no match
+    if (ip == ip_end)
+    {
+      break;
+    }
+    if (ip_end - ip < 2)
+    {
+      return -1;
+    }
+    size_t offset = ip[0] | ip[1] << 8;
+    ip += 2;
+    size_t match_len = (token & 15) + CODEC_MIN_MATCH;
+    if ((token & 15) == 15 && get_length(&ip, ip_end, &match_len) < 0)
+    {
+      return -1;
+    }
+    if (offset == 0 || offset > op || op_end - op < match_len)
+    {
+      return -1;
+    }
+
+    // Byte by byte, a match may overlap what it produces
+    for (size_t i = 0; i < match_len; i++, op++)
+    {
+      buf[op] = buf[op - offset];
+    }
+  }
+
+  if (op != op_end)
+  {
+    return -1;
+  }
+  memcpy(dst, buf + dict_len, dst_len);
+  return dst_len;
+}
+
+// Whether data starts like an already compressed format
+int codec_precompressed(const char *data, size_t len)
+{
+  static const struct
+  {
+    const char *magic;
+    size_t len;
+  } formats[] = {
+    {"\x1f\x8b", 2},             // gzip
+    {"PK\x03\x04", 4},           // zip, docx, jar
+    {"\x89PNG", 4},
+    {"\xff\xd8\xff", 3},         // JPEG
+    {"GIF8", 4},
+    {"\x28\xb5\x2f\xfd", 4},     // zstd
+    {"\xfd" "7zXZ", 5},          // xz
+    {"7z\xbc\xaf", 4},
+    {"BZh", 3},
+    {"\x04\x22\x4d\x18", 4},     // LZ4 frame
+    {"OggS", 4},
+    {"fLaC", 4},
+  };
+
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+  {
+    if (len >= formats[i].len && memcmp(data, formats[i].magic, formats[i].len) == 0)
+    {
+      return 1;
+    }
+  }
+
+  // WebP is a RIFF container, MP4 and friends have their box type at
+  // offset 4
+  if (len >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0)
+  {
+    return 1;
+  }
+  return len >= 8 && memcmp(data + 4, "ftyp", 4) == 0;
+}
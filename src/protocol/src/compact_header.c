@@ -0,0 +1,358 @@
+#include <string.h>
+
+#include "compact_header.h"
+
+// Longest encoding: fixed fields, reference, every varint at its longest
+// and a full payload
+#define COMPACT_MAX_SIZE (6 + 22 + 4 * 5 + 3 + 5 + 10 + 3 + 5 + 3 + MAX_PAYLOAD_SIZE)
+
+// Start decoding compact datagrams
+void compact_init(compact_context *ctx, uint32_t conn_id, uint16_t local_port,
+                  uint16_t remote_port)
+{
+  memset(ctx, 0, sizeof(compact_context));
+  ctx->enabled = 1;
+  ctx->conn_id = conn_id;
+  ctx->local_port = local_port;
+  ctx->remote_port = remote_port;
+}
+
+// Start sending compact datagrams
+void compact_start_sending(compact_context *ctx)
+{
+  ctx->sending = ctx->enabled;
+}
+
+static uint32_t zigzag(uint32_t value, uint32_t from)
+{
+  int32_t delta = (int32_t)(value - from);
+  return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t z, uint32_t from)
+{
+  return from + ((z >> 1) ^ -(z & 1));
+}
+
+static void put_varint(uint8_t **p, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    *(*p)++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *(*p)++ = value;
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint32_t *value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+  {
+    if (*p >= end)
+    {
+      return -1;
+    }
+    uint8_t byte = *(*p)++;
+    *value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+    {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void put_u32(uint8_t **p, uint32_t value)
+{
+  (*p)[0] = value >> 24;
+  (*p)[1] = value >> 16;
+  (*p)[2] = value >> 8;
+  (*p)[3] = value;
+  *p += 4;
+}
+
+static uint32_t get_u32(const uint8_t **p)
+{
+  uint32_t value = (uint32_t)(*p)[0] << 24 | (uint32_t)(*p)[1] << 16 | (*p)[2] << 8 | (*p)[3];
+  *p += 4;
+  return value;
+}
+
+// Whether a delta from the reference has grown past COMPACT_MAX_DELTA
+static int too_far(const packet *pkt, const compact_ref *ref)
+{
+  return zigzag(pkt->seq_num, ref->seq_num) >= 2 * COMPACT_MAX_DELTA ||
+         zigzag(pkt->ack_num, ref->ack_num) >= 2 * COMPACT_MAX_DELTA ||
+         zigzag(pkt->ts_val, ref->ts_val) >= 2 * COMPACT_MAX_DELTA ||
+         zigzag(pkt->ts_ecr, ref->ts_ecr) >= 2 * COMPACT_MAX_DELTA;
+}
+
+// Encode pkt in compact form
+size_t compact_encode(compact_context *ctx, const packet *pkt, uint8_t *out)
+{
+  if (!ctx->sending || (pkt->flags & SYN) || pkt->source_port != ctx->local_port ||
+      pkt->dest_port != ctx->remote_port)
+  {
+    return 0;
+  }
+
+  // Only the payload travels, what follows it must be zero to come back
+  // the same. Without the stream option its length is not a field.
+  size_t len = pkt->data_offset >= STREAM_DATA_OFFSET ? pkt->payload_len : packet_payload_len(pkt);
+  if (len > MAX_PAYLOAD_SIZE || (pkt->data_offset < STREAM_DATA_OFFSET && pkt->payload_len != 0))
+  {
+    return 0;
+  }
+  for (size_t i = len; i < MAX_PAYLOAD_SIZE; i++)
+  {
+    if (pkt->payload[i] != 0)
+    {
+      return 0;
+    }
+  }
+
+  // A new reference when there is none or the deltas have outgrown it
+  if (ctx->tx_generation == 0 || too_far(pkt, &ctx->tx))
+  {
+    ctx->tx.seq_num = pkt->seq_num;
+    ctx->tx.ack_num = pkt->ack_num;
+    ctx->tx.ts_val = pkt->ts_val;
+    ctx->tx.ts_ecr = pkt->ts_ecr;
+    ctx->tx.window_size = pkt->window_size;
+    ctx->tx_generation = ctx->tx_generation % (COMPACT_GENERATIONS - 1) + 1;
+  }
+
+  uint8_t fields = 0;
+  if (ctx->peer_echo != ctx->tx_generation)
+  {
+    fields |= COMPACT_REF;
+  }
+  if (pkt->window_size != ctx->tx.window_size)
+  {
+    fields |= COMPACT_WINDOW;
+  }
+  if (pkt->delay_echo != 0)
+  {
+    fields |= COMPACT_DELAY;
+  }
+  if (pkt->sack_left != 0 || pkt->sack_right != 0)
+  {
+    fields |= COMPACT_SACK;
+  }
+  if (pkt->stream_id != 0 || pkt->stream_offset != 0)
+  {
+    fields |= COMPACT_STREAM;
+  }
+  if (pkt->urgent_pointer != 0)
+  {
+    fields |= COMPACT_URGENT;
+  }
+
+  uint8_t buf[COMPACT_MAX_SIZE];
+  uint8_t *p = buf;
+  *p++ = fields;
+  *p++ = ctx->tx_generation << 4 | ctx->rx_generation;
+  *p++ = pkt->flags;
+  *p++ = pkt->data_offset << 4 | pkt->reserved;
+  *p++ = pkt->checksum >> 8;
+  *p++ = pkt->checksum & 0xff;
+
+  if (fields & COMPACT_REF)
+  {
+    put_u32(&p, ctx->conn_id);
+    put_u32(&p, ctx->tx.seq_num);
+    put_u32(&p, ctx->tx.ack_num);
+    put_u32(&p, ctx->tx.ts_val);
+    put_u32(&p, ctx->tx.ts_ecr);
+    *p++ = ctx->tx.window_size >> 8;
+    *p++ = ctx->tx.window_size & 0xff;
+  }
+
+  put_varint(&p, zigzag(pkt->seq_num, ctx->tx.seq_num));
+  put_varint(&p, zigzag(pkt->ack_num, ctx->tx.ack_num));
+  put_varint(&p, zigzag(pkt->ts_val, ctx->tx.ts_val));
+  put_varint(&p, zigzag(pkt->ts_ecr, ctx->tx.ts_ecr));
+  if (fields & COMPACT_WINDOW)
+  {
+    put_varint(&p, pkt->window_size);
+  }
+  if (fields & COMPACT_DELAY)
+  {
+    put_varint(&p, pkt->delay_echo);
+  }
+  if (fields & COMPACT_SACK)
+  {
+    put_varint(&p, zigzag(pkt->sack_left, pkt->ack_num));
+    put_varint(&p, pkt->sack_right - pkt->sack_left);
+  }
+  if (fields & COMPACT_STREAM)
+  {
+    put_varint(&p, pkt->stream_id);
+    put_varint(&p, pkt->stream_offset);
+  }
+  if (fields & COMPACT_URGENT)
+  {
+    put_varint(&p, pkt->urgent_pointer);
+  }
+  memcpy(p, pkt->payload, len);
+  p += len;
+
+  // Only shorter than a full packet is worth it, and tells the two apart
+  size_t size = p - buf;
+  if (size >= sizeof(packet))
+  {
+    return 0;
+  }
+  memcpy(out, buf, size);
+  ctx->packets++;
+  ctx->full_bytes += sizeof(packet);
+  ctx->wire_bytes += size;
+  return size;
+}
+
+// Decode a compact datagram
+int compact_decode(compact_context *ctx, const uint8_t *in, size_t len, packet *pkt)
+{
+  if (!ctx->enabled || len < 6 || len >= sizeof(packet))
+  {
+    return -1;
+  }
+
+  const uint8_t *p = in;
+  const uint8_t *end = in + len;
+  uint8_t fields = *p++;
+  uint8_t generation = *p >> 4;
+  uint8_t echo = *p++ & 0x0f;
+
+  memset(pkt, 0, sizeof(packet));
+  pkt->source_port = ctx->remote_port;
+  pkt->dest_port = ctx->local_port;
+  pkt->flags = *p++;
+  pkt->data_offset = *p >> 4;
+  pkt->reserved = *p++ & 0x0f;
+  uint16_t checksum = p[0] << 8 | p[1];
+  p += 2;
+
+  // A reference only replaces ours once the packet checks out
+  compact_ref ref = ctx->rx;
+  if (fields & COMPACT_REF)
+  {
+    if (end - p < 22 || get_u32(&p) != ctx->conn_id)
+    {
+      return -1;
+    }
+    ref.seq_num = get_u32(&p);
+    ref.ack_num = get_u32(&p);
+    ref.ts_val = get_u32(&p);
+    ref.ts_ecr = get_u32(&p);
+    ref.window_size = p[0] << 8 | p[1];
+    p += 2;
+  }
+  else if (generation != ctx->rx_generation)
+  {
+    return -1;
+  }
+  if (generation == 0)
+  {
+    return -1;
+  }
+
+  uint32_t value;
+  if (get_varint(&p, end, &value) < 0)
+  {
+    return -1;
+  }
+  pkt->seq_num = unzigzag(value, ref.seq_num);
+  if (get_varint(&p, end, &value) < 0)
+  {
+    return -1;
+  }
+  pkt->ack_num = unzigzag(value, ref.ack_num);
+  if (get_varint(&p, end, &value) < 0)
+  {
+    return -1;
+  }
+  pkt->ts_val = unzigzag(value, ref.ts_val);
+  if (get_varint(&p, end, &value) < 0)
+  {
+    return -1;
+  }
+  pkt->ts_ecr = unzigzag(value, ref.ts_ecr);
+
+  pkt->window_size = ref.window_size;
+  if (fields & COMPACT_WINDOW)
+  {
+    if (get_varint(&p, end, &value) < 0)
+    {
+      return -1;
+    }
+    pkt->window_size = value;
+  }
+  if ((fields & COMPACT_DELAY) && get_varint(&p, end, &pkt->delay_echo) < 0)
+  {
+    return -1;
+  }
+  if (fields & COMPACT_SACK)
+  {
+    if (get_varint(&p, end, &value) < 0)
+    {
+      return -1;
+    }
+    pkt->sack_left = unzigzag(value, pkt->ack_num);
+    if (get_varint(&p, end, &value) < 0)
+    {
+      return -1;
+    }
+    pkt->sack_right = pkt->sack_left + value;
+  }
+  if (fields & COMPACT_STREAM)
+  {
+    if (get_varint(&p, end, &value) < 0)
+    {
+      return -1;
+    }
+    pkt->stream_id = value;
+    if (get_varint(&p, end, &pkt->stream_offset) < 0)
+    {
+      return -1;
+    }
+  }
+  if (fields & COMPACT_URGENT)
+  {
+    if (get_varint(&p, end, &value) < 0)
+    {
+      return -1;
+    }
+    pkt->urgent_pointer = value;
+  }
+
+  size_t payload_len = end - p;
+  if (payload_len > MAX_PAYLOAD_SIZE)
+  {
+    return -1;
+  }
+  memcpy(pkt->payload, p, payload_len);
+  if (pkt->data_offset >= STREAM_DATA_OFFSET)
+  {
+    pkt->payload_len = payload_len;
+  }
+
+  // A packet that does not come back as it was sent was decoded from a
+  // reference other than the sender's. Dropping ours makes the echo ask
+  // for the sender's.
+  if (calculate_checksum(pkt) != checksum)
+  {
+    ctx->rx_generation = 0;
+    return -1;
+  }
+  pkt->checksum = checksum;
+
+  if (fields & COMPACT_REF)
+  {
+    ctx->rx = ref;
+    ctx->rx_generation = generation;
+  }
+  ctx->peer_echo = echo;
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "congestion_control.h"
+#include "flow_control.h"
 
 // Initialize congestion control state
 void init_congestion_control(congestion_control_state *cc_state, uint16_t mss)
@@ -12,12 +13,54 @@ void init_congestion_control(congestion_control_state *cc_state, uint16_t mss)
   cc_state->last_ack = 0;                  // No ACKs received yet
   cc_state->duplicate_acks = 0;            // No duplicate ACKs yet
   cc_state->mss = mss;                     // Store MSS value
+  cc_state->algorithm = CC_RENO;           // Loss-based control by default
+  cc_state->pacing_rate = 0;               // Reno sends are not paced
+  cc_state->recovery_point = 0;            // Not in recovery
+  cc_state->recover_fs = 0;
+  cc_state->prr_delivered = 0;
+  cc_state->prr_out = 0;
+  cc_state->ecn_reacted = 0;               // No ECN echo seen yet
+  cc_state->ecn_recovery_point = 0;
+  bbr_init(&cc_state->bbr, mss);
+  ledbat_init(&cc_state->ledbat, mss);
 
   printf("Congestion control initialized: cwnd=%u, ssthresh=%u, state=%s\n",
          cc_state->cwnd, cc_state->ssthresh,
          cc_state->state == SLOW_START ? "SLOW_START" : cc_state->state == CONGESTION_AVOIDANCE ? "CONGESTION_AVOIDANCE" : "FAST_RECOVERY");
 }
 
+// Enter fast recovery: reduce ssthresh once for the loss episode and let
+// PRR bring the flight down to it
+static void enter_recovery(congestion_control_state *cc_state, flow_control_state *fc_state)
+{
+  if (cc_state->algorithm == CC_LEDBAT)
+  {
+    ledbat_on_loss(&cc_state->ledbat);
+    cc_state->ssthresh = cc_state->ledbat.cwnd;
+    cc_state->cwnd = cc_state->ssthresh;
+  }
+  else if (cc_state->algorithm == CC_RENO)
+  {
+    cc_state->ssthresh = cc_state->cwnd / 2;
+    if (cc_state->ssthresh < cc_state->mss)
+    {
+      cc_state->ssthresh = cc_state->mss;
+    }
+    cc_state->cwnd = cc_state->ssthresh;
+  }
+
+  // BBR keeps its model-driven window
+  cc_state->recovery_point = fc_state->next_seq_num;
+  cc_state->recover_fs = fc_state->next_seq_num - fc_state->last_ack_received;
+  if (cc_state->recover_fs == 0)
+  {
+    cc_state->recover_fs = cc_state->mss;
+  }
+  cc_state->prr_delivered = 0;
+  cc_state->prr_out = 0;
+  cc_state->state = FAST_RECOVERY;
+}
+
 // Update congestion window based on received ACK
 void update_congestion_window(congestion_control_state *cc_state,
                               flow_control_state *fc_state,
@@ -33,27 +76,22 @@ void update_congestion_window(congestion_control_state *cc_state,
       printf("Duplicate ACK received (%d/%d)\n",
              cc_state->duplicate_acks, DUPLICATE_ACK_THRESHOLD);
 
-      // Check for fast retransmit threshold
-      if (cc_state->duplicate_acks == DUPLICATE_ACK_THRESHOLD)
+      // BBR does not cut its window on duplicate ACKs, the model drives cwnd
+      if (cc_state->algorithm == CC_BBR)
+      {
+        return;
+      }
+
+      // Check for fast retransmit threshold, unless loss detection
+      // already started recovery. Within recovery PRR sets cwnd.
+      if (cc_state->duplicate_acks == DUPLICATE_ACK_THRESHOLD &&
+          cc_state->state != FAST_RECOVERY)
       {
-        // Enter fast recovery
-        cc_state->ssthresh = cc_state->cwnd / 2;
-        if (cc_state->ssthresh < cc_state->mss)
-        {
-          cc_state->ssthresh = cc_state->mss;
-        }
-        cc_state->cwnd = cc_state->ssthresh + 3 * cc_state->mss;
-        cc_state->state = FAST_RECOVERY;
+        enter_recovery(cc_state, fc_state);
 
         printf("Fast retransmit triggered: cwnd=%u, ssthresh=%u, state=FAST_RECOVERY\n",
                cc_state->cwnd, cc_state->ssthresh);
       }
-      else if (cc_state->state == FAST_RECOVERY)
-      {
-        // Increase cwnd for each duplicate ACK in fast recovery
-        cc_state->cwnd += cc_state->mss;
-        printf("Fast recovery: increased cwnd to %u\n", cc_state->cwnd);
-      }
     }
     return;
   }
@@ -64,11 +102,29 @@ void update_congestion_window(congestion_control_state *cc_state,
 
   if (cc_state->state == FAST_RECOVERY)
   {
-    // Exit fast recovery
-    cc_state->cwnd = cc_state->ssthresh;
+    // Partial ACKs keep recovery going until all data outstanding at the
+    // loss is acknowledged
+    if (SEQ_LT(ack_num, cc_state->recovery_point))
+    {
+      return;
+    }
+
+    // Exit fast recovery, PRR has already brought the flight down to ssthresh
+    if (cc_state->algorithm == CC_RENO)
+    {
+      cc_state->cwnd = cc_state->ssthresh;
+    }
+    else if (cc_state->algorithm == CC_LEDBAT)
+    {
+      cc_state->cwnd = cc_state->ledbat.cwnd;
+    }
     cc_state->state = CONGESTION_AVOIDANCE;
     printf("Exiting fast recovery: cwnd=%u, state=CONGESTION_AVOIDANCE\n", cc_state->cwnd);
   }
+  else if (cc_state->algorithm != CC_RENO)
+  {
+    // BBR and LEDBAT set cwnd in on_rate_sample()
+  }
   else if (cc_state->state == SLOW_START)
   {
     // Exponential growth during slow start
@@ -98,6 +154,23 @@ void update_congestion_window(congestion_control_state *cc_state,
 // Handle packet loss (timeout)
 void handle_timeout(congestion_control_state *cc_state)
 {
+  if (cc_state->algorithm == CC_BBR)
+  {
+    bbr_on_timeout(&cc_state->bbr);
+    cc_state->cwnd = cc_state->bbr.cwnd;
+    cc_state->duplicate_acks = 0;
+    return;
+  }
+
+  if (cc_state->algorithm == CC_LEDBAT)
+  {
+    ledbat_on_timeout(&cc_state->ledbat);
+    cc_state->cwnd = cc_state->ledbat.cwnd;
+    cc_state->duplicate_acks = 0;
+    cc_state->state = CONGESTION_AVOIDANCE;
+    return;
+  }
+
   // Set ssthresh to half of cwnd (minimum 1 MSS)
   cc_state->ssthresh = cc_state->cwnd / 2;
   if (cc_state->ssthresh < cc_state->mss)
@@ -118,6 +191,242 @@ void handle_timeout(congestion_control_state *cc_state)
          cc_state->cwnd, cc_state->ssthresh);
 }
 
+// Handle packet loss detected before the timeout, once per recovery episode
+void handle_loss(congestion_control_state *cc_state, flow_control_state *fc_state)
+{
+  if (cc_state->state == FAST_RECOVERY)
+  {
+    return;
+  }
+
+  enter_recovery(cc_state, fc_state);
+
+  printf("Loss detected: cwnd=%u, ssthresh=%u, state=FAST_RECOVERY\n",
+         cc_state->cwnd, cc_state->ssthresh);
+}
+
+// React to an ECN echo (RFC 3168) as to a loss, but without a
+// retransmission and at most once per window of data
+int handle_ecn_echo(congestion_control_state *cc_state, flow_control_state *fc_state)
+{
+  // Loss recovery has already reduced the window for this round trip
+  if (cc_state->state == FAST_RECOVERY)
+  {
+    return 0;
+  }
+
+  if (cc_state->ecn_reacted &&
+      SEQ_LT(fc_state->last_ack_received, cc_state->ecn_recovery_point))
+  {
+    return 0;
+  }
+
+  cc_state->ecn_reacted = 1;
+  cc_state->ecn_recovery_point = fc_state->next_seq_num;
+
+  if (cc_state->algorithm == CC_LEDBAT)
+  {
+    ledbat_on_loss(&cc_state->ledbat);
+    cc_state->cwnd = cc_state->ledbat.cwnd;
+  }
+  else if (cc_state->algorithm == CC_RENO)
+  {
+    cc_state->ssthresh = cc_state->cwnd / 2;
+    if (cc_state->ssthresh < cc_state->mss)
+    {
+      cc_state->ssthresh = cc_state->mss;
+    }
+    cc_state->cwnd = cc_state->ssthresh;
+    cc_state->state = CONGESTION_AVOIDANCE;
+  }
+
+  // BBR does not react to ECN, the CWR still stops the echoes
+  printf("ECN echo: cwnd=%u, ssthresh=%u\n", cc_state->cwnd, cc_state->ssthresh);
+  return 1;
+}
+
+// Set cwnd during recovery (PRR-SSRB, RFC 6937). While the flight is above
+// ssthresh, send in proportion to what was delivered so the reduction is
+// spread over the recovery. Once below, regrow towards ssthresh at most one
+// MSS beyond what was delivered.
+void prr_on_ack(congestion_control_state *cc_state, uint32_t delivered, uint32_t pipe)
+{
+  if (cc_state->state != FAST_RECOVERY || cc_state->algorithm == CC_BBR)
+  {
+    return;
+  }
+
+  cc_state->prr_delivered += delivered;
+
+  int64_t sndcnt;
+  if (pipe > cc_state->ssthresh)
+  {
+    sndcnt = ((uint64_t)cc_state->prr_delivered * cc_state->ssthresh + cc_state->recover_fs - 1) /
+                 cc_state->recover_fs -
+             cc_state->prr_out;
+  }
+  else
+  {
+    int64_t limit = (int64_t)cc_state->prr_delivered - cc_state->prr_out;
+    if (limit < delivered)
+    {
+      limit = delivered;
+    }
+    limit += cc_state->mss;
+
+    sndcnt = (int64_t)cc_state->ssthresh - pipe;
+    if (sndcnt > limit)
+    {
+      sndcnt = limit;
+    }
+  }
+
+  if (sndcnt < 0)
+  {
+    sndcnt = 0;
+  }
+
+  // The first retransmission goes out regardless
+  if (cc_state->prr_out == 0 && sndcnt < cc_state->mss)
+  {
+    sndcnt = cc_state->mss;
+  }
+
+  uint32_t cwnd = pipe + sndcnt;
+  cc_state->cwnd = cwnd > SSTHRESH_INITIAL ? SSTHRESH_INITIAL : cwnd;
+
+  printf("PRR: delivered=%u, pipe=%u, prr_delivered=%u, prr_out=%u, cwnd=%u\n",
+         delivered, pipe, cc_state->prr_delivered, cc_state->prr_out, cc_state->cwnd);
+}
+
+// Account for bytes sent during recovery
+void prr_on_send(congestion_control_state *cc_state, uint32_t len)
+{
+  if (cc_state->state == FAST_RECOVERY)
+  {
+    cc_state->prr_out += len;
+  }
+}
+
+// Select the congestion control algorithm for a connection
+void set_congestion_algorithm(congestion_control_state *cc_state, int algorithm)
+{
+  cc_state->algorithm = algorithm;
+
+  if (algorithm == CC_BBR)
+  {
+    bbr_init(&cc_state->bbr, cc_state->mss);
+    cc_state->cwnd = cc_state->bbr.cwnd;
+    cc_state->pacing_rate = cc_state->bbr.pacing_rate;
+    printf("Congestion control algorithm set to BBR: cwnd=%u, pacing_rate=%llu B/s\n",
+           cc_state->cwnd, (unsigned long long)cc_state->pacing_rate);
+  }
+  else if (algorithm == CC_LEDBAT)
+  {
+    ledbat_init(&cc_state->ledbat, cc_state->mss);
+    cc_state->cwnd = cc_state->ledbat.cwnd;
+    cc_state->pacing_rate = 0;
+    printf("Congestion control algorithm set to LEDBAT: cwnd=%u, target=%u us\n",
+           cc_state->cwnd, cc_state->ledbat.target_us);
+  }
+  else
+  {
+    cc_state->pacing_rate = 0;
+    printf("Congestion control algorithm set to Reno: cwnd=%u\n", cc_state->cwnd);
+  }
+}
+
+// Start from the window a previous connection on the same path reached.
+// The path may have changed since, so only half of it is used right away
+// and slow start probes back up to the rest.
+void resume_congestion_control(congestion_control_state *cc_state, uint16_t cwnd,
+                               uint32_t srtt_us)
+{
+  if (cwnd / 2 > cc_state->cwnd)
+  {
+    cc_state->cwnd = cwnd / 2;
+  }
+  if (cwnd > cc_state->cwnd)
+  {
+    cc_state->ssthresh = cwnd;
+  }
+  cc_state->state = SLOW_START;
+
+  if (cc_state->algorithm == CC_LEDBAT)
+  {
+    cc_state->ledbat.cwnd = cc_state->cwnd;
+  }
+  update_pacing_rate(cc_state, srtt_us);
+
+  printf("Congestion control resumed: cwnd=%u, ssthresh=%u\n", cc_state->cwnd, cc_state->ssthresh);
+}
+
+// Feed a delivery rate sample to the active algorithm
+void on_rate_sample(congestion_control_state *cc_state,
+                    flow_control_state *fc_state,
+                    const rate_sample *rs)
+{
+  if (cc_state->algorithm == CC_BBR)
+  {
+    bbr_on_ack(&cc_state->bbr, rs);
+    cc_state->cwnd = cc_state->bbr.cwnd;
+    cc_state->pacing_rate = cc_state->bbr.pacing_rate;
+
+    printf("BBR %s: max_bw=%llu B/s, min_rtt=%u us, cwnd=%u, pacing_rate=%llu B/s\n",
+           bbr_mode_name(cc_state->bbr.mode), (unsigned long long)cc_state->bbr.max_bw,
+           cc_state->bbr.min_rtt_us, cc_state->cwnd, (unsigned long long)cc_state->pacing_rate);
+  }
+  else if (cc_state->algorithm == CC_LEDBAT && rs->has_delay)
+  {
+    // Only delay samples echoed by the receiver can drive LEDBAT
+    ledbat_on_ack(&cc_state->ledbat, rs->now_us, rs->delay_us, rs->acked,
+                  rs->in_flight + rs->acked);
+
+    // PRR owns cwnd until recovery ends
+    if (cc_state->state != FAST_RECOVERY)
+    {
+      cc_state->cwnd = cc_state->ledbat.cwnd;
+    }
+
+    printf("LEDBAT: queuing_delay=%u us, target=%u us, cwnd=%u\n",
+           cc_state->ledbat.queuing_delay_us, cc_state->ledbat.target_us, cc_state->cwnd);
+  }
+
+  if (cc_state->algorithm != CC_BBR)
+  {
+    update_pacing_rate(cc_state, fc_state->srtt_us);
+  }
+
+  apply_congestion_window(cc_state, fc_state);
+}
+
+// Recompute the pacing rate of window-based algorithms from cwnd and SRTT
+void update_pacing_rate(congestion_control_state *cc_state, uint32_t srtt_us)
+{
+  // BBR paces from its own bandwidth model
+  if (cc_state->algorithm == CC_BBR)
+  {
+    return;
+  }
+
+  // Without an RTT sample there is nothing to spread the window over
+  if (srtt_us == 0)
+  {
+    cc_state->pacing_rate = 0;
+    return;
+  }
+
+  uint32_t gain = cc_state->state == SLOW_START ? PACING_GAIN_SLOW_START
+                                                 : PACING_GAIN_CONGESTION_AVOIDANCE;
+  cc_state->pacing_rate = (uint64_t)cc_state->cwnd * gain / PACING_GAIN_UNIT * 1000000 / srtt_us;
+}
+
+// Get current pacing rate in bytes/sec, 0 if sends are not paced
+uint64_t get_pacing_rate(congestion_control_state *cc_state)
+{
+  return cc_state->pacing_rate;
+}
+
 // Get current congestion window size
 uint16_t get_congestion_window(congestion_control_state *cc_state)
 {
@@ -129,8 +438,10 @@ int can_send_data(congestion_control_state *cc_state,
                   flow_control_state *fc_state,
                   size_t data_size)
 {
-  // Calculate in-flight data
-  uint32_t in_flight = fc_state->next_seq_num - fc_state->last_ack_received;
+  // Calculate in-flight data, selectively acknowledged and lost segments
+  // have left the network
+  uint32_t in_flight = fc_state->next_seq_num - fc_state->last_ack_received -
+                       fc_state->sacked_bytes - fc_state->lost_bytes;
 
   // Check if there's enough space in the congestion window
   if (in_flight + data_size <= cc_state->cwnd)
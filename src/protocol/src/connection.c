@@ -0,0 +1,1274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "connection.h"
+#include "codec.h"
+#include "packet.h"
+
+// Name of a connection state for logging
+const char *ct_state_name(ct_state state)
+{
+  switch (state)
+  {
+  case CT_CLOSED:
+    return "CLOSED";
+  case CT_LISTEN:
+    return "LISTEN";
+  case CT_SYN_SENT:
+    return "SYN_SENT";
+  case CT_SYN_RECEIVED:
+    return "SYN_RECEIVED";
+  case CT_ESTABLISHED:
+    return "ESTABLISHED";
+  case CT_FIN_WAIT:
+    return "FIN_WAIT";
+  case CT_CLOSE_WAIT:
+    return "CLOSE_WAIT";
+  case CT_LAST_ACK:
+    return "LAST_ACK";
+  case CT_TIME_WAIT:
+    return "TIME_WAIT";
+  }
+  return "UNKNOWN";
+}
+
+static void send_token(ct_conn *conn);
+
+static void set_state(ct_conn *conn, ct_state state)
+{
+  if (conn->state == state)
+  {
+    return;
+  }
+
+  printf("Connection %s -> %s\n", ct_state_name(conn->state), ct_state_name(state));
+  conn->state = state;
+
+  // A fresh token once the handshake is done, and another with what was
+  // learned about the path when either side closes
+  if (conn->issues_tokens && state >= CT_ESTABLISHED && state <= CT_LAST_ACK)
+  {
+    send_token(conn);
+  }
+
+  if (conn->on_state_change != NULL)
+  {
+    conn->on_state_change(conn, conn->callback_arg);
+  }
+}
+
+// The connection is gone, remember why for ct_send() and ct_recv()
+static void fail(ct_conn *conn, int error)
+{
+  printf("Connection failed: %s\n", strerror(error));
+  conn->error = error;
+  conn->control_timeout_us = 0;
+  set_state(conn, CT_CLOSED);
+}
+
+// Bind the connection's socket and learn the local port, 0 in addr for any
+static int bind_socket(ct_conn *conn, const struct sockaddr_in *addr)
+{
+  struct sockaddr_in local = *addr;
+  socklen_t len = sizeof(local);
+
+  if (bind(conn->fc.socket_fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+      getsockname(conn->fc.socket_fd, (struct sockaddr *)&local, &len) < 0)
+  {
+    perror("bind(2) failed for connection");
+    return -1;
+  }
+
+  conn->fc.local_port = ntohs(local.sin_port);
+  return 0;
+}
+
+static int bind_any(ct_conn *conn)
+{
+  struct sockaddr_in any;
+  memset(&any, 0, sizeof(any));
+  any.sin_family = AF_INET;
+  any.sin_addr.s_addr = INADDR_ANY;
+  return bind_socket(conn, &any);
+}
+
+// Create an unconnected endpoint with its own non-blocking UDP socket. The
+// data stream starts after our SYN, and in-order data waits for ct_recv().
+ct_conn *ct_socket(void)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+  {
+    perror("socket(2)");
+    return NULL;
+  }
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0)
+  {
+    perror("fcntl(2) failed for connection");
+    close(fd);
+    return NULL;
+  }
+
+  ct_conn *conn = calloc(1, sizeof(ct_conn));
+  if (conn == NULL)
+  {
+    perror("calloc failed for connection");
+    close(fd);
+    return NULL;
+  }
+
+  struct sockaddr_in peer_addr;
+  memset(&peer_addr, 0, sizeof(peer_addr));
+
+  init_flow_control(&conn->fc, fd, &peer_addr, 0, 0);
+  conn->fc.rcv_queued = 1;
+  state_channel_init(&conn->states);
+  conn->iss = conn->fc.next_seq_num;
+  conn->fc.next_seq_num = conn->iss + 1;
+  flow_control_queue(&conn->fc, "", 0);
+
+  return conn;
+}
+
+// Bind the endpoint to a local address
+int ct_bind(ct_conn *conn, const struct sockaddr_in *addr)
+{
+  if (conn->state != CT_CLOSED || conn->fc.local_port != 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return bind_socket(conn, addr);
+}
+
+// Fill in the window and timestamps, then send a packet outside the data
+// stream
+static int send_unsequenced(ct_conn *conn, packet *pkt)
+{
+  pkt->source_port = conn->fc.local_port;
+  pkt->dest_port = conn->fc.remote_port;
+  pkt->window_size = conn->fc.rcv_window;
+  pkt->ts_val = (uint32_t)get_time_us();
+  pkt->ts_ecr = conn->fc.ts_recent;
+  pkt->checksum = calculate_checksum(pkt);
+
+  if (flow_control_send_packet(&conn->fc, pkt) < 0)
+  {
+    perror("sendto(2) failed for control packet");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Send a packet carrying control flags, and a payload outside the data
+// stream if len > 0
+static int send_control_payload(ct_conn *conn, uint8_t flags, uint32_t seq_num, uint32_t ack_num,
+                                const void *payload, size_t len)
+{
+  packet pkt;
+  memset(&pkt, 0, sizeof(packet));
+  pkt.seq_num = seq_num;
+  pkt.ack_num = ack_num;
+  pkt.data_offset = TIMESTAMP_DATA_OFFSET;
+  if (len > 0)
+  {
+    pkt.data_offset = STREAM_DATA_OFFSET;
+    pkt.payload_len = len;
+    memcpy(pkt.payload, payload, len);
+  }
+  pkt.flags = flags;
+
+  return send_unsequenced(conn, &pkt);
+}
+
+// Send a SYN or SYN-ACK, offering the features we want in the stream
+// option, and a token if len > 0
+static int send_syn(ct_conn *conn, uint8_t flags, uint32_t seq_num, uint32_t ack_num,
+                    const void *payload, size_t len)
+{
+  packet pkt;
+  memset(&pkt, 0, sizeof(packet));
+  pkt.seq_num = seq_num;
+  pkt.ack_num = ack_num;
+  pkt.data_offset = STREAM_DATA_OFFSET;
+  pkt.flags = flags;
+  int client = conn->state == CT_SYN_SENT;
+  if (client ? conn->compress_offered : conn->compress)
+  {
+    pkt.stream_id |= FEATURE_COMPRESS;
+    pkt.stream_offset = CODEC_DICT_VERSION;
+  }
+  if (client ? conn->compact_offered : conn->fc.compact.enabled)
+  {
+    pkt.stream_id |= FEATURE_COMPACT_HEADERS;
+  }
+  if (client ? conn->fec_offered : conn->fc.fec_enabled)
+  {
+    pkt.stream_id |= FEATURE_FEC;
+  }
+  pkt.payload_len = len;
+  if (len > 0)
+  {
+    memcpy(pkt.payload, payload, len);
+  }
+
+  return send_unsequenced(conn, &pkt);
+}
+
+// Send a state key's value, or with ACK acknowledge one
+static int send_state(ct_conn *conn, uint8_t flags, uint16_t key, uint32_t version,
+                      const void *value, size_t len)
+{
+  packet pkt;
+  memset(&pkt, 0, sizeof(packet));
+  pkt.seq_num = conn->fc.next_seq_num;
+  pkt.ack_num = conn->fc.rcv_nxt;
+  pkt.data_offset = STREAM_DATA_OFFSET;
+  pkt.flags = STATE | flags;
+  pkt.stream_id = key;
+  pkt.stream_offset = version;
+  pkt.payload_len = len;
+  if (len > 0)
+  {
+    memcpy(pkt.payload, value, len);
+  }
+
+  return send_unsequenced(conn, &pkt);
+}
+
+// How long a state value may go unacknowledged: the RTO from the RTT
+// estimate, or the handshake's timeout before there is one
+static uint64_t state_resend_us(ct_conn *conn)
+{
+  if (conn->fc.srtt_us == 0)
+  {
+    return CT_CONTROL_TIMEOUT_US;
+  }
+  return conn->fc.srtt_us + 4 * (uint64_t)conn->fc.rttvar_us;
+}
+
+// Send every state value that is due. A key has at most one value in
+// flight, so under congestion updates are conflated rather than queued.
+static void flush_state(ct_conn *conn, uint64_t now)
+{
+  uint64_t resend_us = state_resend_us(conn);
+  state_out *slot;
+  while ((slot = state_channel_due(&conn->states, now, resend_us)) != NULL)
+  {
+    if (send_state(conn, 0, slot->key, slot->version, slot->value, slot->len) < 0)
+    {
+      return;
+    }
+    state_channel_sent(slot, now);
+  }
+}
+
+// A state value or its acknowledgment from the peer
+static void handle_state(ct_conn *conn, packet *pkt)
+{
+  if (conn->state == CT_LISTEN || conn->state == CT_CLOSED)
+  {
+    return;
+  }
+
+  if (pkt->flags & ACK)
+  {
+    state_channel_on_ack(&conn->states, pkt->stream_id, pkt->stream_offset);
+    flush_state(conn, get_time_us());
+    return;
+  }
+
+  // Overtaken values are acknowledged too, so the peer stops sending them
+  if (state_channel_on_value(&conn->states, pkt->stream_id, pkt->stream_offset, pkt->payload,
+                             packet_payload_len(pkt)) >= 0)
+  {
+    send_state(conn, ACK, pkt->stream_id, pkt->stream_offset, NULL, 0);
+  }
+}
+
+// Send a packet without payload carrying control flags
+static int send_control(ct_conn *conn, uint8_t flags, uint32_t seq_num, uint32_t ack_num)
+{
+  return send_control_payload(conn, flags, seq_num, ack_num, NULL, 0);
+}
+
+// Issue the peer a token describing the path as we see it now
+static void send_token(ct_conn *conn)
+{
+  resume_params params;
+  params.mss = conn->fc.cc.mss;
+  params.window = conn->fc.receiver_window;
+  params.cwnd = conn->fc.cc.cwnd;
+  params.srtt_us = conn->fc.srtt_us;
+  params.rttvar_us = conn->fc.rttvar_us;
+
+  uint8_t token[RESUME_TOKEN_SIZE];
+  resume_token_issue(conn->token_key, conn->fc.peer_addr.sin_addr.s_addr, &params,
+                     get_time_us(), token);
+  printf("Issuing resumption token: cwnd=%u, srtt=%u us\n", params.cwnd, params.srtt_us);
+  send_control_payload(conn, TOKEN, conn->fc.next_seq_num, conn->fc.rcv_nxt, token,
+                       RESUME_TOKEN_SIZE);
+}
+
+// Send the SYN, SYN-ACK or FIN the current state is waiting to have acknowledged
+static int send_pending_control(ct_conn *conn)
+{
+  switch (conn->state)
+  {
+  case CT_SYN_SENT:
+    if (conn->resuming)
+    {
+      return send_syn(conn, SYN | TOKEN, conn->iss, 0, conn->resume_token, RESUME_TOKEN_SIZE);
+    }
+    return send_syn(conn, SYN, conn->iss, 0, NULL, 0);
+  case CT_SYN_RECEIVED:
+    return send_syn(conn, SYN | ACK, conn->iss, conn->irs + 1, NULL, 0);
+  case CT_FIN_WAIT:
+  case CT_LAST_ACK:
+    if (conn->fin_sent && !conn->fin_acked)
+    {
+      return send_control(conn, FIN | ACK, conn->fin_seq, conn->fc.rcv_nxt);
+    }
+    return 0;
+  default:
+    return 0;
+  }
+}
+
+static void arm_control_timer(ct_conn *conn, uint64_t now)
+{
+  conn->control_timeout_us = now + ((uint64_t)CT_CONTROL_TIMEOUT_US << conn->control_retries);
+}
+
+// A SYN or FIN went unanswered, or TIME_WAIT is over
+static void on_control_timeout(ct_conn *conn, uint64_t now)
+{
+  conn->control_timeout_us = 0;
+
+  if (conn->state == CT_TIME_WAIT)
+  {
+    set_state(conn, CT_CLOSED);
+    return;
+  }
+
+  conn->control_retries++;
+  if (conn->control_retries > CT_MAX_CONTROL_RETRIES)
+  {
+    fail(conn, ETIMEDOUT);
+    return;
+  }
+
+  printf("No answer in %s, retransmitting (%d/%d)\n", ct_state_name(conn->state),
+         conn->control_retries, CT_MAX_CONTROL_RETRIES);
+  send_pending_control(conn);
+  arm_control_timer(conn, now);
+}
+
+static void enter_time_wait(ct_conn *conn)
+{
+  set_state(conn, CT_TIME_WAIT);
+  conn->control_timeout_us = get_time_us() + CT_TIME_WAIT_US;
+}
+
+// Our FIN goes out once everything queued before it was acknowledged
+static void maybe_send_fin(ct_conn *conn)
+{
+  if ((conn->state != CT_FIN_WAIT && conn->state != CT_LAST_ACK) || conn->fin_sent ||
+      send_buffer_used(&conn->fc.sndbuf) > 0)
+  {
+    return;
+  }
+
+  conn->fin_seq = conn->fc.next_seq_num;
+  conn->fin_sent = 1;
+  conn->control_retries = 0;
+  printf("Sending FIN seq=%u\n", conn->fin_seq);
+  send_pending_control(conn);
+  arm_control_timer(conn, get_time_us());
+}
+
+static int same_syn(const ct_pending *syn, const struct sockaddr_in *addr, uint32_t seq)
+{
+  return syn->seq == seq && syn->addr.sin_port == addr->sin_port &&
+         syn->addr.sin_addr.s_addr == addr->sin_addr.s_addr;
+}
+
+// Hold a SYN for ct_accept(). Retransmitted SYNs are dropped, the accepted
+// connection retransmits its own SYN-ACK.
+static void queue_syn(ct_conn *listener, packet *pkt)
+{
+  const struct sockaddr_in *from = &listener->fc.peer_addr;
+
+  for (int i = 0; i < listener->backlog_count; i++)
+  {
+    if (same_syn(&listener->backlog[i], from, pkt->seq_num))
+    {
+      return;
+    }
+  }
+  for (int i = 0; i < CT_BACKLOG; i++)
+  {
+    if (same_syn(&listener->accepted[i], from, pkt->seq_num))
+    {
+      return;
+    }
+  }
+  if (listener->backlog_count == CT_BACKLOG)
+  {
+    printf("Backlog full, dropping SYN from port %u\n", pkt->source_port);
+    return;
+  }
+
+  ct_pending *syn = &listener->backlog[listener->backlog_count++];
+  syn->addr = *from;
+  syn->seq = pkt->seq_num;
+  syn->port = pkt->source_port;
+  syn->has_token = (pkt->flags & TOKEN) && packet_payload_len(pkt) == RESUME_TOKEN_SIZE;
+  if (syn->has_token)
+  {
+    memcpy(syn->token, pkt->payload, RESUME_TOKEN_SIZE);
+  }
+  syn->early_count = 0;
+  syn->features = 0;
+  syn->dict_version = 0;
+  if (pkt->data_offset >= STREAM_DATA_OFFSET)
+  {
+    syn->features = pkt->stream_id;
+    syn->dict_version = pkt->stream_offset;
+  }
+}
+
+// Hold data that followed a SYN with a token until ct_accept() decides
+// whether the token is good
+static void queue_early_data(ct_conn *listener, packet *pkt)
+{
+  const struct sockaddr_in *from = &listener->fc.peer_addr;
+
+  for (int i = 0; i < listener->backlog_count; i++)
+  {
+    ct_pending *syn = &listener->backlog[i];
+    if (syn->has_token && syn->addr.sin_port == from->sin_port &&
+        syn->addr.sin_addr.s_addr == from->sin_addr.s_addr)
+    {
+      if (syn->early_count < RESUME_EARLY_SEGMENTS)
+      {
+        syn->early[syn->early_count++] = *pkt;
+      }
+      return;
+    }
+  }
+}
+
+// Run the state machine for one packet from the peer
+static void handle_packet(ct_conn *conn, packet *pkt, int congestion_experienced)
+{
+  if (pkt->flags & STATE)
+  {
+    handle_state(conn, pkt);
+    return;
+  }
+
+  // A token the server issued, outside the data stream
+  if ((pkt->flags & TOKEN) && !(pkt->flags & SYN))
+  {
+    if (!conn->issues_tokens && packet_payload_len(pkt) == RESUME_TOKEN_SIZE)
+    {
+      memcpy(conn->token, pkt->payload, RESUME_TOKEN_SIZE);
+      conn->has_token = 1;
+    }
+    return;
+  }
+
+  switch (conn->state)
+  {
+  case CT_LISTEN:
+    if ((pkt->flags & SYN) && !(pkt->flags & ACK))
+    {
+      queue_syn(conn, pkt);
+    }
+    else if (!(pkt->flags & SYN) && packet_payload_len(pkt) > 0)
+    {
+      queue_early_data(conn, pkt);
+    }
+    return;
+
+  case CT_SYN_SENT:
+    if ((pkt->flags & SYN) && (pkt->flags & ACK) && pkt->ack_num == conn->iss + 1)
+    {
+      conn->irs = pkt->seq_num;
+      conn->fc.rcv_nxt = conn->irs + 1;
+      conn->fc.remote_port = pkt->source_port;
+      conn->control_timeout_us = 0;
+      conn->control_retries = 0;
+      conn->compress = conn->compress_offered && pkt->data_offset >= STREAM_DATA_OFFSET &&
+                       (pkt->stream_id & FEATURE_COMPRESS) &&
+                       pkt->stream_offset == CODEC_DICT_VERSION;
+      // The server decodes compact headers once it sent the SYN-ACK, and
+      // knows us by its initial sequence number
+      if (conn->compact_offered && pkt->data_offset >= STREAM_DATA_OFFSET &&
+          (pkt->stream_id & FEATURE_COMPACT_HEADERS))
+      {
+        compact_init(&conn->fc.compact, conn->irs, conn->fc.local_port, conn->fc.remote_port);
+        compact_start_sending(&conn->fc.compact);
+      }
+      conn->fc.fec_enabled = conn->fec_offered && pkt->data_offset >= STREAM_DATA_OFFSET &&
+                             (pkt->stream_id & FEATURE_FEC);
+      send_control(conn, ACK, conn->iss + 1, conn->fc.rcv_nxt);
+      set_state(conn, CT_ESTABLISHED);
+    }
+    return;
+
+  case CT_SYN_RECEIVED:
+    if (pkt->flags & SYN)
+    {
+      // Our SYN-ACK was lost
+      send_pending_control(conn);
+      return;
+    }
+    // The final ACK, or data sent after it if the ACK was lost. Only now
+    // is the client sure to decode compact headers.
+    if (((pkt->flags & ACK) && pkt->ack_num == conn->iss + 1) || (pkt->flags & PSH))
+    {
+      conn->control_timeout_us = 0;
+      conn->control_retries = 0;
+      compact_start_sending(&conn->fc.compact);
+      set_state(conn, CT_ESTABLISHED);
+    }
+    break;
+
+  case CT_CLOSED:
+    return;
+
+  default:
+    // The peer did not get the final ACK of the handshake
+    if ((pkt->flags & SYN) && (pkt->flags & ACK))
+    {
+      send_control(conn, ACK, conn->iss + 1, conn->fc.rcv_nxt);
+      return;
+    }
+    break;
+  }
+
+  // Parity rebuilds data, it acknowledges nothing
+  if (pkt->reserved & FEC_PARITY)
+  {
+    if (!conn->fin_received)
+    {
+      flow_control_on_parity(&conn->fc, pkt);
+    }
+    return;
+  }
+
+  if (packet_payload_len(pkt) > 0 && !conn->fin_received)
+  {
+    flow_control_on_data(&conn->fc, pkt, congestion_experienced, NULL, 0, NULL);
+  }
+
+  int acks_fin = conn->fin_sent && (pkt->flags & ACK) && pkt->ack_num == conn->fin_seq + 1;
+  if (acks_fin && !conn->fin_acked)
+  {
+    conn->fin_acked = 1;
+    conn->control_timeout_us = 0;
+  }
+  else if ((pkt->flags & ACK) && !acks_fin)
+  {
+    flow_control_on_ack(&conn->fc, pkt);
+  }
+
+  // Only a FIN following all of the peer's data closes its direction. A
+  // peer that answers our FIN with FIN-ACK has nothing more to send either.
+  if ((pkt->flags & FIN) && (pkt->seq_num == conn->fc.rcv_nxt || acks_fin))
+  {
+    send_control(conn, ACK, conn->fin_sent ? conn->fin_seq + 1 : conn->fc.next_seq_num,
+                 pkt->seq_num + 1);
+    if (!conn->fin_received)
+    {
+      printf("Peer closed its direction\n");
+      conn->fin_received = 1;
+      if (conn->state == CT_ESTABLISHED)
+      {
+        set_state(conn, CT_CLOSE_WAIT);
+      }
+      else if (conn->state == CT_FIN_WAIT && !conn->fin_sent)
+      {
+        // Both sides closed, our FIN is still waiting for data to drain
+        set_state(conn, CT_LAST_ACK);
+      }
+    }
+  }
+
+  if (conn->fin_acked && conn->fin_received && conn->state == CT_FIN_WAIT)
+  {
+    enter_time_wait(conn);
+  }
+  else if (conn->fin_acked && conn->state == CT_LAST_ACK)
+  {
+    set_state(conn, CT_CLOSED);
+  }
+}
+
+// States in which the data stream is running. With a token it starts
+// before the handshake completes.
+static int data_state(ct_conn *conn)
+{
+  return conn->state == CT_ESTABLISHED || conn->state == CT_CLOSE_WAIT ||
+         conn->state == CT_FIN_WAIT || conn->state == CT_LAST_ACK ||
+         (conn->state == CT_SYN_SENT && conn->resuming) ||
+         (conn->state == CT_SYN_RECEIVED && conn->resumed);
+}
+
+// Open a connection to addr
+int ct_connect(ct_conn *conn, const struct sockaddr_in *addr)
+{
+  if (conn->state != CT_CLOSED || conn->error != 0)
+  {
+    errno = conn->state == CT_CLOSED ? conn->error : EISCONN;
+    return -1;
+  }
+  if (conn->fc.local_port == 0 && bind_any(conn) < 0)
+  {
+    return -1;
+  }
+
+  conn->fc.peer_addr = *addr;
+  conn->fc.remote_port = ntohs(addr->sin_port);
+  set_state(conn, CT_SYN_SENT);
+  printf("Connecting to port %u, SYN seq=%u\n", conn->fc.remote_port, conn->iss);
+  send_pending_control(conn);
+  arm_control_timer(conn, get_time_us());
+  return 0;
+}
+
+// Open a connection to addr presenting a resumption token, data queued
+// right away follows the SYN
+int ct_connect_token(ct_conn *conn, const struct sockaddr_in *addr, const void *token, size_t len)
+{
+  if (len != RESUME_TOKEN_SIZE)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  if (conn->state != CT_CLOSED || conn->error != 0)
+  {
+    errno = conn->state == CT_CLOSED ? conn->error : EISCONN;
+    return -1;
+  }
+
+  memcpy(conn->resume_token, token, RESUME_TOKEN_SIZE);
+  conn->resuming = 1;
+  return ct_connect(conn, addr);
+}
+
+// Offer message compression in the handshake
+int ct_set_compression(ct_conn *conn, int enable)
+{
+  if (conn->state != CT_CLOSED)
+  {
+    errno = EISCONN;
+    return -1;
+  }
+
+  conn->compress_offered = enable != 0;
+  return 0;
+}
+
+// Whether the handshake agreed to compress messages
+int ct_compressed(ct_conn *conn)
+{
+  return conn->compress;
+}
+
+// Offer compact headers in the handshake
+int ct_set_compact_headers(ct_conn *conn, int enable)
+{
+  if (conn->state != CT_CLOSED)
+  {
+    errno = EISCONN;
+    return -1;
+  }
+
+  conn->compact_offered = enable != 0;
+  return 0;
+}
+
+// Offer forward error correction in the handshake
+int ct_set_fec(ct_conn *conn, int enable)
+{
+  if (conn->state != CT_CLOSED)
+  {
+    errno = EISCONN;
+    return -1;
+  }
+
+  conn->fec_offered = enable != 0;
+  return 0;
+}
+
+// Accept incoming connections on a bound endpoint
+int ct_listen(ct_conn *conn)
+{
+  if (conn->state != CT_CLOSED || conn->fc.local_port == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  printf("Listening on port %u\n", conn->fc.local_port);
+  resume_issuer_init(&conn->resume);
+  set_state(conn, CT_LISTEN);
+  return 0;
+}
+
+// Take the next pending connection from a listening endpoint. Answering
+// from a fresh socket moves the peer off the listening port, it sends to
+// wherever the SYN-ACK came from.
+ct_conn *ct_accept(ct_conn *listener)
+{
+  if (listener->state != CT_LISTEN)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (listener->backlog_count == 0)
+  {
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  ct_conn *conn = ct_socket();
+  if (conn == NULL || bind_any(conn) < 0)
+  {
+    ct_free(conn);
+    return NULL;
+  }
+
+  ct_pending syn = listener->backlog[0];
+  listener->backlog_count--;
+  memmove(&listener->backlog[0], &listener->backlog[1],
+          listener->backlog_count * sizeof(ct_pending));
+  listener->accepted[listener->accepted_next] = syn;
+  listener->accepted_next = (listener->accepted_next + 1) % CT_BACKLOG;
+
+  conn->fc.peer_addr = syn.addr;
+  conn->fc.remote_port = syn.port;
+  conn->irs = syn.seq;
+  conn->fc.rcv_nxt = conn->irs + 1;
+  memcpy(conn->token_key, listener->resume.key, RESUME_KEY_SIZE);
+  conn->issues_tokens = 1;
+
+  // The SYN-ACK tells the client whether we took its offer
+  conn->compress_offered = listener->compress_offered;
+  conn->compress = conn->compress_offered && (syn.features & FEATURE_COMPRESS) &&
+                   syn.dict_version == CODEC_DICT_VERSION;
+  conn->compact_offered = listener->compact_offered;
+  if (conn->compact_offered && (syn.features & FEATURE_COMPACT_HEADERS))
+  {
+    compact_init(&conn->fc.compact, conn->iss, conn->fc.local_port, syn.port);
+  }
+  conn->fec_offered = listener->fec_offered;
+  conn->fc.fec_enabled = conn->fec_offered && (syn.features & FEATURE_FEC);
+
+  // A valid token lets the connection pick up where the client's last one
+  // left off, the path was measured already
+  resume_params params;
+  if (syn.has_token &&
+      resume_token_redeem(&listener->resume, syn.addr.sin_addr.s_addr, syn.token, get_time_us(),
+                          &params) == 0 &&
+      params.mss == conn->fc.cc.mss)
+  {
+    conn->resumed = 1;
+    conn->fc.srtt_us = params.srtt_us;
+    conn->fc.rttvar_us = params.rttvar_us;
+    if (params.window > 0)
+    {
+      conn->fc.receiver_window = params.window;
+    }
+    resume_congestion_control(&conn->fc.cc, params.cwnd, params.srtt_us);
+  }
+  else if (syn.has_token)
+  {
+    printf("Refusing resumption token from port %u, %d early segments dropped\n", syn.port,
+           syn.early_count);
+  }
+
+  set_state(conn, CT_SYN_RECEIVED);
+  printf("Accepted %s%sconnection from port %u on port %u\n", conn->resumed ? "resumed " : "",
+         conn->compress ? "compressed " : "", syn.port, conn->fc.local_port);
+  send_pending_control(conn);
+  arm_control_timer(conn, get_time_us());
+
+  // The SYN-ACK stays armed for retransmission while the early data is
+  // delivered and acknowledged
+  for (int i = 0; conn->resumed && i < syn.early_count; i++)
+  {
+    if (flow_control_on_data(&conn->fc, &syn.early[i], 0, NULL, 0, NULL) < 0)
+    {
+      fail(conn, errno);
+      break;
+    }
+  }
+
+  return conn;
+}
+
+// Queue data for sending on the default stream
+ssize_t ct_send(ct_conn *conn, const void *data, size_t len)
+{
+  return ct_send_stream(conn, 0, data, len);
+}
+
+// Whether data may be queued, sets errno if not
+static int can_queue(ct_conn *conn, uint16_t stream_id)
+{
+  if (stream_id >= MAX_STREAMS)
+  {
+    errno = EINVAL;
+    return 0;
+  }
+
+  int open = conn->state == CT_ESTABLISHED || conn->state == CT_CLOSE_WAIT ||
+             (conn->state == CT_SYN_SENT && conn->resuming) ||
+             (conn->state == CT_SYN_RECEIVED && conn->resumed);
+  if (!open || conn->close_requested)
+  {
+    if (conn->error != 0)
+    {
+      errno = conn->error;
+    }
+    else
+    {
+      errno = conn->state < CT_ESTABLISHED && conn->state != CT_CLOSED ? ENOTCONN : EPIPE;
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+// Whatever the windows allow leaves right away
+static int transmit(ct_conn *conn)
+{
+  if (flow_control_transmit(&conn->fc) < 0)
+  {
+    fail(conn, errno);
+    return -1;
+  }
+
+  return 0;
+}
+
+// Queue data for sending on stream_id
+ssize_t ct_send_stream(ct_conn *conn, uint16_t stream_id, const void *data, size_t len)
+{
+  if (!can_queue(conn, stream_id))
+  {
+    return -1;
+  }
+
+  size_t queued = flow_control_queue_stream(&conn->fc, stream_id, data, len);
+  if (queued == 0 && len > 0)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (transmit(conn) < 0)
+  {
+    return -1;
+  }
+
+  return queued;
+}
+
+// Queue one message on stream_id, all of it or nothing
+ssize_t ct_send_message(ct_conn *conn, uint16_t stream_id, const void *data, size_t len)
+{
+  if (!can_queue(conn, stream_id))
+  {
+    return -1;
+  }
+  if (len > FRAME_MAX_MESSAGE)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  // A compressed message goes out as one frame if it came out smaller
+  if (conn->compress)
+  {
+    char frame[FRAME_COMPRESSED_HEADER_SIZE + FRAME_MAX_MESSAGE];
+    size_t frame_len = frame_encode_compressed(data, len, frame, sizeof(frame));
+    if (frame_len > 0)
+    {
+      if (send_buffer_space(&conn->fc.sndbuf) < frame_len ||
+          flow_control_queue_stream(&conn->fc, stream_id, frame, frame_len) == 0)
+      {
+        errno = EAGAIN;
+        return -1;
+      }
+      if (transmit(conn) < 0)
+      {
+        return -1;
+      }
+      return len;
+    }
+  }
+
+  // The body extends the header's run in the stream map, so once the
+  // header is queued the body is too
+  char header[FRAME_HEADER_SIZE];
+  frame_encode_header(len, header);
+  if (send_buffer_space(&conn->fc.sndbuf) < FRAME_HEADER_SIZE + len ||
+      flow_control_queue_stream(&conn->fc, stream_id, header, FRAME_HEADER_SIZE) == 0)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  flow_control_queue_stream(&conn->fc, stream_id, data, len);
+
+  if (transmit(conn) < 0)
+  {
+    return -1;
+  }
+
+  return len;
+}
+
+// Set the latest value of a state key
+int ct_send_state(ct_conn *conn, uint16_t key, const void *data, size_t len)
+{
+  // Values set during the handshake go out once it completes
+  int open = conn->state == CT_SYN_SENT || conn->state == CT_SYN_RECEIVED ||
+             conn->state == CT_ESTABLISHED || conn->state == CT_CLOSE_WAIT;
+  if (!open || conn->close_requested)
+  {
+    if (conn->error != 0)
+    {
+      errno = conn->error;
+    }
+    else
+    {
+      errno = conn->state == CT_CLOSED && !conn->close_requested ? ENOTCONN : EPIPE;
+    }
+    return -1;
+  }
+
+  if (state_channel_set(&conn->states, key, data, len) < 0)
+  {
+    return -1;
+  }
+  if (data_state(conn))
+  {
+    flush_state(conn, get_time_us());
+  }
+  return 0;
+}
+
+// Copy the latest value of a state key that changed
+ssize_t ct_recv_state(ct_conn *conn, uint16_t *key, void *buffer, size_t len)
+{
+  return state_channel_take(&conn->states, key, buffer, len);
+}
+
+// Read received data from the default stream
+ssize_t ct_recv(ct_conn *conn, void *buffer, size_t len)
+{
+  return ct_recv_stream(conn, 0, buffer, len);
+}
+
+// Read received data from stream_id
+ssize_t ct_recv_stream(ct_conn *conn, uint16_t stream_id, void *buffer, size_t len)
+{
+  if (stream_id >= MAX_STREAMS)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int copied = flow_control_read_stream(&conn->fc, stream_id, buffer, len);
+  if (copied != 0)
+  {
+    return copied;
+  }
+
+  if (conn->fin_received || (conn->state == CT_CLOSED && conn->error == 0))
+  {
+    return 0;
+  }
+
+  errno = conn->error != 0 ? conn->error : EAGAIN;
+  return -1;
+}
+
+// Take up to max complete messages received on stream_id
+int ct_recv_messages(ct_conn *conn, uint16_t stream_id, ct_message *msgs, int max)
+{
+  if (stream_id >= MAX_STREAMS)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  frame_decoder *dec = conn->decoders[stream_id];
+  if (dec == NULL)
+  {
+    dec = conn->decoders[stream_id] = malloc(sizeof(frame_decoder));
+    if (dec == NULL)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+    frame_decoder_init(dec);
+  }
+
+  // Received data goes straight into the decoder, messages are handed out
+  // where they lie
+  size_t space;
+  char *in = frame_decoder_space(dec, &space);
+  int copied = flow_control_read_stream(&conn->fc, stream_id, in, space);
+  if (copied > 0)
+  {
+    frame_decoder_commit(dec, copied);
+  }
+
+  int count = 0;
+  int result = 1;
+  while (count < max)
+  {
+    const char *msg;
+    uint32_t msg_len;
+    result = frame_decoder_next(dec, &msg, &msg_len);
+    if (result <= 0)
+    {
+      break;
+    }
+    msgs[count].data = msg;
+    msgs[count].len = msg_len;
+    count++;
+  }
+
+  if (count > 0)
+  {
+    return count;
+  }
+  if (result < 0)
+  {
+    errno = EBADMSG;
+    return -1;
+  }
+  if (frame_decoder_pending(dec) == 0 &&
+      (conn->fin_received || (conn->state == CT_CLOSED && conn->error == 0)))
+  {
+    return 0;
+  }
+
+  errno = conn->error != 0 ? conn->error : EAGAIN;
+  return -1;
+}
+
+// Close our direction once queued data has been delivered
+void ct_close(ct_conn *conn)
+{
+  conn->close_requested = 1;
+
+  switch (conn->state)
+  {
+  case CT_ESTABLISHED:
+    set_state(conn, CT_FIN_WAIT);
+    break;
+  case CT_CLOSE_WAIT:
+    set_state(conn, CT_LAST_ACK);
+    break;
+  case CT_LISTEN:
+  case CT_SYN_SENT:
+  case CT_SYN_RECEIVED:
+    conn->control_timeout_us = 0;
+    set_state(conn, CT_CLOSED);
+    return;
+  default:
+    return;
+  }
+
+  maybe_send_fin(conn);
+}
+
+// Release the connection and its socket
+void ct_free(ct_conn *conn)
+{
+  if (conn == NULL)
+  {
+    return;
+  }
+
+  release_flow_control(&conn->fc);
+  close(conn->fc.socket_fd);
+  for (int i = 0; i < MAX_STREAMS; i++)
+  {
+    free(conn->decoders[i]);
+  }
+  free(conn);
+}
+
+// Handle incoming packets and expired timers, send what can be sent and
+// run the callbacks
+int ct_process(ct_conn *conn)
+{
+  packet pkt;
+  int congestion_experienced;
+
+  // Drain the socket
+  while (conn->state != CT_CLOSED)
+  {
+    if (receive_flow_control_packet(&conn->fc, &pkt, &congestion_experienced) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        fail(conn, errno);
+      }
+      break;
+    }
+
+    uint16_t received_checksum = pkt.checksum;
+    pkt.checksum = 0;
+    if (calculate_checksum(&pkt) != received_checksum)
+    {
+      printf("Checksum verification failed. Packet might be corrupted.\n");
+      continue;
+    }
+
+    handle_packet(conn, &pkt, congestion_experienced);
+  }
+
+  uint64_t now = get_time_us();
+  if (conn->control_timeout_us != 0 && now >= conn->control_timeout_us)
+  {
+    on_control_timeout(conn, now);
+  }
+
+  if (data_state(conn))
+  {
+    if (flow_control_on_timer(&conn->fc, now) < 0)
+    {
+      fail(conn, ETIMEDOUT);
+    }
+    else if (flow_control_transmit(&conn->fc) < 0)
+    {
+      fail(conn, errno);
+    }
+    maybe_send_fin(conn);
+    flush_state(conn, now);
+  }
+
+  if (conn->on_readable != NULL &&
+      (flow_control_next_stream(&conn->fc) >= 0 || conn->fin_received || conn->error != 0 ||
+       conn->backlog_count > 0 || state_channel_readable(&conn->states)))
+  {
+    conn->on_readable(conn, conn->callback_arg);
+  }
+  if (conn->on_writable != NULL && !conn->close_requested &&
+      (conn->state == CT_ESTABLISHED || conn->state == CT_CLOSE_WAIT) &&
+      send_buffer_space(&conn->fc.sndbuf) > 0)
+  {
+    conn->on_writable(conn, conn->callback_arg);
+  }
+
+  return conn->error != 0 ? -1 : 0;
+}
+
+// Descriptor to poll for readability
+int ct_fd(ct_conn *conn)
+{
+  return conn->fc.socket_fd;
+}
+
+// Milliseconds until ct_process() must run even without incoming packets
+int ct_timeout(ct_conn *conn)
+{
+  uint64_t wake = conn->control_timeout_us;
+
+  if (data_state(conn))
+  {
+    uint64_t timer = flow_control_next_timer(&conn->fc);
+    if (timer != 0 && (wake == 0 || timer < wake))
+    {
+      wake = timer;
+    }
+    timer = state_channel_next_timer(&conn->states, state_resend_us(conn));
+    if (timer != 0 && (wake == 0 || timer < wake))
+    {
+      wake = timer;
+    }
+  }
+
+  if (wake == 0)
+  {
+    return -1;
+  }
+
+  uint64_t now = get_time_us();
+  return wake > now ? (int)((wake - now + 999) / 1000) : 0;
+}
+
+// A stream with data to read, -1 if none
+int ct_next_stream(ct_conn *conn)
+{
+  return flow_control_next_stream(&conn->fc);
+}
+
+// Copy the latest token the server issued on this connection
+ssize_t ct_get_token(ct_conn *conn, void *buffer, size_t len)
+{
+  if (!conn->has_token)
+  {
+    errno = ENOENT;
+    return -1;
+  }
+  if (len < RESUME_TOKEN_SIZE)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memcpy(buffer, conn->token, RESUME_TOKEN_SIZE);
+  return RESUME_TOKEN_SIZE;
+}
+
+// Whether an accepted connection was resumed from a valid token
+int ct_resumed(ct_conn *conn)
+{
+  return conn->resumed;
+}
+
+// Current state
+ct_state ct_get_state(ct_conn *conn)
+{
+  return conn->state;
+}
+
+// errno value the connection failed with, 0 if none
+int ct_get_error(ct_conn *conn)
+{
+  return conn->error;
+}
+
+// Set the readiness callbacks
+void ct_set_callbacks(ct_conn *conn, ct_callback on_readable, ct_callback on_writable,
+                      ct_callback on_state_change, void *arg)
+{
+  conn->on_readable = on_readable;
+  conn->on_writable = on_writable;
+  conn->on_state_change = on_state_change;
+  conn->callback_arg = arg;
+}
@@ -0,0 +1,173 @@
+#include <string.h>
+
+#include "drr.h"
+
+// Initialize a scheduler with no active flows
+void drr_init(drr_sched *sched)
+{
+  memset(sched, 0, sizeof(drr_sched));
+  drr_set_class_weight(sched, DRR_CONTROL, DRR_CONTROL_WEIGHT);
+  drr_set_class_weight(sched, DRR_INTERACTIVE, DRR_INTERACTIVE_WEIGHT);
+  drr_set_class_weight(sched, DRR_BULK, DRR_BULK_WEIGHT);
+}
+
+// Set a class's weight
+void drr_set_class_weight(drr_sched *sched, int cls, uint32_t weight)
+{
+  sched->classes[cls].quantum = (weight > 0 ? weight : 1) * DRR_QUANTUM;
+}
+
+// Initialize an inactive flow
+void drr_flow_init(drr_flow *flow, int cls, uint32_t weight)
+{
+  memset(flow, 0, sizeof(drr_flow));
+  flow->quantum = (weight > 0 ? weight : 1) * DRR_QUANTUM;
+  flow->cls = cls;
+}
+
+static void append(drr_queue *queue, drr_flow *flow)
+{
+  flow->prev = queue->tail;
+  flow->next = NULL;
+  if (queue->tail != NULL)
+  {
+    queue->tail->next = flow;
+  }
+  else
+  {
+    queue->head = flow;
+  }
+  queue->tail = flow;
+}
+
+static void unlink_flow(drr_queue *queue, drr_flow *flow)
+{
+  if (flow->prev != NULL)
+  {
+    flow->prev->next = flow->next;
+  }
+  else
+  {
+    queue->head = flow->next;
+  }
+  if (flow->next != NULL)
+  {
+    flow->next->prev = flow->prev;
+  }
+  else
+  {
+    queue->tail = flow->prev;
+  }
+  flow->prev = NULL;
+  flow->next = NULL;
+}
+
+// Queue a flow behind the active flows of its class
+void drr_activate(drr_sched *sched, drr_flow *flow)
+{
+  if (flow->active)
+  {
+    return;
+  }
+
+  append(&sched->classes[flow->cls], flow);
+  sched->classes[flow->cls].count++;
+  sched->active++;
+  flow->active = 1;
+}
+
+// Take a flow out of the scheduler
+void drr_remove(drr_sched *sched, drr_flow *flow)
+{
+  if (!flow->active)
+  {
+    return;
+  }
+
+  // Credit is not saved up while idle, or a flow could send in bursts
+  // that shut the others out. Overdrafts are repaid on its next turns.
+  drr_queue *queue = &sched->classes[flow->cls];
+  unlink_flow(queue, flow);
+  queue->count--;
+  sched->active--;
+  flow->active = 0;
+  if (flow->deficit > 0)
+  {
+    flow->deficit = 0;
+  }
+  if (queue->count == 0 && queue->deficit > 0)
+  {
+    queue->deficit = 0;
+  }
+}
+
+// Move a flow to another class
+void drr_set_class(drr_sched *sched, drr_flow *flow, int cls)
+{
+  if (flow->cls == cls)
+  {
+    return;
+  }
+
+  int active = flow->active;
+  drr_remove(sched, flow);
+  flow->cls = cls;
+  if (active)
+  {
+    drr_activate(sched, flow);
+  }
+}
+
+// The flow that sends next. A class or flow whose credit is used up gets
+// its quantum for the next turn and passes the turn on. Credit is only
+// added once as much was charged, so over many decisions the loop runs a
+// bounded number of times per decision as long as messages are no larger
+// than a few quanta.
+drr_flow *drr_next(drr_sched *sched)
+{
+  if (sched->active == 0)
+  {
+    return NULL;
+  }
+
+  for (;;)
+  {
+    drr_queue *queue = &sched->classes[sched->current];
+    if (queue->count == 0)
+    {
+      sched->current = (sched->current + 1) % DRR_CLASSES;
+      continue;
+    }
+    if (queue->deficit <= 0)
+    {
+      queue->deficit += queue->quantum;
+      sched->current = (sched->current + 1) % DRR_CLASSES;
+      continue;
+    }
+
+    drr_flow *flow = queue->head;
+    if (flow->deficit <= 0)
+    {
+      flow->deficit += flow->quantum;
+      if (queue->count > 1)
+      {
+        unlink_flow(queue, flow);
+        append(queue, flow);
+      }
+      continue;
+    }
+
+    sched->decisions++;
+    return flow;
+  }
+}
+
+// Charge a flow what it sent, against its class too
+void drr_charge(drr_sched *sched, drr_flow *flow, size_t len)
+{
+  drr_queue *queue = &sched->classes[flow->cls];
+  flow->deficit -= (int64_t)len;
+  queue->deficit -= (int64_t)len;
+  queue->bytes += len;
+  queue->sends++;
+}
@@ -0,0 +1,491 @@
+#include <string.h>
+
+#include "fec.h"
+#include "gf256.h"
+
+// Loss rates at which the block shape changes, of FEC_LOSS_ONE
+#define FEC_XOR_LOSS 328       // 0.5%: one XOR segment per 8
+#define FEC_SMALL_XOR_LOSS 1311 // 2%: one XOR segment per 4
+#define FEC_RS_LOSS 3277       // 5%: four Reed-Solomon segments per 16
+#define FEC_HEAVY_LOSS 6554    // 10%: four Reed-Solomon segments per 8
+
+static int in_range(uint32_t seq, uint32_t first, uint32_t end)
+{
+  return (int32_t)(seq - first) >= 0 && (int32_t)(end - seq) > 0;
+}
+
+// A segment's payload, length and stream option as one symbol
+static void make_symbol(const packet *pkt, size_t len, uint8_t *symbol)
+{
+  memset(symbol, 0, FEC_SYMBOL_SIZE);
+  memcpy(symbol, pkt->payload, len);
+  uint8_t *meta = symbol + MAX_PAYLOAD_SIZE;
+  meta[0] = len;
+  meta[1] = pkt->stream_id >> 8;
+  meta[2] = pkt->stream_id & 0xff;
+  meta[3] = pkt->stream_offset >> 24;
+  meta[4] = pkt->stream_offset >> 16;
+  meta[5] = pkt->stream_offset >> 8;
+  meta[6] = pkt->stream_offset & 0xff;
+}
+
+void fec_encoder_init(fec_encoder *enc)
+{
+  memset(enc, 0, sizeof(fec_encoder));
+}
+
+// Account for a new segment sent
+void fec_on_sent(fec_encoder *enc)
+{
+  enc->loss_rate -= enc->loss_rate >> FEC_LOSS_SHIFT;
+}
+
+// Account for lost segments
+void fec_on_lost(fec_encoder *enc, int count)
+{
+  enc->loss_rate += count * (FEC_LOSS_ONE >> FEC_LOSS_SHIFT);
+  if (enc->loss_rate > FEC_LOSS_ONE)
+  {
+    enc->loss_rate = FEC_LOSS_ONE;
+  }
+}
+
+// The peer's count of rebuilt segments. ACKs may arrive out of order, so
+// a count that went backwards is stale.
+void fec_on_recovered(fec_encoder *enc, uint16_t recovered)
+{
+  uint16_t count = recovered - enc->peer_recovered;
+  if (count == 0 || count >= 0x8000)
+  {
+    return;
+  }
+  enc->peer_recovered = recovered;
+  fec_on_lost(enc, count);
+}
+
+// Data and parity segments per block at a loss rate, none below FEC_XOR_LOSS
+static void block_shape(uint32_t loss_rate, int *data_count, int *parity_count)
+{
+  *data_count = 0;
+  *parity_count = 0;
+  if (loss_rate >= FEC_HEAVY_LOSS)
+  {
+    *data_count = 8;
+    *parity_count = 4;
+  }
+  else if (loss_rate >= FEC_RS_LOSS)
+  {
+    *data_count = 16;
+    *parity_count = 4;
+  }
+  else if (loss_rate >= FEC_SMALL_XOR_LOSS)
+  {
+    *data_count = 4;
+    *parity_count = 1;
+  }
+  else if (loss_rate >= FEC_XOR_LOSS)
+  {
+    *data_count = 8;
+    *parity_count = 1;
+  }
+}
+
+// Code a new data segment into the open block
+int fec_encoder_add(fec_encoder *enc, const packet *pkt)
+{
+  if (enc->data_count == 0)
+  {
+    block_shape(enc->loss_rate, &enc->data_count, &enc->parity_count);
+    if (enc->data_count == 0)
+    {
+      return 0;
+    }
+    enc->count = 0;
+    enc->first_seq = pkt->seq_num;
+    memset(enc->parity, 0, sizeof(enc->parity));
+  }
+
+  // Parity row j weighs segment i by 2^(i*j), row 0 is plain XOR
+  uint8_t symbol[FEC_SYMBOL_SIZE];
+  make_symbol(pkt, pkt->payload_len, symbol);
+  for (int j = 0; j < enc->parity_count; j++)
+  {
+    gf256_mul_add(enc->parity[j], symbol, gf256_exp(enc->count * j), FEC_SYMBOL_SIZE);
+  }
+  enc->count++;
+  enc->end_seq = pkt->seq_num + pkt->payload_len;
+  return enc->count == enc->data_count;
+}
+
+// Parity segments of the open block
+int fec_encoder_pending(const fec_encoder *enc)
+{
+  if (enc->data_count == 0 || enc->count == 0)
+  {
+    return 0;
+  }
+  // A block closed early needs no more parity than it has data
+  return enc->count < enc->parity_count ? enc->count : enc->parity_count;
+}
+
+// Fill in parity segment index of the open block
+void fec_encoder_parity(const fec_encoder *enc, int index, packet *pkt)
+{
+  const uint8_t *symbol = enc->parity[index];
+  const uint8_t *meta = symbol + MAX_PAYLOAD_SIZE;
+
+  memset(pkt, 0, sizeof(packet));
+  pkt->reserved = FEC_PARITY;
+  pkt->seq_num = enc->first_seq;
+  pkt->data_offset = STREAM_DATA_OFFSET;
+  pkt->stream_id = enc->count << 8 | fec_encoder_pending(enc) << 4 | index;
+  pkt->stream_offset = enc->end_seq - enc->first_seq;
+  pkt->sack_left = (uint32_t)meta[0] << 24 | meta[1] << 16 | meta[2] << 8 | meta[3];
+  pkt->sack_right = (uint32_t)meta[4] << 24 | meta[5] << 16 | meta[6] << 8;
+  memcpy(pkt->payload, symbol, MAX_PAYLOAD_SIZE);
+  pkt->payload_len = MAX_PAYLOAD_SIZE;
+}
+
+// Close the open block
+void fec_encoder_close(fec_encoder *enc)
+{
+  if (fec_encoder_pending(enc) > 0)
+  {
+    enc->blocks++;
+    enc->parity_sent += fec_encoder_pending(enc);
+  }
+  enc->data_count = 0;
+  enc->parity_count = 0;
+  enc->count = 0;
+}
+
+void fec_decoder_init(fec_decoder *dec)
+{
+  memset(dec, 0, sizeof(fec_decoder));
+}
+
+static fec_held *held_at(fec_decoder *dec, uint32_t seq_num)
+{
+  for (int i = 0; i < FEC_HISTORY; i++)
+  {
+    if (dec->history[i].used && dec->history[i].seq_num == seq_num)
+    {
+      return &dec->history[i];
+    }
+  }
+  return NULL;
+}
+
+// Keep a received data segment, replacing the oldest
+void fec_decoder_add_data(fec_decoder *dec, const packet *pkt, size_t len)
+{
+  fec_held *held = held_at(dec, pkt->seq_num);
+  if (held == NULL)
+  {
+    held = &dec->history[dec->history_next];
+    dec->history_next = (dec->history_next + 1) % FEC_HISTORY;
+  }
+  held->used = 1;
+  held->seq_num = pkt->seq_num;
+  held->len = len;
+  make_symbol(pkt, len, held->symbol);
+}
+
+// Keep a parity segment
+int fec_decoder_add_parity(fec_decoder *dec, const packet *pkt)
+{
+  int data_count = pkt->stream_id >> 8;
+  int parity_count = (pkt->stream_id >> 4) & 0x0f;
+  int index = pkt->stream_id & 0x0f;
+  uint32_t span = pkt->stream_offset;
+  uint32_t end_seq = pkt->seq_num + span;
+  if (data_count < 1 || data_count > FEC_MAX_DATA || parity_count < 1 ||
+      parity_count > FEC_MAX_PARITY || index >= parity_count ||
+      pkt->payload_len != MAX_PAYLOAD_SIZE || span < (uint32_t)data_count ||
+      span > (uint32_t)data_count * MAX_PAYLOAD_SIZE)
+  {
+    return -1;
+  }
+
+  int block = -1;
+  for (int i = 0; i < FEC_MAX_BLOCKS; i++)
+  {
+    fec_block *b = &dec->blocks[i];
+    if (b->used && b->first_seq == pkt->seq_num && b->end_seq == end_seq)
+    {
+      block = i;
+      break;
+    }
+  }
+  if (block < 0)
+  {
+    block = dec->blocks_next;
+    dec->blocks_next = (dec->blocks_next + 1) % FEC_MAX_BLOCKS;
+    fec_block *b = &dec->blocks[block];
+    memset(b, 0, sizeof(fec_block));
+    b->used = 1;
+    b->first_seq = pkt->seq_num;
+    b->end_seq = end_seq;
+    b->data_count = data_count;
+    b->parity_count = parity_count;
+  }
+
+  fec_block *b = &dec->blocks[block];
+  if (b->data_count != data_count || b->parity_count != parity_count)
+  {
+    return -1;
+  }
+  uint8_t *symbol = b->parity[index];
+  uint8_t *meta = symbol + MAX_PAYLOAD_SIZE;
+  memcpy(symbol, pkt->payload, MAX_PAYLOAD_SIZE);
+  meta[0] = pkt->sack_left >> 24;
+  meta[1] = pkt->sack_left >> 16;
+  meta[2] = pkt->sack_left >> 8;
+  meta[3] = pkt->sack_left;
+  meta[4] = pkt->sack_right >> 24;
+  meta[5] = pkt->sack_right >> 16;
+  meta[6] = pkt->sack_right >> 8;
+  b->have |= 1 << index;
+  return block;
+}
+
+// The block holding seq_num
+int fec_decoder_find(const fec_decoder *dec, uint32_t seq_num)
+{
+  for (int i = 0; i < FEC_MAX_BLOCKS; i++)
+  {
+    const fec_block *b = &dec->blocks[i];
+    if (b->used && in_range(seq_num, b->first_seq, b->end_seq))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Forget a block
+void fec_decoder_drop(fec_decoder *dec, int block)
+{
+  dec->blocks[block].used = 0;
+}
+
+// Solve for the missing symbols. Row p of the system is parity row rows[p]
+// with the received segments' share taken out, its unknowns the missing
+// segments at indices missing[]. Returns -1 if it is singular.
+static int solve(int count, const int *rows, const int *missing,
+                 uint8_t symbols[][FEC_SYMBOL_SIZE])
+{
+  uint8_t matrix[FEC_MAX_PARITY][FEC_MAX_PARITY];
+  for (int p = 0; p < count; p++)
+  {
+    for (int q = 0; q < count; q++)
+    {
+      matrix[p][q] = gf256_exp(rows[p] * missing[q]);
+    }
+  }
+
+  for (int q = 0; q < count; q++)
+  {
+    int pivot = q;
+    while (pivot < count && matrix[pivot][q] == 0)
+    {
+      pivot++;
+    }
+    if (pivot == count)
+    {
+      return -1;
+    }
+    if (pivot != q)
+    {
+      uint8_t row[FEC_MAX_PARITY];
+      uint8_t symbol[FEC_SYMBOL_SIZE];
+      memcpy(row, matrix[q], sizeof(row));
+      memcpy(matrix[q], matrix[pivot], sizeof(row));
+      memcpy(matrix[pivot], row, sizeof(row));
+      memcpy(symbol, symbols[q], FEC_SYMBOL_SIZE);
+      memcpy(symbols[q], symbols[pivot], FEC_SYMBOL_SIZE);
+      memcpy(symbols[pivot], symbol, FEC_SYMBOL_SIZE);
+    }
+
+    // Scale the pivot row to 1, then clear the column from the others
+    uint8_t scale = gf256_inv(matrix[q][q]);
+    uint8_t scaled[FEC_SYMBOL_SIZE] = {0};
+    gf256_mul_add(scaled, symbols[q], scale, FEC_SYMBOL_SIZE);
+    memcpy(symbols[q], scaled, FEC_SYMBOL_SIZE);
+    for (int c = 0; c < count; c++)
+    {
+      matrix[q][c] = gf256_mul(matrix[q][c], scale);
+    }
+
+    for (int p = 0; p < count; p++)
+    {
+      uint8_t factor = matrix[p][q];
+      if (p == q || factor == 0)
+      {
+        continue;
+      }
+      for (int c = 0; c < count; c++)
+      {
+        matrix[p][c] ^= gf256_mul(factor, matrix[q][c]);
+      }
+      gf256_mul_add(symbols[p], symbols[q], factor, FEC_SYMBOL_SIZE);
+    }
+  }
+  return 0;
+}
+
+// Rebuild what a block is missing
+int fec_decoder_recover(fec_decoder *dec, int block, packet *out)
+{
+  fec_block *b = &dec->blocks[block];
+  const fec_held *members[FEC_MAX_DATA];
+  uint32_t gap_start[FEC_MAX_DATA], gap_end[FEC_MAX_DATA];
+  int is_gap[2 * FEC_MAX_DATA];
+  int steps = 0, received = 0, gaps = 0;
+
+  // Walk the block's sequence space: held segments in order, and gaps
+  // between them where segments are missing
+  uint32_t pos = b->first_seq;
+  while (pos != b->end_seq)
+  {
+    if (steps == 2 * FEC_MAX_DATA || received == b->data_count)
+    {
+      fec_decoder_drop(dec, block);
+      return -1;
+    }
+
+    fec_held *held = held_at(dec, pos);
+    if (held != NULL)
+    {
+      if (held->len == 0 || !in_range(pos + held->len - 1, b->first_seq, b->end_seq))
+      {
+        fec_decoder_drop(dec, block);
+        return -1;
+      }
+      is_gap[steps++] = 0;
+      members[received++] = held;
+      pos += held->len;
+      continue;
+    }
+
+    uint32_t next = b->end_seq;
+    for (int i = 0; i < FEC_HISTORY; i++)
+    {
+      const fec_held *h = &dec->history[i];
+      if (h->used && in_range(h->seq_num, pos, next))
+      {
+        next = h->seq_num;
+      }
+    }
+    is_gap[steps++] = 1;
+    gap_start[gaps] = pos;
+    gap_end[gaps++] = next;
+    pos = next;
+  }
+
+  // Missing segments must leave a gap. Held segments that cover the whole
+  // span but fall short of data_count make a malformed block.
+  int lost = b->data_count - received;
+  int available = __builtin_popcount(b->have);
+  if (lost == 0 || gaps == 0 || lost < gaps)
+  {
+    fec_decoder_drop(dec, block);
+    return -1;
+  }
+  // Not enough parity, or several gaps hiding more segments than there
+  // are gaps, which cannot be told apart until one is filled
+  if (lost > available || (gaps > 1 && lost != gaps))
+  {
+    return 0;
+  }
+
+  // Number the segments: one per gap, or all missing ones in the only gap
+  int missing[FEC_MAX_PARITY];
+  int index = 0, member = 0, m = 0;
+  const fec_held *by_index[FEC_MAX_DATA];
+  for (int s = 0; s < steps; s++)
+  {
+    int n = is_gap[s] ? (gaps == 1 ? lost : 1) : 1;
+    for (int i = 0; i < n; i++, index++)
+    {
+      if (is_gap[s])
+      {
+        missing[m++] = index;
+        by_index[index] = NULL;
+      }
+      else
+      {
+        by_index[index] = members[member++];
+      }
+    }
+  }
+  if (index != b->data_count)
+  {
+    fec_decoder_drop(dec, block);
+    return -1;
+  }
+
+  // Take the received segments' share out of the parity we have
+  int rows[FEC_MAX_PARITY];
+  uint8_t symbols[FEC_MAX_PARITY][FEC_SYMBOL_SIZE];
+  int row_count = 0;
+  for (int j = 0; j < b->parity_count && row_count < lost; j++)
+  {
+    if (!(b->have & (1 << j)))
+    {
+      continue;
+    }
+    rows[row_count] = j;
+    memcpy(symbols[row_count], b->parity[j], FEC_SYMBOL_SIZE);
+    for (int i = 0; i < b->data_count; i++)
+    {
+      if (by_index[i] != NULL)
+      {
+        gf256_mul_add(symbols[row_count], by_index[i]->symbol, gf256_exp(i * j), FEC_SYMBOL_SIZE);
+      }
+    }
+    row_count++;
+  }
+  if (solve(lost, rows, missing, symbols) < 0)
+  {
+    fec_decoder_drop(dec, block);
+    return -1;
+  }
+
+  // The rebuilt segments must fill their gaps exactly
+  m = 0;
+  for (int g = 0; g < gaps; g++)
+  {
+    uint32_t seq = gap_start[g];
+    int n = gaps == 1 ? lost : 1;
+    for (int i = 0; i < n; i++, m++)
+    {
+      const uint8_t *meta = symbols[m] + MAX_PAYLOAD_SIZE;
+      size_t len = meta[0];
+      if (len == 0 || len > MAX_PAYLOAD_SIZE || (int32_t)(gap_end[g] - seq) < (int32_t)len)
+      {
+        fec_decoder_drop(dec, block);
+        return -1;
+      }
+      packet *pkt = &out[m];
+      memset(pkt, 0, sizeof(packet));
+      pkt->seq_num = seq;
+      pkt->data_offset = STREAM_DATA_OFFSET;
+      pkt->flags = PSH;
+      pkt->stream_id = meta[1] << 8 | meta[2];
+      pkt->stream_offset = (uint32_t)meta[3] << 24 | meta[4] << 16 | meta[5] << 8 | meta[6];
+      pkt->payload_len = len;
+      memcpy(pkt->payload, symbols[m], len);
+      seq += len;
+    }
+    if (seq != gap_end[g])
+    {
+      fec_decoder_drop(dec, block);
+      return -1;
+    }
+  }
+
+  dec->recovered += lost;
+  fec_decoder_drop(dec, block);
+  return lost;
+}
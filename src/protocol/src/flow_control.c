@@ -4,16 +4,56 @@
 #include <unistd.h>
 #include <sys/select.h>
 #include <errno.h>
+#include <time.h>
+#include <netinet/ip.h>
 
 #include "flow_control.h"
 #include "packet.h"
 #include "congestion_control.h"
 
+// Receive windows committed across all connections and the budget for them
+static uint32_t rcv_memory_committed = 0;
+static uint32_t rcv_memory_limit = RCV_MEMORY_LIMIT;
+
+// Change the advertised receive window, keeping the global account
+static void set_rcv_window(flow_control_state *state, uint32_t window)
+{
+  if (window > MAX_WINDOW_SIZE)
+  {
+    window = MAX_WINDOW_SIZE;
+  }
+  if (window < MIN_WINDOW_SIZE)
+  {
+    window = MIN_WINDOW_SIZE;
+  }
+
+  rcv_memory_committed = rcv_memory_committed - state->rcv_window + window;
+  state->rcv_window = window;
+}
+
+// Send datagrams as ECN-capable (ECT(0)) and ask for the TOS byte of
+// received ones, so that CE marks set by routers can be echoed back
+static int enable_ecn(int socket_fd)
+{
+  int tos = IPTOS_ECN_ECT0;
+  int on = 1;
+
+  if (setsockopt(socket_fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0 ||
+      setsockopt(socket_fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) < 0)
+  {
+    perror("setsockopt ECN");
+    return 0;
+  }
+
+  return 1;
+}
+
 // Initialize flow control state
 void init_flow_control(flow_control_state *state, int socket_fd,
                        struct sockaddr_in *peer_addr,
                        uint16_t local_port, uint16_t remote_port)
 {
+  memset(state, 0, sizeof(flow_control_state));
   state->base_seq_num = rand();
   state->next_seq_num = state->base_seq_num;
   state->last_ack_received = 0;
@@ -27,294 +67,1807 @@ void init_flow_control(flow_control_state *state, int socket_fd,
 
   printf("Flow control initialized. Base sequence number: %u\n", state->base_seq_num);
 
-  // Initialize congestion control
-  congestion_control_state cc_state;
-  init_congestion_control(&cc_state, MAX_PAYLOAD_SIZE);
+  state->ecn_enabled = enable_ecn(socket_fd);
+  set_rcv_window(state, INITIAL_WINDOW_SIZE);
 
-  // Apply initial congestion window
-  apply_congestion_window(&cc_state, state);
+  // Initialize congestion control for this connection. The effective window
+  // is applied once the first ACK arrives, so the receive side keeps
+  // advertising its full initial window.
+  init_congestion_control(&state->cc, MAX_PAYLOAD_SIZE);
+  pacer_init(&state->pacer, MAX_PAYLOAD_SIZE);
+  send_buffer_init(&state->sndbuf, state->next_seq_num);
+  stream_map_init(&state->streams);
+  recv_buffer_init(&state->rcvbuf);
+  state->highest_sent = state->next_seq_num;
 }
 
-// Receive data with flow control
-int receive_data_with_flow_control(flow_control_state *state,
-                                   char *buffer, size_t buffer_size,
-                                   size_t *bytes_received)
+// Return the receive window of a connection to the global memory budget
+void release_flow_control(flow_control_state *state)
 {
-  packet received_packet;
-  socklen_t addr_len = state->addr_len;
+  rcv_memory_committed -= state->rcv_window;
+  state->rcv_window = 0;
+}
 
-  printf("Waiting to receive data with flow control...\n");
+// Set the budget for the receive windows of all connections together
+void set_receive_memory_limit(uint32_t limit)
+{
+  rcv_memory_limit = limit;
+}
 
-  fd_set read_fds;
-  struct timeval timeout;
-  FD_ZERO(&read_fds);
-  FD_SET(state->socket_fd, &read_fds);
-  timeout.tv_sec = 2;
-  timeout.tv_usec = 0;
+// Receive window bytes committed by all connections
+uint32_t get_receive_memory(void)
+{
+  return rcv_memory_committed;
+}
 
-  if (select(state->socket_fd + 1, &read_fds, NULL, NULL, &timeout) <= 0)
+// Monotonic clock in microseconds
+uint64_t get_time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Send a packet to the peer. With kernel pacing the packet carries its
+// release time and the fq qdisc holds it back until then.
+static ssize_t send_packet(flow_control_state *state, packet *pkt, uint64_t release_us)
+{
+  uint8_t compact[sizeof(packet)];
+  const void *data = pkt;
+  size_t len = compact_encode(&state->compact, pkt, compact);
+  if (len > 0)
   {
-    printf("Timeout waiting for data packet\n");
+    data = compact;
+  }
+  else
+  {
+    len = sizeof(packet);
+  }
+
+#ifdef SO_TXTIME
+  if (state->pacer.use_txtime && release_us != 0)
+  {
+    struct iovec iov;
+    struct msghdr msg;
+    char control[CMSG_SPACE(sizeof(uint64_t))];
+    uint64_t txtime_ns = release_us * 1000;
+
+    iov.iov_base = (void *)data;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_name = &state->peer_addr;
+    msg.msg_namelen = state->addr_len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cmsg), &txtime_ns, sizeof(txtime_ns));
+
+    return sendmsg(state->socket_fd, &msg, 0);
+  }
+#endif
+
+  return sendto(state->socket_fd, data, len, 0, (struct sockaddr *)&state->peer_addr,
+                state->addr_len);
+}
+
+// Send a packet whose checksum is set
+ssize_t flow_control_send_packet(flow_control_state *state, packet *pkt)
+{
+  return send_packet(state, pkt, 0);
+}
+
+// Find the SACK block to report: the contiguous run of buffered segments
+// around reassembly[index], or the lowest block beyond the gap if index < 0
+static int find_sack_block(flow_control_state *state, int index,
+                           uint32_t *left, uint32_t *right)
+{
+  if (index < 0)
+  {
+    for (index = 0; index < state->reassembly_count; index++)
+    {
+      if (!SEQ_LT(state->reassembly[index].seq_num, state->rcv_nxt))
+      {
+        break;
+      }
+    }
+    if (index == state->reassembly_count)
+    {
+      return 0;
+    }
+  }
+
+  int first = index;
+  while (first > 0 &&
+         state->reassembly[first - 1].seq_num + state->reassembly[first - 1].len ==
+             state->reassembly[first].seq_num &&
+         !SEQ_LT(state->reassembly[first - 1].seq_num, state->rcv_nxt))
+  {
+    first--;
+  }
+
+  int last = index;
+  while (last + 1 < state->reassembly_count &&
+         state->reassembly[last].seq_num + state->reassembly[last].len ==
+             state->reassembly[last + 1].seq_num)
+  {
+    last++;
+  }
+
+  *left = state->reassembly[first].seq_num;
+  *right = state->reassembly[last].seq_num + state->reassembly[last].len;
+  return 1;
+}
+
+// Window to advertise: the receive buffer less data acknowledged but not
+// yet read by the application. It closes when the application falls behind.
+static uint16_t advertised_window(flow_control_state *state)
+{
+  uint32_t held = recv_buffer_used(&state->rcvbuf);
+  return held >= state->rcv_window ? 0 : state->rcv_window - held;
+}
+
+// Send a pure ACK carrying our receive window, the one-way delay measured
+// for the segment that triggered it and a SACK block for data held beyond
+// a gap. sack_index selects the block, see find_sack_block().
+static int send_ack(flow_control_state *state, uint32_t ack_num, uint32_t delay_echo,
+                    int sack_index)
+{
+  packet ack_packet;
+  memset(&ack_packet, 0, sizeof(packet));
+  ack_packet.source_port = state->local_port;
+  ack_packet.dest_port = state->remote_port;
+  ack_packet.seq_num = state->next_seq_num;
+  ack_packet.ack_num = ack_num;
+  ack_packet.data_offset = SACK_DATA_OFFSET;
+  ack_packet.flags = ACK;
+  ack_packet.reserved = state->ece_pending ? ECN_ECE : 0;
+  ack_packet.window_size = advertised_window(state);
+  ack_packet.ts_val = (uint32_t)get_time_us();
+  ack_packet.ts_ecr = state->ts_recent;
+  ack_packet.delay_echo = delay_echo;
+  ack_packet.urgent_pointer = state->fec_enabled ? state->fec_rx.recovered : 0;
+  find_sack_block(state, sack_index, &ack_packet.sack_left, &ack_packet.sack_right);
+  ack_packet.checksum = calculate_checksum(&ack_packet);
+
+  if (send_packet(state, &ack_packet, 0) < 0)
+  {
+    perror("sendto failed");
     return -1;
   }
 
-  int bytes = recvfrom(state->socket_fd, &received_packet, sizeof(received_packet), 0,
-                       (struct sockaddr *)&state->peer_addr, &addr_len);
+  state->rcv_wnd_advertised = ack_packet.window_size;
+  return 0;
+}
 
-  if (bytes < 0)
+// Whether a segment with len bytes at seq_num may be taken in: it must fit
+// in the advertised window, and once in order in a run of the receive
+// buffer, keeping one for each segment already held
+static int rcv_room(flow_control_state *state, uint32_t seq_num, size_t len)
+{
+  return (uint32_t)(seq_num - state->rcv_nxt) + len <= advertised_window(state) &&
+         recv_buffer_chunks_free(&state->rcvbuf) > state->reassembly_count;
+}
+
+// Hold a segment that arrived ahead of a gap. Returns its index in the
+// reassembly queue, or -1 if it was not kept.
+static int hold_segment(flow_control_state *state, packet *pkt, size_t len)
+{
+  if (!rcv_room(state, pkt->seq_num, len))
   {
-    perror("recvfrom failed");
     return -1;
   }
 
-  printf("Received packet with flags=0x%x, seq=%u\n",
-         received_packet.flags, received_packet.seq_num);
+  int index = state->reassembly_count;
+  while (index > 0 && SEQ_LT(pkt->seq_num, state->reassembly[index - 1].seq_num))
+  {
+    index--;
+  }
 
-  // Verify checksum
-  uint16_t received_checksum = received_packet.checksum;
-  received_packet.checksum = 0;
-  if (calculate_checksum(&received_packet) != received_checksum)
+  if (index > 0 && state->reassembly[index - 1].seq_num == pkt->seq_num)
   {
-    printf("Checksum verification failed\n");
-    return 0;
+    return index - 1; // Already held
   }
 
-  if (strlen(received_packet.payload) > 0)
+  // Streams are told apart only for the application reading through
+  // flow_control_read_stream(), otherwise data goes out in sequence order
+  int has_stream = state->rcv_queued && pkt->data_offset >= STREAM_DATA_OFFSET;
+  if (state->reassembly_count == MAX_REASSEMBLY_SEGMENTS ||
+      (has_stream && pkt->stream_id >= MAX_STREAMS))
   {
-    size_t payload_len = strlen(received_packet.payload);
+    return -1;
+  }
 
-    if (payload_len > buffer_size)
+  memmove(&state->reassembly[index + 1], &state->reassembly[index],
+          (state->reassembly_count - index) * sizeof(reassembly_segment));
+  reassembly_segment *seg = &state->reassembly[index];
+  seg->seq_num = pkt->seq_num;
+  seg->len = len;
+  seg->consumed = 0;
+  seg->has_stream = has_stream;
+  seg->stream_id = has_stream ? pkt->stream_id : 0;
+  seg->stream_offset = has_stream ? pkt->stream_offset : 0;
+  memcpy(seg->data, pkt->payload, len);
+  state->reassembly_count++;
+
+  // A resent segment cut differently may overlap data already read
+  if (has_stream)
+  {
+    int32_t read = (int32_t)(state->rcv_stream_offset[seg->stream_id] - seg->stream_offset);
+    if (read > 0)
     {
-      payload_len = buffer_size;
+      seg->consumed = (size_t)read > len ? len : (size_t)read;
     }
+  }
 
-    memcpy(buffer, received_packet.payload, payload_len);
-    *bytes_received = payload_len;
+  return index;
+}
 
-    // Send ACK
-    packet ack_packet;
-    memset(&ack_packet, 0, sizeof(packet));
-    ack_packet.source_port = state->local_port;
-    ack_packet.dest_port = state->remote_port;
-    ack_packet.seq_num = state->next_seq_num;
-    ack_packet.ack_num = received_packet.seq_num + payload_len;
-    ack_packet.data_offset = 5;
-    ack_packet.flags = ACK;
-    ack_packet.window_size = state->current_window;
-    ack_packet.checksum = calculate_checksum(&ack_packet);
-
-    if (sendto(state->socket_fd, &ack_packet, sizeof(ack_packet), 0,
-               (struct sockaddr *)&state->peer_addr, addr_len) < 0)
-    {
-      perror("sendto failed");
-      return -1;
-    }
+// Whether the application may read a held segment before the gap is
+// filled. Held stream data is in order once everything before it on its
+// own stream has been read, gaps in other streams do not matter. Other
+// data waits for the receive buffer.
+static int deliverable(flow_control_state *state, reassembly_segment *seg)
+{
+  return state->rcv_queued && seg->has_stream && seg->consumed < seg->len &&
+         seg->stream_offset + seg->consumed == state->rcv_stream_offset[seg->stream_id];
+}
 
-    state->last_ack_received = received_packet.seq_num + payload_len;
+static void remove_held(flow_control_state *state, int index)
+{
+  state->reassembly_count--;
+  memmove(&state->reassembly[index], &state->reassembly[index + 1],
+          (state->reassembly_count - index) * sizeof(reassembly_segment));
+}
 
-    return payload_len;
+// Hand out the oldest held segment of stream_id that can be read
+static int deliver_reassembled(flow_control_state *state, uint16_t stream_id,
+                               char *buffer, size_t buffer_size, size_t *bytes_received)
+{
+  int index = 0;
+  while (index < state->reassembly_count &&
+         (state->reassembly[index].stream_id != stream_id ||
+          !deliverable(state, &state->reassembly[index])))
+  {
+    index++;
+  }
+  if (index == state->reassembly_count)
+  {
+    return 0;
   }
 
-  return 0;
+  reassembly_segment *seg = &state->reassembly[index];
+  size_t len = seg->len - seg->consumed;
+  if (len > buffer_size)
+  {
+    len = buffer_size;
+  }
+  memcpy(buffer, seg->data + seg->consumed, len);
+  *bytes_received = len;
+
+  printf("Delivering reassembled segment seq=%u, %zu bytes\n", seg->seq_num + seg->consumed, len);
+
+  // Keep what did not fit for the next call. The segment stays until the
+  // gap is filled.
+  seg->consumed += len;
+  state->rcv_stream_offset[seg->stream_id] += len;
+
+  return len;
 }
 
-// Helper function to initialize a packet for data transfer
-static void prepare_data_packet(packet *pkt, flow_control_state *state,
-                                const char *data, size_t len)
+// Hand out data of stream_id that can be read, in-order data from the
+// receive buffer before stream data held beyond the gap
+static int deliver(flow_control_state *state, uint16_t stream_id,
+                   char *buffer, size_t buffer_size, size_t *bytes_received)
 {
-  memset(pkt, 0, sizeof(packet));
-  pkt->source_port = state->local_port;
-  pkt->dest_port = state->remote_port;
-  pkt->seq_num = state->next_seq_num;
-  pkt->ack_num = state->last_ack_received;
-  pkt->data_offset = 5; // Standard TCP header size (5 * 4 bytes)
-  pkt->flags = PSH;     // Push data flag
-  pkt->window_size = state->current_window;
-  pkt->urgent_pointer = 0;
+  int has_stream = 0;
+  size_t len = recv_buffer_read(&state->rcvbuf, stream_id, buffer, buffer_size, &has_stream);
+  if (len == 0)
+  {
+    return deliver_reassembled(state, stream_id, buffer, buffer_size, bytes_received);
+  }
 
-  // Copy data to payload, ensuring we don't exceed MAX_PAYLOAD_SIZE
-  size_t copy_len = (len > MAX_PAYLOAD_SIZE) ? MAX_PAYLOAD_SIZE : len;
-  printf("Preparing data packet: copying %zu bytes to payload\n", copy_len);
-  memcpy(pkt->payload, data, copy_len);
-  pkt->payload[copy_len] = '\0';
+  if (has_stream)
+  {
+    state->rcv_stream_offset[stream_id] += len;
+  }
+  *bytes_received = len;
+  return len;
+}
 
-  // Calculate checksum
-  pkt->checksum = calculate_checksum(pkt);
+// Move in-order payload into the receive buffer. Stream data that was read
+// already, while it was held beyond a gap or from a resent segment cut
+// differently, is left out. Returns -1 if it does not fit.
+static int buffer_in_order(flow_control_state *state, int has_stream, uint16_t stream_id,
+                           uint32_t stream_offset, const char *data, size_t len)
+{
+  if (has_stream)
+  {
+    int32_t read = (int32_t)(state->rcv_stream_offset[stream_id] - stream_offset);
+    if (read > 0)
+    {
+      size_t skip = (size_t)read > len ? len : (size_t)read;
+      data += skip;
+      len -= skip;
+      stream_offset += skip;
+    }
+  }
+
+  return recv_buffer_write(&state->rcvbuf, has_stream, stream_id, stream_offset, data, len);
 }
 
-// Send data with flow control
-int send_data_with_flow_control(flow_control_state *state,
-                                const char *data, size_t data_len)
+// PAWS (RFC 7323): a segment carrying an older timestamp than one already
+// accepted is an old duplicate, even if its wrapped sequence number looks valid
+static int paws_reject(flow_control_state *state, packet *pkt)
 {
-  size_t bytes_sent = 0;
-  int retransmissions = 0;
-  congestion_control_state cc_state;
+  if (pkt->data_offset < TIMESTAMP_DATA_OFFSET || state->ts_recent_time_us == 0)
+  {
+    return 0;
+  }
+
+  // After a long idle period the timestamps may have wrapped
+  if (get_time_us() - state->ts_recent_time_us > PAWS_IDLE_LIMIT_US)
+  {
+    return 0;
+  }
 
-  // Initialize congestion control
-  init_congestion_control(&cc_state, MAX_PAYLOAD_SIZE);
+  return (int32_t)(pkt->ts_val - state->ts_recent) < 0;
+}
 
-  while (bytes_sent < data_len)
+// Remember the timestamp of an in-order segment to echo it back
+static void update_ts_recent(flow_control_state *state, packet *pkt)
+{
+  if (pkt->data_offset >= TIMESTAMP_DATA_OFFSET)
   {
-    // Calculate available window using congestion control
-    uint16_t window = get_available_window(state);
-    size_t remaining = data_len - bytes_sent;
-    size_t chunk_size = (remaining < window) ? remaining : window;
+    state->ts_recent = pkt->ts_val;
+    state->ts_recent_time_us = get_time_us();
+  }
+}
 
-    // Limit chunk size to maximum payload size
-    if (chunk_size > MAX_PAYLOAD_SIZE)
-    {
-      chunk_size = MAX_PAYLOAD_SIZE;
-    }
+// Measure the RTT on the receive side from the timestamp the sender echoes
+// back, it is our own clock from the ACK that released the segment
+static void rcv_rtt_sample(flow_control_state *state, packet *pkt)
+{
+  if (pkt->data_offset < TIMESTAMP_DATA_OFFSET || pkt->ts_ecr == 0)
+  {
+    return;
+  }
 
-    // Check if we can send data based on congestion window
-    if (!can_send_data(&cc_state, state, chunk_size))
-    {
-      // Wait for ACKs to open the congestion window
-      fd_set read_fds;
-      FD_ZERO(&read_fds);
-      FD_SET(state->socket_fd, &read_fds);
+  uint32_t sample = (uint32_t)get_time_us() - pkt->ts_ecr;
+  if (sample >= FLOW_CONTROL_TIMEOUT_SEC * 1000000 * MAX_RETRANSMISSIONS)
+  {
+    return;
+  }
 
-      struct timeval timeout;
-      timeout.tv_sec = 0;
-      timeout.tv_usec = 100000; // 100ms
+  state->rcv_rtt_us = state->rcv_rtt_us == 0 ? sample : (7 * state->rcv_rtt_us + sample) / 8;
+}
 
-      if (select(state->socket_fd + 1, &read_fds, NULL, NULL, &timeout) > 0)
-      {
-        // Process ACKs to update congestion window
-        packet ack_packet;
-        socklen_t addr_len = state->addr_len;
+// Size the receive window from how fast the application drains data: once
+// per RTT, allow twice what was consumed in the last one so a sender that
+// is only window-limited can keep doubling. Under global memory pressure
+// the window shrinks to what the application needs.
+static void rcv_space_adjust(flow_control_state *state, size_t copied)
+{
+  uint64_t now = get_time_us();
 
-        if (recvfrom(state->socket_fd, &ack_packet, sizeof(ack_packet), 0,
-                     (struct sockaddr *)&state->peer_addr, &addr_len) > 0)
-        {
+  if (state->rcv_measure_start_us == 0)
+  {
+    state->rcv_measure_start_us = now;
+    state->rcv_copied = 0;
+  }
+  state->rcv_copied += copied;
 
-          if (ack_packet.flags & ACK)
-          {
-            int is_duplicate = (ack_packet.ack_num == cc_state.last_ack);
-            update_congestion_window(&cc_state, state, ack_packet.ack_num, is_duplicate);
-          }
-        }
-      }
-      continue;
-    }
+  if (state->rcv_rtt_us == 0 || now - state->rcv_measure_start_us < state->rcv_rtt_us)
+  {
+    return;
+  }
 
-    // Prepare and send packet
-    packet data_packet;
-    prepare_data_packet(&data_packet, state, data + bytes_sent, chunk_size);
+  uint32_t target = 2 * state->rcv_copied + 2 * MAX_PAYLOAD_SIZE;
+  uint32_t window = state->rcv_window;
+
+  if (rcv_memory_committed > rcv_memory_limit / 4 * 3)
+  {
+    window = target;
+  }
+  else if (target > window)
+  {
+    window = target;
+  }
 
-    printf("Sending %zu bytes, seq=%u, window=%u, payload='%s'\n",
-           chunk_size, state->next_seq_num, state->current_window, data_packet.payload);
+  uint32_t others = rcv_memory_committed - state->rcv_window;
+  if (others + window > rcv_memory_limit)
+  {
+    window = rcv_memory_limit > others ? rcv_memory_limit - others : MIN_WINDOW_SIZE;
+  }
 
-    if (sendto(state->socket_fd, &data_packet, sizeof(data_packet), 0,
-               (struct sockaddr *)&state->peer_addr, state->addr_len) < 0)
-    {
-      perror("sendto(2) failed in flow control");
-      return -1;
-    }
+  uint16_t previous = state->rcv_window;
+  set_rcv_window(state, window);
+  if (state->rcv_window != previous)
+  {
+    printf("Receive window %u -> %u (drained %u bytes in %llu us)\n", previous,
+           state->rcv_window, state->rcv_copied,
+           (unsigned long long)(now - state->rcv_measure_start_us));
+  }
+
+  state->rcv_measure_start_us = now;
+  state->rcv_copied = 0;
+}
 
-    // Wait for ACK with timeout
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(state->socket_fd, &read_fds);
+// Decode a compact datagram received into pkt in place. Returns 0 if it
+// does not decode.
+static int decode_compact(flow_control_state *state, packet *pkt, int bytes)
+{
+  uint8_t compact[sizeof(packet)];
+  memcpy(compact, pkt, bytes);
+  if (compact_decode(&state->compact, compact, bytes, pkt) < 0)
+  {
+    printf("Dropping compact packet that does not decode\n");
+    return 0;
+  }
+  return 1;
+}
 
-    struct timeval timeout;
-    timeout.tv_sec = FLOW_CONTROL_TIMEOUT_SEC;
-    timeout.tv_usec = FLOW_CONTROL_TIMEOUT_USEC;
+// Receive a datagram from the peer, reporting whether it carried a
+// Congestion Experienced mark
+int receive_flow_control_packet(flow_control_state *state, packet *pkt,
+                                int *congestion_experienced)
+{
+  struct iovec iov;
+  struct msghdr msg;
+  char control[CMSG_SPACE(sizeof(int))];
+  int bytes;
 
-    int select_result = select(state->socket_fd + 1, &read_fds, NULL, NULL, &timeout);
+  // Full packets are exactly sizeof(packet), compact ones are shorter
+  for (;;)
+  {
+    iov.iov_base = pkt;
+    iov.iov_len = sizeof(packet);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &state->peer_addr;
+    msg.msg_namelen = sizeof(state->peer_addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
 
-    if (select_result < 0)
+    bytes = recvmsg(state->socket_fd, &msg, 0);
+    if (bytes < 0)
     {
-      if (errno == EINTR)
-        continue;
-      perror("select(2) failed in flow control");
-      return -1;
+      return bytes;
+    }
+    if (!state->compact.enabled || bytes == sizeof(packet) || decode_compact(state, pkt, bytes))
+    {
+      break;
     }
+  }
+  state->addr_len = msg.msg_namelen;
 
-    if (select_result == 0)
+  *congestion_experienced = 0;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
     {
-      // Timeout occurred, retransmit
-      printf("Timeout waiting for ACK. Retransmitting... (%d/%d)\n",
-             retransmissions + 1, MAX_RETRANSMISSIONS);
+      uint8_t tos = *(uint8_t *)CMSG_DATA(cmsg);
+      *congestion_experienced = (tos & IPTOS_ECN_MASK) == IPTOS_ECN_CE;
+    }
+  }
 
-      retransmissions++;
-      if (retransmissions >= MAX_RETRANSMISSIONS)
-      {
-        printf("Maximum retransmissions reached. Giving up.\n");
-        return -1;
-      }
+  return bytes;
+}
 
-      // Handle timeout in congestion control
-      handle_timeout(&cc_state);
-      continue;
-    }
+// Bytes acknowledged in order and held for flow_control_read()
+uint32_t flow_control_readable(flow_control_state *state)
+{
+  return recv_buffer_unread(&state->rcvbuf);
+}
 
-    // Reset retransmission counter
-    retransmissions = 0;
+// Copy acknowledged data held in order into buffer
+int flow_control_read(flow_control_state *state, char *buffer, size_t buffer_size)
+{
+  return flow_control_read_stream(state, 0, buffer, buffer_size);
+}
 
-    // Receive ACK
-    packet ack_packet;
-    socklen_t addr_len = state->addr_len;
+// A stream with data to read, -1 if none
+int flow_control_next_stream(flow_control_state *state)
+{
+  int stream_id = recv_buffer_next_stream(&state->rcvbuf);
+  if (stream_id >= 0)
+  {
+    return stream_id;
+  }
 
-    if (recvfrom(state->socket_fd, &ack_packet, sizeof(ack_packet), 0,
-                 (struct sockaddr *)&state->peer_addr, &addr_len) < 0)
+  for (int i = 0; i < state->reassembly_count; i++)
+  {
+    if (deliverable(state, &state->reassembly[i]))
     {
-      perror("recvfrom(2) failed in flow control");
-      continue;
+      return state->reassembly[i].stream_id;
     }
+  }
 
-    // Verify checksum
-    uint16_t received_checksum = ack_packet.checksum;
-    ack_packet.checksum = 0;
-    if (calculate_checksum(&ack_packet) != received_checksum)
-    {
-      printf("Checksum verification failed. Packet might be corrupted.\n");
-      continue;
-    }
+  return -1;
+}
 
-    // Process ACK
-    if (ack_packet.flags & ACK)
-    {
-      printf("Received ACK: %u, window: %u\n",
-             ack_packet.ack_num, ack_packet.window_size);
+// Copy data of stream_id that is in order within its stream into buffer
+int flow_control_read_stream(flow_control_state *state, uint16_t stream_id,
+                             char *buffer, size_t buffer_size)
+{
+  size_t copied = 0;
+  size_t len = 0;
 
-      // Update flow control state
-      update_flow_control(state, &ack_packet);
+  while (copied < buffer_size &&
+         deliver(state, stream_id, buffer + copied, buffer_size - copied, &len) > 0)
+  {
+    copied += len;
+  }
 
-      // Update congestion control state
-      int is_duplicate = (ack_packet.ack_num == cc_state.last_ack);
-      update_congestion_window(&cc_state, state, ack_packet.ack_num, is_duplicate);
+  if (copied == 0)
+  {
+    return 0;
+  }
 
-      // Check if this ACK acknowledges our data
-      if (ack_packet.ack_num > state->next_seq_num)
-      {
-        // Calculate acknowledged bytes
-        size_t acked_bytes = ack_packet.ack_num - state->next_seq_num;
-        if (acked_bytes > chunk_size)
-        {
-          acked_bytes = chunk_size;
-        }
+  rcv_space_adjust(state, copied);
 
-        // Advance in the data stream
-        bytes_sent += acked_bytes;
-        state->next_seq_num += acked_bytes;
-      }
-    }
-    else
+  // The sender stopped on the window we last advertised, tell it as soon
+  // as a full segment fits again instead of leaving it to its persist timer
+  if (state->rcv_wnd_advertised < MAX_PAYLOAD_SIZE &&
+      advertised_window(state) >= MAX_PAYLOAD_SIZE)
+  {
+    printf("Receive window reopened, sending window update\n");
+    if (send_ack(state, state->rcv_nxt, 0, -1) < 0)
     {
-      printf("Received non-ACK packet. Ignoring.\n");
+      return -1;
     }
   }
 
-  printf("All data sent successfully.\n");
-  return data_len;
+  return copied;
+}
+
+// Take in a data segment from the peer, see flow_control_on_data()
+static int receive_segment(flow_control_state *state, packet *received_packet,
+                           int congestion_experienced, char *buffer, size_t buffer_size,
+                           size_t *bytes_received)
+{
+  rcv_rtt_sample(state, received_packet);
+
+  // Keep echoing a CE mark until the sender confirms it reduced its window
+  if (received_packet->reserved & ECN_CWR)
+  {
+    state->ece_pending = 0;
+  }
+  if (congestion_experienced)
+  {
+    printf("Congestion Experienced mark on seq=%u\n", received_packet->seq_num);
+    state->ece_pending = 1;
+  }
+
+  size_t payload_len = packet_payload_len(received_packet);
+
+  // One-way delay including the unknown clock offset, the sender only
+  // looks at how it changes relative to its minimum
+  uint32_t delay = (uint32_t)get_time_us() - received_packet->ts_val;
+
+  if (payload_len == 0)
+  {
+    return 0;
+  }
+
+  if (paws_reject(state, received_packet))
+  {
+    printf("PAWS: dropping old segment seq=%u, ts_val=%u < ts_recent=%u\n",
+           received_packet->seq_num, received_packet->ts_val, state->ts_recent);
+    if (send_ack(state, state->rcv_nxt, delay, -1) < 0)
+    {
+      return -1;
+    }
+    return 0;
+  }
+
+  // Kept to rebuild others of its FEC block from the parity
+  if (state->fec_enabled && state->rcv_queued)
+  {
+    fec_decoder_add_data(&state->fec_rx, received_packet, payload_len);
+  }
+
+  // Only the next in-order segment is delivered, the first data segment
+  // fixes the expected sequence number. Segments beyond a gap are held
+  // for reassembly and reported in the SACK block of a duplicate ACK.
+  if (state->rcv_nxt != 0 && received_packet->seq_num != state->rcv_nxt)
+  {
+    int index = -1;
+    if (SEQ_LT(state->rcv_nxt, received_packet->seq_num))
+    {
+      index = hold_segment(state, received_packet, payload_len);
+    }
+
+    printf("Out-of-order segment seq=%u, expected %u. Sending duplicate ACK\n",
+           received_packet->seq_num, state->rcv_nxt);
+    if (send_ack(state, state->rcv_nxt, delay, index) < 0)
+    {
+      return -1;
+    }
+    return 0;
+  }
+
+  if (state->rcv_queued)
+  {
+    // Buffer the segment until the application reads it. Without room for
+    // it, the duplicate ACK repeats the window that should have held it off.
+    // The first segment may be the one that fixes rcv_nxt.
+    int has_stream = received_packet->data_offset >= STREAM_DATA_OFFSET;
+    state->rcv_nxt = received_packet->seq_num;
+    if ((has_stream && received_packet->stream_id >= MAX_STREAMS) ||
+        !rcv_room(state, received_packet->seq_num, payload_len) ||
+        buffer_in_order(state, has_stream, has_stream ? received_packet->stream_id : 0,
+                        has_stream ? received_packet->stream_offset : 0,
+                        received_packet->payload, payload_len) < 0)
+    {
+      printf("No room for segment seq=%u, dropping it\n", received_packet->seq_num);
+      if (send_ack(state, state->rcv_nxt, delay, -1) < 0)
+      {
+        return -1;
+      }
+      return 0;
+    }
+  }
+  else
+  {
+    if (payload_len > buffer_size)
+    {
+      payload_len = buffer_size;
+    }
+
+    memcpy(buffer, received_packet->payload, payload_len);
+    *bytes_received = payload_len;
+  }
+  update_ts_recent(state, received_packet);
+
+  // Segments held behind the gap are now in order too, acknowledge them
+  // all and move them to the receive buffer for the next calls. What was
+  // read while they were beyond the gap is not needed any more.
+  state->rcv_nxt = received_packet->seq_num + payload_len;
+  while (state->reassembly_count > 0 && !SEQ_LT(state->rcv_nxt, state->reassembly[0].seq_num))
+  {
+    reassembly_segment *seg = &state->reassembly[0];
+    uint32_t from = state->rcv_nxt - seg->seq_num;
+    if (from < seg->len)
+    {
+      if (from < seg->consumed)
+      {
+        from = seg->consumed;
+      }
+      buffer_in_order(state, seg->has_stream, seg->stream_id, seg->stream_offset + from,
+                      seg->data + from, seg->len - from);
+      state->rcv_nxt = seg->seq_num + seg->len;
+    }
+    remove_held(state, 0);
+  }
+
+  // Size the window advertised in this ACK from the drain rate. Queued
+  // data counts once the application reads it.
+  rcv_space_adjust(state, state->rcv_queued ? 0 : payload_len);
+
+  // Send ACK
+  if (send_ack(state, state->rcv_nxt, delay, -1) < 0)
+  {
+    return -1;
+  }
+
+  return payload_len;
+}
+
+// Rebuild what one of the peer's FEC blocks is missing, if it can be by
+// now, and take the segments in as if they had arrived with the timestamp
+// of the segment that completed it
+static int fec_rebuild(flow_control_state *state, int block, uint32_t ts_val)
+{
+  packet rebuilt[FEC_MAX_PARITY];
+  int count = fec_decoder_recover(&state->fec_rx, block, rebuilt);
+  int accepted = 0;
+  for (int i = 0; i < count; i++)
+  {
+    packet *pkt = &rebuilt[i];
+    pkt->source_port = state->remote_port;
+    pkt->dest_port = state->local_port;
+    pkt->ts_val = ts_val;
+    printf("FEC rebuilt segment seq=%u, %u bytes\n", pkt->seq_num, pkt->payload_len);
+
+    int len = receive_segment(state, pkt, 0, NULL, 0, NULL);
+    if (len < 0)
+    {
+      return -1;
+    }
+    accepted += len;
+  }
+  return accepted;
+}
+
+// Handle a data segment from the peer
+int flow_control_on_data(flow_control_state *state, packet *received_packet,
+                         int congestion_experienced, char *buffer, size_t buffer_size,
+                         size_t *bytes_received)
+{
+  int accepted = receive_segment(state, received_packet, congestion_experienced,
+                                 buffer, buffer_size, bytes_received);
+  if (accepted < 0 || !state->fec_enabled || !state->rcv_queued)
+  {
+    return accepted;
+  }
+
+  // The segment may be what a block waited for to rebuild the rest
+  int block = fec_decoder_find(&state->fec_rx, received_packet->seq_num);
+  if (block < 0)
+  {
+    return accepted;
+  }
+  int rebuilt = fec_rebuild(state, block, received_packet->ts_val);
+  return rebuilt < 0 ? -1 : accepted + rebuilt;
+}
+
+// Handle a forward error correction parity segment from the peer
+int flow_control_on_parity(flow_control_state *state, packet *parity_packet)
+{
+  if (!state->fec_enabled || !state->rcv_queued)
+  {
+    return 0;
+  }
+
+  // Everything it covers has arrived already
+  uint32_t end_seq = parity_packet->seq_num + parity_packet->stream_offset;
+  if (state->rcv_nxt != 0 && !SEQ_LT(state->rcv_nxt, end_seq))
+  {
+    return 0;
+  }
+
+  int block = fec_decoder_add_parity(&state->fec_rx, parity_packet);
+  if (block < 0)
+  {
+    printf("Dropping malformed FEC parity for seq=%u\n", parity_packet->seq_num);
+    return 0;
+  }
+  return fec_rebuild(state, block, parity_packet->ts_val);
+}
+
+// Receive data with flow control
+int receive_data_with_flow_control(flow_control_state *state,
+                                   char *buffer, size_t buffer_size,
+                                   size_t *bytes_received)
+{
+  packet received_packet;
+
+  // Data already acknowledged behind a filled gap goes out first
+  int reassembled = flow_control_read(state, buffer, buffer_size);
+  if (reassembled != 0)
+  {
+    *bytes_received = reassembled > 0 ? (size_t)reassembled : 0;
+    return reassembled;
+  }
+
+  printf("Waiting to receive data with flow control...\n");
+
+  fd_set read_fds;
+  struct timeval timeout;
+  FD_ZERO(&read_fds);
+  FD_SET(state->socket_fd, &read_fds);
+  timeout.tv_sec = 2;
+  timeout.tv_usec = 0;
+
+  if (select(state->socket_fd + 1, &read_fds, NULL, NULL, &timeout) <= 0)
+  {
+    printf("Timeout waiting for data packet\n");
+    return -1;
+  }
+
+  int congestion_experienced = 0;
+  int bytes = receive_flow_control_packet(state, &received_packet, &congestion_experienced);
+
+  if (bytes < 0)
+  {
+    perror("recvfrom failed");
+    return -1;
+  }
+
+  printf("Received packet with flags=0x%x, seq=%u\n",
+         received_packet.flags, received_packet.seq_num);
+
+  // Verify checksum
+  uint16_t received_checksum = received_packet.checksum;
+  received_packet.checksum = 0;
+  if (calculate_checksum(&received_packet) != received_checksum)
+  {
+    printf("Checksum verification failed\n");
+    return 0;
+  }
+
+  return flow_control_on_data(state, &received_packet, congestion_experienced,
+                              buffer, buffer_size, bytes_received);
+}
+
+// Helper function to initialize a packet for data transfer, the payload
+// is taken from the send buffer
+static void prepare_data_packet(packet *pkt, flow_control_state *state,
+                                uint32_t seq_num, size_t len)
+{
+  memset(pkt, 0, sizeof(packet));
+  pkt->source_port = state->local_port;
+  pkt->dest_port = state->remote_port;
+  pkt->seq_num = seq_num;
+  pkt->ack_num = state->rcv_nxt;
+  pkt->data_offset = STREAM_DATA_OFFSET;    // TCP header plus timestamp, SACK and stream options
+  pkt->flags = PSH;                         // Push data flag
+  if (state->cwr_pending)
+  {
+    // Tell the receiver the window was reduced so it stops echoing CE
+    pkt->reserved = ECN_CWR;
+    state->cwr_pending = 0;
+  }
+  pkt->window_size = advertised_window(state);
+  pkt->urgent_pointer = state->fec_enabled ? state->fec_rx.recovered : 0;
+  pkt->ts_val = (uint32_t)get_time_us();
+  pkt->ts_ecr = state->ts_recent;
+  stream_map_lookup(&state->streams, seq_num, &pkt->stream_id, &pkt->stream_offset);
+
+  // Copy data to payload, ensuring we don't exceed MAX_PAYLOAD_SIZE
+  size_t copy_len = (len > MAX_PAYLOAD_SIZE) ? MAX_PAYLOAD_SIZE : len;
+  printf("Preparing data packet: copying %zu bytes to payload\n", copy_len);
+  send_buffer_read(&state->sndbuf, seq_num, pkt->payload, copy_len);
+  pkt->payload_len = copy_len;
+  if (copy_len < MAX_PAYLOAD_SIZE)
+  {
+    pkt->payload[copy_len] = '\0';
+  }
+
+  // Calculate checksum
+  pkt->checksum = calculate_checksum(pkt);
+}
+
+// Stamp a segment with the delivery state at the time it is transmitted
+static void stamp_segment(flow_control_state *state, segment_info *seg, uint64_t now)
+{
+  seg->sent_time_us = now;
+  seg->delivered = state->delivered;
+  seg->delivered_time_us = state->delivered_time_us;
+  seg->first_sent_time_us = state->first_sent_time_us;
+  seg->is_app_limited = state->app_limited != 0;
+}
+
+// Send the parity of the open FEC block at the release time of its last
+// segment, and close it
+static int send_fec_parity(flow_control_state *state, uint64_t now, uint64_t release_us)
+{
+  fec_encoder *enc = &state->fec_tx;
+  int count = fec_encoder_pending(enc);
+  uint64_t sent_time = release_us > now ? release_us : now;
+  for (int i = 0; i < count; i++)
+  {
+    packet parity;
+    fec_encoder_parity(enc, i, &parity);
+    parity.source_port = state->local_port;
+    parity.dest_port = state->remote_port;
+    parity.ack_num = state->rcv_nxt;
+    parity.window_size = advertised_window(state);
+    parity.urgent_pointer = state->fec_rx.recovered;
+    parity.ts_val = (uint32_t)get_time_us();
+    parity.ts_ecr = state->ts_recent;
+    parity.checksum = calculate_checksum(&parity);
+
+    if (send_packet(state, &parity, release_us) < 0)
+    {
+      perror("sendto(2) failed for FEC parity");
+      return -1;
+    }
+    pacer_on_send(&state->pacer, MAX_PAYLOAD_SIZE, sent_time);
+  }
+
+  printf("FEC: sent %d parity segments for %d segments from seq=%u\n",
+         count, enc->count, enc->first_seq);
+  fec_encoder_close(enc);
+  return 0;
+}
+
+// Code a new segment into the open FEC block, sending the parity once it
+// is full. A block only covers consecutive segments.
+static int fec_code_segment(flow_control_state *state, packet *pkt,
+                            uint64_t now, uint64_t release_us)
+{
+  fec_encoder *enc = &state->fec_tx;
+  if (fec_encoder_pending(enc) > 0 && pkt->seq_num != enc->end_seq &&
+      send_fec_parity(state, now, release_us) < 0)
+  {
+    return -1;
+  }
+  if (fec_encoder_add(enc, pkt) == 1)
+  {
+    return send_fec_parity(state, now, release_us);
+  }
+  return 0;
+}
+
+// Transmit a segment from the scoreboard at its pacer release time
+static int transmit_segment(flow_control_state *state, segment_info *seg,
+                            uint64_t now, uint64_t release_us)
+{
+  packet data_packet;
+  prepare_data_packet(&data_packet, state, seg->seq_num, seg->len);
+
+  printf("Sending %u bytes, seq=%u, window=%u, payload='%.*s'%s\n",
+         seg->len, seg->seq_num, state->current_window, (int)seg->len,
+         data_packet.payload, seg->retransmitted ? " (retransmission)" : "");
+
+  if (send_packet(state, &data_packet, release_us) < 0)
+  {
+    perror("sendto(2) failed in flow control");
+    return -1;
+  }
+
+  // Segments handed to the kernel ahead of time leave at their release time
+  uint64_t sent_time = release_us > now ? release_us : now;
+  stamp_segment(state, seg, sent_time);
+  pacer_on_send(&state->pacer, seg->len, sent_time);
+  prr_on_send(&state->cc, seg->len);
+
+  // Parity follows the new segments it covers
+  if (!seg->retransmitted)
+  {
+    fec_on_sent(&state->fec_tx);
+    if (state->fec_enabled && fec_code_segment(state, &data_packet, now, release_us) < 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Smooth RTT samples (RFC 6298)
+static void update_rtt(flow_control_state *state, uint32_t rtt_us)
+{
+  if (state->srtt_us == 0)
+  {
+    state->srtt_us = rtt_us;
+    state->rttvar_us = rtt_us / 2;
+    return;
+  }
+
+  uint32_t err = state->srtt_us > rtt_us ? state->srtt_us - rtt_us : rtt_us - state->srtt_us;
+  state->rttvar_us = (3 * state->rttvar_us + err) / 4;
+  state->srtt_us = (7 * state->srtt_us + rtt_us) / 8;
+}
+
+// Mark segments covered by the SACK block of an ACK as delivered
+static void process_sack(flow_control_state *state, packet *ack_packet, uint64_t now)
+{
+  uint32_t left = ack_packet->sack_left;
+  uint32_t right = ack_packet->sack_right;
+
+  if (!SEQ_LT(left, right) || !SEQ_LT(state->last_ack_received, right))
+  {
+    return;
+  }
+
+  for (int i = 0; i < state->segment_count; i++)
+  {
+    segment_info *seg = &state->segments[(state->segment_head + i) % MAX_INFLIGHT_SEGMENTS];
+    uint32_t end = seg->seq_num + seg->len;
+
+    if (seg->sacked || SEQ_LT(seg->seq_num, left) || SEQ_LT(right, end))
+    {
+      continue;
+    }
+
+    seg->sacked = 1;
+    state->sacked_bytes += seg->len;
+    if (seg->lost)
+    {
+      seg->lost = 0;
+      state->lost_bytes -= seg->len;
+    }
+    rack_on_delivered(&state->rack, seg->sent_time_us, end, seg->retransmitted, now);
+  }
+}
+
+// Mark segments lost once a segment sent after them has been delivered and
+// the reordering window has passed (RACK, RFC 8985). Segments that are not
+// overdue yet arm the reordering timer.
+static void detect_losses(flow_control_state *state, uint64_t now)
+{
+  int sacked = 0;
+  int newly_lost = 0;
+  uint64_t reo_timeout = 0;
+
+  for (int i = 0; i < state->segment_count; i++)
+  {
+    sacked += state->segments[(state->segment_head + i) % MAX_INFLIGHT_SEGMENTS].sacked;
+  }
+  rack_update_reo_wnd(&state->rack,
+                      state->cc.state == FAST_RECOVERY || sacked >= DUPLICATE_ACK_THRESHOLD,
+                      state->srtt_us);
+
+  for (int i = 0; i < state->segment_count; i++)
+  {
+    segment_info *seg = &state->segments[(state->segment_head + i) % MAX_INFLIGHT_SEGMENTS];
+
+    if (seg->sacked || seg->lost)
+    {
+      continue;
+    }
+
+    uint64_t loss_time = rack_loss_time(&state->rack, seg->sent_time_us, seg->seq_num + seg->len);
+    if (loss_time == 0)
+    {
+      continue;
+    }
+
+    if (now >= loss_time)
+    {
+      printf("RACK: segment seq=%u lost\n", seg->seq_num);
+      seg->lost = 1;
+      state->lost_bytes += seg->len;
+      fec_on_lost(&state->fec_tx, 1);
+      newly_lost++;
+    }
+    else if (reo_timeout == 0 || loss_time < reo_timeout)
+    {
+      reo_timeout = loss_time;
+    }
+  }
+
+  state->reo_timeout_us = reo_timeout;
+
+  if (newly_lost > 0)
+  {
+    handle_loss(&state->cc, state);
+    update_pacing_rate(&state->cc, state->srtt_us);
+    apply_congestion_window(&state->cc, state);
+  }
+}
+
+// Arm the tail loss probe while data is outstanding and no loss repair
+// or earlier probe is under way. New data and forward progress restart it.
+static void schedule_tlp(flow_control_state *state, uint64_t now, int restart)
+{
+  if (state->segment_count == 0 || state->tlp_in_flight || state->lost_bytes > 0 ||
+      state->reo_timeout_us != 0)
+  {
+    state->tlp_timeout_us = 0;
+    return;
+  }
+
+  if (restart || state->tlp_timeout_us == 0)
+  {
+    state->tlp_timeout_us = now + rack_probe_timeout(state->srtt_us);
+  }
+}
+
+// Interval until the next zero window probe: the RTO from the RTT
+// estimate, doubled for every probe that found the window still closed
+static uint64_t persist_interval(flow_control_state *state)
+{
+  uint64_t interval = (uint64_t)FLOW_CONTROL_TIMEOUT_SEC * 1000000;
+  if (state->srtt_us != 0)
+  {
+    interval = state->srtt_us + 4 * (uint64_t)state->rttvar_us;
+  }
+  if (interval < PERSIST_MIN_US)
+  {
+    interval = PERSIST_MIN_US;
+  }
+
+  for (int i = 0; i < state->persist_backoff && interval < PERSIST_MAX_US; i++)
+  {
+    interval *= 2;
+  }
+
+  return interval < PERSIST_MAX_US ? interval : PERSIST_MAX_US;
+}
+
+// Retransmit segments marked lost, oldest first, as the congestion window
+// allows. PRR always leaves room for the first retransmission of a recovery.
+static int retransmit_lost(flow_control_state *state)
+{
+  for (int i = 0; i < state->segment_count && state->lost_bytes > 0; i++)
+  {
+    segment_info *seg = &state->segments[(state->segment_head + i) % MAX_INFLIGHT_SEGMENTS];
+
+    if (!seg->lost)
+    {
+      continue;
+    }
+
+    if (!can_send_data(&state->cc, state, seg->len))
+    {
+      break;
+    }
+
+    seg->lost = 0;
+    seg->retransmitted = 1;
+    state->lost_bytes -= seg->len;
+
+    uint64_t now = get_time_us();
+    if (transmit_segment(state, seg, now, now) < 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Remove acknowledged segments from the scoreboard and feed a delivery
+// rate sample to congestion control
+static void process_new_ack(flow_control_state *state, uint32_t prior_una,
+                            packet *ack_packet, uint64_t now)
+{
+  rate_sample rs;
+  segment_info newest;
+  int have_sample = 0;
+
+  memset(&rs, 0, sizeof(rs));
+  rs.now_us = now;
+  rs.acked = state->last_ack_received - prior_una;
+  rs.has_delay = ack_packet->data_offset >= TIMESTAMP_DATA_OFFSET;
+  rs.delay_us = ack_packet->delay_echo;
+  state->delivered += rs.acked;
+  state->delivered_time_us = now;
+
+  while (state->segment_count > 0)
+  {
+    segment_info *seg = &state->segments[state->segment_head];
+
+    if (SEQ_LT(state->last_ack_received, seg->seq_num + seg->len))
+    {
+      // Partially acknowledged, keep only the remainder
+      if (SEQ_LT(seg->seq_num, state->last_ack_received))
+      {
+        uint32_t acked = state->last_ack_received - seg->seq_num;
+        seg->seq_num += acked;
+        seg->len -= acked;
+        if (seg->lost)
+        {
+          state->lost_bytes -= acked;
+        }
+      }
+      break;
+    }
+
+    if (seg->sacked)
+    {
+      state->sacked_bytes -= seg->len;
+    }
+    else
+    {
+      rack_on_delivered(&state->rack, seg->sent_time_us, seg->seq_num + seg->len,
+                        seg->retransmitted, now);
+    }
+    if (seg->lost)
+    {
+      state->lost_bytes -= seg->len;
+    }
+
+    // The most recently sent acknowledged segment gives the freshest sample
+    if (!have_sample || seg->delivered >= newest.delivered)
+    {
+      newest = *seg;
+      have_sample = 1;
+    }
+
+    state->segment_head = (state->segment_head + 1) % MAX_INFLIGHT_SEGMENTS;
+    state->segment_count--;
+  }
+
+  if (have_sample)
+  {
+    uint64_t send_elapsed = newest.sent_time_us - newest.first_sent_time_us;
+    uint64_t ack_elapsed = now - newest.delivered_time_us;
+
+    rs.prior_delivered = newest.delivered;
+    rs.delivered = state->delivered - newest.delivered;
+    rs.interval_us = send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed;
+    rs.is_app_limited = newest.is_app_limited;
+    state->first_sent_time_us = newest.sent_time_us;
+
+    // Karn's algorithm: a retransmitted segment gives an ambiguous RTT
+    if (!newest.retransmitted)
+    {
+      rs.rtt_us = now - newest.sent_time_us;
+    }
+  }
+
+  // The echoed timestamp names the transmission that was acknowledged, so
+  // every ACK of new data gives an RTT sample, retransmissions included
+  if (ack_packet->data_offset >= TIMESTAMP_DATA_OFFSET && ack_packet->ts_ecr != 0)
+  {
+    uint32_t ts_rtt = (uint32_t)now - ack_packet->ts_ecr;
+    if (ts_rtt < FLOW_CONTROL_TIMEOUT_SEC * 1000000 * MAX_RETRANSMISSIONS)
+    {
+      rs.rtt_us = ts_rtt;
+    }
+  }
+
+  if (rs.rtt_us != 0)
+  {
+    update_rtt(state, rs.rtt_us);
+  }
+
+  if (state->app_limited != 0 && state->delivered > state->app_limited)
+  {
+    state->app_limited = 0;
+  }
+
+  rs.in_flight = state->next_seq_num - state->last_ack_received;
+  on_rate_sample(&state->cc, state, &rs);
+}
+
+// Retransmission timeout
+#define RTO_US ((uint64_t)FLOW_CONTROL_TIMEOUT_SEC * 1000000 + FLOW_CONTROL_TIMEOUT_USEC)
+
+// Start sending afresh from next_seq_num once everything queued before has
+// been acknowledged
+static void reset_sender(flow_control_state *state)
+{
+  send_buffer_init(&state->sndbuf, state->next_seq_num);
+  stream_map_clear(&state->streams);
+  state->highest_sent = state->next_seq_num;
+  state->retransmissions = 0;
+  state->tlp_due = 0;
+
+  // Nothing is in flight
+  state->last_ack_received = state->next_seq_num;
+  state->segment_head = 0;
+  state->segment_count = 0;
+  state->sacked_bytes = 0;
+  state->lost_bytes = 0;
+  state->reo_timeout_us = 0;
+  state->tlp_timeout_us = 0;
+  state->tlp_in_flight = 0;
+  state->persist_timeout_us = 0;
+  state->persist_backoff = 0;
+}
+
+// Queue as much of data in the send buffer as fits
+size_t flow_control_queue(flow_control_state *state, const char *data, size_t data_len)
+{
+  return flow_control_queue_stream(state, 0, data, data_len);
+}
+
+// Queue data on stream_id
+size_t flow_control_queue_stream(flow_control_state *state, uint16_t stream_id,
+                                 const char *data, size_t data_len)
+{
+  if (send_buffer_used(&state->sndbuf) == 0)
+  {
+    reset_sender(state);
+  }
+
+  uint32_t space = send_buffer_space(&state->sndbuf);
+  if (data_len > space)
+  {
+    data_len = space;
+  }
+
+  // The stream map takes the run first, it may be out of chunks
+  data_len = stream_map_add(&state->streams, stream_id, state->sndbuf.tail, data_len);
+  return send_buffer_write(&state->sndbuf, data, data_len);
+}
+
+// Queue data for sending and transmit what the windows allow
+int send_data_with_flow_control(flow_control_state *state,
+                                const char *data, size_t data_len)
+{
+  size_t queued = flow_control_queue(state, data, data_len);
+
+  // The send buffer is full, keep the connection going until ACKs free space
+  while (queued < data_len)
+  {
+    if (process_flow_control(state, RTO_US) < 0)
+    {
+      return -1;
+    }
+    queued += flow_control_queue(state, data + queued, data_len - queued);
+  }
+
+  printf("Queued %zu bytes, %u waiting for acknowledgement\n", data_len,
+         send_buffer_used(&state->sndbuf));
+
+  // Send what can go out now without waiting, the rest follows as ACKs arrive
+  if (process_flow_control(state, 0) < 0)
+  {
+    return -1;
+  }
+
+  return data_len;
+}
+
+// Wait until all queued data has been acknowledged
+int flush_flow_control(flow_control_state *state)
+{
+  while (send_buffer_used(&state->sndbuf) > 0)
+  {
+    if (process_flow_control(state, RTO_US) < 0)
+    {
+      return -1;
+    }
+  }
+
+  printf("All data sent successfully.\n");
+  return 0;
+}
+
+// Transmit queued data as the windows allow, lost segments and probes first
+int flow_control_transmit(flow_control_state *state)
+{
+  uint32_t end_seq = state->sndbuf.tail;
+
+  // Repair losses before sending anything new
+  if (retransmit_lost(state) < 0)
+  {
+    return -1;
+  }
+
+  uint64_t now = get_time_us();
+  state->pacing_wake_us = 0;
+
+  // Send new segments while the windows, the scoreboard and the pacer
+  // allow. A tail loss probe may exceed the congestion window by one segment.
+  while (SEQ_LT(state->next_seq_num, end_seq) &&
+         state->segment_count < MAX_INFLIGHT_SEGMENTS)
+  {
+    size_t chunk_size = end_seq - state->next_seq_num;
+    uint32_t in_flight = state->next_seq_num - state->last_ack_received;
+
+    // Limit chunk size to maximum payload size, and to one stream
+    if (chunk_size > MAX_PAYLOAD_SIZE)
+    {
+      chunk_size = MAX_PAYLOAD_SIZE;
+    }
+    uint16_t stream_id;
+    uint32_t stream_offset;
+    uint32_t stream_left = stream_map_lookup(&state->streams, state->next_seq_num,
+                                             &stream_id, &stream_offset);
+    if (stream_left != 0 && chunk_size > stream_left)
+    {
+      chunk_size = stream_left;
+    }
+
+    // Respect both the congestion window and the receiver's window
+    if ((!state->tlp_due && !can_send_data(&state->cc, state, chunk_size)) ||
+        in_flight + chunk_size > state->receiver_window)
+    {
+      break;
+    }
+
+    // Hold the segment back until the pacer releases it
+    pacer_set_rate(&state->pacer, get_pacing_rate(&state->cc));
+    uint64_t release = state->tlp_due ? now : pacer_release_time(&state->pacer, chunk_size, now);
+    if (release > now + pacer_lookahead(&state->pacer))
+    {
+      state->pacing_wake_us = release - pacer_lookahead(&state->pacer);
+      break;
+    }
+
+    // The flight is application-limited if this empties the send buffer
+    // and the window still has room, so its rate samples understate the path
+    if (state->next_seq_num + chunk_size == end_seq &&
+        in_flight + chunk_size < get_congestion_window(&state->cc))
+    {
+      state->app_limited = state->delivered + in_flight + chunk_size;
+    }
+
+    if (state->segment_count == 0)
+    {
+      // Start of a new flight
+      state->first_sent_time_us = now;
+      state->delivered_time_us = now;
+    }
+
+    segment_info *seg = &state->segments[(state->segment_head + state->segment_count) %
+                                         MAX_INFLIGHT_SEGMENTS];
+    seg->seq_num = state->next_seq_num;
+    seg->len = chunk_size;
+    seg->retransmitted = SEQ_LT(state->next_seq_num, state->highest_sent);
+    seg->sacked = 0;
+    seg->lost = 0;
+    state->segment_count++;
+
+    if (transmit_segment(state, seg, now, release) < 0)
+    {
+      return -1;
+    }
+
+    state->next_seq_num += chunk_size;
+    if (SEQ_LT(state->highest_sent, state->next_seq_num))
+    {
+      state->highest_sent = state->next_seq_num;
+    }
+    now = get_time_us();
+
+    if (state->tlp_due)
+    {
+      printf("Tail loss probe sent new data, seq=%u\n", seg->seq_num);
+      state->tlp_in_flight = 1;
+      state->tlp_retransmitted = 0;
+      state->tlp_end_seq = state->next_seq_num;
+      state->tlp_due = 0;
+    }
+    schedule_tlp(state, now, 1);
+  }
+
+  // Out of data for now, the end of a message should not wait for more to
+  // fill its FEC block
+  if (state->fec_enabled && state->next_seq_num == end_seq &&
+      fec_encoder_pending(&state->fec_tx) > 0 && send_fec_parity(state, now, now) < 0)
+  {
+    return -1;
+  }
+
+  // A probe that found no new data to send resends the last segment
+  if (state->tlp_due)
+  {
+    state->tlp_due = 0;
+    if (state->segment_count > 0)
+    {
+      segment_info *seg = &state->segments[(state->segment_head + state->segment_count - 1) %
+                                           MAX_INFLIGHT_SEGMENTS];
+      printf("Tail loss probe resending seq=%u\n", seg->seq_num);
+      seg->retransmitted = 1;
+      if (transmit_segment(state, seg, now, now) < 0)
+      {
+        return -1;
+      }
+      state->tlp_in_flight = 1;
+      state->tlp_retransmitted = 1;
+      state->tlp_end_seq = state->next_seq_num;
+      schedule_tlp(state, now, 1);
+    }
+  }
+
+  // With the peer's window closed and nothing in flight no ACK will come
+  // to reopen it, unless the window update the receiver sends gets lost.
+  // Probe it on the persist timer rather than waiting on the RTO.
+  uint32_t next_chunk = end_seq - state->next_seq_num;
+  if (next_chunk > MAX_PAYLOAD_SIZE)
+  {
+    next_chunk = MAX_PAYLOAD_SIZE;
+  }
+  int window_closed = SEQ_LT(state->next_seq_num, end_seq) &&
+                      state->receiver_window < next_chunk;
+  if (window_closed && state->segment_count == 0)
+  {
+    if (state->persist_timeout_us == 0)
+    {
+      state->persist_timeout_us = now + persist_interval(state);
+    }
+  }
+  else
+  {
+    state->persist_timeout_us = 0;
+    if (!window_closed)
+    {
+      state->persist_backoff = 0;
+    }
+  }
+
+  return 0;
+}
+
+// When the first unacknowledged segment times out, 0 if nothing is in flight
+static uint64_t rto_deadline(flow_control_state *state)
+{
+  if (state->segment_count == 0)
+  {
+    return 0;
+  }
+
+  return state->segments[state->segment_head].sent_time_us + RTO_US;
+}
+
+// Earliest sender timer: the retransmission timeout, a loss detection or
+// persist timer, or the next pacing slot. 0 if none is armed.
+uint64_t flow_control_next_timer(flow_control_state *state)
+{
+  uint64_t wake_time = 0;
+  uint64_t timers[] = {rto_deadline(state), state->pacing_wake_us, state->reo_timeout_us,
+                       state->tlp_timeout_us, state->persist_timeout_us};
+  for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++)
+  {
+    if (timers[i] != 0 && (wake_time == 0 || timers[i] < wake_time))
+    {
+      wake_time = timers[i];
+    }
+  }
+
+  return wake_time;
+}
+
+// Handle the sender timer that has expired by now, if any
+int flow_control_on_timer(flow_control_state *state, uint64_t now)
+{
+  // Segments that were not overdue on the last ACK may be by now
+  if (state->reo_timeout_us != 0 && now >= state->reo_timeout_us)
+  {
+    detect_losses(state, now);
+    schedule_tlp(state, now, 0);
+    return 0;
+  }
+
+  // No ACK for the tail of the flight, probe for it
+  if (state->tlp_timeout_us != 0 && now >= state->tlp_timeout_us)
+  {
+    state->tlp_timeout_us = 0;
+    state->tlp_due = 1;
+    return 0;
+  }
+
+  // The window is still closed, send one byte of new data past it. The
+  // receiver acknowledges it with its current window, and takes the byte
+  // only if the window has opened. The probe stays out of the scoreboard,
+  // so the RTO and tail loss probes never resend it and a peer that keeps
+  // its window closed never fails the connection. Only this timer sends
+  // it again, backing off.
+  if (state->persist_timeout_us != 0 && now >= state->persist_timeout_us)
+  {
+    state->persist_timeout_us = 0;
+    if (state->persist_backoff < 16)
+    {
+      state->persist_backoff++;
+    }
+
+    packet probe;
+    prepare_data_packet(&probe, state, state->next_seq_num, 1);
+    printf("Zero window probe seq=%u (backoff %d)\n", probe.seq_num, state->persist_backoff);
+    if (send_packet(state, &probe, now) < 0)
+    {
+      perror("sendto(2) failed in flow control");
+      return -1;
+    }
+
+    // Accept the ACK of the byte if the receiver took it
+    if (SEQ_LT(state->highest_sent, state->next_seq_num + 1))
+    {
+      state->highest_sent = state->next_seq_num + 1;
+    }
+    return 0;
+  }
+
+  // The pacer releases the next segment on the next transmit
+  if (state->pacing_wake_us != 0 && now >= state->pacing_wake_us)
+  {
+    state->pacing_wake_us = 0;
+    return 0;
+  }
+
+  // Nothing has been outstanding for a full RTO yet
+  if (state->segment_count == 0 || now < rto_deadline(state))
+  {
+    return 0;
+  }
+
+  // Timeout occurred, retransmit
+  printf("Timeout waiting for ACK. Retransmitting... (%d/%d)\n",
+         state->retransmissions + 1, MAX_RETRANSMISSIONS);
+
+  state->retransmissions++;
+  if (state->retransmissions >= MAX_RETRANSMISSIONS)
+  {
+    printf("Maximum retransmissions reached. Giving up.\n");
+    return -1;
+  }
+
+  // Handle timeout in congestion control
+  handle_timeout(&state->cc);
+  fec_on_lost(&state->fec_tx, 1);
+  update_pacing_rate(&state->cc, state->srtt_us);
+
+  // Go back to the first unacknowledged byte and resend from there
+  state->next_seq_num = state->last_ack_received;
+  state->segment_count = 0;
+  state->sacked_bytes = 0;
+  state->lost_bytes = 0;
+  state->reo_timeout_us = 0;
+  state->tlp_timeout_us = 0;
+  state->tlp_in_flight = 0;
+  return 0;
+}
+
+// Handle an ACK from the peer
+void flow_control_on_ack(flow_control_state *state, packet *ack_packet)
+{
+  uint64_t now;
+
+  printf("Received ACK: %u, window: %u\n",
+         ack_packet->ack_num, ack_packet->window_size);
+
+  // Ignore ACKs that are stale or cover data never sent
+  if (SEQ_LT(ack_packet->ack_num, state->last_ack_received) ||
+      SEQ_LT(state->highest_sent, ack_packet->ack_num))
+  {
+    printf("ACK %u outside of the send window. Ignoring.\n", ack_packet->ack_num);
+    return;
+  }
+
+  uint32_t prior_una = state->last_ack_received;
+
+  // Segments the peer rebuilt from parity were lost all the same
+  if (state->fec_enabled)
+  {
+    fec_on_recovered(&state->fec_tx, ack_packet->urgent_pointer);
+  }
+
+  // Keep the peer's clock to echo it in data segments
+  if (!paws_reject(state, ack_packet))
+  {
+    update_ts_recent(state, ack_packet);
+  }
+
+  // Update flow control state
+  uint16_t prior_window = state->receiver_window;
+  update_flow_control(state, ack_packet);
+
+  // Update congestion control state. An ACK that only changes the window
+  // is a window update, not a sign of loss, nor is one that answers a zero
+  // window probe with nothing in flight.
+  int is_duplicate = ack_packet->ack_num == state->cc.last_ack &&
+                     ack_packet->window_size == prior_window &&
+                     state->next_seq_num != state->last_ack_received;
+  update_congestion_window(&state->cc, state, ack_packet->ack_num, is_duplicate);
+
+  now = get_time_us();
+  int has_sack = ack_packet->data_offset >= SACK_DATA_OFFSET;
+  uint32_t prior_sacked = state->sacked_bytes;
+  if (has_sack)
+  {
+    process_sack(state, ack_packet, now);
+  }
+  uint32_t newly_sacked = state->sacked_bytes - prior_sacked;
+
+  // The network marked congestion before it had to drop anything
+  if (state->ecn_enabled && (ack_packet->reserved & ECN_ECE) &&
+      handle_ecn_echo(&state->cc, state))
+  {
+    state->cwr_pending = 1;
+    update_pacing_rate(&state->cc, state->srtt_us);
+  }
+
+  if (state->last_ack_received != prior_una)
+  {
+    // New data acknowledged, its bytes leave the send buffer. After a
+    // go-back-N restart the peer may already hold data beyond what we resent.
+    state->retransmissions = 0;
+    send_buffer_ack(&state->sndbuf, state->last_ack_received);
+    stream_map_ack(&state->streams, state->last_ack_received);
+    if (SEQ_LT(state->next_seq_num, state->last_ack_received))
+    {
+      state->next_seq_num = state->last_ack_received;
+    }
+    process_new_ack(state, prior_una, ack_packet, now);
+
+    // An acknowledged probe that resent data repaired a tail loss
+    if (state->tlp_in_flight && !SEQ_LT(state->last_ack_received, state->tlp_end_seq))
+    {
+      state->tlp_in_flight = 0;
+      if (state->tlp_retransmitted)
+      {
+        printf("Tail loss probe repaired a loss\n");
+        handle_loss(&state->cc, state);
+        update_pacing_rate(&state->cc, state->srtt_us);
+        apply_congestion_window(&state->cc, state);
+      }
+    }
+  }
+  else if (!has_sack && is_duplicate &&
+           state->cc.duplicate_acks == DUPLICATE_ACK_THRESHOLD && state->segment_count > 0)
+  {
+    // Without SACK information RACK cannot tell which segments arrived,
+    // fall back to the duplicate ACK threshold for the first one
+    segment_info *seg = &state->segments[state->segment_head];
+    if (!seg->lost)
+    {
+      seg->lost = 1;
+      state->lost_bytes += seg->len;
+      fec_on_lost(&state->fec_tx, 1);
+    }
+  }
+
+  detect_losses(state, now);
+  schedule_tlp(state, now, state->last_ack_received != prior_una);
+
+  // Bytes this ACK reports delivered: newly acknowledged data that was not
+  // SACKed before, plus newly SACKed data. A duplicate ACK without SACK
+  // information stands for one segment leaving the network.
+  uint32_t sacked_released = prior_sacked + newly_sacked - state->sacked_bytes;
+  uint32_t delivered = (state->last_ack_received - prior_una) - sacked_released + newly_sacked;
+  if (delivered == 0 && is_duplicate && !has_sack)
+  {
+    delivered = state->cc.mss;
+  }
+
+  uint32_t pipe = state->next_seq_num - state->last_ack_received -
+                  state->sacked_bytes - state->lost_bytes;
+  prr_on_ack(&state->cc, delivered, pipe);
+  apply_congestion_window(&state->cc, state);
+}
+
+// Transmit queued data as the windows allow, then wait up to max_wait_us
+// for an ACK or a sender timer and handle it
+int process_flow_control(flow_control_state *state, uint64_t max_wait_us)
+{
+  if (flow_control_transmit(state) < 0)
+  {
+    return -1;
+  }
+
+  uint64_t now = get_time_us();
+  uint64_t wake_time = flow_control_next_timer(state);
+  uint64_t wait_us = wake_time > now ? wake_time - now : 0;
+  if (wake_time == 0 || wait_us > max_wait_us)
+  {
+    wait_us = max_wait_us;
+  }
+
+  fd_set read_fds;
+  FD_ZERO(&read_fds);
+  FD_SET(state->socket_fd, &read_fds);
+
+  struct timeval timeout;
+  timeout.tv_sec = wait_us / 1000000;
+  timeout.tv_usec = wait_us % 1000000;
+
+  int select_result = select(state->socket_fd + 1, &read_fds, NULL, NULL, &timeout);
+
+  if (select_result < 0)
+  {
+    if (errno == EINTR)
+      return 0;
+    perror("select(2) failed in flow control");
+    return -1;
+  }
+
+  if (select_result == 0)
+  {
+    return flow_control_on_timer(state, get_time_us());
+  }
+
+  // Receive ACK
+  packet ack_packet;
+  socklen_t addr_len = state->addr_len;
+
+  if (recvfrom(state->socket_fd, &ack_packet, sizeof(ack_packet), 0,
+               (struct sockaddr *)&state->peer_addr, &addr_len) < 0)
+  {
+    perror("recvfrom(2) failed in flow control");
+    return 0;
+  }
+
+  // Verify checksum
+  uint16_t received_checksum = ack_packet.checksum;
+  ack_packet.checksum = 0;
+  if (calculate_checksum(&ack_packet) != received_checksum)
+  {
+    printf("Checksum verification failed. Packet might be corrupted.\n");
+    return 0;
+  }
+
+  // Process ACK
+  if (!(ack_packet.flags & ACK))
+  {
+    printf("Received non-ACK packet. Ignoring.\n");
+    return 0;
+  }
+
+  flow_control_on_ack(state, &ack_packet);
+  return 0;
 }
 
 // Update flow control state based on received ACK
 void update_flow_control(flow_control_state *state, packet *ack_packet)
 {
   // Update last ACK received
-  if (ack_packet->ack_num > state->last_ack_received)
+  if (SEQ_LT(state->last_ack_received, ack_packet->ack_num))
   {
     state->last_ack_received = ack_packet->ack_num;
   }
@@ -0,0 +1,134 @@
+#include <string.h>
+#include <arpa/inet.h>
+#include "framing.h"
+#include "codec.h"
+
+// Write the header for a message of len bytes
+size_t frame_encode_header(uint32_t len, char *out)
+{
+  uint32_t net_len = htonl(len);
+  memcpy(out, &net_len, FRAME_HEADER_SIZE);
+  return FRAME_HEADER_SIZE;
+}
+
+// Write a whole compressed frame for a message
+size_t frame_encode_compressed(const char *msg, uint32_t len, char *out, size_t cap)
+{
+  if (len < FRAME_COMPRESS_MIN || len > FRAME_MAX_MESSAGE || codec_precompressed(msg, len) ||
+      cap <= FRAME_COMPRESSED_HEADER_SIZE)
+  {
+    return 0;
+  }
+
+  // Only worth it if the frame comes out smaller than the plain one
+  size_t limit = len + FRAME_HEADER_SIZE - FRAME_COMPRESSED_HEADER_SIZE - 1;
+  if (limit > cap - FRAME_COMPRESSED_HEADER_SIZE)
+  {
+    limit = cap - FRAME_COMPRESSED_HEADER_SIZE;
+  }
+  size_t body = codec_compress(msg, len, out + FRAME_COMPRESSED_HEADER_SIZE, limit);
+  if (body == 0)
+  {
+    return 0;
+  }
+
+  frame_encode_header((2 + body) | FRAME_COMPRESSED, out);
+  out[FRAME_HEADER_SIZE] = len >> 8;
+  out[FRAME_HEADER_SIZE + 1] = len & 0xff;
+  return FRAME_COMPRESSED_HEADER_SIZE + body;
+}
+
+// Initialize an empty decoder
+void frame_decoder_init(frame_decoder *dec)
+{
+  dec->start = 0;
+  dec->end = 0;
+  dec->expanded = 0;
+}
+
+// Where to receive the next bytes, and how many fit
+char *frame_decoder_space(frame_decoder *dec, size_t *space)
+{
+  if (dec->start > 0)
+  {
+    memmove(dec->data, dec->data + dec->start, dec->end - dec->start);
+    dec->end -= dec->start;
+    dec->start = 0;
+  }
+  dec->expanded = 0;
+
+  *space = FRAME_BUFFER_SIZE - dec->end;
+  return dec->data + dec->end;
+}
+
+// Account for len bytes received into the space
+void frame_decoder_commit(frame_decoder *dec, size_t len)
+{
+  dec->end += len;
+}
+
+// Take the next complete message
+int frame_decoder_next(frame_decoder *dec, const char **msg, uint32_t *len)
+{
+  uint32_t available = dec->end - dec->start;
+  if (available < FRAME_HEADER_SIZE)
+  {
+    return 0;
+  }
+
+  uint32_t net_len;
+  memcpy(&net_len, dec->data + dec->start, FRAME_HEADER_SIZE);
+  uint32_t msg_len = ntohl(net_len);
+  int compressed = (msg_len & FRAME_COMPRESSED) != 0;
+  msg_len &= ~FRAME_COMPRESSED;
+  if (msg_len > FRAME_MAX_MESSAGE)
+  {
+    return -1;
+  }
+  if (available < FRAME_HEADER_SIZE + msg_len)
+  {
+    return 0;
+  }
+
+  const char *body = dec->data + dec->start + FRAME_HEADER_SIZE;
+  if (!compressed)
+  {
+    *msg = body;
+    *len = msg_len;
+    dec->start += FRAME_HEADER_SIZE + msg_len;
+    return 1;
+  }
+
+  if (msg_len < 2)
+  {
+    return -1;
+  }
+  uint32_t original = (uint8_t)body[0] << 8 | (uint8_t)body[1];
+  if (original > FRAME_MAX_MESSAGE)
+  {
+    return -1;
+  }
+  // The messages handed out so far hold the expansion buffer until the
+  // next frame_decoder_space()
+  if (dec->expanded + original > FRAME_BUFFER_SIZE)
+  {
+    return 0;
+  }
+
+  char *out = dec->expanded_data + dec->expanded;
+  if (codec_decompress(body + 2, msg_len - 2, out, original) < 0)
+  {
+    return -1;
+  }
+  *msg = out;
+  *len = original;
+  dec->expanded += original;
+  dec->start += FRAME_HEADER_SIZE + msg_len;
+  return 1;
+}
+
+// Bytes received and not handed out
+uint32_t frame_decoder_pending(frame_decoder *dec)
+{
+  return dec->end - dec->start;
+}
@@ -0,0 +1,131 @@
+#include <pthread.h>
+
+#include "gf256.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF256_SSSE3 1
+#endif
+
+// exp_table is doubled so the sum of two logs needs no reduction
+static uint8_t exp_table[512];
+static uint8_t log_table[256];
+// Products of each factor with the low and the high nibbles
+static uint8_t nibble_table[256][2][16];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables(void)
+{
+  unsigned x = 1;
+  for (int i = 0; i < 255; i++)
+  {
+    exp_table[i] = x;
+    exp_table[i + 255] = x;
+    log_table[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+    {
+      x ^= 0x11d;
+    }
+  }
+  exp_table[510] = exp_table[0];
+  exp_table[511] = exp_table[1];
+
+  for (int c = 1; c < 256; c++)
+  {
+    for (int i = 1; i < 16; i++)
+    {
+      nibble_table[c][0][i] = exp_table[log_table[c] + log_table[i]];
+      nibble_table[c][1][i] = exp_table[log_table[c] + log_table[i << 4]];
+    }
+  }
+}
+
+// Product of a and b
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+  pthread_once(&tables_once, build_tables);
+  if (a == 0 || b == 0)
+  {
+    return 0;
+  }
+  return exp_table[log_table[a] + log_table[b]];
+}
+
+// Inverse of a
+uint8_t gf256_inv(uint8_t a)
+{
+  pthread_once(&tables_once, build_tables);
+  return exp_table[255 - log_table[a]];
+}
+
+// 2 to the power n
+uint8_t gf256_exp(unsigned n)
+{
+  pthread_once(&tables_once, build_tables);
+  return exp_table[n % 255];
+}
+
+static void mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+  unsigned log_c = log_table[c];
+  for (size_t i = 0; i < len; i++)
+  {
+    if (src[i] != 0)
+    {
+      dst[i] ^= exp_table[log_c + log_table[src[i]]];
+    }
+  }
+}
+
+#ifdef GF256_SSSE3
+// Multiplication by c is linear, so c * x = c * (x & 0x0f) ^ c * (x & 0xf0),
+// and each half is a lookup in a 16-entry table that pshufb does for 16
+// bytes at once
+__attribute__((target("ssse3")))
+static void mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+  __m128i low_table = _mm_loadu_si128((const __m128i *)nibble_table[c][0]);
+  __m128i high_table = _mm_loadu_si128((const __m128i *)nibble_table[c][1]);
+  __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i lo = _mm_and_si128(x, mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+    __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low_table, lo),
+                                    _mm_shuffle_epi8(high_table, hi));
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, product));
+  }
+  mul_add_scalar(dst + i, src + i, c, len - i);
+}
+#endif
+
+// dst ^= c * src
+void gf256_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+  pthread_once(&tables_once, build_tables);
+  if (c == 0)
+  {
+    return;
+  }
+  if (c == 1)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      dst[i] ^= src[i];
+    }
+    return;
+  }
+
+#ifdef GF256_SSSE3
+  if (len >= 16 && __builtin_cpu_supports("ssse3"))
+  {
+    mul_add_ssse3(dst, src, c, len);
+    return;
+  }
+#endif
+  mul_add_scalar(dst, src, c, len);
+}
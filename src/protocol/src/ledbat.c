@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include "ledbat.h"
+
+// One-way delays include an unknown clock offset and wrap with the 32-bit
+// sender clock, so they are only ever compared relative to each other
+#define DELAY_LT(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+static uint32_t min_cwnd(ledbat_state *ledbat)
+{
+  return LEDBAT_MIN_CWND * ledbat->mss;
+}
+
+// Initialize LEDBAT state
+void ledbat_init(ledbat_state *ledbat, uint16_t mss)
+{
+  memset(ledbat, 0, sizeof(ledbat_state));
+  ledbat->mss = mss;
+  ledbat->cwnd = LEDBAT_INIT_CWND * mss;
+  ledbat->target_us = LEDBAT_TARGET_US;
+}
+
+// Keep the minimum delay of each interval for the last LEDBAT_BASE_HISTORY
+// intervals, so a route change raising the base delay is eventually noticed
+static void update_base_delay(ledbat_state *ledbat, uint64_t now_us, uint32_t delay_us)
+{
+  if (ledbat->base_count == 0)
+  {
+    ledbat->base_history[0] = delay_us;
+    ledbat->base_index = 0;
+    ledbat->base_count = 1;
+    ledbat->base_interval_start_us = now_us;
+    return;
+  }
+
+  if (now_us - ledbat->base_interval_start_us >= LEDBAT_BASE_INTERVAL_US)
+  {
+    ledbat->base_index = (ledbat->base_index + 1) % LEDBAT_BASE_HISTORY;
+    ledbat->base_history[ledbat->base_index] = delay_us;
+    ledbat->base_interval_start_us = now_us;
+    if (ledbat->base_count < LEDBAT_BASE_HISTORY)
+    {
+      ledbat->base_count++;
+    }
+    return;
+  }
+
+  if (DELAY_LT(delay_us, ledbat->base_history[ledbat->base_index]))
+  {
+    ledbat->base_history[ledbat->base_index] = delay_us;
+  }
+}
+
+static uint32_t base_delay(ledbat_state *ledbat)
+{
+  uint32_t base = ledbat->base_history[ledbat->base_index];
+  for (int i = 0; i < ledbat->base_count; i++)
+  {
+    if (DELAY_LT(ledbat->base_history[i], base))
+    {
+      base = ledbat->base_history[i];
+    }
+  }
+  return base;
+}
+
+// Filter the current delay over the last few samples to ride out jitter
+static uint32_t current_delay(ledbat_state *ledbat, uint32_t delay_us)
+{
+  ledbat->current_samples[ledbat->current_index] = delay_us;
+  ledbat->current_index = (ledbat->current_index + 1) % LEDBAT_CURRENT_FILTER;
+  if (ledbat->current_count < LEDBAT_CURRENT_FILTER)
+  {
+    ledbat->current_count++;
+  }
+
+  uint32_t current = delay_us;
+  for (int i = 0; i < ledbat->current_count; i++)
+  {
+    if (DELAY_LT(ledbat->current_samples[i], current))
+    {
+      current = ledbat->current_samples[i];
+    }
+  }
+  return current;
+}
+
+// Update cwnd from a one-way delay sample carried by an ACK
+void ledbat_on_ack(ledbat_state *ledbat, uint64_t now_us, uint32_t delay_us,
+                   uint32_t acked, uint32_t flight_size)
+{
+  if (acked == 0)
+  {
+    return;
+  }
+
+  update_base_delay(ledbat, now_us, delay_us);
+  int32_t queuing_delay = (int32_t)(current_delay(ledbat, delay_us) - base_delay(ledbat));
+  if (queuing_delay < 0)
+  {
+    queuing_delay = 0;
+  }
+  ledbat->queuing_delay_us = queuing_delay;
+
+  // Grow below the target and shrink above it, in proportion to how far off it we are
+  int64_t off_target = (int64_t)ledbat->target_us - queuing_delay;
+  int64_t cwnd = ledbat->cwnd + LEDBAT_GAIN * off_target * acked * ledbat->mss /
+                                    ((int64_t)ledbat->target_us * ledbat->cwnd);
+
+  // Do not let an application-limited sender build up unused window
+  int64_t max_allowed = (int64_t)flight_size + LEDBAT_ALLOWED_INCREASE * ledbat->mss;
+  if (cwnd > max_allowed)
+  {
+    cwnd = max_allowed;
+  }
+
+  if (cwnd < min_cwnd(ledbat))
+  {
+    cwnd = min_cwnd(ledbat);
+  }
+  if (cwnd > LEDBAT_MAX_CWND)
+  {
+    cwnd = LEDBAT_MAX_CWND;
+  }
+
+  ledbat->cwnd = cwnd;
+}
+
+// Halve cwnd on packet loss
+void ledbat_on_loss(ledbat_state *ledbat)
+{
+  ledbat->cwnd /= 2;
+  if (ledbat->cwnd < min_cwnd(ledbat))
+  {
+    ledbat->cwnd = min_cwnd(ledbat);
+  }
+  printf("LEDBAT: loss, cwnd=%u\n", ledbat->cwnd);
+}
+
+// Collapse cwnd on a retransmission timeout
+void ledbat_on_timeout(ledbat_state *ledbat)
+{
+  ledbat->cwnd = ledbat->mss;
+  printf("LEDBAT: timeout, cwnd=%u\n", ledbat->cwnd);
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#endif
+#include "pacer.h"
+
+// Tokens are kept in millionths of a byte so that refilling by
+// rate (bytes/sec) * elapsed (us) needs no division
+#define TOKEN_SCALE 1000000
+
+// Initialize pacer state with a full bucket
+void pacer_init(pacer_state *pacer, uint16_t mss)
+{
+  memset(pacer, 0, sizeof(pacer_state));
+  pacer->burst = PACER_BURST_SEGMENTS * mss;
+  pacer->tokens = (int64_t)pacer->burst * TOKEN_SCALE;
+}
+
+// Set the release rate in bytes/sec
+void pacer_set_rate(pacer_state *pacer, uint64_t rate)
+{
+  pacer->rate = rate;
+}
+
+// Add the credit earned up to now_us, never beyond the bucket depth
+static void refill(pacer_state *pacer, uint64_t now_us)
+{
+  if (now_us <= pacer->last_update_us)
+  {
+    return;
+  }
+
+  int64_t cap = (int64_t)pacer->burst * TOKEN_SCALE;
+  if (pacer->rate == 0 || pacer->last_update_us == 0)
+  {
+    pacer->tokens = cap;
+  }
+  else
+  {
+    uint64_t elapsed = now_us - pacer->last_update_us;
+    if (elapsed > (uint64_t)(cap - pacer->tokens) / pacer->rate + 1)
+    {
+      pacer->tokens = cap;
+    }
+    else
+    {
+      pacer->tokens += (int64_t)(pacer->rate * elapsed);
+      if (pacer->tokens > cap)
+      {
+        pacer->tokens = cap;
+      }
+    }
+  }
+
+  pacer->last_update_us = now_us;
+}
+
+// Earliest time a segment of len bytes may be released
+uint64_t pacer_release_time(pacer_state *pacer, size_t len, uint64_t now_us)
+{
+  if (pacer->rate == 0)
+  {
+    return now_us;
+  }
+
+  refill(pacer, now_us);
+
+  // Segments already scheduled ahead push the base past now
+  uint64_t base = pacer->last_update_us > now_us ? pacer->last_update_us : now_us;
+  int64_t needed = (int64_t)len * TOKEN_SCALE - pacer->tokens;
+  if (needed <= 0)
+  {
+    return base;
+  }
+
+  return base + ((uint64_t)needed + pacer->rate - 1) / pacer->rate;
+}
+
+// Charge a segment of len bytes released at release_us
+void pacer_on_send(pacer_state *pacer, size_t len, uint64_t release_us)
+{
+  refill(pacer, release_us);
+  pacer->tokens -= (int64_t)len * TOKEN_SCALE;
+}
+
+// How far before its release time a segment may be handed to the socket
+uint64_t pacer_lookahead(pacer_state *pacer)
+{
+  return pacer->use_txtime ? PACER_TXTIME_HORIZON_US : 0;
+}
+
+// Let the kernel enforce release times via SO_TXTIME
+int pacer_enable_txtime(pacer_state *pacer, int socket_fd)
+{
+#ifdef SO_TXTIME
+  struct sock_txtime txtime;
+  memset(&txtime, 0, sizeof(txtime));
+  txtime.clockid = CLOCK_MONOTONIC;
+
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) == 0)
+  {
+    pacer->use_txtime = 1;
+    printf("Kernel pacing enabled with SO_TXTIME\n");
+    return 1;
+  }
+  perror("setsockopt SO_TXTIME");
+#else
+  (void)socket_fd;
+#endif
+
+  pacer->use_txtime = 0;
+  printf("Kernel pacing unavailable, pacing with a userspace timer\n");
+  return 0;
+}
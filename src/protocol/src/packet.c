@@ -33,3 +33,13 @@ uint16_t calculate_checksum(packet *pkt){
 
   return sum;
 }
+
+// Payload length. Without the stream option the payload is NUL-terminated
+// unless it fills the whole payload area.
+size_t packet_payload_len(const packet *pkt){
+  if (pkt->data_offset >= STREAM_DATA_OFFSET){
+    return pkt->payload_len > MAX_PAYLOAD_SIZE ? MAX_PAYLOAD_SIZE : pkt->payload_len;
+  }
+
+  return strnlen(pkt->payload, MAX_PAYLOAD_SIZE);
+}
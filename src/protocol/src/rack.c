@@ -0,0 +1,101 @@
+#include <string.h>
+#include "rack.h"
+
+// Sequence number comparison that tolerates wrap-around
+#define RACK_SEQ_LT(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+// Segment 1 was sent after segment 2. Segments sent back-to-back may share
+// a timestamp, the sequence number breaks the tie.
+static int sent_after(uint64_t t1, uint32_t seq1, uint64_t t2, uint32_t seq2)
+{
+  return t1 > t2 || (t1 == t2 && RACK_SEQ_LT(seq2, seq1));
+}
+
+// Initialize RACK state
+void rack_init(rack_state *rack)
+{
+  memset(rack, 0, sizeof(rack_state));
+}
+
+// Record that a segment was delivered, by a cumulative or a selective ACK
+void rack_on_delivered(rack_state *rack, uint64_t xmit_ts_us, uint32_t end_seq,
+                       int retransmitted, uint64_t now_us)
+{
+  uint32_t rtt = now_us - xmit_ts_us;
+
+  // An ACK arriving faster than the path allows was triggered by the
+  // original transmission, not the retransmission
+  if (retransmitted && rtt < rack->min_rtt_us)
+  {
+    return;
+  }
+
+  if (!retransmitted && (rack->min_rtt_us == 0 || rtt < rack->min_rtt_us))
+  {
+    rack->min_rtt_us = rtt;
+  }
+
+  if (!rack->has_delivered || sent_after(xmit_ts_us, end_seq, rack->xmit_ts_us, rack->end_seq))
+  {
+    rack->xmit_ts_us = xmit_ts_us;
+    rack->end_seq = end_seq;
+    rack->rtt_us = rtt;
+  }
+
+  // Delivery below the forward-most delivered sequence means the network reordered
+  if (rack->has_delivered && RACK_SEQ_LT(end_seq, rack->fack))
+  {
+    if (!retransmitted)
+    {
+      rack->reordering_seen = 1;
+    }
+  }
+  else
+  {
+    rack->fack = end_seq;
+  }
+
+  rack->has_delivered = 1;
+}
+
+// Recompute the reordering window
+void rack_update_reo_wnd(rack_state *rack, int dup_thresh_hit, uint32_t srtt_us)
+{
+  // Without any reordering on the path, losses are repaired as quickly as
+  // the duplicate ACK threshold would
+  if (!rack->reordering_seen && dup_thresh_hit)
+  {
+    rack->reo_wnd_us = 0;
+    return;
+  }
+
+  rack->reo_wnd_us = rack->min_rtt_us / RACK_REO_WND_DIVISOR;
+  if (srtt_us != 0 && rack->reo_wnd_us > srtt_us)
+  {
+    rack->reo_wnd_us = srtt_us;
+  }
+}
+
+// Time at which an outstanding segment is deemed lost
+uint64_t rack_loss_time(rack_state *rack, uint64_t xmit_ts_us, uint32_t end_seq)
+{
+  if (!rack->has_delivered || !sent_after(rack->xmit_ts_us, rack->end_seq, xmit_ts_us, end_seq))
+  {
+    return 0;
+  }
+
+  return xmit_ts_us + rack->rtt_us + rack->reo_wnd_us;
+}
+
+// Probe timeout for a tail loss probe. Receivers in this protocol ACK every
+// segment immediately, so no delayed ACK allowance is added.
+uint32_t rack_probe_timeout(uint32_t srtt_us)
+{
+  if (srtt_us == 0)
+  {
+    return RACK_DEFAULT_PTO_US;
+  }
+
+  uint32_t pto = 2 * srtt_us;
+  return pto < RACK_MIN_PTO_US ? RACK_MIN_PTO_US : pto;
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include "recv_buffer.h"
+
+#define RECV_BUFFER_MASK (RECV_BUFFER_SIZE - 1)
+
+static recv_chunk *chunk_at(recv_buffer *buf, int i)
+{
+  return &buf->chunks[(buf->chunk_head + i) % RECV_BUFFER_CHUNKS];
+}
+
+// Initialize an empty buffer
+void recv_buffer_init(recv_buffer *buf)
+{
+  buf->head = 0;
+  buf->tail = 0;
+  buf->unread = 0;
+  buf->chunk_head = 0;
+  buf->chunk_count = 0;
+}
+
+// Append len bytes of stream_id starting at stream_offset
+int recv_buffer_write(recv_buffer *buf, int has_stream, uint16_t stream_id,
+                      uint32_t stream_offset, const char *data, size_t len)
+{
+  if (len == 0)
+  {
+    return 0;
+  }
+  if (len > RECV_BUFFER_SIZE - recv_buffer_used(buf))
+  {
+    return -1;
+  }
+
+  // Data that continues the last run extends it
+  recv_chunk *last = buf->chunk_count > 0 ? chunk_at(buf, buf->chunk_count - 1) : NULL;
+  if (last != NULL && last->has_stream == has_stream && last->stream_id == stream_id &&
+      (!has_stream || last->stream_offset + last->len == stream_offset))
+  {
+    last->len += len;
+  }
+  else
+  {
+    if (buf->chunk_count == RECV_BUFFER_CHUNKS)
+    {
+      return -1;
+    }
+    recv_chunk *chunk = chunk_at(buf, buf->chunk_count);
+    chunk->start = buf->tail;
+    chunk->len = len;
+    chunk->consumed = 0;
+    chunk->stream_offset = stream_offset;
+    chunk->stream_id = stream_id;
+    chunk->has_stream = has_stream;
+    buf->chunk_count++;
+  }
+
+  // The run may wrap around the end of the storage
+  size_t offset = buf->tail & RECV_BUFFER_MASK;
+  size_t first = RECV_BUFFER_SIZE - offset;
+  if (first > len)
+  {
+    first = len;
+  }
+  memcpy(buf->data + offset, data, first);
+  memcpy(buf->data, data + first, len - first);
+
+  buf->tail += len;
+  buf->unread += len;
+  return 0;
+}
+
+// Copy up to len bytes of the oldest unread run of stream_id into out
+size_t recv_buffer_read(recv_buffer *buf, uint16_t stream_id, char *out, size_t len,
+                        int *has_stream)
+{
+  int i = 0;
+  while (i < buf->chunk_count &&
+         (chunk_at(buf, i)->stream_id != stream_id ||
+          chunk_at(buf, i)->consumed == chunk_at(buf, i)->len))
+  {
+    i++;
+  }
+  if (i == buf->chunk_count)
+  {
+    return 0;
+  }
+
+  recv_chunk *chunk = chunk_at(buf, i);
+  if (len > chunk->len - chunk->consumed)
+  {
+    len = chunk->len - chunk->consumed;
+  }
+
+  size_t offset = (chunk->start + chunk->consumed) & RECV_BUFFER_MASK;
+  size_t first = RECV_BUFFER_SIZE - offset;
+  if (first > len)
+  {
+    first = len;
+  }
+  memcpy(out, buf->data + offset, first);
+  memcpy(out + first, buf->data, len - first);
+
+  chunk->consumed += len;
+  buf->unread -= len;
+  *has_stream = chunk->has_stream;
+
+  // Release the runs read through at the front, and what was read of the
+  // oldest one left
+  while (buf->chunk_count > 0 && chunk_at(buf, 0)->consumed == chunk_at(buf, 0)->len)
+  {
+    buf->chunk_head = (buf->chunk_head + 1) % RECV_BUFFER_CHUNKS;
+    buf->chunk_count--;
+  }
+  if (buf->chunk_count > 0)
+  {
+    buf->head = chunk_at(buf, 0)->start + chunk_at(buf, 0)->consumed;
+  }
+  else
+  {
+    buf->head = buf->tail;
+  }
+
+  return len;
+}
+
+// The stream of the oldest unread byte, -1 if everything was read
+int recv_buffer_next_stream(recv_buffer *buf)
+{
+  for (int i = 0; i < buf->chunk_count; i++)
+  {
+    recv_chunk *chunk = chunk_at(buf, i);
+    if (chunk->consumed < chunk->len)
+    {
+      return chunk->stream_id;
+    }
+  }
+
+  return -1;
+}
+
+// Bytes taking up space, including those read already but not released
+uint32_t recv_buffer_used(recv_buffer *buf)
+{
+  return buf->tail - buf->head;
+}
+
+// Bytes not yet read
+uint32_t recv_buffer_unread(recv_buffer *buf)
+{
+  return buf->unread;
+}
+
+// Runs that can still be started
+int recv_buffer_chunks_free(recv_buffer *buf)
+{
+  return RECV_BUFFER_CHUNKS - buf->chunk_count;
+}
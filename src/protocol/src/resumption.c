@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "resumption.h"
+
+// Token layout, all fields big-endian:
+//   0  issue time in microseconds (8)
+//   8  mss (2), window (2), cwnd (2), reserved (2)
+//  16  srtt_us (4), rttvar_us (4)
+//  24  SipHash-2-4 over bytes 0..23 and the client address (8)
+#define TOKEN_BODY_SIZE 24
+
+static void put_be(uint8_t *p, uint64_t v, int bytes)
+{
+  for (int i = bytes - 1; i >= 0; i--)
+  {
+    p[i] = (uint8_t)v;
+    v >>= 8;
+  }
+}
+
+static uint64_t get_be(const uint8_t *p, int bytes)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++)
+  {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+// MAC over the token body bound to the client address, so a token
+// captured on the way cannot be presented from elsewhere
+static uint64_t token_mac(const uint8_t key[RESUME_KEY_SIZE], uint32_t client_ip,
+                          const uint8_t *body)
+{
+  uint8_t input[TOKEN_BODY_SIZE + 4];
+  memcpy(input, body, TOKEN_BODY_SIZE);
+  memcpy(input + TOKEN_BODY_SIZE, &client_ip, 4);
+  return siphash24(key, input, sizeof(input));
+}
+
+// Initialize an issuer with a random key
+void resume_issuer_init(resume_issuer *issuer)
+{
+  memset(issuer, 0, sizeof(resume_issuer));
+
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd >= 0 && read(fd, issuer->key, RESUME_KEY_SIZE) == RESUME_KEY_SIZE)
+  {
+    close(fd);
+    return;
+  }
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+
+  // No entropy source, tokens are still bound to this process
+  printf("Could not read /dev/urandom, deriving the resumption key from the clock\n");
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t seed = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ ((uint64_t)getpid() << 16);
+  put_be(issuer->key, seed, 8);
+  put_be(issuer->key + 8, seed * 0x9e3779b97f4a7c15ULL, 8);
+}
+
+// Write a token for a client at client_ip to out
+void resume_token_issue(const uint8_t key[RESUME_KEY_SIZE], uint32_t client_ip,
+                        const resume_params *params, uint64_t now_us,
+                        uint8_t out[RESUME_TOKEN_SIZE])
+{
+  memset(out, 0, RESUME_TOKEN_SIZE);
+  put_be(out, now_us, 8);
+  put_be(out + 8, params->mss, 2);
+  put_be(out + 10, params->window, 2);
+  put_be(out + 12, params->cwnd, 2);
+  put_be(out + 16, params->srtt_us, 4);
+  put_be(out + 20, params->rttvar_us, 4);
+  put_be(out + TOKEN_BODY_SIZE, token_mac(key, client_ip, out), 8);
+}
+
+// Check a token's MAC, address and age
+int resume_token_verify(const uint8_t key[RESUME_KEY_SIZE], uint32_t client_ip,
+                        const uint8_t token[RESUME_TOKEN_SIZE], uint64_t now_us,
+                        resume_params *params)
+{
+  if (get_be(token + TOKEN_BODY_SIZE, 8) != token_mac(key, client_ip, token))
+  {
+    return -1;
+  }
+
+  uint64_t issued = get_be(token, 8);
+  if (issued > now_us || now_us - issued > RESUME_LIFETIME_US)
+  {
+    return -1;
+  }
+
+  params->mss = (uint16_t)get_be(token + 8, 2);
+  params->window = (uint16_t)get_be(token + 10, 2);
+  params->cwnd = (uint16_t)get_be(token + 12, 2);
+  params->srtt_us = (uint32_t)get_be(token + 16, 4);
+  params->rttvar_us = (uint32_t)get_be(token + 20, 4);
+  return 0;
+}
+
+// Verify a token and refuse it if it was redeemed before
+int resume_token_redeem(resume_issuer *issuer, uint32_t client_ip,
+                        const uint8_t token[RESUME_TOKEN_SIZE], uint64_t now_us,
+                        resume_params *params)
+{
+  if (resume_token_verify(issuer->key, client_ip, token, now_us, params) < 0)
+  {
+    return -1;
+  }
+
+  uint64_t mac = get_be(token + TOKEN_BODY_SIZE, 8);
+  uint64_t issued = get_be(token, 8);
+  if (issued <= issuer->floor_us)
+  {
+    printf("Resumption token older than the replay floor, refusing it\n");
+    return -1;
+  }
+  for (int i = 0; i < issuer->used_count; i++)
+  {
+    if (issuer->used[i].mac == mac)
+    {
+      printf("Resumption token replayed, refusing it\n");
+      return -1;
+    }
+  }
+
+  // The token forgotten to make room may still be presented until it
+  // expires, the floor keeps it out
+  resume_redeemed *slot = &issuer->used[issuer->used_next];
+  if (issuer->used_count == RESUME_REPLAY_SLOTS)
+  {
+    if (slot->issued_us > issuer->floor_us)
+    {
+      issuer->floor_us = slot->issued_us;
+    }
+  }
+  else
+  {
+    issuer->used_count++;
+  }
+  slot->mac = mac;
+  slot->issued_us = issued;
+  issuer->used_next = (issuer->used_next + 1) % RESUME_REPLAY_SLOTS;
+  return 0;
+}
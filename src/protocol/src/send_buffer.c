@@ -0,0 +1,69 @@
+#include <string.h>
+#include "send_buffer.h"
+
+#define SEND_BUFFER_MASK (SEND_BUFFER_SIZE - 1)
+
+// Initialize an empty buffer whose first byte will carry sequence number seq
+void send_buffer_init(send_buffer *buf, uint32_t seq)
+{
+  buf->head = seq;
+  buf->tail = seq;
+}
+
+// Queue up to len bytes at the tail
+size_t send_buffer_write(send_buffer *buf, const char *data, size_t len)
+{
+  uint32_t space = send_buffer_space(buf);
+  if (len > space)
+  {
+    len = space;
+  }
+
+  // The run may wrap around the end of the storage
+  size_t offset = buf->tail & SEND_BUFFER_MASK;
+  size_t first = SEND_BUFFER_SIZE - offset;
+  if (first > len)
+  {
+    first = len;
+  }
+  memcpy(buf->data + offset, data, first);
+  memcpy(buf->data, data + first, len - first);
+
+  buf->tail += len;
+  return len;
+}
+
+// Copy len queued bytes starting at sequence number seq
+void send_buffer_read(send_buffer *buf, uint32_t seq, char *out, size_t len)
+{
+  size_t offset = seq & SEND_BUFFER_MASK;
+  size_t first = SEND_BUFFER_SIZE - offset;
+  if (first > len)
+  {
+    first = len;
+  }
+  memcpy(out, buf->data + offset, first);
+  memcpy(out + first, buf->data, len - first);
+}
+
+// Release the bytes acknowledged up to, not including, ack
+void send_buffer_ack(send_buffer *buf, uint32_t ack)
+{
+  // Never move past what was queued
+  if ((int32_t)(ack - buf->head) > 0 && (int32_t)(buf->tail - ack) >= 0)
+  {
+    buf->head = ack;
+  }
+}
+
+// Bytes queued and not yet acknowledged
+uint32_t send_buffer_used(send_buffer *buf)
+{
+  return buf->tail - buf->head;
+}
+
+// Bytes that can still be queued
+uint32_t send_buffer_space(send_buffer *buf)
+{
+  return SEND_BUFFER_SIZE - send_buffer_used(buf);
+}
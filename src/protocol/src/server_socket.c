@@ -14,11 +14,12 @@
 #include "packet.h"
 #include "client_manager.h"
 #include "flow_control.h"
+#include "framing.h"
 
 #define PORT 12345
 
 // Initialize socket and bind to server address
-int init(int server_port, int *server_socket, struct sockaddr_in *server_address)
+int init_server(int server_port, int *server_socket, struct sockaddr_in *server_address)
 {
   if ((*server_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
   {
@@ -131,9 +132,16 @@ void handle_data_exchange(int socket_fd, int server_port, packet *received_packe
     packet ack_packet;
     init_packet(&ack_packet, server_port, received_packet->source_port);
     ack_packet.seq_num = client->current_seq_num;
-    ack_packet.ack_num = received_packet->seq_num + strlen(received_packet->payload);
+    ack_packet.ack_num = received_packet->seq_num + packet_payload_len(received_packet);
     ack_packet.flags = ACK;
     ack_packet.payload[0] = '\0'; // Empty payload for pure ACK
+
+    // Echo the timestamp for RTT measurement and the one-way delay so
+    // delay-based senders can see queueing
+    ack_packet.data_offset = TIMESTAMP_DATA_OFFSET;
+    ack_packet.ts_val = (uint32_t)get_time_us();
+    ack_packet.ts_ecr = received_packet->ts_val;
+    ack_packet.delay_echo = ack_packet.ts_val - received_packet->ts_val;
     ack_packet.checksum = calculate_checksum(&ack_packet);
 
     sendto(socket_fd, &ack_packet, sizeof(ack_packet), 0,
@@ -161,18 +169,58 @@ void handle_data_with_flow_control(int socket_fd, int server_port, packet *recei
   {
     // First data packet, initialize flow control
     client->fc_state = malloc(sizeof(flow_control_state));
-    if (client->fc_state == NULL)
+    client->decoder = malloc(sizeof(frame_decoder));
+    if (client->fc_state == NULL || client->decoder == NULL)
     {
       perror("malloc failed for flow control state");
+      free(client->fc_state);
+      free(client->decoder);
+      client->fc_state = NULL;
+      client->decoder = NULL;
       return;
     }
 
     init_flow_control(client->fc_state, socket_fd, client_address,
                       server_port, received_packet->source_port);
+    frame_decoder_init(client->decoder);
+  }
+
+  // Process the received data using flow control. In-order data lands in
+  // the client's message decoder directly, followed by anything the
+  // segment moved from the reassembly queue to the receive buffer.
+  size_t space;
+  size_t bytes = 0;
+  char *in = frame_decoder_space(client->decoder, &space);
+  if (flow_control_on_data(client->fc_state, received_packet, 0, in, space, &bytes) > 0)
+  {
+    frame_decoder_commit(client->decoder, bytes);
   }
 
-  // Process the received data using flow control
-  printf("Received data packet: %u bytes\n", (unsigned int)strlen(received_packet->payload));
+  int copied;
+  do
+  {
+    in = frame_decoder_space(client->decoder, &space);
+    copied = flow_control_read(client->fc_state, in, space);
+    if (copied > 0)
+    {
+      frame_decoder_commit(client->decoder, copied);
+    }
+  } while (copied > 0 && space > 0);
+
+  // A message may span segments, only complete ones are handled
+  const char *msg;
+  uint32_t msg_len;
+  int result;
+  while ((result = frame_decoder_next(client->decoder, &msg, &msg_len)) > 0)
+  {
+    printf("Received message: %.*s\n", (int)msg_len, msg);
+  }
+
+  if (result < 0)
+  {
+    printf("Client sent a malformed message stream. Discarding buffered data.\n");
+    frame_decoder_init(client->decoder);
+  }
 }
 
 // Main server loop
@@ -272,7 +320,7 @@ int main(int argc, char *argv[])
     printf("No arguments provided. Using default values: %d\n", server_port);
   }
 
-  if (!init(server_port, &server_socket, &server_address))
+  if (!init_server(server_port, &server_socket, &server_address))
   {
     return 1;
   }
@@ -0,0 +1,76 @@
+#include "siphash.h"
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+static uint64_t load_le64(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--)
+  {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static void sip_round(uint64_t v[4])
+{
+  v[0] += v[1];
+  v[1] = ROTL(v[1], 13);
+  v[1] ^= v[0];
+  v[0] = ROTL(v[0], 32);
+  v[2] += v[3];
+  v[3] = ROTL(v[3], 16);
+  v[3] ^= v[2];
+  v[0] += v[3];
+  v[3] = ROTL(v[3], 21);
+  v[3] ^= v[0];
+  v[2] += v[1];
+  v[1] = ROTL(v[1], 17);
+  v[1] ^= v[2];
+  v[2] = ROTL(v[2], 32);
+}
+
+// SipHash-2-4 of len bytes under a 128-bit key
+uint64_t siphash24(const uint8_t key[SIPHASH_KEY_SIZE], const void *data, size_t len)
+{
+  const uint8_t *in = data;
+  uint64_t k0 = load_le64(key);
+  uint64_t k1 = load_le64(key + 8);
+  uint64_t v[4] = {
+      k0 ^ 0x736f6d6570736575ULL,
+      k1 ^ 0x646f72616e646f6dULL,
+      k0 ^ 0x6c7967656e657261ULL,
+      k1 ^ 0x7465646279746573ULL,
+  };
+
+  // Two compression rounds per full 8-byte word
+  size_t full = len & ~(size_t)7;
+  for (size_t i = 0; i < full; i += 8)
+  {
+    uint64_t m = load_le64(in + i);
+    v[3] ^= m;
+    sip_round(v);
+    sip_round(v);
+    v[0] ^= m;
+  }
+
+  // The last word holds the remaining bytes and the length
+  uint64_t b = (uint64_t)len << 56;
+  for (size_t i = 0; i < (len & 7); i++)
+  {
+    b |= (uint64_t)in[full + i] << (8 * i);
+  }
+  v[3] ^= b;
+  sip_round(v);
+  sip_round(v);
+  v[0] ^= b;
+
+  // Four finalization rounds
+  v[2] ^= 0xff;
+  for (int i = 0; i < 4; i++)
+  {
+    sip_round(v);
+  }
+
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
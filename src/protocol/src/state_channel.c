@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "state_channel.h"
+
+// Initialize a channel with no keys
+void state_channel_init(state_channel *ch)
+{
+  memset(ch, 0, sizeof(state_channel));
+}
+
+// Whether a sent value is waiting for its acknowledgment
+static int in_flight(const state_out *slot)
+{
+  return slot->sent > slot->acked;
+}
+
+// Whether a key has nothing left to deliver, so its slot may be reused
+static int settled(const state_out *slot)
+{
+  return slot->acked >= slot->version;
+}
+
+// Set a key's latest value
+int state_channel_set(state_channel *ch, uint16_t key, const void *data, size_t len)
+{
+  if (len > STATE_MAX_VALUE)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  // The key's own slot, else a free one, else one that is settled
+  state_out *slot = NULL;
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    state_out *candidate = &ch->out[i];
+    if (candidate->used && candidate->key == key)
+    {
+      slot = candidate;
+      break;
+    }
+    if (slot == NULL || (slot->used && !candidate->used))
+    {
+      if (!candidate->used || settled(candidate))
+      {
+        slot = candidate;
+      }
+    }
+  }
+  if (slot == NULL)
+  {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  if (!slot->used || slot->key != key)
+  {
+    memset(slot, 0, sizeof(state_out));
+    slot->used = 1;
+    slot->key = key;
+  }
+  slot->version = ++ch->next_version;
+  slot->len = len;
+  memcpy(slot->value, data, len);
+  return 0;
+}
+
+// When an unacknowledged send of a slot is given up as lost
+static uint64_t resend_deadline(const state_out *slot, uint64_t resend_us)
+{
+  if (resend_us < STATE_MIN_RESEND_US)
+  {
+    resend_us = STATE_MIN_RESEND_US;
+  }
+  return slot->sent_us + (resend_us << slot->retries);
+}
+
+// A value due to be sent at now
+state_out *state_channel_due(state_channel *ch, uint64_t now, uint64_t resend_us)
+{
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    state_out *slot = &ch->out[i];
+    if (!slot->used || settled(slot))
+    {
+      continue;
+    }
+
+    // A newer value waits for the one in flight, it replaces it if that
+    // one is lost
+    if (!in_flight(slot))
+    {
+      return slot;
+    }
+    if (now < resend_deadline(slot, resend_us))
+    {
+      continue;
+    }
+    if (slot->retries + 1 >= STATE_MAX_RETRIES)
+    {
+      printf("State key %u went unacknowledged %d times, dropping it\n", slot->key,
+             slot->retries + 1);
+      slot->acked = slot->version;
+      continue;
+    }
+    return slot;
+  }
+
+  return NULL;
+}
+
+// Record that a key's latest value was sent
+void state_channel_sent(state_out *slot, uint64_t now)
+{
+  slot->retries = in_flight(slot) ? slot->retries + 1 : 0;
+  slot->sent = slot->version;
+  slot->sent_us = now;
+}
+
+// The peer acknowledged version of a key
+void state_channel_on_ack(state_channel *ch, uint16_t key, uint32_t version)
+{
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    state_out *slot = &ch->out[i];
+    if (slot->used && slot->key == key)
+    {
+      if (version > slot->acked && version <= slot->version)
+      {
+        slot->acked = version;
+      }
+      return;
+    }
+  }
+}
+
+// A value arrived
+int state_channel_on_value(state_channel *ch, uint16_t key, uint32_t version, const void *data,
+                           size_t len)
+{
+  if (len > STATE_MAX_VALUE)
+  {
+    return -1;
+  }
+
+  // The key's own entry, else a free one, else one already taken
+  state_in *entry = NULL;
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    state_in *candidate = &ch->in[i];
+    if (candidate->used && candidate->key == key)
+    {
+      entry = candidate;
+      break;
+    }
+    if (!candidate->used || !candidate->fresh)
+    {
+      if (entry == NULL || (entry->used && !candidate->used))
+      {
+        entry = candidate;
+      }
+    }
+  }
+  if (entry == NULL)
+  {
+    return -1;
+  }
+
+  if (entry->used && entry->key == key)
+  {
+    if (version <= entry->version)
+    {
+      return 0;
+    }
+  }
+  else
+  {
+    entry->used = 1;
+    entry->key = key;
+  }
+
+  entry->version = version;
+  entry->fresh = 1;
+  entry->len = len;
+  memcpy(entry->value, data, len);
+  return 1;
+}
+
+// Whether any received key changed since it was last taken
+int state_channel_readable(const state_channel *ch)
+{
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    if (ch->in[i].used && ch->in[i].fresh)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Copy the value of a key that changed since it was last taken
+ssize_t state_channel_take(state_channel *ch, uint16_t *key, void *buffer, size_t len)
+{
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    state_in *entry = &ch->in[i];
+    if (!entry->used || !entry->fresh)
+    {
+      continue;
+    }
+    if (len < entry->len)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    *key = entry->key;
+    memcpy(buffer, entry->value, entry->len);
+    entry->fresh = 0;
+    return entry->len;
+  }
+
+  errno = EAGAIN;
+  return -1;
+}
+
+// When state_channel_due() will next have a value
+uint64_t state_channel_next_timer(const state_channel *ch, uint64_t resend_us)
+{
+  uint64_t wake = 0;
+
+  for (int i = 0; i < STATE_MAX_KEYS; i++)
+  {
+    const state_out *slot = &ch->out[i];
+    if (!slot->used || settled(slot))
+    {
+      continue;
+    }
+
+    // A value not sent yet is due right away
+    uint64_t due = in_flight(slot) ? resend_deadline(slot, resend_us) : 1;
+    if (wake == 0 || due < wake)
+    {
+      wake = due;
+    }
+  }
+
+  return wake;
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "stream.h"
+
+// Sequence number comparison that tolerates wrap-around
+#define STREAM_SEQ_LT(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+static stream_chunk *chunk_at(stream_map *map, int i)
+{
+  return &map->chunks[(map->head + i) % MAX_STREAM_CHUNKS];
+}
+
+// Initialize an empty map, all streams at offset 0
+void stream_map_init(stream_map *map)
+{
+  memset(map, 0, sizeof(stream_map));
+}
+
+// Forget the queued chunks, stream offsets carry on
+void stream_map_clear(stream_map *map)
+{
+  map->head = 0;
+  map->count = 0;
+}
+
+// Record len bytes of stream_id queued at seq_num
+size_t stream_map_add(stream_map *map, uint16_t stream_id, uint32_t seq_num, size_t len)
+{
+  if (len == 0 || stream_id >= MAX_STREAMS)
+  {
+    return 0;
+  }
+
+  // Consecutive writes to one stream extend its last chunk
+  if (map->count > 0)
+  {
+    stream_chunk *last = chunk_at(map, map->count - 1);
+    if (last->stream_id == stream_id && last->seq_num + last->len == seq_num)
+    {
+      last->len += len;
+      map->snd_offset[stream_id] += len;
+      return len;
+    }
+  }
+
+  if (map->count == MAX_STREAM_CHUNKS)
+  {
+    return 0;
+  }
+
+  stream_chunk *chunk = chunk_at(map, map->count);
+  chunk->seq_num = seq_num;
+  chunk->len = len;
+  chunk->stream_offset = map->snd_offset[stream_id];
+  chunk->stream_id = stream_id;
+  map->count++;
+
+  map->snd_offset[stream_id] += len;
+  return len;
+}
+
+// Look up the stream of the byte at seq_num
+uint32_t stream_map_lookup(stream_map *map, uint32_t seq_num, uint16_t *stream_id,
+                           uint32_t *stream_offset)
+{
+  for (int i = 0; i < map->count; i++)
+  {
+    stream_chunk *chunk = chunk_at(map, i);
+    uint32_t into = seq_num - chunk->seq_num;
+    if (into < chunk->len)
+    {
+      *stream_id = chunk->stream_id;
+      *stream_offset = chunk->stream_offset + into;
+      return chunk->len - into;
+    }
+  }
+
+  return 0;
+}
+
+// Drop chunks acknowledged up to, not including, ack
+void stream_map_ack(stream_map *map, uint32_t ack)
+{
+  while (map->count > 0)
+  {
+    stream_chunk *chunk = chunk_at(map, 0);
+    if (STREAM_SEQ_LT(ack, chunk->seq_num + chunk->len))
+    {
+      break;
+    }
+
+    map->head = (map->head + 1) % MAX_STREAM_CHUNKS;
+    map->count--;
+  }
+}
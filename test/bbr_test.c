@@ -0,0 +1,176 @@
+#include "test_utils.h"
+#include "bbr.h"
+
+#define TEST_MSS 44
+
+// Deliver one round trip worth of data at a fixed bandwidth and RTT
+static void deliver_round(bbr_state *bbr, uint64_t *now_us, uint64_t bw,
+                          uint32_t rtt_us, uint32_t in_flight)
+{
+  rate_sample rs;
+  memset(&rs, 0, sizeof(rs));
+
+  *now_us += rtt_us;
+  rs.now_us = *now_us;
+  rs.acked = bw * rtt_us / 1000000;
+  rs.delivered = rs.acked;
+  rs.prior_delivered = bbr->delivered;
+  rs.interval_us = rtt_us;
+  rs.rtt_us = rtt_us;
+  rs.in_flight = in_flight;
+
+  bbr_on_ack(bbr, &rs);
+}
+
+// Test initial BBR state
+int test_bbr_init()
+{
+  bbr_state bbr;
+  bbr_init(&bbr, TEST_MSS);
+
+  ASSERT_EQUAL(BBR_STARTUP, bbr.mode);
+  ASSERT_EQUAL(BBR_INITIAL_CWND_SEGMENTS * TEST_MSS, bbr.cwnd);
+  ASSERT_EQUAL(BBR_HIGH_GAIN, bbr.pacing_gain);
+  ASSERT_EQUAL(0, bbr.min_rtt_us);
+  ASSERT_TRUE(bbr.pacing_rate > 0);
+
+  return TEST_PASS;
+}
+
+// Test that startup finds the bottleneck, drains and settles in PROBE_BW
+int test_bbr_startup_to_probe_bw()
+{
+  bbr_state bbr;
+  uint64_t now = 0;
+  uint64_t bw = 200000; // 200 KB/s
+  uint32_t rtt = 10000; // 10 ms
+  uint32_t bdp = bw * rtt / 1000000;
+
+  bbr_init(&bbr, TEST_MSS);
+
+  for (int round = 0; round < 10 && bbr.mode != BBR_PROBE_BW; round++)
+  {
+    deliver_round(&bbr, &now, bw, rtt, bdp);
+  }
+
+  ASSERT_EQUAL(BBR_PROBE_BW, bbr.mode);
+  ASSERT_TRUE(bbr.filled_pipe);
+  ASSERT_EQUAL((int)bw, (int)bbr.max_bw);
+  ASSERT_EQUAL((int)rtt, (int)bbr.min_rtt_us);
+  ASSERT_EQUAL((int)bdp, (int)bbr_inflight(&bbr, BBR_UNIT));
+
+  // Inflight is capped at cwnd_gain * BDP plus the aggregation allowance
+  for (int round = 0; round < 5; round++)
+  {
+    deliver_round(&bbr, &now, bw, rtt, bdp);
+  }
+  ASSERT_TRUE(bbr.cwnd <= 2 * bdp + 3 * TEST_MSS);
+
+  // Pacing follows the bandwidth estimate once the pipe is full
+  ASSERT_TRUE(bbr.pacing_rate >= bw * 3 / 4);
+  ASSERT_TRUE(bbr.pacing_rate <= bw * 5 / 4);
+
+  return TEST_PASS;
+}
+
+// Test that the windowed max filter forgets old bandwidth samples
+int test_bbr_bw_filter_expiry()
+{
+  bbr_state bbr;
+  uint64_t now = 0;
+  uint32_t rtt = 10000;
+
+  bbr_init(&bbr, TEST_MSS);
+
+  deliver_round(&bbr, &now, 400000, rtt, 0);
+  ASSERT_EQUAL(400000, (int)bbr.max_bw);
+
+  for (int round = 0; round < BBR_BW_FILTER_ROUNDS; round++)
+  {
+    deliver_round(&bbr, &now, 100000, rtt, 0);
+  }
+  ASSERT_EQUAL(100000, (int)bbr.max_bw);
+
+  return TEST_PASS;
+}
+
+// Test PROBE_RTT entry on a stale min RTT and recovery afterwards
+int test_bbr_probe_rtt()
+{
+  bbr_state bbr;
+  uint64_t now = 0;
+  uint64_t bw = 200000;
+  uint32_t rtt = 10000;
+
+  bbr_init(&bbr, TEST_MSS);
+
+  for (int round = 0; round < 10; round++)
+  {
+    deliver_round(&bbr, &now, bw, rtt, 0);
+  }
+  ASSERT_EQUAL(BBR_PROBE_BW, bbr.mode);
+  uint32_t cwnd_before = bbr.cwnd;
+
+  // Queueing delay hides the true min RTT until the filter window expires
+  now += BBR_MIN_RTT_WINDOW_US;
+  deliver_round(&bbr, &now, bw, rtt * 2, bbr.cwnd);
+  ASSERT_EQUAL(BBR_PROBE_RTT, bbr.mode);
+  ASSERT_EQUAL(BBR_MIN_CWND_SEGMENTS * TEST_MSS, bbr.cwnd);
+
+  // Hold inflight at the minimum for the probe duration
+  for (int round = 0; round < 30 && bbr.mode == BBR_PROBE_RTT; round++)
+  {
+    deliver_round(&bbr, &now, bw, rtt, 2 * TEST_MSS);
+  }
+
+  ASSERT_EQUAL(BBR_PROBE_BW, bbr.mode);
+  ASSERT_EQUAL((int)rtt, (int)bbr.min_rtt_us);
+  ASSERT_TRUE(bbr.cwnd >= cwnd_before);
+
+  return TEST_PASS;
+}
+
+// Test that BBR ignores Reno loss reactions in congestion control
+int test_bbr_congestion_control()
+{
+  congestion_control_state cc_state;
+  flow_control_state fc_state;
+
+  memset(&fc_state, 0, sizeof(fc_state));
+  fc_state.receiver_window = 10000;
+
+  init_congestion_control(&cc_state, TEST_MSS);
+  set_congestion_algorithm(&cc_state, CC_BBR);
+  ASSERT_EQUAL(CC_BBR, cc_state.algorithm);
+  ASSERT_EQUAL(BBR_INITIAL_CWND_SEGMENTS * TEST_MSS, cc_state.cwnd);
+  ASSERT_TRUE(get_pacing_rate(&cc_state) > 0);
+
+  // Duplicate ACKs do not halve the window
+  cc_state.last_ack = 1000;
+  uint16_t cwnd = cc_state.cwnd;
+  for (int i = 0; i < DUPLICATE_ACK_THRESHOLD; i++)
+  {
+    update_congestion_window(&cc_state, &fc_state, 1000, 1);
+  }
+  ASSERT_EQUAL(cwnd, cc_state.cwnd);
+  ASSERT_TRUE(cc_state.state != FAST_RECOVERY);
+
+  // A timeout restarts from the minimum window
+  handle_timeout(&cc_state);
+  ASSERT_EQUAL(BBR_MIN_CWND_SEGMENTS * TEST_MSS, cc_state.cwnd);
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_bbr_init);
+  RUN_TEST(test_bbr_startup_to_probe_bw);
+  RUN_TEST(test_bbr_bw_filter_expiry);
+  RUN_TEST(test_bbr_probe_rtt);
+  RUN_TEST(test_bbr_congestion_control);
+
+  printf("All BBR tests passed!\n");
+  return TEST_PASS;
+}
@@ -0,0 +1,202 @@
+#include "test_utils.h"
+#include "buffer_pool.h"
+#include <pthread.h>
+
+#define THREADS 4
+#define THREAD_ROUNDS 20000
+
+// Test that buffers are aligned, distinct and sized as asked
+int test_buffer_pool_alloc()
+{
+  static void *bufs[1000];
+  buffer_pool pool;
+  buffer_pool_stats stats;
+
+  ASSERT_EQUAL(-1, buffer_pool_init(&pool, 0, 0));
+  ASSERT_EQUAL(-1, buffer_pool_init(&pool, BUFFER_SLAB_SIZE, 0));
+  ASSERT_EQUAL(0, buffer_pool_init(&pool, 100, 0));
+
+  for (int i = 0; i < 1000; i++)
+  {
+    bufs[i] = buffer_alloc(&pool);
+    ASSERT_TRUE(bufs[i] != NULL);
+    ASSERT_EQUAL(0, (int)((uintptr_t)bufs[i] % BUFFER_CACHE_LINE));
+    ASSERT_EQUAL(1, (int)buffer_refs(bufs[i]));
+    memset(bufs[i], i & 0xff, 100);
+  }
+  for (int i = 0; i < 1000; i++)
+  {
+    for (int j = 0; j < 100; j++)
+    {
+      ASSERT_EQUAL(i & 0xff, ((unsigned char *)bufs[i])[j]);
+    }
+  }
+
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(100, (int)stats.buffer_size);
+  ASSERT_EQUAL(1000, (int)stats.in_use);
+  ASSERT_EQUAL(1, (int)stats.slabs);
+  ASSERT_EQUAL(BUFFER_SLAB_SIZE / (BUFFER_CACHE_LINE + 128), (int)stats.buffers);
+
+  for (int i = 0; i < 1000; i++)
+  {
+    buffer_release(bufs[i]);
+  }
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(0, (int)stats.in_use);
+  ASSERT_EQUAL(1000, (int)stats.frees);
+
+  // Released buffers are taken again before a new slab
+  for (int i = 0; i < 1000; i++)
+  {
+    bufs[i] = buffer_alloc(&pool);
+  }
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(1, (int)stats.slabs);
+  for (int i = 0; i < 1000; i++)
+  {
+    buffer_release(bufs[i]);
+  }
+
+  buffer_pool_destroy(&pool);
+  return TEST_PASS;
+}
+
+// Test that a buffer returns to the pool with its last reference only
+int test_buffer_pool_refs()
+{
+  buffer_pool pool;
+  buffer_pool_stats stats;
+
+  ASSERT_EQUAL(0, buffer_pool_init(&pool, 64, BUFFER_POOL_HUGE_PAGES));
+  char *buf = buffer_alloc(&pool);
+  ASSERT_TRUE(buf != NULL);
+  strcpy(buf, "shared");
+
+  ASSERT_TRUE(buffer_retain(buf) == buf);
+  buffer_retain(buf);
+  ASSERT_EQUAL(3, (int)buffer_refs(buf));
+  buffer_release(buf);
+  buffer_release(buf);
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(1, (int)stats.in_use);
+  ASSERT_TRUE(strcmp(buf, "shared") == 0);
+
+  buffer_release(buf);
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(0, (int)stats.in_use);
+
+  // Whatever backs the slab, huge pages or not, holds the buffers
+  ASSERT_EQUAL(1, (int)stats.slabs);
+  ASSERT_TRUE(stats.huge_slabs <= 1);
+  buffer_pool_destroy(&pool);
+  return TEST_PASS;
+}
+
+// Allocates in one thread, shares with the next through a queue of one
+typedef struct
+{
+  buffer_pool *pool;
+  int id;
+  int errors;
+} worker_arg;
+
+static void *worker(void *p)
+{
+  worker_arg *arg = p;
+  void *held[16] = {NULL};
+
+  for (int i = 0; i < THREAD_ROUNDS; i++)
+  {
+    int slot = i % 16;
+    if (held[slot] != NULL)
+    {
+      if (((int *)held[slot])[0] != arg->id || ((int *)held[slot])[1] != i - 16)
+      {
+        arg->errors++;
+      }
+      buffer_release(held[slot]);
+    }
+
+    held[slot] = buffer_alloc(arg->pool);
+    if (held[slot] == NULL)
+    {
+      arg->errors++;
+      continue;
+    }
+    ((int *)held[slot])[0] = arg->id;
+    ((int *)held[slot])[1] = i;
+
+    // A second reference taken and dropped, as by another queue
+    buffer_release(buffer_retain(held[slot]));
+  }
+
+  for (int slot = 0; slot < 16; slot++)
+  {
+    if (held[slot] != NULL)
+    {
+      buffer_release(held[slot]);
+    }
+  }
+  return NULL;
+}
+
+// Test that threads allocating and releasing at once never share a buffer
+// and that exiting threads give their cached buffers back
+int test_buffer_pool_threads()
+{
+  buffer_pool pool;
+  buffer_pool_stats stats;
+  pthread_t threads[THREADS];
+  worker_arg args[THREADS];
+
+  ASSERT_EQUAL(0, buffer_pool_init(&pool, 200, 0));
+  for (int i = 0; i < THREADS; i++)
+  {
+    args[i].pool = &pool;
+    args[i].id = i;
+    args[i].errors = 0;
+    ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, worker, &args[i]));
+  }
+  for (int i = 0; i < THREADS; i++)
+  {
+    pthread_join(threads[i], NULL);
+    ASSERT_EQUAL(0, args[i].errors);
+  }
+
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(THREADS * THREAD_ROUNDS, (int)stats.allocs);
+  ASSERT_EQUAL(THREADS * THREAD_ROUNDS, (int)stats.frees);
+  ASSERT_EQUAL(0, (int)stats.in_use);
+  ASSERT_EQUAL(1, (int)stats.slabs);
+  ASSERT_TRUE(pool.caches == NULL);
+
+  // All of them are back for the taking without another slab
+  static void *bufs[BUFFER_SLAB_SIZE / 256];
+  int count = (int)stats.buffers;
+  for (int i = 0; i < count; i++)
+  {
+    bufs[i] = buffer_alloc(&pool);
+    ASSERT_TRUE(bufs[i] != NULL);
+  }
+  buffer_pool_get_stats(&pool, &stats);
+  ASSERT_EQUAL(1, (int)stats.slabs);
+  for (int i = 0; i < count; i++)
+  {
+    buffer_release(bufs[i]);
+  }
+
+  buffer_pool_destroy(&pool);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_buffer_pool_alloc);
+  RUN_TEST(test_buffer_pool_refs);
+  RUN_TEST(test_buffer_pool_threads);
+
+  printf("All buffer pool tests passed!\n");
+  return TEST_PASS;
+}
@@ -0,0 +1,218 @@
+#include "test_utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "chat_log.h"
+
+// Fresh directory for a log
+static void make_log_dir(char *path)
+{
+  strcpy(path, "/tmp/chat_log_testXXXXXX");
+  if (mkdtemp(path) == NULL)
+  {
+    perror("mkdtemp");
+    exit(TEST_FAIL);
+  }
+}
+
+static void remove_log_dir(const char *path)
+{
+  char cmd[PATH_MAX + 16];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", path);
+  if (system(cmd) != 0)
+  {
+    printf("Could not remove %s\n", path);
+  }
+}
+
+// Test that messages are read back in place, by ID and from the end
+int test_log_append_read()
+{
+  char path[PATH_MAX];
+  chat_log log;
+  chat_log_entry entries[8];
+  char text[16];
+
+  make_log_dir(path);
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+  ASSERT_EQUAL(0, chat_log_last(&log, 5, entries, 8));
+
+  for (int i = 1; i <= 100; i++)
+  {
+    int len = snprintf(text, sizeof(text), "message %d", i);
+    ASSERT_EQUAL(i, (int)chat_log_append(&log, text, len, 1000));
+  }
+  ASSERT_EQUAL(0, (int)chat_log_append(&log, text, 0, 1000));
+
+  // Past a sparse index entry, straight out of the mapping
+  ASSERT_EQUAL(3, chat_log_read(&log, 40, entries, 3));
+  ASSERT_EQUAL(40, (int)entries[0].id);
+  ASSERT_EQUAL(10, (int)entries[0].len);
+  ASSERT_TRUE(memcmp(entries[0].data, "message 40", 10) == 0);
+  ASSERT_EQUAL(42, (int)entries[2].id);
+  ASSERT_TRUE(entries[0].data > log.segments[0].map &&
+              entries[0].data < log.segments[0].map + CHAT_LOG_SEGMENT_SIZE);
+
+  ASSERT_EQUAL(5, chat_log_last(&log, 5, entries, 8));
+  ASSERT_EQUAL(96, (int)entries[0].id);
+  ASSERT_TRUE(memcmp(entries[4].data, "message 100", 11) == 0);
+  ASSERT_EQUAL(0, chat_log_read(&log, 101, entries, 8));
+
+  chat_log_close(&log);
+  remove_log_dir(path);
+  return TEST_PASS;
+}
+
+// Test that appends are synced as a group
+int test_log_group_sync()
+{
+  char path[PATH_MAX];
+  chat_log log;
+
+  make_log_dir(path);
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+  ASSERT_EQUAL(0, (int)chat_log_sync_deadline(&log));
+
+  chat_log_append(&log, "one", 3, 1000);
+  chat_log_append(&log, "two", 3, 2000);
+  ASSERT_EQUAL(1000 + CHAT_LOG_SYNC_INTERVAL_US, (int)chat_log_sync_deadline(&log));
+
+  // Not due yet, then one sync for both
+  ASSERT_EQUAL(0, chat_log_sync(&log, 3000, 0));
+  ASSERT_TRUE(chat_log_sync_deadline(&log) != 0);
+  ASSERT_EQUAL(0, chat_log_sync(&log, 1000 + CHAT_LOG_SYNC_INTERVAL_US, 0));
+  ASSERT_EQUAL(0, (int)chat_log_sync_deadline(&log));
+
+  chat_log_close(&log);
+  remove_log_dir(path);
+  return TEST_PASS;
+}
+
+// Test that the log rolls over to new segments and drops the oldest
+int test_log_segments()
+{
+  static char big[8000];
+  char path[PATH_MAX];
+  chat_log log;
+  chat_log_entry entries[4];
+
+  make_log_dir(path);
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+
+  // About 130 records fill a segment
+  int total = 130 * (CHAT_LOG_MAX_SEGMENTS + 2);
+  for (int i = 1; i <= total; i++)
+  {
+    memset(big, 'a' + i % 26, sizeof(big));
+    ASSERT_EQUAL(i, (int)chat_log_append(&log, big, sizeof(big), i));
+  }
+  ASSERT_EQUAL(CHAT_LOG_MAX_SEGMENTS, log.segment_count);
+  ASSERT_TRUE(log.segments[0].base_id > 1);
+
+  // Deleted messages are skipped, a read crosses segment boundaries
+  ASSERT_EQUAL(1, chat_log_read(&log, 1, entries, 1));
+  ASSERT_EQUAL((int)log.segments[0].base_id, (int)entries[0].id);
+  uint64_t boundary = log.segments[3].base_id;
+  ASSERT_EQUAL(4, chat_log_read(&log, boundary - 2, entries, 4));
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT_EQUAL((int)(boundary - 2 + i), (int)entries[i].id);
+    ASSERT_EQUAL('a' + (int)(entries[i].id % 26), entries[i].data[0]);
+  }
+  chat_log_close(&log);
+
+  // Reopening finds the same messages
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+  ASSERT_EQUAL(total + 1, (int)log.next_id);
+  ASSERT_EQUAL(1, chat_log_read(&log, boundary, entries, 1));
+  ASSERT_EQUAL((int)boundary, (int)entries[0].id);
+
+  chat_log_close(&log);
+  remove_log_dir(path);
+  return TEST_PASS;
+}
+
+// Test that a record torn by a crash is cut off on reopening
+int test_log_recovery()
+{
+  char path[PATH_MAX];
+  char segment[PATH_MAX + 32];
+  chat_log log;
+  chat_log_entry entries[8];
+
+  make_log_dir(path);
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+  chat_log_append(&log, "12345678", 8, 1000);
+  chat_log_append(&log, "abcdefgh", 8, 1000);
+  chat_log_append(&log, "ABCDEFGH", 8, 1000);
+  chat_log_close(&log);
+
+  // Each record takes a 16-byte header and 8 bytes, garble the third
+  // record's message as if the crash came before it reached the disk
+  snprintf(segment, sizeof(segment), "%s/%020d.log", path, 1);
+  int fd = open(segment, O_WRONLY);
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQUAL(2, (int)pwrite(fd, "??", 2, 2 * 24 + 16));
+  close(fd);
+
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+  ASSERT_EQUAL(3, (int)log.next_id);
+  ASSERT_EQUAL(2, chat_log_read(&log, 1, entries, 8));
+
+  // New messages take the torn record's place
+  ASSERT_EQUAL(3, (int)chat_log_append(&log, "new", 3, 1000));
+  ASSERT_EQUAL(1, chat_log_read(&log, 3, entries, 8));
+  ASSERT_TRUE(memcmp(entries[0].data, "new", 3) == 0);
+
+  chat_log_close(&log);
+  remove_log_dir(path);
+  return TEST_PASS;
+}
+
+// Test that a segment the file system cannot hold fails the open and
+// leaves no file behind. A file size limit stands in for a full disk.
+int test_log_no_space()
+{
+  char path[PATH_MAX];
+  char segment[PATH_MAX + 32];
+  chat_log log;
+  struct rlimit old_limit;
+  struct rlimit limit;
+
+  make_log_dir(path);
+  signal(SIGXFSZ, SIG_IGN);
+  getrlimit(RLIMIT_FSIZE, &old_limit);
+  limit = old_limit;
+  limit.rlim_cur = CHAT_LOG_SEGMENT_SIZE / 2;
+  ASSERT_EQUAL(0, setrlimit(RLIMIT_FSIZE, &limit));
+
+  int result = chat_log_open(&log, path);
+  int err = errno;
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  signal(SIGXFSZ, SIG_DFL);
+  ASSERT_EQUAL(-1, result);
+  ASSERT_EQUAL(EFBIG, err);
+
+  snprintf(segment, sizeof(segment), "%s/%020llu.log", path, 1ULL);
+  ASSERT_TRUE(access(segment, F_OK) < 0);
+
+  // With room again the log opens as usual
+  ASSERT_EQUAL(0, chat_log_open(&log, path));
+  ASSERT_EQUAL(1, (int)chat_log_append(&log, "hello", 5, 1000));
+  chat_log_close(&log);
+  remove_log_dir(path);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_log_append_read);
+  RUN_TEST(test_log_group_sync);
+  RUN_TEST(test_log_segments);
+  RUN_TEST(test_log_recovery);
+  RUN_TEST(test_log_no_space);
+
+  printf("All chat log tests passed!\n");
+  return TEST_PASS;
+}
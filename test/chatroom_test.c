@@ -0,0 +1,499 @@
+#include "test_utils.h"
+#include "chatroom.h"
+
+// Test that a broadcast shares one message among all recipients
+int test_broadcast_shares_message()
+{
+  static chat_member members[5];
+  chat_directory dir;
+
+  chat_directory_init(&dir, NULL);
+  chat_room *lobby = chat_directory_room(&dir, "lobby");
+  ASSERT_TRUE(lobby != NULL);
+  for (int i = 0; i < 5; i++)
+  {
+    chat_member_init(&members[i], NULL, "user");
+    ASSERT_EQUAL(0, chat_directory_add(&dir, &members[i]));
+    ASSERT_EQUAL(0, chat_room_join(&dir, lobby, &members[i]));
+  }
+
+  chat_msg *msg = chat_msg_encode("lobby", "alice", "hello", 5);
+  ASSERT_TRUE(msg != NULL);
+  ASSERT_EQUAL(20, (int)msg->len);
+  ASSERT_TRUE(memcmp(msg->data, "[lobby] alice: hello", 20) == 0);
+
+  // Everyone but the sender holds a reference to the same bytes
+  ASSERT_EQUAL(4, chat_room_broadcast(&dir, lobby, msg, &members[2]));
+  ASSERT_EQUAL(5, (int)buffer_refs(msg));
+  ASSERT_EQUAL(0, members[2].queue_count);
+  ASSERT_TRUE(members[0].queue[0] == msg && members[4].queue[0] == msg);
+
+  // The last release frees it
+  chat_msg_release(msg);
+  for (int i = 0; i < 4; i++)
+  {
+    chat_member_clear(&members[i]);
+  }
+  ASSERT_EQUAL(1, (int)buffer_refs(msg));
+  chat_member_clear(&members[4]);
+
+  chat_directory_free(&dir);
+  return TEST_PASS;
+}
+
+// Test joining and leaving rooms
+int test_room_membership()
+{
+  static chat_member members[4];
+  chat_directory dir;
+
+  chat_directory_init(&dir, NULL);
+  chat_room *lobby = chat_directory_room(&dir, "lobby");
+  chat_room *dev = chat_directory_room(&dir, "dev");
+  ASSERT_TRUE(chat_directory_room(&dir, "lobby") == lobby);
+  for (int i = 0; i < 4; i++)
+  {
+    chat_member_init(&members[i], NULL, "user");
+    chat_directory_add(&dir, &members[i]);
+    chat_room_join(&dir, lobby, &members[i]);
+  }
+
+  // Joining another room keeps the first, text goes to the new one
+  ASSERT_EQUAL(0, chat_room_join(&dir, dev, &members[1]));
+  ASSERT_EQUAL(4, (int)chat_room_size(&dir, lobby));
+  ASSERT_EQUAL(1, (int)chat_room_size(&dir, dev));
+  ASSERT_EQUAL((int)dev->id, (int)members[1].active_room);
+
+  chat_room_leave(&dir, lobby, &members[1]);
+  chat_msg *msg = chat_msg_encode("lobby", "bob", "hi", 2);
+  ASSERT_EQUAL(3, chat_room_broadcast(&dir, lobby, msg, NULL));
+  ASSERT_EQUAL(0, members[1].queue_count);
+  chat_msg_release(msg);
+
+  // Leaving the active room falls back to another one
+  chat_room_join(&dir, dev, &members[0]);
+  chat_room_leave(&dir, dev, &members[0]);
+  ASSERT_EQUAL((int)lobby->id, (int)members[0].active_room);
+  chat_room_leave(&dir, lobby, &members[0]);
+  ASSERT_EQUAL(-1, (int)members[0].active_room);
+
+  // A removed member's slot goes to the next one added
+  uint32_t slot = members[2].slot;
+  chat_directory_remove(&dir, &members[2]);
+  ASSERT_EQUAL(1, (int)chat_room_size(&dir, lobby));
+  ASSERT_EQUAL(3, (int)dir.member_count);
+  ASSERT_EQUAL(0, chat_directory_add(&dir, &members[2]));
+  ASSERT_EQUAL((int)slot, (int)members[2].slot);
+
+  for (int i = 0; i < 4; i++)
+  {
+    chat_member_clear(&members[i]);
+  }
+  chat_directory_free(&dir);
+  return TEST_PASS;
+}
+
+// Test that a member who cannot keep up loses messages, not the room
+int test_queue_overflow()
+{
+  static chat_member member;
+
+  chat_member_init(&member, NULL, "slow");
+  chat_msg *msg = chat_msg_encode("lobby", "alice", "spam", 4);
+  for (int i = 0; i < CHAT_QUEUE_SIZE; i++)
+  {
+    ASSERT_EQUAL(0, chat_member_enqueue(&member, msg));
+  }
+  ASSERT_EQUAL(-1, chat_member_enqueue(&member, msg));
+  ASSERT_EQUAL(1, (int)member.dropped);
+  ASSERT_EQUAL(CHAT_QUEUE_SIZE + 1, (int)buffer_refs(msg));
+
+  chat_member_clear(&member);
+  ASSERT_EQUAL(1, (int)buffer_refs(msg));
+  chat_msg_release(msg);
+  return TEST_PASS;
+}
+
+// Test that joining members get the latest messages from the room's ring
+int test_recent_replay()
+{
+  static chat_member member;
+  chat_directory dir;
+  char text[8];
+
+  chat_directory_init(&dir, NULL);
+  dir.recent_messages = 4;
+  chat_room *lobby = chat_directory_room(&dir, "lobby");
+  ASSERT_TRUE(lobby != NULL && lobby->cached);
+  for (int i = 0; i < 6; i++)
+  {
+    int len = snprintf(text, sizeof(text), "msg %d", i);
+    chat_msg *msg = chat_msg_encode("lobby", "alice", text, len);
+    ASSERT_EQUAL(0, chat_room_post(&dir, lobby, msg, NULL));
+    chat_msg_release(msg);
+  }
+
+  chat_member_init(&member, NULL, "bob");
+  chat_member_replay(&member, lobby, 3);
+  ASSERT_EQUAL(3, member.queue_count);
+  ASSERT_TRUE(memcmp(member.queue[0]->data, "[lobby] alice: msg 3", 20) == 0);
+  ASSERT_TRUE(memcmp(member.queue[2]->data, "[lobby] alice: msg 5", 20) == 0);
+  chat_member_clear(&member);
+
+  // Without a log, a longer replay gets what the ring still holds
+  chat_member_replay(&member, lobby, 10);
+  ASSERT_EQUAL(4, member.queue_count);
+  ASSERT_TRUE(memcmp(member.queue[member.queue_head]->data, "[lobby] alice: msg 2", 20) == 0);
+  chat_member_clear(&member);
+
+  recent_ring_stats stats;
+  recent_ring_get_stats(&lobby->recent, &stats);
+  ASSERT_EQUAL(4, (int)stats.messages);
+  ASSERT_EQUAL(1, (int)stats.hits);
+  ASSERT_EQUAL(1, (int)stats.misses);
+
+  chat_directory_free(&dir);
+  return TEST_PASS;
+}
+
+// Run the server and every client once
+static void pump(chat_server *server, ct_conn **clients, int count)
+{
+  chat_server_run_once(server, 1);
+  for (int i = 0; i < count; i++)
+  {
+    ct_process(clients[i]);
+  }
+}
+
+// Test a message from one client reaching the others through the server
+int test_chat_server()
+{
+  struct sockaddr_in addr;
+  chat_server server;
+  ct_conn *clients[3];
+  ct_message msgs[4];
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 32);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  ASSERT_EQUAL(0, chat_server_init(&server, &addr, NULL));
+
+  for (int i = 0; i < 3; i++)
+  {
+    clients[i] = ct_socket();
+    ASSERT_TRUE(clients[i] != NULL);
+    ASSERT_EQUAL(0, ct_connect(clients[i], &addr));
+  }
+
+  uint64_t deadline = get_time_us() + 3000000;
+  int established = 0;
+  while (established < 3 && get_time_us() < deadline)
+  {
+    pump(&server, clients, 3);
+    established = 0;
+    for (int i = 0; i < 3; i++)
+    {
+      established += ct_get_state(clients[i]) == CT_ESTABLISHED;
+    }
+  }
+  ASSERT_EQUAL(3, established);
+  while (server.dir.member_count < 3 && get_time_us() < deadline)
+  {
+    pump(&server, clients, 3);
+  }
+  ASSERT_EQUAL(3, (int)server.dir.member_count);
+
+  ASSERT_EQUAL(11, (int)ct_send_message(clients[0], CHAT_STREAM, "/nick alice", 11));
+  ASSERT_EQUAL(5, (int)ct_send_message(clients[0], CHAT_STREAM, "hello", 5));
+
+  // Both others get the message once, the sender does not
+  int received[3] = {0, 0, 0};
+  while ((received[1] == 0 || received[2] == 0) && get_time_us() < deadline)
+  {
+    pump(&server, clients, 3);
+    for (int i = 0; i < 3; i++)
+    {
+      int count = ct_recv_messages(clients[i], CHAT_STREAM, msgs, 4);
+      for (int j = 0; j < count; j++)
+      {
+        ASSERT_EQUAL(20, (int)msgs[j].len);
+        ASSERT_TRUE(memcmp(msgs[j].data, "[lobby] alice: hello", 20) == 0);
+        received[i]++;
+      }
+    }
+  }
+  ASSERT_EQUAL(0, received[0]);
+  ASSERT_EQUAL(1, received[1]);
+  ASSERT_EQUAL(1, received[2]);
+
+  // Leaving a room that does not exist does not create it, and a member
+  // joining one new room after another only creates so many
+  char command[32];
+  ASSERT_EQUAL(14, (int)ct_send_message(clients[2], CHAT_STREAM, "/leave nowhere", 14));
+  for (int i = 0; i < CHAT_MEMBER_ROOMS + 2; i++)
+  {
+    int len = snprintf(command, sizeof(command), "/join room%d", i);
+    ASSERT_EQUAL(len, (int)ct_send_message(clients[2], CHAT_STREAM, command, len));
+  }
+  ASSERT_EQUAL(11, (int)ct_send_message(clients[2], CHAT_STREAM, "/join lobby", 11));
+  ASSERT_EQUAL(4, (int)ct_send_message(clients[2], CHAT_STREAM, "done", 4));
+  int done = 0;
+  while (!done && get_time_us() < deadline)
+  {
+    pump(&server, clients, 3);
+    done = ct_recv_messages(clients[0], CHAT_STREAM, msgs, 4) > 0;
+  }
+  ASSERT_TRUE(done);
+  ASSERT_TRUE(chat_directory_find(&server.dir, "nowhere") == NULL);
+  ASSERT_EQUAL(1 + CHAT_MEMBER_ROOMS, (int)server.dir.room_count);
+
+  for (int i = 0; i < 3; i++)
+  {
+    ct_free(clients[i]);
+  }
+  chat_server_free(&server);
+  return TEST_PASS;
+}
+
+// Test that no rooms are created past the directory's limit
+int test_room_limit()
+{
+  chat_directory dir;
+
+  chat_directory_init(&dir, NULL);
+  dir.max_rooms = 3;
+  chat_room *lobby = chat_directory_room(&dir, "lobby");
+  ASSERT_TRUE(lobby != NULL);
+  ASSERT_TRUE(chat_directory_find(&dir, "dev") == NULL);
+  ASSERT_EQUAL(1, (int)dir.room_count);
+
+  ASSERT_TRUE(chat_directory_room(&dir, "dev") != NULL);
+  ASSERT_TRUE(chat_directory_room(&dir, "ops") != NULL);
+  ASSERT_TRUE(chat_directory_room(&dir, "misc") == NULL);
+  ASSERT_EQUAL(3, (int)dir.room_count);
+
+  // Existing rooms are still found
+  ASSERT_TRUE(chat_directory_room(&dir, "lobby") == lobby);
+  ASSERT_TRUE(chat_directory_find(&dir, "lobby") == lobby);
+
+  chat_directory_free(&dir);
+  return TEST_PASS;
+}
+
+// Test that a member joining a room is sent what was said there before
+int test_chat_history()
+{
+  struct sockaddr_in addr;
+  chat_server server;
+  ct_conn *clients[2];
+  ct_message msgs[4];
+  char log_dir[] = "/tmp/chat_history_testXXXXXX";
+
+  ASSERT_TRUE(mkdtemp(log_dir) != NULL);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 33);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  ASSERT_EQUAL(0, chat_server_init(&server, &addr, log_dir));
+
+  clients[0] = ct_socket();
+  ASSERT_TRUE(clients[0] != NULL);
+  ASSERT_EQUAL(0, ct_connect(clients[0], &addr));
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server.dir.member_count < 1 && get_time_us() < deadline)
+  {
+    pump(&server, clients, 1);
+  }
+  ASSERT_EQUAL(1, (int)server.dir.member_count);
+
+  ASSERT_EQUAL(11, (int)ct_send_message(clients[0], CHAT_STREAM, "/nick alice", 11));
+  ASSERT_EQUAL(5, (int)ct_send_message(clients[0], CHAT_STREAM, "hello", 5));
+  chat_room *lobby = chat_directory_room(&server.dir, CHAT_DEFAULT_ROOM);
+  ASSERT_TRUE(lobby != NULL && lobby->log != NULL);
+  while (lobby->log->next_id < 2 && get_time_us() < deadline)
+  {
+    pump(&server, clients, 1);
+  }
+  ASSERT_EQUAL(2, (int)lobby->log->next_id);
+
+  // The late client gets the message from the log
+  clients[1] = ct_socket();
+  ASSERT_TRUE(clients[1] != NULL);
+  ASSERT_EQUAL(0, ct_connect(clients[1], &addr));
+  int received = 0;
+  while (received == 0 && get_time_us() < deadline)
+  {
+    pump(&server, clients, 2);
+    int count = ct_recv_messages(clients[1], CHAT_STREAM, msgs, 4);
+    for (int j = 0; j < count; j++)
+    {
+      ASSERT_EQUAL(20, (int)msgs[j].len);
+      ASSERT_TRUE(memcmp(msgs[j].data, "[lobby] alice: hello", 20) == 0);
+      received++;
+    }
+  }
+  ASSERT_EQUAL(1, received);
+
+  // Both joins were served from memory
+  recent_ring_stats stats;
+  recent_ring_get_stats(&lobby->recent, &stats);
+  ASSERT_EQUAL(2, (int)stats.hits);
+  ASSERT_EQUAL(0, (int)stats.misses);
+
+  for (int i = 0; i < 2; i++)
+  {
+    ct_free(clients[i]);
+  }
+  chat_server_free(&server);
+
+  char cmd[64];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", log_dir);
+  ASSERT_EQUAL(0, system(cmd));
+  return TEST_PASS;
+}
+
+// Test that members see who is typing and how many are in the room
+// Take the indicators a client was sent: the room count into online, and
+// into shown whether someone is typing
+static void read_indicators(ct_conn *conn, uint16_t presence, uint16_t typing, char *online,
+                            int *shown)
+{
+  char value[CT_MAX_STATE];
+  uint16_t key;
+  ssize_t len;
+
+  while ((len = ct_recv_state(conn, &key, value, sizeof(value))) >= 0)
+  {
+    if (key == presence)
+    {
+      memcpy(online, value, len);
+      online[len] = '\0';
+    }
+    else if (key == typing)
+    {
+      *shown = len > 0;
+    }
+  }
+}
+
+int test_chat_indicators()
+{
+  struct sockaddr_in addr;
+  chat_server server;
+  ct_conn *clients[2];
+  ct_message msgs[4];
+  char value[CT_MAX_STATE];
+  uint16_t key;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 35);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  ASSERT_EQUAL(0, chat_server_init(&server, &addr, NULL));
+
+  for (int i = 0; i < 2; i++)
+  {
+    clients[i] = ct_socket();
+    ASSERT_TRUE(clients[i] != NULL);
+    ASSERT_EQUAL(0, ct_connect(clients[i], &addr));
+  }
+  uint64_t deadline = get_time_us() + 3000000;
+  while ((server.dir.member_count < 2 || ct_get_state(clients[0]) != CT_ESTABLISHED ||
+          ct_get_state(clients[1]) != CT_ESTABLISHED) &&
+         get_time_us() < deadline)
+  {
+    pump(&server, clients, 2);
+  }
+  ASSERT_EQUAL(2, (int)server.dir.member_count);
+  chat_room *lobby = chat_directory_room(&server.dir, CHAT_DEFAULT_ROOM);
+  uint16_t presence = 2 * lobby->id + CHAT_STATE_PRESENCE;
+  uint16_t typing = 2 * lobby->id + CHAT_STATE_TYPING;
+
+  ASSERT_EQUAL(9, (int)ct_send_message(clients[1], CHAT_STREAM, "/nick bob", 9));
+  ASSERT_EQUAL(7, (int)ct_send_message(clients[1], CHAT_STREAM, "/typing", 7));
+  ASSERT_EQUAL(2, (int)ct_send_message(clients[1], CHAT_STREAM, "hi", 2));
+
+  // Bob is shown typing, then not once his message is posted. Only the
+  // latest may arrive. The room count is announced as members join.
+  int saw_idle = 0;
+  int saw_message = 0;
+  char online[CT_MAX_STATE + 1] = "";
+  while ((!saw_idle || !saw_message || strcmp(online, "[lobby] 2 online") != 0) &&
+         get_time_us() < deadline)
+  {
+    pump(&server, clients, 2);
+    ssize_t len;
+    while ((len = ct_recv_state(clients[0], &key, value, sizeof(value))) >= 0)
+    {
+      if (key == presence)
+      {
+        memcpy(online, value, len);
+        online[len] = '\0';
+      }
+      else if (key == typing && len > 0)
+      {
+        ASSERT_EQUAL(21, (int)len);
+        ASSERT_TRUE(memcmp(value, "[lobby] bob is typing", 21) == 0);
+      }
+      else if (key == typing)
+      {
+        saw_idle = 1;
+      }
+    }
+    saw_message += ct_recv_messages(clients[0], CHAT_STREAM, msgs, 4) > 0;
+  }
+  ASSERT_TRUE(saw_idle);
+  ASSERT_TRUE(saw_message);
+  ASSERT_TRUE(strcmp(online, "[lobby] 2 online") == 0);
+
+  // The typist never sees their own indicator
+  while (ct_recv_state(clients[1], &key, value, sizeof(value)) >= 0)
+  {
+    ASSERT_TRUE(key != typing);
+  }
+
+  // Bob leaves while typing, the room is told he is gone and not typing
+  ASSERT_EQUAL(7, (int)ct_send_message(clients[1], CHAT_STREAM, "/typing", 7));
+  int shown = 0;
+  deadline = get_time_us() + 3000000;
+  while (!shown && get_time_us() < deadline)
+  {
+    pump(&server, clients, 2);
+    read_indicators(clients[0], presence, typing, online, &shown);
+  }
+  ASSERT_TRUE(shown);
+
+  ct_close(clients[1]);
+  while ((shown || strcmp(online, "[lobby] 1 online") != 0) && get_time_us() < deadline)
+  {
+    pump(&server, clients, 2);
+    read_indicators(clients[0], presence, typing, online, &shown);
+  }
+  ASSERT_FALSE(shown);
+  ASSERT_TRUE(strcmp(online, "[lobby] 1 online") == 0);
+
+  for (int i = 0; i < 2; i++)
+  {
+    ct_free(clients[i]);
+  }
+  chat_server_free(&server);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_broadcast_shares_message);
+  RUN_TEST(test_room_membership);
+  RUN_TEST(test_queue_overflow);
+  RUN_TEST(test_recent_replay);
+  RUN_TEST(test_room_limit);
+  RUN_TEST(test_chat_server);
+  RUN_TEST(test_chat_history);
+  RUN_TEST(test_chat_indicators);
+
+  printf("All chatroom tests passed!\n");
+  return TEST_PASS;
+}
@@ -0,0 +1,107 @@
+#include "test_utils.h"
+#include "codec.h"
+
+static const char *lines[] = {
+  "hey, anyone know how to get the server to restart after an update?",
+  "thanks! I'll try that tomorrow morning and let you know",
+  "lol yeah that's what I was thinking too, probably a version problem",
+  "[lobby] alice: good morning everyone, meeting in 10 minutes",
+};
+
+// Test that chat text comes back intact and smaller
+int test_codec_round_trip()
+{
+  char packed[CODEC_BOUND(256)];
+  char unpacked[256];
+
+  for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+  {
+    size_t len = strlen(lines[i]);
+    size_t packed_len = codec_compress(lines[i], len, packed, sizeof(packed));
+    ASSERT_TRUE(packed_len > 0 && packed_len < len);
+    ASSERT_EQUAL((int)len, codec_decompress(packed, packed_len, unpacked, len));
+    ASSERT_TRUE(memcmp(unpacked, lines[i], len) == 0);
+  }
+
+  // Repeats within a message are matched too, overlapping their source
+  char repeated[200];
+  memset(repeated, 'a', sizeof(repeated));
+  size_t packed_len = codec_compress(repeated, sizeof(repeated), packed, sizeof(packed));
+  ASSERT_TRUE(packed_len > 0 && packed_len < 16);
+  ASSERT_EQUAL((int)sizeof(repeated), codec_decompress(packed, packed_len, unpacked,
+                                                       sizeof(repeated)));
+  ASSERT_TRUE(memcmp(unpacked, repeated, sizeof(repeated)) == 0);
+  return TEST_PASS;
+}
+
+// Test that data without matches fits in the bound but not in less
+int test_codec_incompressible()
+{
+  static char data[CODEC_MAX_INPUT];
+  static char packed[CODEC_BOUND(CODEC_MAX_INPUT)];
+  static char unpacked[CODEC_MAX_INPUT];
+
+  uint32_t x = 12345;
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    x = x * 1103515245 + 12345;
+    data[i] = x >> 24;
+  }
+
+  size_t packed_len = codec_compress(data, sizeof(data), packed, sizeof(packed));
+  ASSERT_TRUE(packed_len >= sizeof(data));
+  ASSERT_EQUAL((int)sizeof(data), codec_decompress(packed, packed_len, unpacked, sizeof(data)));
+  ASSERT_TRUE(memcmp(unpacked, data, sizeof(data)) == 0);
+
+  ASSERT_EQUAL(0, (int)codec_compress(data, sizeof(data), packed, sizeof(data)));
+  ASSERT_EQUAL(0, (int)codec_compress(data, CODEC_MAX_INPUT + 1, packed, sizeof(packed)));
+  return TEST_PASS;
+}
+
+// Test that malformed blocks are refused rather than read or written past
+int test_codec_malformed()
+{
+  char packed[CODEC_BOUND(256)];
+  char unpacked[256];
+  size_t len = strlen(lines[0]);
+  size_t packed_len = codec_compress(lines[0], len, packed, sizeof(packed));
+
+  // Wrong length, truncated block
+  ASSERT_EQUAL(-1, codec_decompress(packed, packed_len, unpacked, len - 1));
+  ASSERT_EQUAL(-1, codec_decompress(packed, packed_len, unpacked, len + 1));
+  ASSERT_EQUAL(-1, codec_decompress(packed, packed_len - 1, unpacked, len));
+
+  // A match reaching back before the dictionary
+  const char far[] = {0x10, 'x', (char)0xff, (char)0xff, 0x00};
+  ASSERT_EQUAL(-1, codec_decompress(far, sizeof(far), unpacked, 6));
+
+  // Literals running past the block
+  const char literals[] = {(char)0xf0, (char)0xff, 'x'};
+  ASSERT_EQUAL(-1, codec_decompress(literals, sizeof(literals), unpacked, sizeof(unpacked)));
+  return TEST_PASS;
+}
+
+// Test that compressed formats are recognized and text is not
+int test_codec_precompressed()
+{
+  ASSERT_TRUE(codec_precompressed("\x1f\x8b\x08\x00", 4));
+  ASSERT_TRUE(codec_precompressed("\x89PNG\r\n\x1a\n", 8));
+  ASSERT_TRUE(codec_precompressed("\xff\xd8\xff\xe0", 4));
+  ASSERT_TRUE(codec_precompressed("RIFF\x10\x00\x00\x00WEBPVP8 ", 16));
+  ASSERT_TRUE(codec_precompressed("\x00\x00\x00\x18" "ftypmp42", 12));
+  ASSERT_TRUE(!codec_precompressed(lines[0], strlen(lines[0])));
+  ASSERT_TRUE(!codec_precompressed("\x1f", 1));
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_codec_round_trip);
+  RUN_TEST(test_codec_incompressible);
+  RUN_TEST(test_codec_malformed);
+  RUN_TEST(test_codec_precompressed);
+
+  printf("All codec tests passed!\n");
+  return TEST_PASS;
+}
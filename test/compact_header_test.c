@@ -0,0 +1,206 @@
+#include "test_utils.h"
+#include "compact_header.h"
+
+// A data packet as flow control sends it
+static void data_packet(packet *pkt, uint32_t seq, uint32_t ack, uint32_t ts, const char *text)
+{
+  memset(pkt, 0, sizeof(packet));
+  pkt->source_port = 4000;
+  pkt->dest_port = 5000;
+  pkt->seq_num = seq;
+  pkt->ack_num = ack;
+  pkt->data_offset = STREAM_DATA_OFFSET;
+  pkt->flags = PSH;
+  pkt->window_size = 4096;
+  pkt->ts_val = ts;
+  pkt->ts_ecr = ts - 300;
+  pkt->stream_id = 1;
+  pkt->stream_offset = seq - 1000;
+  pkt->payload_len = strlen(text);
+  memcpy(pkt->payload, text, pkt->payload_len);
+  pkt->checksum = calculate_checksum(pkt);
+}
+
+// A pure ACK from the other side
+static void ack_packet(packet *pkt, uint32_t seq, uint32_t ack, uint32_t ts)
+{
+  memset(pkt, 0, sizeof(packet));
+  pkt->source_port = 5000;
+  pkt->dest_port = 4000;
+  pkt->seq_num = seq;
+  pkt->ack_num = ack;
+  pkt->data_offset = SACK_DATA_OFFSET;
+  pkt->flags = ACK;
+  pkt->window_size = 2048;
+  pkt->ts_val = ts;
+  pkt->ts_ecr = ts - 200;
+  pkt->delay_echo = 150;
+  pkt->sack_left = ack + 88;
+  pkt->sack_right = ack + 132;
+  pkt->checksum = calculate_checksum(pkt);
+}
+
+// Send pkt from one context to the other, returns the compact size
+static size_t transfer(compact_context *from, compact_context *to, const packet *pkt)
+{
+  uint8_t wire[sizeof(packet)];
+  packet out;
+  size_t len = compact_encode(from, pkt, wire);
+  if (len == 0 || compact_decode(to, wire, len, &out) < 0)
+  {
+    return 0;
+  }
+  return memcmp(&out, pkt, sizeof(packet)) == 0 ? len : 0;
+}
+
+// Test that packets come back exactly, and shrink once the reference is known
+int test_compact_round_trip()
+{
+  compact_context client, server;
+  packet pkt;
+  compact_init(&client, 77, 4000, 5000);
+  compact_init(&server, 77, 5000, 4000);
+  compact_start_sending(&client);
+  compact_start_sending(&server);
+
+  // The first packet carries the reference, the ACK echoes it
+  data_packet(&pkt, 1000, 9000, 50000, "hello there");
+  size_t first = transfer(&client, &server, &pkt);
+  ASSERT_TRUE(first > 0);
+  ack_packet(&pkt, 9000, 1011, 50100);
+  ASSERT_TRUE(transfer(&server, &client, &pkt) > 0);
+  ASSERT_EQUAL(client.tx_generation, client.peer_echo);
+
+  data_packet(&pkt, 1011, 9000, 51000, "how are you?");
+  size_t later = transfer(&client, &server, &pkt);
+  ASSERT_TRUE(later > 0 && later + 15 < first);
+  ASSERT_TRUE(later < 12 + 16);
+
+  // A changed window, urgent pointer and no payload
+  data_packet(&pkt, 1023, 9000, 52000, "");
+  pkt.window_size = 100;
+  pkt.urgent_pointer = 3;
+  pkt.checksum = 0;
+  pkt.checksum = calculate_checksum(&pkt);
+  ASSERT_TRUE(transfer(&client, &server, &pkt) > 0);
+
+  // A retransmission from before the reference
+  data_packet(&pkt, 990, 8990, 49000, "old");
+  ASSERT_TRUE(transfer(&client, &server, &pkt) > 0);
+
+  ASSERT_EQUAL(4, (int)client.packets);
+  ASSERT_TRUE(client.wire_bytes * 2 < client.full_bytes);
+  return TEST_PASS;
+}
+
+// Test that a lost reference is resent until the peer holds it
+int test_compact_resync()
+{
+  compact_context client, server;
+  packet pkt, out;
+  uint8_t wire[sizeof(packet)];
+  compact_init(&client, 77, 4000, 5000);
+  compact_init(&server, 77, 5000, 4000);
+  compact_start_sending(&client);
+  compact_start_sending(&server);
+
+  // The reference is lost, the next packet carries it again
+  data_packet(&pkt, 1000, 9000, 50000, "lost");
+  ASSERT_TRUE(compact_encode(&client, &pkt, wire) > 0);
+  data_packet(&pkt, 1004, 9000, 50100, "arrives");
+  ASSERT_TRUE(transfer(&client, &server, &pkt) > 0);
+  ack_packet(&pkt, 9000, 1011, 50200);
+  ASSERT_TRUE(transfer(&server, &client, &pkt) > 0);
+
+  // Deltas past the limit pick a new reference, which is lost too. Until
+  // the peer echoes it every packet carries it.
+  data_packet(&pkt, 1011 + 3 * COMPACT_MAX_DELTA, 9000, 50300, "far");
+  size_t len = compact_encode(&client, &pkt, wire);
+  ASSERT_TRUE(len > 0);
+  ASSERT_TRUE(wire[0] & COMPACT_REF);
+  data_packet(&pkt, 1014 + 3 * COMPACT_MAX_DELTA, 9000, 50400, "next");
+  len = compact_encode(&client, &pkt, wire);
+  ASSERT_TRUE(wire[0] & COMPACT_REF);
+  ASSERT_EQUAL(0, compact_decode(&server, wire, len, &out));
+  ASSERT_TRUE(memcmp(&out, &pkt, sizeof(packet)) == 0);
+
+  // A compact packet from a reference the peer does not hold is refused,
+  // and so is one from another connection
+  ack_packet(&pkt, 9000, 1018, 50500);
+  ASSERT_TRUE(transfer(&server, &client, &pkt) > 0);
+  data_packet(&pkt, 1018 + 3 * COMPACT_MAX_DELTA, 9000, 50600, "ok");
+  len = compact_encode(&client, &pkt, wire);
+  ASSERT_TRUE(!(wire[0] & COMPACT_REF));
+  wire[1] = (wire[1] & 0x0f) | ((client.tx_generation % 15 + 1) << 4);
+  ASSERT_EQUAL(-1, compact_decode(&server, wire, len, &out));
+
+  compact_context other;
+  compact_init(&other, 78, 5000, 4000);
+  client.peer_echo = 0;
+  len = compact_encode(&client, &pkt, wire);
+  ASSERT_EQUAL(-1, compact_decode(&other, wire, len, &out));
+
+  // A corrupted packet fails the checksum and drops the reference
+  ASSERT_EQUAL(0, compact_decode(&server, wire, len, &out));
+  wire[len - 1] ^= 1;
+  ASSERT_EQUAL(-1, compact_decode(&server, wire, len, &out));
+  ASSERT_EQUAL(0, server.rx_generation);
+  return TEST_PASS;
+}
+
+// Test the packets that must travel in full
+int test_compact_full()
+{
+  compact_context ctx;
+  packet pkt;
+  uint8_t wire[sizeof(packet)];
+  compact_init(&ctx, 77, 4000, 5000);
+
+  data_packet(&pkt, 1000, 9000, 50000, "hi");
+  ASSERT_EQUAL(0, (int)compact_encode(&ctx, &pkt, wire));
+  compact_start_sending(&ctx);
+  ASSERT_TRUE(compact_encode(&ctx, &pkt, wire) > 0);
+
+  pkt.flags = SYN;
+  ASSERT_EQUAL(0, (int)compact_encode(&ctx, &pkt, wire));
+
+  // Bytes past the payload would be lost
+  data_packet(&pkt, 1000, 9000, 50000, "hi");
+  pkt.payload[10] = 'x';
+  ASSERT_EQUAL(0, (int)compact_encode(&ctx, &pkt, wire));
+
+  // A full payload with the reference does not fit
+  char text[MAX_PAYLOAD_SIZE + 1];
+  memset(text, 'a', MAX_PAYLOAD_SIZE);
+  text[MAX_PAYLOAD_SIZE] = '\0';
+  data_packet(&pkt, 1000, 9000, 50000, text);
+  pkt.delay_echo = 0xffffffff;
+  pkt.sack_left = 1;
+  pkt.sack_right = 0x80000000;
+  pkt.window_size = 65535;
+  pkt.checksum = 0;
+  pkt.checksum = calculate_checksum(&pkt);
+  ASSERT_EQUAL(0, (int)compact_encode(&ctx, &pkt, wire));
+
+  // Truncated datagrams do not decode
+  data_packet(&pkt, 1000, 9000, 50000, "hi");
+  size_t len = compact_encode(&ctx, &pkt, wire);
+  compact_context peer;
+  packet out;
+  compact_init(&peer, 77, 5000, 4000);
+  ASSERT_EQUAL(-1, compact_decode(&peer, wire, 5, &out));
+  ASSERT_EQUAL(-1, compact_decode(&peer, wire, 20, &out));
+  ASSERT_EQUAL(0, compact_decode(&peer, wire, len, &out));
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_compact_round_trip);
+  RUN_TEST(test_compact_resync);
+  RUN_TEST(test_compact_full);
+
+  printf("All compact header tests passed!\n");
+  return TEST_PASS;
+}
@@ -154,6 +154,130 @@ int test_timeout_handling()
   return TEST_PASS;
 }
 
+// Test PRR through a recovery with three losses in one window. Every ACK
+// reports one segment delivered, the sender sends whatever cwnd allows.
+int test_prr_multiple_losses()
+{
+  congestion_control_state cc_state;
+  flow_control_state fc_state;
+  uint16_t mss = 100;
+
+  init_congestion_control(&cc_state, mss);
+  memset(&fc_state, 0, sizeof(fc_state));
+  fc_state.receiver_window = 60000;
+  cc_state.state = CONGESTION_AVOIDANCE;
+  cc_state.cwnd = 20 * mss;
+
+  // Twenty segments in flight, segments 0, 5 and 10 are lost
+  fc_state.last_ack_received = 0;
+  fc_state.next_seq_num = 20 * mss;
+  handle_loss(&cc_state, &fc_state);
+  ASSERT_EQUAL(FAST_RECOVERY, cc_state.state);
+  ASSERT_EQUAL(10 * mss, cc_state.ssthresh);
+
+  uint32_t ssthresh = cc_state.ssthresh;
+  uint32_t pipe = 17 * mss; // Lost segments have left the network
+  int to_retransmit = 3;
+  int sacks_left = 17;      // Surviving segments of the original flight
+  int sent = 0;             // Segments sent during recovery
+  int acked = 0;            // Of those, acknowledged so far, in send order
+  int max_burst = 0;
+
+  while (cc_state.state == FAST_RECOVERY)
+  {
+    // Sending must never stall with nothing left to acknowledge
+    ASSERT_TRUE(sacks_left > 0 || acked < sent);
+
+    if (sacks_left > 0)
+    {
+      sacks_left--;
+    }
+    else
+    {
+      // Retransmissions went out first, each one moves the cumulative ACK
+      acked++;
+      uint32_t ack_num = acked == 1 ? 5 * mss : acked == 2 ? 10 * mss : fc_state.next_seq_num;
+      if (acked <= 3)
+      {
+        update_congestion_window(&cc_state, &fc_state, ack_num, 0);
+      }
+    }
+    pipe -= mss;
+    prr_on_ack(&cc_state, mss, pipe);
+
+    int burst = 0;
+    while (cc_state.state == FAST_RECOVERY && pipe + mss <= cc_state.cwnd)
+    {
+      prr_on_send(&cc_state, mss);
+      pipe += mss;
+      sent++;
+      burst++;
+      if (to_retransmit > 0)
+      {
+        to_retransmit--;
+      }
+      else
+      {
+        fc_state.next_seq_num += mss;
+      }
+    }
+    if (burst > max_burst)
+    {
+      max_burst = burst;
+    }
+
+    // Above ssthresh, sending tracks delivery in proportion ssthresh / RecoverFS
+    if (pipe > ssthresh)
+    {
+      ASSERT_TRUE(cc_state.prr_out * cc_state.recover_fs <=
+                  (cc_state.prr_delivered + mss) * ssthresh);
+    }
+  }
+
+  // Recovery ended once the last retransmission was acknowledged, with the
+  // flight already at ssthresh and no burst on the way
+  ASSERT_EQUAL(3, acked);
+  ASSERT_EQUAL(CONGESTION_AVOIDANCE, cc_state.state);
+  ASSERT_EQUAL((int)ssthresh, cc_state.cwnd);
+  ASSERT_TRUE(pipe + mss >= ssthresh && pipe <= ssthresh);
+  ASSERT_TRUE(max_burst <= 2);
+
+  return TEST_PASS;
+}
+
+// Test that ECN echoes reduce cwnd once per window of data, without recovery
+int test_ecn_response()
+{
+  congestion_control_state cc_state;
+  flow_control_state fc_state;
+  uint16_t mss = 100;
+
+  init_congestion_control(&cc_state, mss);
+  memset(&fc_state, 0, sizeof(fc_state));
+  cc_state.state = CONGESTION_AVOIDANCE;
+  cc_state.cwnd = 20 * mss;
+  fc_state.last_ack_received = 0;
+  fc_state.next_seq_num = 20 * mss;
+
+  // The first echo halves cwnd
+  ASSERT_EQUAL(1, handle_ecn_echo(&cc_state, &fc_state));
+  ASSERT_EQUAL(10 * mss, cc_state.cwnd);
+  ASSERT_EQUAL(CONGESTION_AVOIDANCE, cc_state.state);
+
+  // Echoes for the same window of data are ignored
+  fc_state.last_ack_received = 10 * mss;
+  fc_state.next_seq_num = 30 * mss;
+  ASSERT_EQUAL(0, handle_ecn_echo(&cc_state, &fc_state));
+  ASSERT_EQUAL(10 * mss, cc_state.cwnd);
+
+  // Once the data outstanding at the first echo is acknowledged, a new echo counts
+  fc_state.last_ack_received = 20 * mss;
+  ASSERT_EQUAL(1, handle_ecn_echo(&cc_state, &fc_state));
+  ASSERT_EQUAL(5 * mss, cc_state.cwnd);
+
+  return TEST_PASS;
+}
+
 int main()
 {
   // Seed random number generator
@@ -165,6 +289,8 @@ int main()
   RUN_TEST(test_congestion_avoidance_transition);
   RUN_TEST(test_fast_retransmit);
   RUN_TEST(test_timeout_handling);
+  RUN_TEST(test_prr_multiple_losses);
+  RUN_TEST(test_ecn_response);
 
   printf("All congestion control tests passed!\n");
   return TEST_PASS;
@@ -1,5 +1,7 @@
 #include "test_utils.h"
 #include "packet.h"
+#include "connection.h"
+#include <poll.h>
 
 // Test three-way handshake for connection establishment
 int test_three_way_handshake()
@@ -179,6 +181,973 @@ int test_four_way_handshake()
   return TEST_PASS;
 }
 
+// Wait for any of the connections to become ready, then process all of them
+static void pump(ct_conn **conns, int count)
+{
+  struct pollfd fds[64];
+  int timeout = 10;
+
+  for (int i = 0; i < count; i++)
+  {
+    fds[i].fd = ct_fd(conns[i]);
+    fds[i].events = POLLIN;
+    int conn_timeout = ct_timeout(conns[i]);
+    if (conn_timeout >= 0 && conn_timeout < timeout)
+    {
+      timeout = conn_timeout;
+    }
+  }
+
+  poll(fds, count, timeout);
+  for (int i = 0; i < count; i++)
+  {
+    ct_process(conns[i]);
+  }
+}
+
+// Test a full connection lifetime driven by one thread without blocking
+int test_nonblocking_connection()
+{
+  struct sockaddr_in addr;
+  char data[1000];
+  char received[1000];
+  size_t total = 0;
+  size_t queued = 0;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 26);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ASSERT_TRUE(listener != NULL);
+  ASSERT_EQUAL(-1, ct_listen(listener));
+  ASSERT_EQUAL(EINVAL, errno);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_TRUE(ct_accept(listener) == NULL);
+  ASSERT_EQUAL(EAGAIN, errno);
+
+  ct_conn *client = ct_socket();
+  ASSERT_TRUE(client != NULL);
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+  ASSERT_EQUAL(-1, ct_connect(client, &addr));
+  ASSERT_EQUAL(EISCONN, errno);
+
+  // The SYN waits on the listener until it is accepted
+  uint64_t deadline = get_time_us() + 2000000;
+  ct_conn *server = NULL;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ASSERT_TRUE(ct_fd(server) != ct_fd(listener));
+  ct_conn *conns[] = {client, server, listener};
+
+  // Nothing can be sent or read before the handshake
+  ASSERT_EQUAL(CT_SYN_SENT, client->state);
+  ASSERT_EQUAL(-1, (int)ct_send(client, "x", 1));
+  ASSERT_EQUAL(ENOTCONN, errno);
+  ASSERT_EQUAL(-1, (int)ct_recv(server, received, sizeof(received)));
+  ASSERT_EQUAL(EAGAIN, errno);
+
+  while ((client->state != CT_ESTABLISHED || server->state != CT_ESTABLISHED) &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 3);
+  }
+  ASSERT_TRUE(ct_accept(listener) == NULL);
+  ASSERT_EQUAL(CT_ESTABLISHED, client->state);
+  ASSERT_EQUAL(CT_ESTABLISHED, server->state);
+
+  // Stream data to the server
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = 'a' + i % 26;
+  }
+  while (total < sizeof(data) && get_time_us() < deadline)
+  {
+    if (queued < sizeof(data))
+    {
+      ssize_t n = ct_send(client, data + queued, sizeof(data) - queued);
+      if (n > 0)
+      {
+        queued += n;
+      }
+    }
+    pump(conns, 3);
+
+    ssize_t n = ct_recv(server, received + total, sizeof(received) - total);
+    if (n > 0)
+    {
+      total += n;
+    }
+  }
+  ASSERT_EQUAL((int)sizeof(data), (int)total);
+  ASSERT_TRUE(memcmp(data, received, sizeof(data)) == 0);
+
+  // And back
+  ASSERT_EQUAL(4, (int)ct_send(server, "pong", 4));
+  total = 0;
+  while (total < 4 && get_time_us() < deadline)
+  {
+    pump(conns, 3);
+    ssize_t n = ct_recv(client, received + total, 4 - total);
+    if (n > 0)
+    {
+      total += n;
+    }
+  }
+  ASSERT_TRUE(total == 4 && memcmp(received, "pong", 4) == 0);
+
+  // The client closes first, the server sees the end of the stream
+  ct_close(client);
+  ASSERT_EQUAL(-1, (int)ct_send(client, "x", 1));
+  ASSERT_EQUAL(EPIPE, errno);
+  while (server->state != CT_CLOSE_WAIT && get_time_us() < deadline)
+  {
+    pump(conns, 3);
+  }
+  ASSERT_EQUAL(CT_CLOSE_WAIT, server->state);
+  ASSERT_EQUAL(0, (int)ct_recv(server, received, sizeof(received)));
+
+  ct_close(server);
+  while ((server->state != CT_CLOSED || client->state != CT_TIME_WAIT) &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 3);
+  }
+  ASSERT_EQUAL(CT_CLOSED, server->state);
+  ASSERT_EQUAL(CT_TIME_WAIT, client->state);
+  ASSERT_EQUAL(0, client->error);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Count readable callbacks
+static void count_readable(ct_conn *conn, void *arg)
+{
+  char buffer[64];
+  if (ct_recv(conn, buffer, sizeof(buffer)) > 0)
+  {
+    (*(int *)arg)++;
+  }
+}
+
+// Accept every pending connection, each is added to conns
+static void accept_all(ct_conn *listener, void *arg)
+{
+  ct_conn **conns = arg;
+  ct_conn *conn;
+
+  while ((conn = ct_accept(listener)) != NULL)
+  {
+    int i = 0;
+    while (conns[i] != NULL)
+    {
+      i++;
+    }
+    conns[i] = conn;
+  }
+}
+
+// Test that one thread multiplexes many connections through callbacks
+int test_multiplexed_connections()
+{
+  enum { PAIRS = 16 };
+  ct_conn *conns[2 * PAIRS + 1];
+  ct_conn *servers[PAIRS + 1];
+  int messages = 0;
+  struct sockaddr_in addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 100);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  memset(servers, 0, sizeof(servers));
+
+  // All clients connect to one listening port
+  ct_conn *listener = ct_socket();
+  ASSERT_TRUE(listener != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ct_set_callbacks(listener, accept_all, NULL, NULL, servers);
+  conns[0] = listener;
+
+  for (int i = 0; i < PAIRS; i++)
+  {
+    conns[1 + i] = ct_socket();
+    ASSERT_TRUE(conns[1 + i] != NULL);
+    ASSERT_EQUAL(0, ct_connect(conns[1 + i], &addr));
+  }
+
+  int sent = 0;
+  int count = 1 + PAIRS;
+  uint64_t deadline = get_time_us() + 3000000;
+  while (messages < PAIRS && get_time_us() < deadline)
+  {
+    pump(conns, count);
+
+    // Accepted connections join the poll set
+    while (count < 1 + 2 * PAIRS && servers[count - 1 - PAIRS] != NULL)
+    {
+      conns[count] = servers[count - 1 - PAIRS];
+      ct_set_callbacks(conns[count], count_readable, NULL, NULL, &messages);
+      count++;
+    }
+
+    // Every client writes once its connection is up
+    for (int i = 0; i < PAIRS && sent < PAIRS; i++)
+    {
+      ct_conn *client = conns[1 + i];
+      if (client->state == CT_ESTABLISHED && client->callback_arg == NULL &&
+          ct_send(client, "hello", 5) == 5)
+      {
+        client->callback_arg = client;
+        sent++;
+      }
+    }
+  }
+
+  ASSERT_EQUAL(1 + 2 * PAIRS, count);
+  ASSERT_EQUAL(PAIRS, sent);
+  ASSERT_EQUAL(PAIRS, messages);
+
+  for (int i = 0; i < count; i++)
+  {
+    ct_free(conns[i]);
+  }
+  return TEST_PASS;
+}
+
+// Test that streams of one connection are read separately
+int test_connection_streams()
+{
+  struct sockaddr_in addr;
+  char buffer[64];
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 29);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+
+  uint64_t deadline = get_time_us() + 2000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ct_conn *conns[] = {client, server};
+  while (client->state != CT_ESTABLISHED && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+
+  // Streams open on first use, no round-trip
+  ASSERT_EQUAL(-1, (int)ct_send_stream(client, CT_MAX_STREAMS, "x", 1));
+  ASSERT_EQUAL(EINVAL, errno);
+  ASSERT_EQUAL(5, (int)ct_send_stream(client, 7, "lobby", 5));
+  ASSERT_EQUAL(4, (int)ct_send_stream(client, 3, "file", 4));
+  ASSERT_EQUAL(6, (int)ct_send_stream(client, 7, " hello", 6));
+
+  while (flow_control_readable(&server->fc) < 15 && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+
+  ASSERT_EQUAL(-1, (int)ct_recv(server, buffer, sizeof(buffer)));
+  ASSERT_EQUAL(EAGAIN, errno);
+  ASSERT_EQUAL(11, (int)ct_recv_stream(server, 7, buffer, sizeof(buffer)));
+  ASSERT_TRUE(memcmp(buffer, "lobby hello", 11) == 0);
+  ASSERT_EQUAL(3, ct_next_stream(server));
+  ASSERT_EQUAL(4, (int)ct_recv_stream(server, 3, buffer, sizeof(buffer)));
+  ASSERT_TRUE(memcmp(buffer, "file", 4) == 0);
+  ASSERT_EQUAL(-1, ct_next_stream(server));
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Test that the receive window grows past what the reassembly slots could
+// hold while the application keeps reading
+int test_connection_window_growth()
+{
+  struct sockaddr_in addr;
+  static char data[256 * 1024];
+  static char received[sizeof(data)];
+  size_t total = 0;
+  size_t queued = 0;
+  uint16_t largest = 0;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 40);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+
+  uint64_t deadline = get_time_us() + 2000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ct_conn *conns[] = {client, server};
+
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = 'a' + i % 23;
+  }
+
+  deadline = get_time_us() + 20000000;
+  while (total < sizeof(data) && get_time_us() < deadline)
+  {
+    if (queued < sizeof(data))
+    {
+      ssize_t n = ct_send(client, data + queued, sizeof(data) - queued);
+      if (n > 0)
+      {
+        queued += n;
+      }
+    }
+    pump(conns, 2);
+
+    ssize_t n = ct_recv(server, received + total, sizeof(received) - total);
+    if (n > 0)
+    {
+      total += n;
+    }
+    if (server->fc.rcv_wnd_advertised > largest)
+    {
+      largest = server->fc.rcv_wnd_advertised;
+    }
+  }
+  ASSERT_EQUAL((int)sizeof(data), (int)total);
+  ASSERT_TRUE(memcmp(data, received, sizeof(data)) == 0);
+  ASSERT_TRUE(largest > MAX_REASSEMBLY_SEGMENTS * MAX_PAYLOAD_SIZE);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Test that message boundaries survive segmentation
+int test_connection_messages()
+{
+  struct sockaddr_in addr;
+  char big[CT_MAX_MESSAGE];
+  ct_message msgs[8];
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 30);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ct_conn *conns[] = {client, server};
+  while (client->state != CT_ESTABLISHED && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+
+  // Three messages, the middle one spans many segments
+  for (size_t i = 0; i < sizeof(big); i++)
+  {
+    big[i] = i % 251;
+  }
+  ASSERT_EQUAL(-1, (int)ct_send_message(client, 1, big, sizeof(big) + 1));
+  ASSERT_EQUAL(EMSGSIZE, errno);
+  ASSERT_EQUAL(5, (int)ct_send_message(client, 1, "first", 5));
+  ASSERT_EQUAL((int)sizeof(big), (int)ct_send_message(client, 1, big, sizeof(big)));
+  ASSERT_EQUAL(4, (int)ct_send_message(client, 1, "last", 4));
+
+  ASSERT_EQUAL(-1, ct_recv_messages(server, 1, msgs, 8));
+  ASSERT_EQUAL(EAGAIN, errno);
+
+  // A batch is only valid until the next call, check each as it arrives
+  const char *expected[] = {"first", big, "last"};
+  size_t expected_len[] = {5, sizeof(big), 4};
+  int received = 0;
+  while (received < 3 && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+
+    int count = ct_recv_messages(server, 1, msgs, 8);
+    for (int i = 0; i < count && received < 3; i++, received++)
+    {
+      ASSERT_EQUAL((int)expected_len[received], (int)msgs[i].len);
+      ASSERT_TRUE(memcmp(msgs[i].data, expected[received], msgs[i].len) == 0);
+    }
+  }
+  ASSERT_EQUAL(3, received);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Test that compression is negotiated in the handshake and messages
+// survive it
+int test_connection_compression()
+{
+  struct sockaddr_in addr;
+  ct_message msgs[8];
+  const char *texts[] = {
+    "hey everyone, did anyone see the update to the server this morning?",
+    "ok",
+    "yeah I think it's working now, let me know if you have any problem with it",
+  };
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 36);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *plain = ct_socket();
+  ct_conn *server = NULL;
+  ct_conn *plain_server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL && plain != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_set_compression(listener, 1));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(-1, ct_set_compression(listener, 0));
+  ASSERT_EQUAL(EISCONN, errno);
+  ASSERT_EQUAL(0, ct_set_compression(client, 1));
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+
+  // A client that did not offer it gets plain messages
+  ASSERT_EQUAL(0, ct_connect(plain, &addr));
+  while (plain_server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {plain, listener};
+    pump(pending, 2);
+    plain_server = ct_accept(listener);
+  }
+  ASSERT_TRUE(plain_server != NULL);
+
+  ct_conn *conns[] = {client, server, plain, plain_server};
+  while ((client->state != CT_ESTABLISHED || plain->state != CT_ESTABLISHED) &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 4);
+  }
+  ASSERT_TRUE(ct_compressed(client) && ct_compressed(server));
+  ASSERT_TRUE(!ct_compressed(plain) && !ct_compressed(plain_server));
+
+  // Both directions, the short message goes out plain
+  for (int i = 0; i < 3; i++)
+  {
+    ASSERT_EQUAL((int)strlen(texts[i]), (int)ct_send_message(client, 1, texts[i], strlen(texts[i])));
+    ASSERT_EQUAL((int)strlen(texts[i]), (int)ct_send_message(server, 1, texts[i], strlen(texts[i])));
+  }
+
+  ct_conn *receivers[] = {server, client};
+  for (int r = 0; r < 2; r++)
+  {
+    int received = 0;
+    while (received < 3 && get_time_us() < deadline)
+    {
+      pump(conns, 4);
+
+      int count = ct_recv_messages(receivers[r], 1, msgs, 8);
+      for (int i = 0; i < count && received < 3; i++, received++)
+      {
+        ASSERT_EQUAL((int)strlen(texts[received]), (int)msgs[i].len);
+        ASSERT_TRUE(memcmp(msgs[i].data, texts[received], msgs[i].len) == 0);
+      }
+    }
+    ASSERT_EQUAL(3, received);
+  }
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(plain);
+  ct_free(plain_server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Test that compact headers are negotiated in the handshake and carry a
+// conversation in far fewer bytes
+int test_connection_compact_headers()
+{
+  struct sockaddr_in addr;
+  ct_message msgs[8];
+  char text[32];
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 37);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_set_compact_headers(listener, 1));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(0, ct_set_compact_headers(client, 1));
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+  ASSERT_EQUAL(-1, ct_set_compact_headers(client, 0));
+  ASSERT_EQUAL(EISCONN, errno);
+
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ct_conn *conns[] = {client, server};
+  while ((client->state != CT_ESTABLISHED || server->state != CT_ESTABLISHED) &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+  ASSERT_TRUE(client->fc.compact.sending && server->fc.compact.sending);
+
+  // A back and forth of one-line messages, each waiting for the last
+  for (int i = 0; i < 20; i++)
+  {
+    ct_conn *from = i % 2 ? server : client;
+    ct_conn *to = i % 2 ? client : server;
+    int len = snprintf(text, sizeof(text), "message number %d", i);
+    ASSERT_EQUAL(len, (int)ct_send_message(from, 1, text, len));
+
+    int count = 0;
+    while (count <= 0 && get_time_us() < deadline)
+    {
+      pump(conns, 2);
+      count = ct_recv_messages(to, 1, msgs, 8);
+    }
+    ASSERT_EQUAL(1, count);
+    ASSERT_EQUAL(len, (int)msgs[0].len);
+    ASSERT_TRUE(memcmp(msgs[0].data, text, len) == 0);
+  }
+
+  // Data, ACKs and the token all went compact, at well under half the bytes
+  ASSERT_TRUE(client->fc.compact.packets >= 10 && server->fc.compact.packets >= 10);
+  ASSERT_TRUE(client->fc.compact.wire_bytes * 2 < client->fc.compact.full_bytes);
+  ASSERT_TRUE(server->fc.compact.wire_bytes * 2 < server->fc.compact.full_bytes);
+  printf("Compact headers: %llu packets in %llu bytes instead of %llu\n",
+         (unsigned long long)client->fc.compact.packets,
+         (unsigned long long)client->fc.compact.wire_bytes,
+         (unsigned long long)client->fc.compact.full_bytes);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Forwards datagrams between a client and whichever server socket last
+// answered it, dropping every drop_every-th one the client sends
+typedef struct {
+  int fd;
+  struct sockaddr_in client;
+  struct sockaddr_in server;
+  int has_client;
+  int from_client;
+  int drop_every;
+  int dropped;
+} lossy_relay;
+
+static void relay_pump(lossy_relay *relay)
+{
+  char buf[256];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  ssize_t len;
+
+  while ((len = recvfrom(relay->fd, buf, sizeof(buf), MSG_DONTWAIT,
+                         (struct sockaddr *)&from, &from_len)) > 0)
+  {
+    if (!relay->has_client)
+    {
+      relay->client = from;
+      relay->has_client = 1;
+    }
+    if (from.sin_port == relay->client.sin_port)
+    {
+      if (++relay->from_client % relay->drop_every == 0)
+      {
+        relay->dropped++;
+      }
+      else
+      {
+        sendto(relay->fd, buf, len, 0, (struct sockaddr *)&relay->server, sizeof(relay->server));
+      }
+    }
+    else
+    {
+      relay->server = from;
+      sendto(relay->fd, buf, len, 0, (struct sockaddr *)&relay->client, sizeof(relay->client));
+    }
+    from_len = sizeof(from);
+  }
+}
+
+// Test that forward error correction rebuilds segments lost on the way
+// and the messages arrive intact
+int test_connection_fec()
+{
+  struct sockaddr_in addr, relay_addr;
+  ct_message msgs[8];
+  char text[48];
+  lossy_relay relay;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 38);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  relay_addr = addr;
+  relay_addr.sin_port = htons(TEST_PORT_BASE + 39);
+
+  memset(&relay, 0, sizeof(relay));
+  relay.fd = socket(AF_INET, SOCK_DGRAM, 0);
+  relay.server = addr;
+  relay.drop_every = 7;
+  ASSERT_TRUE(relay.fd >= 0);
+  ASSERT_EQUAL(0, bind(relay.fd, (struct sockaddr *)&relay_addr, sizeof(relay_addr)));
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_set_fec(listener, 1));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(0, ct_set_fec(client, 1));
+  ASSERT_EQUAL(0, ct_connect(client, &relay_addr));
+  ASSERT_EQUAL(-1, ct_set_fec(client, 0));
+  ASSERT_EQUAL(EISCONN, errno);
+
+  uint64_t deadline = get_time_us() + 10000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    relay_pump(&relay);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ct_conn *conns[] = {client, server};
+  while ((client->state != CT_ESTABLISHED || server->state != CT_ESTABLISHED) &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 2);
+    relay_pump(&relay);
+  }
+  ASSERT_TRUE(client->fc.fec_enabled && server->fc.fec_enabled);
+
+  // Rounds of messages, so that the losses of the first ones turn on the
+  // parity for the later ones
+  int received = 0;
+  for (int i = 0; i < 120; i++)
+  {
+    int len = snprintf(text, sizeof(text), "message %d of a chat over a lossy path", i);
+    ASSERT_EQUAL(len, (int)ct_send_message(client, 1, text, len));
+    if (i % 10 != 9)
+    {
+      continue;
+    }
+
+    while (received <= i && get_time_us() < deadline)
+    {
+      pump(conns, 2);
+      relay_pump(&relay);
+      int count = ct_recv_messages(server, 1, msgs, 8);
+      for (int m = 0; m < count; m++, received++)
+      {
+        len = snprintf(text, sizeof(text), "message %d of a chat over a lossy path", received);
+        ASSERT_EQUAL(len, (int)msgs[m].len);
+        ASSERT_TRUE(memcmp(msgs[m].data, text, len) == 0);
+      }
+    }
+    ASSERT_EQUAL(i + 1, received);
+  }
+
+  // Parity went out and the server rebuilt segments from it, which the
+  // client hears about in the ACKs
+  while (client->fc.fec_tx.peer_recovered != server->fc.fec_rx.recovered &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 2);
+    relay_pump(&relay);
+  }
+  ASSERT_TRUE(relay.dropped > 0);
+  ASSERT_TRUE(client->fc.fec_tx.parity_sent > 0);
+  ASSERT_TRUE(server->fc.fec_rx.recovered > 0);
+  ASSERT_EQUAL((int)server->fc.fec_rx.recovered, (int)client->fc.fec_tx.peer_recovered);
+  printf("FEC: %d of %d datagrams dropped, %llu parity segments sent, %d segments rebuilt\n",
+         relay.dropped, relay.from_client, (unsigned long long)client->fc.fec_tx.parity_sent,
+         server->fc.fec_rx.recovered);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  close(relay.fd);
+  return TEST_PASS;
+}
+
+// Test that state updates overtaken before they went out are never sent
+int test_connection_state()
+{
+  struct sockaddr_in addr;
+  char value[CT_MAX_STATE + 1];
+  uint16_t key;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 34);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(-1, ct_send_state(client, 1, "early", 5));
+  ASSERT_EQUAL(ENOTCONN, errno);
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+  ASSERT_EQUAL(0, ct_send_state(client, 3, "early", 5));
+
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ct_conn *conns[] = {client, server};
+  while ((client->state != CT_ESTABLISHED || server->state != CT_ESTABLISHED) &&
+         get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+
+  ASSERT_EQUAL(-1, ct_send_state(client, 1, value, sizeof(value)));
+  ASSERT_EQUAL(EMSGSIZE, errno);
+  ASSERT_EQUAL(-1, (int)ct_recv_state(client, &key, value, sizeof(value)));
+  ASSERT_EQUAL(EAGAIN, errno);
+
+  // "one" goes out at once, "two" is replaced while it waits
+  ASSERT_EQUAL(0, ct_send_state(client, 1, "one", 3));
+  ASSERT_EQUAL(0, ct_send_state(client, 1, "two", 3));
+  ASSERT_EQUAL(0, ct_send_state(client, 1, "three", 5));
+  ASSERT_EQUAL(0, ct_send_state(client, 2, "other", 5));
+
+  int seen_three = 0;
+  int seen_other = 0;
+  int seen_early = 0;
+  while ((!seen_three || !seen_other || !seen_early) && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+    ssize_t len;
+    while ((len = ct_recv_state(server, &key, value, sizeof(value))) >= 0)
+    {
+      ASSERT_TRUE(key >= 1 && key <= 3);
+      ASSERT_TRUE(!(len == 3 && memcmp(value, "two", 3) == 0));
+      seen_three |= key == 1 && len == 5 && memcmp(value, "three", 5) == 0;
+      seen_other |= key == 2 && len == 5 && memcmp(value, "other", 5) == 0;
+      seen_early |= key == 3 && len == 5 && memcmp(value, "early", 5) == 0;
+    }
+  }
+  ASSERT_TRUE(seen_three && seen_other && seen_early);
+
+  // Once acknowledged, values are not sent again
+  while (state_channel_next_timer(&client->states, 0) != 0 && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+  ASSERT_EQUAL(0, (int)state_channel_next_timer(&client->states, 0));
+  ASSERT_TRUE(client->states.out[0].sent == client->states.out[0].version);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
+// Accept the next connection presenting token, with data sent behind the SYN
+static ct_conn *connect_early(ct_conn *listener, ct_conn *client,
+                              const struct sockaddr_in *addr, const uint8_t *token)
+{
+  if (ct_connect_token(client, addr, token, CT_TOKEN_SIZE) < 0 ||
+      ct_send(client, "early", 5) != 5)
+  {
+    return NULL;
+  }
+
+  ct_conn *server = NULL;
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  return server;
+}
+
+// Test that a token from one connection lets the next deliver data with the SYN
+int test_connection_resumption()
+{
+  struct sockaddr_in addr;
+  uint8_t token[CT_TOKEN_SIZE];
+  char buffer[16];
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TEST_PORT_BASE + 31);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ct_conn *listener = ct_socket();
+  ct_conn *client = ct_socket();
+  ct_conn *server = NULL;
+  ASSERT_TRUE(listener != NULL && client != NULL);
+  ASSERT_EQUAL(0, ct_bind(listener, &addr));
+  ASSERT_EQUAL(0, ct_listen(listener));
+  ASSERT_EQUAL(0, ct_connect(client, &addr));
+  ASSERT_EQUAL(-1, (int)ct_get_token(client, token, sizeof(token)));
+  ASSERT_EQUAL(ENOENT, errno);
+
+  // A full handshake, after which the server issues a token
+  uint64_t deadline = get_time_us() + 3000000;
+  while (server == NULL && get_time_us() < deadline)
+  {
+    ct_conn *pending[] = {client, listener};
+    pump(pending, 2);
+    server = ct_accept(listener);
+  }
+  ASSERT_TRUE(server != NULL);
+  ASSERT_EQUAL(0, ct_resumed(server));
+  ct_conn *conns[] = {client, server};
+  while (ct_get_token(client, token, sizeof(token)) < 0 && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+  }
+  ASSERT_EQUAL(CT_TOKEN_SIZE, (int)ct_get_token(client, token, sizeof(token)));
+  ct_free(client);
+  ct_free(server);
+
+  // The next connection's data is readable as soon as it is accepted
+  client = ct_socket();
+  server = connect_early(listener, client, &addr, token);
+  ASSERT_TRUE(server != NULL);
+  ASSERT_EQUAL(1, ct_resumed(server));
+  ASSERT_EQUAL(CT_SYN_RECEIVED, server->state);
+  ASSERT_EQUAL(5, (int)ct_recv(server, buffer, sizeof(buffer)));
+  ASSERT_TRUE(memcmp(buffer, "early", 5) == 0);
+
+  // And the server may answer before the handshake completes
+  ASSERT_EQUAL(5, (int)ct_send(server, "reply", 5));
+  conns[0] = client;
+  conns[1] = server;
+  int received = 0;
+  deadline = get_time_us() + 3000000;
+  while (received == 0 && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+    received = ct_recv(client, buffer, sizeof(buffer));
+  }
+  ASSERT_EQUAL(5, received);
+  ASSERT_TRUE(memcmp(buffer, "reply", 5) == 0);
+  ct_free(client);
+  ct_free(server);
+
+  // A replayed token falls back to the full handshake
+  client = ct_socket();
+  server = connect_early(listener, client, &addr, token);
+  ASSERT_TRUE(server != NULL);
+  ASSERT_EQUAL(0, ct_resumed(server));
+  ASSERT_EQUAL(-1, (int)ct_recv(server, buffer, sizeof(buffer)));
+  ASSERT_EQUAL(EAGAIN, errno);
+  ct_free(client);
+  ct_free(server);
+
+  // So does a forged one, the early data arrives once retransmitted
+  token[10] ^= 0xff;
+  client = ct_socket();
+  server = connect_early(listener, client, &addr, token);
+  ASSERT_TRUE(server != NULL);
+  ASSERT_EQUAL(0, ct_resumed(server));
+  conns[0] = client;
+  conns[1] = server;
+  received = 0;
+  deadline = get_time_us() + 5000000;
+  while (received <= 0 && get_time_us() < deadline)
+  {
+    pump(conns, 2);
+    received = ct_recv(server, buffer, sizeof(buffer));
+  }
+  ASSERT_EQUAL(5, received);
+  ASSERT_TRUE(memcmp(buffer, "early", 5) == 0);
+
+  ct_free(client);
+  ct_free(server);
+  ct_free(listener);
+  return TEST_PASS;
+}
+
 int main()
 {
   // Seed random number generator
@@ -187,6 +1156,16 @@ int main()
   // Run tests
   RUN_TEST(test_three_way_handshake);
   RUN_TEST(test_four_way_handshake);
+  RUN_TEST(test_nonblocking_connection);
+  RUN_TEST(test_multiplexed_connections);
+  RUN_TEST(test_connection_streams);
+  RUN_TEST(test_connection_window_growth);
+  RUN_TEST(test_connection_messages);
+  RUN_TEST(test_connection_resumption);
+  RUN_TEST(test_connection_state);
+  RUN_TEST(test_connection_compression);
+  RUN_TEST(test_connection_compact_headers);
+  RUN_TEST(test_connection_fec);
 
   printf("All connection tests passed!\n");
   return TEST_PASS;
@@ -0,0 +1,235 @@
+#include "test_utils.h"
+#include "drr.h"
+
+#define MANY_FLOWS 10000
+
+// Pick and charge the next flow len bytes, returning its index in flows
+static int send_one(drr_sched *sched, drr_flow *flows, size_t len)
+{
+  drr_flow *flow = drr_next(sched);
+  if (flow == NULL)
+  {
+    return -1;
+  }
+  drr_charge(sched, flow, len);
+  return (int)(flow - flows);
+}
+
+// Test that busy flows of one class share bytes evenly whatever their
+// message sizes
+int test_drr_fair_share()
+{
+  drr_sched sched;
+  drr_flow flows[3];
+  const size_t sizes[3] = {8000, 100, 700};
+  size_t bytes[3] = {0, 0, 0};
+
+  drr_init(&sched);
+  ASSERT_TRUE(drr_next(&sched) == NULL);
+  for (int i = 0; i < 3; i++)
+  {
+    drr_flow_init(&flows[i], DRR_INTERACTIVE, 1);
+    drr_activate(&sched, &flows[i]);
+  }
+  ASSERT_EQUAL(3, (int)sched.active);
+
+  for (int i = 0; i < 30000; i++)
+  {
+    drr_flow *flow = drr_next(&sched);
+    int index = flow - flows;
+    drr_charge(&sched, flow, sizes[index]);
+    bytes[index] += sizes[index];
+  }
+
+  // Each is within one large message of the others
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      ASSERT_TRUE(bytes[i] + 8000 + DRR_QUANTUM >= bytes[j]);
+    }
+  }
+  return TEST_PASS;
+}
+
+// Test that flows get bytes in proportion to their weights
+int test_drr_weights()
+{
+  drr_sched sched;
+  drr_flow flows[2];
+  size_t bytes[2] = {0, 0};
+
+  drr_init(&sched);
+  drr_flow_init(&flows[0], DRR_BULK, 1);
+  drr_flow_init(&flows[1], DRR_BULK, 3);
+  drr_activate(&sched, &flows[0]);
+  drr_activate(&sched, &flows[1]);
+
+  for (int i = 0; i < 40000; i++)
+  {
+    int index = send_one(&sched, flows, 100);
+    bytes[index] += 100;
+  }
+
+  // Within a turn of 3:1
+  ASSERT_TRUE(bytes[1] * 100 >= 299 * bytes[0] && bytes[1] * 100 <= 301 * bytes[0]);
+  return TEST_PASS;
+}
+
+// Test that classes share by their weights, and that a flow of a class
+// that was idle goes within one turn of a busy one
+int test_drr_classes()
+{
+  drr_sched sched;
+  drr_flow flows[DRR_CLASSES];
+  int next;
+
+  drr_init(&sched);
+  drr_flow_init(&flows[DRR_INTERACTIVE], DRR_INTERACTIVE, 1);
+  drr_flow_init(&flows[DRR_BULK], DRR_BULK, 1);
+  drr_activate(&sched, &flows[DRR_BULK]);
+
+  // Bulk alone gets everything
+  for (int i = 0; i < 1000; i++)
+  {
+    next = send_one(&sched, flows, 500);
+    ASSERT_EQUAL(DRR_BULK, next);
+  }
+
+  // Interactive data is sent before bulk has used up another turn
+  drr_activate(&sched, &flows[DRR_INTERACTIVE]);
+  size_t bulk_first = 0;
+  while (send_one(&sched, flows, 500) == DRR_BULK)
+  {
+    bulk_first += 500;
+  }
+  ASSERT_TRUE(bulk_first <= DRR_BULK_WEIGHT * DRR_QUANTUM + 500);
+
+  // Both busy, they share 4:1 within a turn and bulk is not starved
+  uint64_t bulk_before = sched.classes[DRR_BULK].bytes;
+  for (int i = 0; i < 50000; i++)
+  {
+    send_one(&sched, flows, 500);
+  }
+  uint64_t interactive = sched.classes[DRR_INTERACTIVE].bytes;
+  uint64_t bulk = sched.classes[DRR_BULK].bytes - bulk_before;
+  ASSERT_TRUE(interactive * 100 >= 399 * bulk && interactive * 100 <= 401 * bulk);
+
+  // Control gets 8 shares to their 4 and 1
+  drr_flow_init(&flows[DRR_CONTROL], DRR_CONTROL, 1);
+  drr_activate(&sched, &flows[DRR_CONTROL]);
+  bulk_before = sched.classes[DRR_BULK].bytes;
+  for (int i = 0; i < 50000; i++)
+  {
+    send_one(&sched, flows, 500);
+  }
+  uint64_t control = sched.classes[DRR_CONTROL].bytes;
+  bulk = sched.classes[DRR_BULK].bytes - bulk_before;
+  ASSERT_TRUE(control * 100 >= 799 * bulk && control * 100 <= 801 * bulk);
+
+  // A flow moved to another class sends with it
+  drr_set_class(&sched, &flows[DRR_BULK], DRR_CONTROL);
+  ASSERT_EQUAL(0, (int)sched.classes[DRR_BULK].count);
+  ASSERT_EQUAL(2, (int)sched.classes[DRR_CONTROL].count);
+  return TEST_PASS;
+}
+
+// Test activating and removing flows, from anywhere in their class
+int test_drr_remove()
+{
+  drr_sched sched;
+  drr_flow flows[4];
+  int next;
+
+  drr_init(&sched);
+  for (int i = 0; i < 4; i++)
+  {
+    drr_flow_init(&flows[i], DRR_INTERACTIVE, 1);
+    drr_activate(&sched, &flows[i]);
+  }
+  drr_activate(&sched, &flows[2]);
+  ASSERT_EQUAL(4, (int)sched.active);
+
+  // Turns go in order of activation, a message of a quantum each
+  for (int i = 0; i < 4; i++)
+  {
+    next = send_one(&sched, flows, DRR_QUANTUM);
+    ASSERT_EQUAL(i, next);
+  }
+
+  drr_remove(&sched, &flows[1]);
+  drr_remove(&sched, &flows[1]);
+  drr_remove(&sched, &flows[3]);
+  ASSERT_EQUAL(2, (int)sched.active);
+  for (int i = 0; i < 10; i++)
+  {
+    next = send_one(&sched, flows, DRR_QUANTUM);
+    ASSERT_EQUAL(i % 2 == 0 ? 0 : 2, next);
+  }
+
+  // A flow that went idle with credit left does not keep it
+  next = send_one(&sched, flows, 10);
+  ASSERT_EQUAL(0, next);
+  drr_remove(&sched, &flows[0]);
+  ASSERT_EQUAL(0, (int)flows[0].deficit);
+
+  // An overdraft is kept, and repaid by skipping turns
+  next = send_one(&sched, flows, 3 * DRR_QUANTUM);
+  ASSERT_EQUAL(2, next);
+  drr_remove(&sched, &flows[2]);
+  ASSERT_EQUAL(-2 * DRR_QUANTUM, (int)flows[2].deficit);
+  drr_activate(&sched, &flows[2]);
+  drr_activate(&sched, &flows[0]);
+  next = send_one(&sched, flows, DRR_QUANTUM);
+  ASSERT_EQUAL(0, next);
+  next = send_one(&sched, flows, DRR_QUANTUM);
+  ASSERT_EQUAL(0, next);
+  next = send_one(&sched, flows, DRR_QUANTUM);
+  ASSERT_EQUAL(2, next);
+
+  drr_remove(&sched, &flows[0]);
+  drr_remove(&sched, &flows[2]);
+  ASSERT_TRUE(drr_next(&sched) == NULL);
+  return TEST_PASS;
+}
+
+// Test that thousands of flows each get one turn per round
+int test_drr_many_flows()
+{
+  static drr_flow flows[MANY_FLOWS];
+  drr_sched sched;
+
+  drr_init(&sched);
+  for (int i = 0; i < MANY_FLOWS; i++)
+  {
+    drr_flow_init(&flows[i], i % 2 == 0 ? DRR_INTERACTIVE : DRR_BULK, 1);
+    drr_activate(&sched, &flows[i]);
+  }
+
+  // Messages of a quantum, so each flow sends one per turn
+  static int sends[MANY_FLOWS];
+  for (int i = 0; i < 5 * MANY_FLOWS; i++)
+  {
+    sends[send_one(&sched, flows, DRR_QUANTUM)]++;
+  }
+  for (int i = 0; i < MANY_FLOWS; i++)
+  {
+    int turns = i % 2 == 0 ? 8 : 2;
+    ASSERT_TRUE(sends[i] >= turns - 1 && sends[i] <= turns + 1);
+  }
+  ASSERT_EQUAL(5 * MANY_FLOWS, (int)sched.decisions);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_drr_fair_share);
+  RUN_TEST(test_drr_weights);
+  RUN_TEST(test_drr_classes);
+  RUN_TEST(test_drr_remove);
+  RUN_TEST(test_drr_many_flows);
+
+  printf("All deficit round robin tests passed!\n");
+  return TEST_PASS;
+}
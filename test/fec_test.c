@@ -0,0 +1,298 @@
+#include "test_utils.h"
+#include "fec.h"
+#include "gf256.h"
+
+// A data segment of len bytes at seq_num, its payload derived from both
+static void make_segment(packet *pkt, uint32_t seq_num, size_t len, uint16_t stream_id)
+{
+  memset(pkt, 0, sizeof(packet));
+  pkt->seq_num = seq_num;
+  pkt->data_offset = STREAM_DATA_OFFSET;
+  pkt->flags = PSH;
+  pkt->stream_id = stream_id;
+  pkt->stream_offset = seq_num * 3;
+  pkt->payload_len = len;
+  for (size_t i = 0; i < len; i++)
+  {
+    pkt->payload[i] = (char)(seq_num * 7 + i * 13);
+  }
+}
+
+// Code count segments of the given lengths from seq_num into one block.
+// Returns the sequence number following them.
+static uint32_t code_block(fec_encoder *enc, packet *segments, const size_t *lens,
+                           int count, uint32_t seq_num)
+{
+  for (int i = 0; i < count; i++)
+  {
+    make_segment(&segments[i], seq_num, lens[i], i % 3);
+    fec_encoder_add(enc, &segments[i]);
+    seq_num += lens[i];
+  }
+  return seq_num;
+}
+
+// Feed the decoder all segments but the lost ones, then parity segments
+// up to parity_count. Returns what the last recovery attempt returned.
+static int deliver_block(fec_encoder *enc, fec_decoder *dec, packet *segments, int count,
+                         const int *lost, int parity_count, packet *rebuilt)
+{
+  for (int i = 0; i < count; i++)
+  {
+    if (!lost[i])
+    {
+      fec_decoder_add_data(dec, &segments[i], segments[i].payload_len);
+    }
+  }
+
+  int result = 0;
+  for (int j = 0; j < parity_count; j++)
+  {
+    packet parity;
+    fec_encoder_parity(enc, j, &parity);
+    int block = fec_decoder_add_parity(dec, &parity);
+    if (block < 0)
+    {
+      return -2;
+    }
+    result = fec_decoder_recover(dec, block, rebuilt);
+    if (result != 0)
+    {
+      break;
+    }
+  }
+  return result;
+}
+
+static int same_segment(const packet *a, const packet *b)
+{
+  return a->seq_num == b->seq_num && a->payload_len == b->payload_len &&
+         a->stream_id == b->stream_id && a->stream_offset == b->stream_offset &&
+         memcmp(a->payload, b->payload, a->payload_len) == 0;
+}
+
+// Test that the SIMD multiply agrees with the tables at every length
+int test_gf256()
+{
+  uint8_t src[100], dst[100], expected[100];
+  const uint8_t factors[] = {0, 1, 2, 0x53, 0x8e, 0xff};
+
+  for (int a = 1; a < 256; a++)
+  {
+    ASSERT_EQUAL(1, (int)gf256_mul(a, gf256_inv(a)));
+  }
+  ASSERT_EQUAL(1, (int)gf256_exp(0));
+  ASSERT_EQUAL(1, (int)gf256_exp(255));
+
+  for (size_t len = 0; len <= sizeof(src); len++)
+  {
+    for (size_t f = 0; f < sizeof(factors); f++)
+    {
+      for (size_t i = 0; i < len; i++)
+      {
+        src[i] = i * 37 + f;
+        dst[i] = i * 11;
+        expected[i] = dst[i] ^ gf256_mul(factors[f], src[i]);
+      }
+      gf256_mul_add(dst, src, factors[f], len);
+      ASSERT_TRUE(memcmp(dst, expected, len) == 0);
+    }
+  }
+  return TEST_PASS;
+}
+
+// Test that XOR parity rebuilds one lost segment of a small group
+int test_fec_xor()
+{
+  fec_encoder enc;
+  fec_decoder dec;
+  packet segments[FEC_MAX_DATA];
+  packet rebuilt[FEC_MAX_PARITY];
+  const size_t lens[] = {44, 44, 30, 44, 7, 44, 44, 12};
+  int lost[8] = {0};
+
+  fec_encoder_init(&enc);
+  fec_decoder_init(&dec);
+  enc.loss_rate = FEC_LOSS_ONE / 100;
+  code_block(&enc, segments, lens, 8, 1000);
+  ASSERT_EQUAL(1, fec_encoder_pending(&enc));
+
+  lost[4] = 1;
+  ASSERT_EQUAL(1, deliver_block(&enc, &dec, segments, 8, lost, 1, rebuilt));
+  ASSERT_TRUE(same_segment(&rebuilt[0], &segments[4]));
+  ASSERT_EQUAL(1, (int)dec.recovered);
+
+  // A block that arrived whole has nothing to rebuild
+  lost[4] = 0;
+  fec_decoder_init(&dec);
+  ASSERT_EQUAL(-1, deliver_block(&enc, &dec, segments, 8, lost, 1, rebuilt));
+  return TEST_PASS;
+}
+
+// Test that Reed-Solomon parity rebuilds as many lost segments as it has
+// parity segments, scattered or in a run
+int test_fec_reed_solomon()
+{
+  fec_encoder enc;
+  fec_decoder dec;
+  packet segments[FEC_MAX_DATA];
+  packet rebuilt[FEC_MAX_PARITY];
+  size_t lens[FEC_MAX_DATA];
+
+  for (int i = 0; i < FEC_MAX_DATA; i++)
+  {
+    lens[i] = i % 5 == 2 ? 9 + i : MAX_PAYLOAD_SIZE;
+  }
+
+  // Four scattered losses out of 8
+  fec_encoder_init(&enc);
+  fec_decoder_init(&dec);
+  enc.loss_rate = FEC_LOSS_ONE / 5;
+  code_block(&enc, segments, lens, 8, 0xfffffff0);
+  ASSERT_EQUAL(4, fec_encoder_pending(&enc));
+  int scattered[8] = {1, 0, 0, 1, 0, 1, 0, 1};
+  ASSERT_EQUAL(4, deliver_block(&enc, &dec, segments, 8, scattered, 4, rebuilt));
+  ASSERT_TRUE(same_segment(&rebuilt[0], &segments[0]));
+  ASSERT_TRUE(same_segment(&rebuilt[1], &segments[3]));
+  ASSERT_TRUE(same_segment(&rebuilt[2], &segments[5]));
+  ASSERT_TRUE(same_segment(&rebuilt[3], &segments[7]));
+
+  // A run of three out of 16 needs three of the four parity segments
+  fec_encoder_init(&enc);
+  fec_decoder_init(&dec);
+  enc.loss_rate = FEC_LOSS_ONE / 16;
+  code_block(&enc, segments, lens, 16, 5000);
+  ASSERT_EQUAL(4, fec_encoder_pending(&enc));
+  int run[16] = {0};
+  run[9] = run[10] = run[11] = 1;
+  ASSERT_EQUAL(3, deliver_block(&enc, &dec, segments, 16, run, 3, rebuilt));
+  for (int i = 0; i < 3; i++)
+  {
+    ASSERT_TRUE(same_segment(&rebuilt[i], &segments[9 + i]));
+  }
+  return TEST_PASS;
+}
+
+// Test that a block waits while it cannot be rebuilt yet
+int test_fec_waits()
+{
+  fec_encoder enc;
+  fec_decoder dec;
+  packet segments[FEC_MAX_DATA];
+  packet rebuilt[FEC_MAX_PARITY];
+  const size_t lens[] = {44, 44, 44, 44, 44, 44, 44, 44};
+
+  fec_encoder_init(&enc);
+  fec_decoder_init(&dec);
+  enc.loss_rate = FEC_LOSS_ONE / 5;
+  code_block(&enc, segments, lens, 8, 100);
+
+  // Three lost in two gaps could be split either way between them
+  int lost[8] = {0, 1, 1, 0, 0, 1, 0, 0};
+  ASSERT_EQUAL(0, deliver_block(&enc, &dec, segments, 8, lost, 4, rebuilt));
+  int block = fec_decoder_find(&dec, segments[2].seq_num);
+  ASSERT_TRUE(block >= 0);
+
+  // Once a retransmission fills one of them it can
+  fec_decoder_add_data(&dec, &segments[1], segments[1].payload_len);
+  ASSERT_EQUAL(2, fec_decoder_recover(&dec, block, rebuilt));
+  ASSERT_TRUE(same_segment(&rebuilt[0], &segments[2]));
+  ASSERT_TRUE(same_segment(&rebuilt[1], &segments[5]));
+  ASSERT_EQUAL(-1, fec_decoder_find(&dec, segments[2].seq_num));
+
+  // Two lost with one parity segment in so far
+  fec_decoder_init(&dec);
+  int two[8] = {0, 0, 0, 1, 0, 0, 1, 0};
+  ASSERT_EQUAL(0, deliver_block(&enc, &dec, segments, 8, two, 1, rebuilt));
+
+  // Malformed parity is refused
+  packet parity;
+  fec_encoder_parity(&enc, 0, &parity);
+  parity.stream_id = 0;
+  ASSERT_EQUAL(-1, fec_decoder_add_parity(&dec, &parity));
+
+  // Parity claiming four segments where one held segment covers the whole
+  // span never rebuilds anything
+  fec_decoder_init(&dec);
+  make_segment(&parity, 5000, 44, 0);
+  fec_decoder_add_data(&dec, &parity, 44);
+  for (int j = 0; j < 3; j++)
+  {
+    fec_encoder_parity(&enc, j, &parity);
+    parity.seq_num = 5000;
+    parity.stream_id = 4 << 8 | 3 << 4 | j;
+    parity.stream_offset = 44;
+    block = fec_decoder_add_parity(&dec, &parity);
+    ASSERT_TRUE(block >= 0);
+    ASSERT_EQUAL(-1, fec_decoder_recover(&dec, block, rebuilt));
+    ASSERT_EQUAL(-1, fec_decoder_find(&dec, 5000));
+  }
+  return TEST_PASS;
+}
+
+// Test that the amount of parity follows the loss rate
+int test_fec_adapts()
+{
+  fec_encoder enc;
+  packet pkt;
+
+  // No parity until segments go missing
+  fec_encoder_init(&enc);
+  make_segment(&pkt, 1, 10, 0);
+  ASSERT_EQUAL(0, fec_encoder_add(&enc, &pkt));
+  ASSERT_EQUAL(0, fec_encoder_pending(&enc));
+
+  // One loss in fifty: XOR over 8
+  for (int i = 0; i < 200; i++)
+  {
+    fec_on_sent(&enc);
+    if (i % 50 == 0)
+    {
+      fec_on_lost(&enc, 1);
+    }
+  }
+  ASSERT_EQUAL(0, fec_encoder_add(&enc, &pkt));
+  ASSERT_EQUAL(8, enc.data_count);
+  ASSERT_EQUAL(1, fec_encoder_pending(&enc));
+  fec_encoder_close(&enc);
+  ASSERT_EQUAL(1, (int)enc.parity_sent);
+
+  // Segments the peer rebuilt count as lost, stale reports do not
+  fec_on_recovered(&enc, 2);
+  uint32_t rate = enc.loss_rate;
+  fec_on_recovered(&enc, 1);
+  ASSERT_EQUAL((int)rate, (int)enc.loss_rate);
+  ASSERT_EQUAL(0, fec_encoder_add(&enc, &pkt));
+  ASSERT_EQUAL(4, enc.data_count);
+  ASSERT_EQUAL(1, fec_encoder_pending(&enc));
+  fec_encoder_close(&enc);
+
+  // Heavy loss: Reed-Solomon, with no more parity than data so far
+  fec_on_lost(&enc, 20);
+  ASSERT_EQUAL(0, fec_encoder_add(&enc, &pkt));
+  ASSERT_EQUAL(4, enc.parity_count);
+  ASSERT_EQUAL(1, fec_encoder_pending(&enc));
+  fec_encoder_close(&enc);
+
+  // And off again once the path recovers
+  for (int i = 0; i < 2000; i++)
+  {
+    fec_on_sent(&enc);
+  }
+  ASSERT_EQUAL(0, fec_encoder_add(&enc, &pkt));
+  ASSERT_EQUAL(0, fec_encoder_pending(&enc));
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_gf256);
+  RUN_TEST(test_fec_xor);
+  RUN_TEST(test_fec_reed_solomon);
+  RUN_TEST(test_fec_waits);
+  RUN_TEST(test_fec_adapts);
+
+  printf("All FEC tests passed!\n");
+  return TEST_PASS;
+}
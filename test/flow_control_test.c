@@ -91,6 +91,427 @@ int test_flow_control_update()
   return TEST_PASS;
 }
 
+// Send a data segment from the test peer to the receiver under test
+static int send_test_segment(int sock, struct sockaddr_in *addr, uint32_t seq, const char *data)
+{
+  packet pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.seq_num = seq;
+  pkt.data_offset = TIMESTAMP_DATA_OFFSET;
+  pkt.flags = PSH;
+  strncpy(pkt.payload, data, MAX_PAYLOAD_SIZE);
+  pkt.checksum = calculate_checksum(&pkt);
+
+  return sendto(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)addr, sizeof(*addr));
+}
+
+// Test that segments beyond a gap are held, reported via SACK and delivered in order
+int test_out_of_order_reassembly()
+{
+  int receiver_sock = create_test_socket(TEST_PORT_BASE + 10);
+  int peer_sock = create_test_socket(TEST_PORT_BASE + 11);
+  struct sockaddr_in receiver_addr, peer_addr;
+  flow_control_state fc_state;
+  char buffer[MAX_PAYLOAD_SIZE];
+  size_t bytes_received = 0;
+  packet ack;
+
+  ASSERT_TRUE(receiver_sock >= 0);
+  ASSERT_TRUE(peer_sock >= 0);
+
+  memset(&receiver_addr, 0, sizeof(receiver_addr));
+  receiver_addr.sin_family = AF_INET;
+  receiver_addr.sin_port = htons(TEST_PORT_BASE + 10);
+  receiver_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  peer_addr = receiver_addr;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 11);
+
+  init_flow_control(&fc_state, receiver_sock, &peer_addr, TEST_PORT_BASE + 10, TEST_PORT_BASE + 11);
+
+  // The first segment fixes the expected sequence number
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 1000, "aaaa") > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(1004, (int)ack.ack_num);
+
+  // Segment 1008 arrives before 1004
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 1008, "cccc") > 0);
+  ASSERT_EQUAL(0, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(1004, (int)ack.ack_num);
+  ASSERT_EQUAL(SACK_DATA_OFFSET, ack.data_offset);
+  ASSERT_EQUAL(1008, (int)ack.sack_left);
+  ASSERT_EQUAL(1012, (int)ack.sack_right);
+
+  // Filling the gap acknowledges both segments at once
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 1004, "bbbb") > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(memcmp(buffer, "bbbb", 4) == 0);
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(1012, (int)ack.ack_num);
+  ASSERT_EQUAL(0, (int)(ack.sack_right - ack.sack_left));
+
+  // The held segment is delivered without another packet
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(memcmp(buffer, "cccc", 4) == 0);
+  ASSERT_EQUAL(0, fc_state.reassembly_count);
+
+  close(receiver_sock);
+  close(peer_sock);
+  return TEST_PASS;
+}
+
+// Send a data segment carrying the given timestamp
+static int send_stamped_segment(int sock, struct sockaddr_in *addr, uint32_t seq,
+                                const char *data, uint32_t ts_val)
+{
+  packet pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.seq_num = seq;
+  pkt.data_offset = TIMESTAMP_DATA_OFFSET;
+  pkt.flags = PSH;
+  pkt.ts_val = ts_val;
+  strncpy(pkt.payload, data, MAX_PAYLOAD_SIZE);
+  pkt.checksum = calculate_checksum(&pkt);
+
+  return sendto(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)addr, sizeof(*addr));
+}
+
+// Test that timestamps are echoed and that PAWS drops segments with old ones
+int test_timestamps_and_paws()
+{
+  int receiver_sock = create_test_socket(TEST_PORT_BASE + 16);
+  int peer_sock = create_test_socket(TEST_PORT_BASE + 17);
+  struct sockaddr_in receiver_addr, peer_addr;
+  flow_control_state fc_state;
+  char buffer[MAX_PAYLOAD_SIZE];
+  size_t bytes_received = 0;
+  packet ack;
+
+  ASSERT_TRUE(receiver_sock >= 0);
+  ASSERT_TRUE(peer_sock >= 0);
+
+  memset(&receiver_addr, 0, sizeof(receiver_addr));
+  receiver_addr.sin_family = AF_INET;
+  receiver_addr.sin_port = htons(TEST_PORT_BASE + 16);
+  receiver_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  peer_addr = receiver_addr;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 17);
+
+  init_flow_control(&fc_state, receiver_sock, &peer_addr, TEST_PORT_BASE + 16, TEST_PORT_BASE + 17);
+
+  // The timestamp of an accepted segment is echoed in the ACK
+  ASSERT_TRUE(send_stamped_segment(peer_sock, &receiver_addr, 3000, "aaaa", 50000) > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(3004, (int)ack.ack_num);
+  ASSERT_EQUAL(50000, (int)ack.ts_ecr);
+
+  // A segment with the expected sequence number but an older timestamp
+  // belongs to a previous trip around the sequence space
+  ASSERT_TRUE(send_stamped_segment(peer_sock, &receiver_addr, 3004, "old!", 40000) > 0);
+  ASSERT_EQUAL(0, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(3004, (int)ack.ack_num);
+  ASSERT_EQUAL(50000, (int)ack.ts_ecr);
+
+  // Timestamps that wrap past 2^32 are still newer
+  fc_state.ts_recent = 0xFFFFFF00;
+  ASSERT_TRUE(send_stamped_segment(peer_sock, &receiver_addr, 3004, "bbbb", 0x100) > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(memcmp(buffer, "bbbb", 4) == 0);
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(3008, (int)ack.ack_num);
+  ASSERT_EQUAL(0x100, (int)ack.ts_ecr);
+
+  close(receiver_sock);
+  close(peer_sock);
+  return TEST_PASS;
+}
+
+// Test that the receive window follows the application's drain rate and
+// shrinks under global memory pressure
+int test_receive_window_autotuning()
+{
+  int receiver_sock = create_test_socket(TEST_PORT_BASE + 18);
+  int peer_sock = create_test_socket(TEST_PORT_BASE + 19);
+  struct sockaddr_in receiver_addr, peer_addr;
+  flow_control_state fc_state;
+  char buffer[MAX_PAYLOAD_SIZE];
+  char data[MAX_PAYLOAD_SIZE + 1];
+  size_t bytes_received = 0;
+  uint32_t seq = 4000;
+  packet ack;
+
+  ASSERT_TRUE(receiver_sock >= 0);
+  ASSERT_TRUE(peer_sock >= 0);
+
+  memset(data, 'x', MAX_PAYLOAD_SIZE);
+  data[MAX_PAYLOAD_SIZE] = '\0';
+
+  memset(&receiver_addr, 0, sizeof(receiver_addr));
+  receiver_addr.sin_family = AF_INET;
+  receiver_addr.sin_port = htons(TEST_PORT_BASE + 18);
+  receiver_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  peer_addr = receiver_addr;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 19);
+
+  uint32_t memory_before = get_receive_memory();
+  init_flow_control(&fc_state, receiver_sock, &peer_addr, TEST_PORT_BASE + 18, TEST_PORT_BASE + 19);
+  ASSERT_EQUAL(INITIAL_WINDOW_SIZE, fc_state.rcv_window);
+  ASSERT_EQUAL((int)(memory_before + INITIAL_WINDOW_SIZE), (int)get_receive_memory());
+
+  // The test peer echoes no timestamps, assume a 1 ms path
+  fc_state.rcv_rtt_us = 1000;
+
+  // A fast application drains a full window within one RTT
+  for (int i = 0; i < INITIAL_WINDOW_SIZE / MAX_PAYLOAD_SIZE; i++)
+  {
+    ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, seq, data) > 0);
+    ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer),
+                                                                  &bytes_received));
+    ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+    seq += MAX_PAYLOAD_SIZE;
+  }
+  usleep(2000);
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, seq, data) > 0);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer),
+                                                                &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  seq += MAX_PAYLOAD_SIZE;
+
+  uint16_t grown = fc_state.rcv_window;
+  ASSERT_TRUE(grown > INITIAL_WINDOW_SIZE);
+  ASSERT_EQUAL(grown, ack.window_size);
+
+  // Under memory pressure a slow application only keeps what it uses
+  set_receive_memory_limit(get_receive_memory());
+  usleep(2000);
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, seq, data) > 0);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer),
+                                                                &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  set_receive_memory_limit(RCV_MEMORY_LIMIT);
+
+  ASSERT_TRUE(fc_state.rcv_window < grown);
+  ASSERT_EQUAL(fc_state.rcv_window, ack.window_size);
+
+  release_flow_control(&fc_state);
+  ASSERT_EQUAL((int)memory_before, (int)get_receive_memory());
+
+  close(receiver_sock);
+  close(peer_sock);
+  return TEST_PASS;
+}
+
+// Test that a CE mark is echoed until the sender signals CWR. The test
+// peer stands in for a congesting router by sending with the CE codepoint.
+int test_ecn_echo()
+{
+  int receiver_sock = create_test_socket(TEST_PORT_BASE + 14);
+  int peer_sock = create_test_socket(TEST_PORT_BASE + 15);
+  struct sockaddr_in receiver_addr, peer_addr;
+  flow_control_state fc_state;
+  char buffer[MAX_PAYLOAD_SIZE];
+  size_t bytes_received = 0;
+  packet pkt, ack;
+  int tos;
+
+  ASSERT_TRUE(receiver_sock >= 0);
+  ASSERT_TRUE(peer_sock >= 0);
+
+  memset(&receiver_addr, 0, sizeof(receiver_addr));
+  receiver_addr.sin_family = AF_INET;
+  receiver_addr.sin_port = htons(TEST_PORT_BASE + 14);
+  receiver_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  peer_addr = receiver_addr;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 15);
+
+  init_flow_control(&fc_state, receiver_sock, &peer_addr, TEST_PORT_BASE + 14, TEST_PORT_BASE + 15);
+  ASSERT_EQUAL(1, fc_state.ecn_enabled);
+
+  // An unmarked segment is acknowledged without an echo
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 2000, "aaaa") > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(0, ack.reserved & ECN_ECE);
+
+  // A CE-marked segment is echoed, and keeps being echoed
+  tos = 0x03; // CE
+  ASSERT_TRUE(setsockopt(peer_sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == 0);
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 2004, "bbbb") > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(ECN_ECE, ack.reserved & ECN_ECE);
+
+  tos = 0x02; // ECT(0)
+  ASSERT_TRUE(setsockopt(peer_sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == 0);
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 2008, "cccc") > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(ECN_ECE, ack.reserved & ECN_ECE);
+
+  // CWR from the sender ends the echo
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.seq_num = 2012;
+  pkt.flags = PSH;
+  pkt.reserved = ECN_CWR;
+  strcpy(pkt.payload, "dddd");
+  pkt.checksum = calculate_checksum(&pkt);
+  ASSERT_TRUE(sendto(peer_sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&receiver_addr,
+                     sizeof(receiver_addr)) > 0);
+  ASSERT_EQUAL(4, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(0, ack.reserved & ECN_ECE);
+
+  close(receiver_sock);
+  close(peer_sock);
+  return TEST_PASS;
+}
+
+// Test that a window closed by held data is reopened with a window update
+int test_window_update()
+{
+  int receiver_sock = create_test_socket(TEST_PORT_BASE + 22);
+  int peer_sock = create_test_socket(TEST_PORT_BASE + 23);
+  struct sockaddr_in receiver_addr, peer_addr;
+  flow_control_state fc_state;
+  char buffer[MAX_PAYLOAD_SIZE];
+  char segment[4][MAX_PAYLOAD_SIZE + 1];
+  size_t bytes_received = 0;
+  packet ack;
+
+  ASSERT_TRUE(receiver_sock >= 0);
+  ASSERT_TRUE(peer_sock >= 0);
+
+  memset(&receiver_addr, 0, sizeof(receiver_addr));
+  receiver_addr.sin_family = AF_INET;
+  receiver_addr.sin_port = htons(TEST_PORT_BASE + 22);
+  receiver_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  peer_addr = receiver_addr;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 23);
+
+  init_flow_control(&fc_state, receiver_sock, &peer_addr, TEST_PORT_BASE + 22, TEST_PORT_BASE + 23);
+
+  for (int i = 0; i < 4; i++)
+  {
+    memset(segment[i], 'a' + i, MAX_PAYLOAD_SIZE);
+    segment[i][MAX_PAYLOAD_SIZE] = '\0';
+  }
+
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 1000, segment[0]) > 0);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(INITIAL_WINDOW_SIZE, ack.window_size);
+
+  // Two segments arrive beyond a gap
+  for (int i = 2; i < 4; i++)
+  {
+    ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 1000 + i * MAX_PAYLOAD_SIZE, segment[i]) > 0);
+    ASSERT_EQUAL(0, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+    ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  }
+
+  // Memory pressure shrinks the buffer to exactly what is held, so the
+  // ACK for the filled gap closes the window
+  fc_state.rcv_window = 2 * MAX_PAYLOAD_SIZE;
+  ASSERT_TRUE(send_test_segment(peer_sock, &receiver_addr, 1000 + MAX_PAYLOAD_SIZE, segment[1]) > 0);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(1000 + 4 * MAX_PAYLOAD_SIZE, (int)ack.ack_num);
+  ASSERT_EQUAL(0, ack.window_size);
+
+  // Reading a held segment frees a full segment, the sender is told at once
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(memcmp(buffer, segment[2], MAX_PAYLOAD_SIZE) == 0);
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), MSG_DONTWAIT) > 0);
+  ASSERT_EQUAL(ACK, ack.flags);
+  ASSERT_EQUAL(1000 + 4 * MAX_PAYLOAD_SIZE, (int)ack.ack_num);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, ack.window_size);
+
+  // The window is open now, further reads send no more updates
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, receive_data_with_flow_control(&fc_state, buffer, sizeof(buffer), &bytes_received));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), MSG_DONTWAIT) < 0);
+
+  close(receiver_sock);
+  close(peer_sock);
+  return TEST_PASS;
+}
+
+// Build a data segment carrying the stream option
+static void stream_segment(packet *pkt, uint32_t seq, uint16_t stream_id, uint32_t offset,
+                           const char *data)
+{
+  memset(pkt, 0, sizeof(packet));
+  pkt->seq_num = seq;
+  pkt->flags = PSH;
+  pkt->data_offset = STREAM_DATA_OFFSET;
+  pkt->stream_id = stream_id;
+  pkt->stream_offset = offset;
+  strncpy(pkt->payload, data, MAX_PAYLOAD_SIZE);
+  pkt->payload_len = strnlen(data, MAX_PAYLOAD_SIZE);
+}
+
+// Test that a loss on one stream does not hold back another
+int test_stream_delivery()
+{
+  int receiver_sock = create_test_socket(TEST_PORT_BASE + 27);
+  int peer_sock = create_test_socket(TEST_PORT_BASE + 28);
+  struct sockaddr_in peer_addr;
+  flow_control_state fc_state;
+  char bulk[MAX_PAYLOAD_SIZE + 1];
+  char buffer[64];
+  packet pkt, ack;
+
+  ASSERT_TRUE(receiver_sock >= 0);
+  ASSERT_TRUE(peer_sock >= 0);
+
+  memset(&peer_addr, 0, sizeof(peer_addr));
+  peer_addr.sin_family = AF_INET;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 28);
+  peer_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  init_flow_control(&fc_state, receiver_sock, &peer_addr, TEST_PORT_BASE + 27, TEST_PORT_BASE + 28);
+  fc_state.rcv_queued = 1;
+  fc_state.rcv_nxt = 1000;
+  memset(bulk, 'b', MAX_PAYLOAD_SIZE);
+  bulk[MAX_PAYLOAD_SIZE] = '\0';
+
+  // A bulk segment on stream 2 is lost, a chat message on stream 1 follows
+  stream_segment(&pkt, 1000 + MAX_PAYLOAD_SIZE, 1, 0, "hello room");
+  ASSERT_EQUAL(0, flow_control_on_data(&fc_state, &pkt, 0, NULL, 0, NULL));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(1000, (int)ack.ack_num);
+
+  // The message can be read while its sequence numbers are beyond the gap
+  ASSERT_EQUAL(1, flow_control_next_stream(&fc_state));
+  ASSERT_EQUAL(0, flow_control_read_stream(&fc_state, 2, buffer, sizeof(buffer)));
+  ASSERT_EQUAL(10, flow_control_read_stream(&fc_state, 1, buffer, sizeof(buffer)));
+  ASSERT_TRUE(memcmp(buffer, "hello room", 10) == 0);
+  ASSERT_EQUAL(-1, flow_control_next_stream(&fc_state));
+
+  // The retransmission fills the gap, both segments are acknowledged
+  stream_segment(&pkt, 1000, 2, 0, bulk);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, flow_control_on_data(&fc_state, &pkt, 0, NULL, 0, NULL));
+  ASSERT_TRUE(recv(peer_sock, &ack, sizeof(ack), 0) > 0);
+  ASSERT_EQUAL(1000 + MAX_PAYLOAD_SIZE + 10, (int)ack.ack_num);
+
+  ASSERT_EQUAL(2, flow_control_next_stream(&fc_state));
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, flow_control_read_stream(&fc_state, 2, buffer, sizeof(buffer)));
+  ASSERT_TRUE(memcmp(buffer, bulk, MAX_PAYLOAD_SIZE) == 0);
+  ASSERT_EQUAL(0, fc_state.reassembly_count);
+
+  // A stale copy of data already read is acknowledged but not read again
+  stream_segment(&pkt, fc_state.rcv_nxt, 1, 0, "hello room");
+  ASSERT_EQUAL(10, flow_control_on_data(&fc_state, &pkt, 0, NULL, 0, NULL));
+  ASSERT_EQUAL(-1, flow_control_next_stream(&fc_state));
+  ASSERT_EQUAL(0, fc_state.reassembly_count);
+
+  close(receiver_sock);
+  close(peer_sock);
+  return TEST_PASS;
+}
+
 int main()
 {
   // Seed random number generator
@@ -100,6 +521,12 @@ int main()
   RUN_TEST(test_flow_control_init);
   RUN_TEST(test_window_calculation);
   RUN_TEST(test_flow_control_update);
+  RUN_TEST(test_out_of_order_reassembly);
+  RUN_TEST(test_ecn_echo);
+  RUN_TEST(test_timestamps_and_paws);
+  RUN_TEST(test_receive_window_autotuning);
+  RUN_TEST(test_window_update);
+  RUN_TEST(test_stream_delivery);
 
   printf("All flow control tests passed!\n");
   return TEST_PASS;
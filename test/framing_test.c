@@ -0,0 +1,154 @@
+#include "test_utils.h"
+#include "framing.h"
+
+// Append a framed message to the decoder as if it had been received
+static void receive(frame_decoder *dec, const char *data, size_t len)
+{
+  size_t space;
+  char *in = frame_decoder_space(dec, &space);
+  memcpy(in, data, len);
+  frame_decoder_commit(dec, len);
+}
+
+static size_t frame(char *out, const char *msg)
+{
+  size_t len = strlen(msg);
+  frame_encode_header(len, out);
+  memcpy(out + FRAME_HEADER_SIZE, msg, len);
+  return FRAME_HEADER_SIZE + len;
+}
+
+// Test that several complete messages come out of one read
+int test_frame_batch()
+{
+  static frame_decoder dec;
+  char wire[64];
+  size_t len = 0;
+  const char *msg;
+  uint32_t msg_len;
+
+  frame_decoder_init(&dec);
+  len += frame(wire + len, "hi");
+  len += frame(wire + len, "");
+  len += frame(wire + len, "there");
+  receive(&dec, wire, len);
+
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL(2, (int)msg_len);
+  ASSERT_TRUE(memcmp(msg, "hi", 2) == 0);
+
+  // Messages point into the decoder, nothing was copied
+  ASSERT_TRUE(msg == dec.data + FRAME_HEADER_SIZE);
+
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL(0, (int)msg_len);
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_TRUE(msg_len == 5 && memcmp(msg, "there", 5) == 0);
+  ASSERT_EQUAL(0, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL(0, (int)frame_decoder_pending(&dec));
+
+  return TEST_PASS;
+}
+
+// Test that a message split across reads is reassembled
+int test_frame_partial()
+{
+  static frame_decoder dec;
+  char wire[64];
+  const char *msg;
+  uint32_t msg_len;
+
+  frame_decoder_init(&dec);
+  size_t first = frame(wire, "one");
+  size_t len = first + frame(wire + first, "a longer message");
+
+  // The first message and part of the second header
+  receive(&dec, wire, first + 2);
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL(0, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL(2, (int)frame_decoder_pending(&dec));
+
+  // The partial message moves to the front, the rest arrives in two parts
+  receive(&dec, wire + first + 2, 10);
+  ASSERT_EQUAL(0, (int)dec.start);
+  ASSERT_EQUAL(0, frame_decoder_next(&dec, &msg, &msg_len));
+  receive(&dec, wire + first + 12, len - first - 12);
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_TRUE(msg_len == 16 && memcmp(msg, "a longer message", 16) == 0);
+
+  return TEST_PASS;
+}
+
+// Test that an oversized length is reported instead of waited for
+int test_frame_too_large()
+{
+  static frame_decoder dec;
+  char header[FRAME_HEADER_SIZE];
+  const char *msg;
+  uint32_t msg_len;
+
+  frame_decoder_init(&dec);
+  frame_encode_header(FRAME_MAX_MESSAGE + 1, header);
+  receive(&dec, header, sizeof(header));
+  ASSERT_EQUAL(-1, frame_decoder_next(&dec, &msg, &msg_len));
+
+  // The largest message fits behind a partial one
+  size_t space;
+  frame_decoder_init(&dec);
+  receive(&dec, header, 2);
+  frame_decoder_space(&dec, &space);
+  ASSERT_TRUE(space >= FRAME_HEADER_SIZE + FRAME_MAX_MESSAGE);
+
+  return TEST_PASS;
+}
+
+// Test that a compressed frame expands, and that only text worth it is
+// compressed
+int test_frame_compressed()
+{
+  static frame_decoder dec;
+  char wire[FRAME_COMPRESSED_HEADER_SIZE + FRAME_MAX_MESSAGE];
+  const char *msg;
+  uint32_t msg_len;
+  const char *text = "thanks, I'll let you know tomorrow morning if the update works";
+  size_t text_len = strlen(text);
+
+  frame_decoder_init(&dec);
+  size_t len = frame_encode_compressed(text, text_len, wire, sizeof(wire));
+  ASSERT_TRUE(len > 0 && len < FRAME_HEADER_SIZE + text_len);
+  len += frame(wire + len, "raw");
+  receive(&dec, wire, len);
+
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL((int)text_len, (int)msg_len);
+  ASSERT_TRUE(memcmp(msg, text, text_len) == 0);
+  ASSERT_EQUAL(1, frame_decoder_next(&dec, &msg, &msg_len));
+  ASSERT_EQUAL(3, (int)msg_len);
+  ASSERT_EQUAL(0, frame_decoder_next(&dec, &msg, &msg_len));
+
+  // Short messages and compressed files go out as they are
+  ASSERT_EQUAL(0, (int)frame_encode_compressed("ok", 2, wire, sizeof(wire)));
+  char png[64] = "\x89PNG\r\n\x1a\n";
+  ASSERT_EQUAL(0, (int)frame_encode_compressed(png, sizeof(png), wire, sizeof(wire)));
+
+  // A body that does not expand to its announced length
+  frame_decoder_init(&dec);
+  len = frame_encode_compressed(text, text_len, wire, sizeof(wire));
+  wire[FRAME_HEADER_SIZE + 1]++;
+  receive(&dec, wire, len);
+  ASSERT_EQUAL(-1, frame_decoder_next(&dec, &msg, &msg_len));
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_frame_batch);
+  RUN_TEST(test_frame_partial);
+  RUN_TEST(test_frame_too_large);
+  RUN_TEST(test_frame_compressed);
+
+  printf("All framing tests passed!\n");
+  return TEST_PASS;
+}
@@ -0,0 +1,181 @@
+#include "test_utils.h"
+#include "ledbat.h"
+
+#define TEST_MSS 44
+
+// Feed a run of ACKs with the same one-way delay
+static void ack_with_delay(ledbat_state *ledbat, uint64_t *now_us, uint32_t delay_us,
+                           int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    *now_us += 1000;
+    ledbat_on_ack(ledbat, *now_us, delay_us, TEST_MSS, ledbat->cwnd);
+  }
+}
+
+// Test initial LEDBAT state
+int test_ledbat_init()
+{
+  ledbat_state ledbat;
+  ledbat_init(&ledbat, TEST_MSS);
+
+  ASSERT_EQUAL(LEDBAT_INIT_CWND * TEST_MSS, ledbat.cwnd);
+  ASSERT_EQUAL(LEDBAT_TARGET_US, ledbat.target_us);
+  ASSERT_EQUAL(0, ledbat.base_count);
+
+  return TEST_PASS;
+}
+
+// Test that cwnd grows while queueing delay stays below target
+int test_ledbat_grows_below_target()
+{
+  ledbat_state ledbat;
+  uint64_t now = 0;
+
+  ledbat_init(&ledbat, TEST_MSS);
+  uint32_t initial_cwnd = ledbat.cwnd;
+
+  ack_with_delay(&ledbat, &now, 5000, 50);
+
+  ASSERT_EQUAL(0, ledbat.queuing_delay_us);
+  ASSERT_TRUE(ledbat.cwnd > initial_cwnd);
+
+  return TEST_PASS;
+}
+
+// Test that cwnd backs off once delay rises above target, before any loss
+int test_ledbat_backs_off_above_target()
+{
+  ledbat_state ledbat;
+  uint64_t now = 0;
+
+  ledbat_init(&ledbat, TEST_MSS);
+
+  // Establish the base delay and open the window
+  ack_with_delay(&ledbat, &now, 5000, 100);
+  uint32_t open_cwnd = ledbat.cwnd;
+
+  // Queueing delay of twice the target
+  ack_with_delay(&ledbat, &now, 5000 + 2 * LEDBAT_TARGET_US, 20);
+
+  ASSERT_EQUAL(2 * LEDBAT_TARGET_US, ledbat.queuing_delay_us);
+  ASSERT_TRUE(ledbat.cwnd < open_cwnd);
+  ASSERT_TRUE(ledbat.cwnd >= LEDBAT_MIN_CWND * TEST_MSS);
+
+  return TEST_PASS;
+}
+
+// Test that an arbitrary clock offset, even one that wraps, does not matter
+int test_ledbat_clock_offset()
+{
+  ledbat_state ledbat;
+  uint64_t now = 0;
+  uint32_t offset = 0xFFFFF000;
+
+  ledbat_init(&ledbat, TEST_MSS);
+
+  ack_with_delay(&ledbat, &now, offset + 5000, 20);
+  ASSERT_EQUAL(0, ledbat.queuing_delay_us);
+
+  ack_with_delay(&ledbat, &now, offset + 5000 + LEDBAT_TARGET_US, 4);
+  ASSERT_EQUAL(LEDBAT_TARGET_US, ledbat.queuing_delay_us);
+
+  return TEST_PASS;
+}
+
+// Test that old base delay minima expire after the history window
+int test_ledbat_base_delay_expiry()
+{
+  ledbat_state ledbat;
+  uint64_t now = 0;
+
+  ledbat_init(&ledbat, TEST_MSS);
+
+  ack_with_delay(&ledbat, &now, 1000, 4);
+
+  // The path now has a higher fixed delay
+  for (int interval = 0; interval < LEDBAT_BASE_HISTORY; interval++)
+  {
+    now += LEDBAT_BASE_INTERVAL_US;
+    ack_with_delay(&ledbat, &now, 20000, 4);
+  }
+
+  ASSERT_EQUAL(0, ledbat.queuing_delay_us);
+
+  return TEST_PASS;
+}
+
+// Test loss and timeout responses
+int test_ledbat_loss()
+{
+  ledbat_state ledbat;
+  uint64_t now = 0;
+
+  ledbat_init(&ledbat, TEST_MSS);
+  ack_with_delay(&ledbat, &now, 5000, 100);
+
+  uint32_t cwnd = ledbat.cwnd;
+  ledbat_on_loss(&ledbat);
+  ASSERT_TRUE(ledbat.cwnd == cwnd / 2 || ledbat.cwnd == LEDBAT_MIN_CWND * TEST_MSS);
+
+  ledbat_on_timeout(&ledbat);
+  ASSERT_EQUAL(TEST_MSS, ledbat.cwnd);
+
+  return TEST_PASS;
+}
+
+// Test LEDBAT selection through congestion control
+int test_ledbat_congestion_control()
+{
+  congestion_control_state cc_state;
+  flow_control_state fc_state;
+  rate_sample rs;
+
+  memset(&fc_state, 0, sizeof(fc_state));
+  fc_state.receiver_window = 10000;
+
+  init_congestion_control(&cc_state, TEST_MSS);
+  set_congestion_algorithm(&cc_state, CC_LEDBAT);
+  ASSERT_EQUAL(CC_LEDBAT, cc_state.algorithm);
+  ASSERT_EQUAL(LEDBAT_INIT_CWND * TEST_MSS, cc_state.cwnd);
+
+  // ACKs without a delay sample leave the window alone
+  memset(&rs, 0, sizeof(rs));
+  rs.acked = TEST_MSS;
+  rs.in_flight = cc_state.cwnd;
+  on_rate_sample(&cc_state, &fc_state, &rs);
+  ASSERT_EQUAL(LEDBAT_INIT_CWND * TEST_MSS, cc_state.cwnd);
+
+  rs.has_delay = 1;
+  rs.delay_us = 3000;
+  on_rate_sample(&cc_state, &fc_state, &rs);
+  ASSERT_TRUE(cc_state.cwnd > LEDBAT_INIT_CWND * TEST_MSS);
+
+  // Three duplicate ACKs halve the window once
+  cc_state.last_ack = 1000;
+  cc_state.cwnd = cc_state.ledbat.cwnd = 20 * TEST_MSS;
+  for (int i = 0; i < DUPLICATE_ACK_THRESHOLD + 2; i++)
+  {
+    update_congestion_window(&cc_state, &fc_state, 1000, 1);
+  }
+  ASSERT_EQUAL(10 * TEST_MSS, cc_state.cwnd);
+  ASSERT_EQUAL(FAST_RECOVERY, cc_state.state);
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_ledbat_init);
+  RUN_TEST(test_ledbat_grows_below_target);
+  RUN_TEST(test_ledbat_backs_off_above_target);
+  RUN_TEST(test_ledbat_clock_offset);
+  RUN_TEST(test_ledbat_base_delay_expiry);
+  RUN_TEST(test_ledbat_loss);
+  RUN_TEST(test_ledbat_congestion_control);
+
+  printf("All LEDBAT tests passed!\n");
+  return TEST_PASS;
+}
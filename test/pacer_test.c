@@ -0,0 +1,134 @@
+#include "test_utils.h"
+#include "pacer.h"
+
+#define TEST_MSS 44
+#define TEST_RATE 44000 // One segment per millisecond
+
+// Test that an unpaced sender releases everything immediately
+int test_pacer_disabled()
+{
+  pacer_state pacer;
+  pacer_init(&pacer, TEST_MSS);
+
+  for (int i = 0; i < 10; i++)
+  {
+    ASSERT_EQUAL(1000, (int)pacer_release_time(&pacer, TEST_MSS, 1000));
+    pacer_on_send(&pacer, TEST_MSS, 1000);
+  }
+
+  return TEST_PASS;
+}
+
+// Test that a full bucket lets a short burst out, then spaces segments
+int test_pacer_spacing()
+{
+  pacer_state pacer;
+  uint64_t now = 1000;
+
+  pacer_init(&pacer, TEST_MSS);
+  pacer_set_rate(&pacer, TEST_RATE);
+
+  // The bucket holds PACER_BURST_SEGMENTS segments
+  for (int i = 0; i < PACER_BURST_SEGMENTS; i++)
+  {
+    uint64_t release = pacer_release_time(&pacer, TEST_MSS, now);
+    ASSERT_EQUAL((int)now, (int)release);
+    pacer_on_send(&pacer, TEST_MSS, release);
+  }
+
+  // Afterwards each segment waits len / rate
+  uint64_t prev = now;
+  for (int i = 0; i < 5; i++)
+  {
+    uint64_t release = pacer_release_time(&pacer, TEST_MSS, now);
+    ASSERT_EQUAL(1000, (int)(release - prev));
+    pacer_on_send(&pacer, TEST_MSS, release);
+    prev = release;
+  }
+
+  return TEST_PASS;
+}
+
+// Test that idle time does not bank more than one burst of credit
+int test_pacer_idle_cap()
+{
+  pacer_state pacer;
+  uint64_t now = 1000;
+
+  pacer_init(&pacer, TEST_MSS);
+  pacer_set_rate(&pacer, TEST_RATE);
+  pacer_on_send(&pacer, TEST_MSS, now);
+
+  // A long idle period
+  now += 10000000;
+
+  int immediate = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    uint64_t release = pacer_release_time(&pacer, TEST_MSS, now);
+    if (release == now)
+    {
+      immediate++;
+    }
+    pacer_on_send(&pacer, TEST_MSS, release);
+  }
+  ASSERT_EQUAL(PACER_BURST_SEGMENTS, immediate);
+
+  return TEST_PASS;
+}
+
+// Test that the lookahead follows whether kernel pacing is in use
+int test_pacer_txtime()
+{
+  pacer_state pacer;
+  pacer_init(&pacer, TEST_MSS);
+  ASSERT_EQUAL(0, (int)pacer_lookahead(&pacer));
+
+  int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_TRUE(socket_fd >= 0);
+
+  int enabled = pacer_enable_txtime(&pacer, socket_fd);
+  ASSERT_EQUAL(enabled, pacer.use_txtime);
+  ASSERT_EQUAL(enabled ? PACER_TXTIME_HORIZON_US : 0, (int)pacer_lookahead(&pacer));
+
+  close(socket_fd);
+  return TEST_PASS;
+}
+
+// Test the pacing rate derived for window-based congestion control
+int test_window_pacing_rate()
+{
+  congestion_control_state cc_state;
+
+  init_congestion_control(&cc_state, TEST_MSS);
+  cc_state.cwnd = 100 * TEST_MSS;
+
+  // No RTT sample yet
+  update_pacing_rate(&cc_state, 0);
+  ASSERT_EQUAL(0, (int)get_pacing_rate(&cc_state));
+
+  // Slow start paces at twice cwnd per SRTT
+  update_pacing_rate(&cc_state, 10000);
+  ASSERT_EQUAL(2 * 100 * TEST_MSS * 100, (int)get_pacing_rate(&cc_state));
+
+  // Congestion avoidance leaves less headroom
+  cc_state.state = CONGESTION_AVOIDANCE;
+  update_pacing_rate(&cc_state, 10000);
+  ASSERT_TRUE(get_pacing_rate(&cc_state) < 2 * 100 * TEST_MSS * 100);
+  ASSERT_TRUE(get_pacing_rate(&cc_state) > 100 * TEST_MSS * 100);
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_pacer_disabled);
+  RUN_TEST(test_pacer_spacing);
+  RUN_TEST(test_pacer_idle_cap);
+  RUN_TEST(test_pacer_txtime);
+  RUN_TEST(test_window_pacing_rate);
+
+  printf("All pacer tests passed!\n");
+  return TEST_PASS;
+}
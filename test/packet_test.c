@@ -113,12 +113,35 @@ int test_packet_flags()
   return TEST_PASS;
 }
 
+// Test that the stream option carries the payload length, NULs included
+int test_payload_len()
+{
+  packet pkt;
+
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.data_offset = TIMESTAMP_DATA_OFFSET;
+  strcpy(pkt.payload, "text");
+  ASSERT_EQUAL(4, (int)packet_payload_len(&pkt));
+
+  memset(pkt.payload, 'x', MAX_PAYLOAD_SIZE);
+  ASSERT_EQUAL(MAX_PAYLOAD_SIZE, (int)packet_payload_len(&pkt));
+
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.data_offset = STREAM_DATA_OFFSET;
+  memcpy(pkt.payload, "\0\0\0\x05hello", 9);
+  pkt.payload_len = 9;
+  ASSERT_EQUAL(9, (int)packet_payload_len(&pkt));
+
+  return TEST_PASS;
+}
+
 int main()
 {
   // Run tests
   RUN_TEST(test_packet_init);
   RUN_TEST(test_checksum);
   RUN_TEST(test_packet_flags);
+  RUN_TEST(test_payload_len);
 
   printf("All packet tests passed!\n");
   return TEST_PASS;
@@ -0,0 +1,101 @@
+#include "test_utils.h"
+#include "rack.h"
+
+#define TEST_RTT_US 10000
+
+// Test that nothing is judged lost before any delivery
+int test_rack_init()
+{
+  rack_state rack;
+  rack_init(&rack);
+
+  ASSERT_EQUAL(0, (int)rack_loss_time(&rack, 1000, 100));
+  ASSERT_EQUAL(0, rack.reordering_seen);
+
+  return TEST_PASS;
+}
+
+// Test that a segment sent before a delivered one is lost after an RTT
+// plus the reordering window
+int test_rack_loss_time()
+{
+  rack_state rack;
+  rack_init(&rack);
+
+  // Segments 100 and 144 sent 1 ms apart, only 144 is delivered
+  rack_on_delivered(&rack, 2000, 188, 0, 2000 + TEST_RTT_US);
+  ASSERT_EQUAL(TEST_RTT_US, (int)rack.min_rtt_us);
+
+  rack_update_reo_wnd(&rack, 0, TEST_RTT_US);
+  ASSERT_EQUAL(TEST_RTT_US / RACK_REO_WND_DIVISOR, (int)rack.reo_wnd_us);
+  ASSERT_EQUAL(1000 + TEST_RTT_US + TEST_RTT_US / RACK_REO_WND_DIVISOR,
+               (int)rack_loss_time(&rack, 1000, 144));
+
+  // Segments sent later cannot be judged yet
+  ASSERT_EQUAL(0, (int)rack_loss_time(&rack, 3000, 232));
+
+  // Without reordering on the path the window closes in recovery
+  rack_update_reo_wnd(&rack, 1, TEST_RTT_US);
+  ASSERT_EQUAL(0, (int)rack.reo_wnd_us);
+  ASSERT_EQUAL(1000 + TEST_RTT_US, (int)rack_loss_time(&rack, 1000, 144));
+
+  return TEST_PASS;
+}
+
+// Test that a late delivery of an earlier segment is seen as reordering
+int test_rack_reordering()
+{
+  rack_state rack;
+  rack_init(&rack);
+
+  rack_on_delivered(&rack, 2000, 188, 0, 2000 + TEST_RTT_US);
+  rack_on_delivered(&rack, 1000, 144, 0, 2500 + TEST_RTT_US);
+  ASSERT_EQUAL(1, rack.reordering_seen);
+
+  // The reordering window stays open once reordering was seen
+  rack_update_reo_wnd(&rack, 1, TEST_RTT_US);
+  ASSERT_TRUE(rack.reo_wnd_us > 0);
+
+  // The most recently sent delivered segment is still the reference
+  ASSERT_EQUAL(188, (int)rack.end_seq);
+
+  return TEST_PASS;
+}
+
+// Test that an ACK too fast for a retransmission is not taken for it
+int test_rack_spurious_retransmission()
+{
+  rack_state rack;
+  rack_init(&rack);
+
+  rack_on_delivered(&rack, 1000, 144, 0, 1000 + TEST_RTT_US);
+
+  // Retransmitted at 20000, acked 1 ms later by the original's ACK
+  rack_on_delivered(&rack, 20000, 188, 1, 21000);
+  ASSERT_EQUAL(144, (int)rack.end_seq);
+
+  return TEST_PASS;
+}
+
+// Test the tail loss probe timeout
+int test_rack_probe_timeout()
+{
+  ASSERT_EQUAL(RACK_DEFAULT_PTO_US, (int)rack_probe_timeout(0));
+  ASSERT_EQUAL(RACK_MIN_PTO_US, (int)rack_probe_timeout(100));
+  ASSERT_EQUAL(2 * 50000, (int)rack_probe_timeout(50000));
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_rack_init);
+  RUN_TEST(test_rack_loss_time);
+  RUN_TEST(test_rack_reordering);
+  RUN_TEST(test_rack_spurious_retransmission);
+  RUN_TEST(test_rack_probe_timeout);
+
+  printf("All RACK tests passed!\n");
+  return TEST_PASS;
+}
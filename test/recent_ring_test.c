@@ -0,0 +1,172 @@
+#include "test_utils.h"
+#include <pthread.h>
+#include "recent_ring.h"
+
+// Test that the oldest messages go once the ring holds its count
+int test_ring_evicts_by_count()
+{
+  recent_ring ring;
+  recent_entry entries[8];
+  char buf[256];
+  char text[16];
+
+  ASSERT_EQUAL(0, recent_ring_init(&ring, 4, 1024));
+  ASSERT_EQUAL(0, recent_ring_snapshot(&ring, 3, entries, 8, buf, sizeof(buf)));
+
+  for (int i = 0; i < 10; i++)
+  {
+    int len = snprintf(text, sizeof(text), "message %d", i);
+    ASSERT_EQUAL(0, recent_ring_push(&ring, text, len));
+  }
+
+  ASSERT_EQUAL(3, recent_ring_snapshot(&ring, 3, entries, 8, buf, sizeof(buf)));
+  ASSERT_EQUAL(7, (int)entries[0].id);
+  ASSERT_EQUAL(9, (int)entries[0].len);
+  ASSERT_TRUE(memcmp(entries[0].data, "message 7", 9) == 0);
+  ASSERT_TRUE(memcmp(entries[2].data, "message 9", 9) == 0);
+
+  // Asking for more than is kept is a miss
+  ASSERT_EQUAL(4, recent_ring_snapshot(&ring, 8, entries, 8, buf, sizeof(buf)));
+  ASSERT_EQUAL(6, (int)entries[0].id);
+
+  recent_ring_stats stats;
+  recent_ring_get_stats(&ring, &stats);
+  ASSERT_EQUAL(4, (int)stats.messages);
+  ASSERT_EQUAL(36, (int)stats.bytes);
+  ASSERT_EQUAL(2, (int)stats.hits);
+  ASSERT_EQUAL(1, (int)stats.misses);
+  ASSERT_TRUE(stats.memory >= 1024 + 4 * sizeof(recent_slot));
+
+  recent_ring_free(&ring);
+  return TEST_PASS;
+}
+
+// Test that bytes wrap around the end and the oldest make room
+int test_ring_evicts_by_bytes()
+{
+  recent_ring ring;
+  recent_entry entries[16];
+  char buf[256];
+  char text[40];
+
+  ASSERT_EQUAL(0, recent_ring_init(&ring, 16, 100));
+  ASSERT_EQUAL(-1, recent_ring_push(&ring, buf, 101));
+
+  // 30 bytes each, three fit
+  for (int i = 0; i < 7; i++)
+  {
+    memset(text, 'a' + i, 30);
+    ASSERT_EQUAL(0, recent_ring_push(&ring, text, 30));
+  }
+  ASSERT_EQUAL(3, recent_ring_snapshot(&ring, 16, entries, 16, buf, sizeof(buf)));
+  for (int i = 0; i < 3; i++)
+  {
+    ASSERT_EQUAL(4 + i, (int)entries[i].id);
+    ASSERT_EQUAL(30, (int)entries[i].len);
+    for (int j = 0; j < 30; j++)
+    {
+      ASSERT_EQUAL('a' + 4 + i, entries[i].data[j]);
+    }
+  }
+
+  // A reader's buffer limits the snapshot to the newest that fit
+  ASSERT_EQUAL(2, recent_ring_snapshot(&ring, 3, entries, 16, buf, 70));
+  ASSERT_EQUAL(5, (int)entries[0].id);
+
+  // One message may take all of it
+  ASSERT_EQUAL(0, recent_ring_push(&ring, buf, 100));
+  ASSERT_EQUAL(1, recent_ring_snapshot(&ring, 16, entries, 16, buf, sizeof(buf)));
+  ASSERT_EQUAL(7, (int)entries[0].id);
+
+  recent_ring_free(&ring);
+  return TEST_PASS;
+}
+
+// Test that messages written before the ring was filled count as missing
+int test_ring_skip()
+{
+  recent_ring ring;
+  recent_entry entries[8];
+  char buf[64];
+
+  ASSERT_EQUAL(0, recent_ring_init(&ring, 8, 64));
+  recent_ring_skip(&ring, 10);
+  recent_ring_push(&ring, "eleven", 6);
+  ASSERT_EQUAL(1, recent_ring_snapshot(&ring, 1, entries, 8, buf, sizeof(buf)));
+  ASSERT_EQUAL(10, (int)entries[0].id);
+  ASSERT_EQUAL(1, recent_ring_snapshot(&ring, 2, entries, 8, buf, sizeof(buf)));
+
+  recent_ring_stats stats;
+  recent_ring_get_stats(&ring, &stats);
+  ASSERT_EQUAL(1, (int)stats.hits);
+  ASSERT_EQUAL(1, (int)stats.misses);
+
+  recent_ring_free(&ring);
+  return TEST_PASS;
+}
+
+#define WRITES 200000
+
+// Message i is its number followed by i % 50 copies of its last digit
+static uint32_t make_message(uint64_t i, char *text)
+{
+  int len = snprintf(text, 24, "%llu:", (unsigned long long)i);
+  int extra = i % 50;
+  memset(text + len, '0' + i % 10, extra);
+  return len + extra;
+}
+
+static void *writer(void *arg)
+{
+  recent_ring *ring = arg;
+  char text[80];
+  for (uint64_t i = 0; i < WRITES; i++)
+  {
+    recent_ring_push(ring, text, make_message(i, text));
+  }
+  return NULL;
+}
+
+// Test that snapshots taken while the writer runs only hold whole messages
+int test_ring_concurrent_reader()
+{
+  recent_ring ring;
+  recent_entry entries[32];
+  char buf[2048];
+  char expected[80];
+  pthread_t thread;
+
+  ASSERT_EQUAL(0, recent_ring_init(&ring, 32, 1024));
+  ASSERT_EQUAL(0, pthread_create(&thread, NULL, writer, &ring));
+
+  int snapshots = 0;
+  while (atomic_load(&ring.head) < WRITES)
+  {
+    int n = recent_ring_snapshot(&ring, 32, entries, 32, buf, sizeof(buf));
+    for (int i = 0; i < n; i++)
+    {
+      ASSERT_TRUE(i == 0 || entries[i].id == entries[i - 1].id + 1);
+      uint32_t len = make_message(entries[i].id, expected);
+      ASSERT_EQUAL((int)len, (int)entries[i].len);
+      ASSERT_TRUE(memcmp(entries[i].data, expected, len) == 0);
+    }
+    snapshots++;
+  }
+  pthread_join(thread, NULL);
+  printf("Took %d snapshots while the writer ran\n", snapshots);
+
+  recent_ring_free(&ring);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_ring_evicts_by_count);
+  RUN_TEST(test_ring_evicts_by_bytes);
+  RUN_TEST(test_ring_skip);
+  RUN_TEST(test_ring_concurrent_reader);
+
+  printf("All recent ring tests passed!\n");
+  return TEST_PASS;
+}
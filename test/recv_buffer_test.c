@@ -0,0 +1,116 @@
+#include "test_utils.h"
+#include "recv_buffer.h"
+
+// Test buffering and reading data without streams
+int test_recv_buffer_basic()
+{
+  static recv_buffer buf;
+  char out[16];
+  int has_stream = 1;
+
+  recv_buffer_init(&buf);
+  ASSERT_EQUAL(-1, recv_buffer_next_stream(&buf));
+  ASSERT_EQUAL(0, (int)recv_buffer_read(&buf, 0, out, sizeof(out), &has_stream));
+
+  // Consecutive writes share a run
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 0, 0, 0, "hello ", 6));
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 0, 0, 0, "world", 5));
+  ASSERT_EQUAL(1, buf.chunk_count);
+  ASSERT_EQUAL(11, (int)recv_buffer_unread(&buf));
+  ASSERT_EQUAL(0, recv_buffer_next_stream(&buf));
+
+  // What was read is released at once
+  ASSERT_EQUAL(4, (int)recv_buffer_read(&buf, 0, out, 4, &has_stream));
+  ASSERT_TRUE(memcmp(out, "hell", 4) == 0);
+  ASSERT_EQUAL(0, has_stream);
+  ASSERT_EQUAL(7, (int)recv_buffer_used(&buf));
+  ASSERT_EQUAL(7, (int)recv_buffer_read(&buf, 0, out, sizeof(out), &has_stream));
+  ASSERT_TRUE(memcmp(out, "o world", 7) == 0);
+  ASSERT_EQUAL(0, (int)recv_buffer_used(&buf));
+  ASSERT_EQUAL(0, buf.chunk_count);
+
+  return TEST_PASS;
+}
+
+// Test that streams are read independently, and space is released once
+// everything before it was read
+int test_recv_buffer_streams()
+{
+  static recv_buffer buf;
+  char out[16];
+  int has_stream = 0;
+
+  recv_buffer_init(&buf);
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 1, 2, 0, "bulk", 4));
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 1, 1, 0, "chat", 4));
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 1, 2, 4, "data", 4));
+  ASSERT_EQUAL(3, buf.chunk_count);
+  ASSERT_EQUAL(2, recv_buffer_next_stream(&buf));
+
+  // Stream 1 is read while older data of stream 2 waits
+  ASSERT_EQUAL(4, (int)recv_buffer_read(&buf, 1, out, sizeof(out), &has_stream));
+  ASSERT_TRUE(memcmp(out, "chat", 4) == 0);
+  ASSERT_EQUAL(1, has_stream);
+  ASSERT_EQUAL(8, (int)recv_buffer_unread(&buf));
+  ASSERT_EQUAL(12, (int)recv_buffer_used(&buf));
+  ASSERT_EQUAL(0, (int)recv_buffer_read(&buf, 1, out, sizeof(out), &has_stream));
+
+  // Reading stream 2 releases everything up to what is left of it
+  ASSERT_EQUAL(4, (int)recv_buffer_read(&buf, 2, out, sizeof(out), &has_stream));
+  ASSERT_TRUE(memcmp(out, "bulk", 4) == 0);
+  ASSERT_EQUAL(4, (int)recv_buffer_used(&buf));
+  ASSERT_EQUAL(4, (int)recv_buffer_read(&buf, 2, out, sizeof(out), &has_stream));
+  ASSERT_TRUE(memcmp(out, "data", 4) == 0);
+  ASSERT_EQUAL(-1, recv_buffer_next_stream(&buf));
+  ASSERT_EQUAL(0, (int)recv_buffer_used(&buf));
+
+  return TEST_PASS;
+}
+
+// Test that data wraps around the end of the storage and the buffer
+// refuses what does not fit
+int test_recv_buffer_full()
+{
+  static recv_buffer buf;
+  static char block[RECV_BUFFER_SIZE];
+  char out[8];
+  int has_stream = 0;
+
+  recv_buffer_init(&buf);
+  memset(block, 'x', sizeof(block));
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 0, 0, 0, block, RECV_BUFFER_SIZE - 4));
+  ASSERT_EQUAL(-1, recv_buffer_write(&buf, 0, 0, 0, "abcdefgh", 8));
+  ASSERT_EQUAL(RECV_BUFFER_SIZE - 4, (int)recv_buffer_unread(&buf));
+
+  size_t drained = 0;
+  while (drained < RECV_BUFFER_SIZE - 4)
+  {
+    drained += recv_buffer_read(&buf, 0, block, sizeof(block), &has_stream);
+  }
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 0, 0, 0, "abcdefgh", 8));
+  ASSERT_EQUAL(8, (int)recv_buffer_read(&buf, 0, out, sizeof(out), &has_stream));
+  ASSERT_TRUE(memcmp(out, "abcdefgh", 8) == 0);
+
+  // Interleaved streams use up the runs before the bytes
+  recv_buffer_init(&buf);
+  for (int i = 0; i < RECV_BUFFER_CHUNKS; i++)
+  {
+    ASSERT_EQUAL(0, recv_buffer_write(&buf, 1, i % 2, i / 2, "x", 1));
+  }
+  ASSERT_EQUAL(0, recv_buffer_chunks_free(&buf));
+  ASSERT_EQUAL(-1, recv_buffer_write(&buf, 1, 0, RECV_BUFFER_CHUNKS / 2, "x", 1));
+  ASSERT_EQUAL(0, recv_buffer_write(&buf, 1, 1, RECV_BUFFER_CHUNKS / 2, "x", 1));
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_recv_buffer_basic);
+  RUN_TEST(test_recv_buffer_streams);
+  RUN_TEST(test_recv_buffer_full);
+
+  printf("All receive buffer tests passed!\n");
+  return TEST_PASS;
+}
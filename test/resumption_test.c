@@ -0,0 +1,126 @@
+#include "test_utils.h"
+#include "resumption.h"
+
+#define TEST_CLIENT_IP 0x0100007f // 127.0.0.1 in network byte order
+#define TEST_NOW 5000000000ULL
+
+// Test SipHash-2-4 against the reference vector of its authors
+int test_siphash_vector()
+{
+  uint8_t key[SIPHASH_KEY_SIZE];
+  uint8_t msg[15];
+
+  for (int i = 0; i < SIPHASH_KEY_SIZE; i++)
+  {
+    key[i] = i;
+  }
+  for (int i = 0; i < 15; i++)
+  {
+    msg[i] = i;
+  }
+
+  ASSERT_TRUE(siphash24(key, msg, sizeof(msg)) == 0xa129ca6149be45e5ULL);
+  ASSERT_TRUE(siphash24(key, msg, 0) == 0x726fdb47dd0e0e31ULL);
+
+  return TEST_PASS;
+}
+
+// Test that a token carries the path state back to its issuer
+int test_token_round_trip()
+{
+  resume_issuer issuer;
+  resume_params params = {44, 4096, 880, 20000, 5000};
+  resume_params restored;
+  uint8_t token[RESUME_TOKEN_SIZE];
+
+  resume_issuer_init(&issuer);
+  resume_token_issue(issuer.key, TEST_CLIENT_IP, &params, TEST_NOW, token);
+
+  ASSERT_EQUAL(0, resume_token_verify(issuer.key, TEST_CLIENT_IP, token, TEST_NOW + 1000, &restored));
+  ASSERT_EQUAL(44, restored.mss);
+  ASSERT_EQUAL(4096, restored.window);
+  ASSERT_EQUAL(880, restored.cwnd);
+  ASSERT_EQUAL(20000, (int)restored.srtt_us);
+  ASSERT_EQUAL(5000, (int)restored.rttvar_us);
+
+  return TEST_PASS;
+}
+
+// Test that forged, misplaced, expired and replayed tokens are refused
+int test_token_rejection()
+{
+  resume_issuer issuer;
+  resume_issuer other;
+  resume_params params = {44, 4096, 880, 20000, 5000};
+  resume_params restored;
+  uint8_t token[RESUME_TOKEN_SIZE];
+
+  resume_issuer_init(&issuer);
+  resume_issuer_init(&other);
+  resume_token_issue(issuer.key, TEST_CLIENT_IP, &params, TEST_NOW, token);
+
+  // Another server's key
+  ASSERT_EQUAL(-1, resume_token_verify(other.key, TEST_CLIENT_IP, token, TEST_NOW, &restored));
+
+  // Another client address
+  ASSERT_EQUAL(-1, resume_token_verify(issuer.key, TEST_CLIENT_IP + 1, token, TEST_NOW, &restored));
+
+  // Too old
+  ASSERT_EQUAL(-1, resume_token_verify(issuer.key, TEST_CLIENT_IP, token,
+                                       TEST_NOW + RESUME_LIFETIME_US + 1, &restored));
+
+  // A raised window
+  token[12] ^= 0x10;
+  ASSERT_EQUAL(-1, resume_token_verify(issuer.key, TEST_CLIENT_IP, token, TEST_NOW, &restored));
+  token[12] ^= 0x10;
+
+  // Redeemed once only
+  ASSERT_EQUAL(0, resume_token_redeem(&issuer, TEST_CLIENT_IP, token, TEST_NOW, &restored));
+  ASSERT_EQUAL(-1, resume_token_redeem(&issuer, TEST_CLIENT_IP, token, TEST_NOW, &restored));
+
+  return TEST_PASS;
+}
+
+// Test that a token stays redeemed once more than RESUME_REPLAY_SLOTS
+// others were redeemed after it
+int test_token_replay_after_many()
+{
+  resume_issuer issuer;
+  resume_params params = {44, 4096, 880, 20000, 5000};
+  resume_params restored;
+  uint8_t first[RESUME_TOKEN_SIZE];
+  uint8_t token[RESUME_TOKEN_SIZE];
+
+  resume_issuer_init(&issuer);
+  resume_token_issue(issuer.key, TEST_CLIENT_IP, &params, TEST_NOW, first);
+  ASSERT_EQUAL(0, resume_token_redeem(&issuer, TEST_CLIENT_IP, first, TEST_NOW, &restored));
+
+  for (int i = 1; i <= RESUME_REPLAY_SLOTS; i++)
+  {
+    resume_token_issue(issuer.key, TEST_CLIENT_IP + i, &params, TEST_NOW + i, token);
+    ASSERT_EQUAL(0, resume_token_redeem(&issuer, TEST_CLIENT_IP + i, token, TEST_NOW + 100, &restored));
+  }
+
+  // Forgotten by now, but still well within its lifetime
+  ASSERT_EQUAL(-1, resume_token_redeem(&issuer, TEST_CLIENT_IP, first, TEST_NOW + 1000, &restored));
+
+  // The latest are still remembered one by one, and newer tokens redeem
+  ASSERT_EQUAL(-1, resume_token_redeem(&issuer, TEST_CLIENT_IP + RESUME_REPLAY_SLOTS, token,
+                                       TEST_NOW + 1000, &restored));
+  resume_token_issue(issuer.key, TEST_CLIENT_IP, &params, TEST_NOW + 500, token);
+  ASSERT_EQUAL(0, resume_token_redeem(&issuer, TEST_CLIENT_IP, token, TEST_NOW + 1000, &restored));
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_siphash_vector);
+  RUN_TEST(test_token_round_trip);
+  RUN_TEST(test_token_rejection);
+  RUN_TEST(test_token_replay_after_many);
+
+  printf("All resumption tests passed!\n");
+  return TEST_PASS;
+}
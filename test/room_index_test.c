@@ -0,0 +1,99 @@
+#include "test_utils.h"
+#include "room_index.h"
+
+// Test adding, removing and finding IDs across words
+int test_slot_set()
+{
+  slot_set set;
+  slot_set_init(&set);
+
+  ASSERT_EQUAL(-1, (int)slot_set_next(&set, 0));
+  ASSERT_EQUAL(1, slot_set_add(&set, 3));
+  ASSERT_EQUAL(0, slot_set_add(&set, 3));
+  ASSERT_EQUAL(1, slot_set_add(&set, 64));
+  ASSERT_EQUAL(1, slot_set_add(&set, 70000));
+  ASSERT_EQUAL(3, (int)set.count);
+  ASSERT_TRUE(slot_set_contains(&set, 64));
+  ASSERT_FALSE(slot_set_contains(&set, 65));
+  ASSERT_FALSE(slot_set_contains(&set, 1000000));
+
+  ASSERT_EQUAL(3, (int)slot_set_next(&set, 0));
+  ASSERT_EQUAL(64, (int)slot_set_next(&set, 4));
+  ASSERT_EQUAL(70000, (int)slot_set_next(&set, 65));
+  ASSERT_EQUAL(-1, (int)slot_set_next(&set, 70001));
+
+  // An emptied word drops out of the summary
+  ASSERT_EQUAL(1, slot_set_remove(&set, 64));
+  ASSERT_EQUAL(0, slot_set_remove(&set, 64));
+  ASSERT_EQUAL(70000, (int)slot_set_next(&set, 4));
+  ASSERT_EQUAL(0, (int)(set.summary[0] & 2));
+
+  slot_set_free(&set);
+  return TEST_PASS;
+}
+
+// Test that walking a large set visits every member once, in order
+int test_slot_set_walk()
+{
+  slot_set set;
+  slot_set_init(&set);
+
+  for (uint32_t id = 0; id < 50000; id += 7)
+  {
+    ASSERT_EQUAL(1, slot_set_add(&set, id));
+  }
+
+  uint32_t expected = 0;
+  int visited = 0;
+  for (int64_t id = slot_set_next(&set, 0); id >= 0; id = slot_set_next(&set, id + 1))
+  {
+    ASSERT_EQUAL((int)expected, (int)id);
+    expected += 7;
+    visited++;
+  }
+  ASSERT_EQUAL((int)set.count, visited);
+
+  slot_set_free(&set);
+  return TEST_PASS;
+}
+
+// Test that both directions of the index stay in step
+int test_room_index()
+{
+  room_index index;
+  room_index_init(&index);
+
+  ASSERT_TRUE(room_index_members(&index, 0) == NULL);
+  ASSERT_EQUAL(1, room_index_join(&index, 0, 5));
+  ASSERT_EQUAL(0, room_index_join(&index, 0, 5));
+  ASSERT_EQUAL(1, room_index_join(&index, 2, 5));
+  ASSERT_EQUAL(1, room_index_join(&index, 2, 9));
+
+  ASSERT_EQUAL(1, (int)room_index_members(&index, 0)->count);
+  ASSERT_EQUAL(2, (int)room_index_members(&index, 2)->count);
+  ASSERT_EQUAL(2, (int)room_index_rooms(&index, 5)->count);
+  ASSERT_TRUE(slot_set_contains(room_index_rooms(&index, 9), 2));
+
+  ASSERT_EQUAL(1, room_index_leave(&index, 2, 9));
+  ASSERT_EQUAL(0, room_index_leave(&index, 2, 9));
+  ASSERT_EQUAL(0, (int)room_index_rooms(&index, 9)->count);
+
+  room_index_leave_all(&index, 5);
+  ASSERT_EQUAL(0, (int)room_index_members(&index, 0)->count);
+  ASSERT_EQUAL(0, (int)room_index_members(&index, 2)->count);
+  ASSERT_EQUAL(0, (int)room_index_rooms(&index, 5)->count);
+
+  room_index_free(&index);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_slot_set);
+  RUN_TEST(test_slot_set_walk);
+  RUN_TEST(test_room_index);
+
+  printf("All room index tests passed!\n");
+  return TEST_PASS;
+}
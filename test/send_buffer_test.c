@@ -0,0 +1,120 @@
+#include "test_utils.h"
+#include "send_buffer.h"
+
+// Test queueing, reading and releasing bytes
+int test_send_buffer_basic()
+{
+  send_buffer buf;
+  char out[16];
+
+  send_buffer_init(&buf, 1000);
+  ASSERT_EQUAL(0, (int)send_buffer_used(&buf));
+  ASSERT_EQUAL(SEND_BUFFER_SIZE, (int)send_buffer_space(&buf));
+
+  ASSERT_EQUAL(11, (int)send_buffer_write(&buf, "hello world", 11));
+  ASSERT_EQUAL(11, (int)send_buffer_used(&buf));
+
+  // Segments are sliced by sequence number
+  send_buffer_read(&buf, 1006, out, 5);
+  ASSERT_TRUE(memcmp(out, "world", 5) == 0);
+
+  send_buffer_ack(&buf, 1006);
+  ASSERT_EQUAL(5, (int)send_buffer_used(&buf));
+  send_buffer_read(&buf, 1006, out, 5);
+  ASSERT_TRUE(memcmp(out, "world", 5) == 0);
+
+  // ACKs that are stale or beyond the queued data are ignored
+  send_buffer_ack(&buf, 1002);
+  send_buffer_ack(&buf, 2000);
+  ASSERT_EQUAL(1006, (int)buf.head);
+
+  return TEST_PASS;
+}
+
+// Test that data wraps around the end of the storage, and the sequence space
+int test_send_buffer_wrap()
+{
+  static send_buffer buf;
+  char out[8];
+
+  send_buffer_init(&buf, 0xFFFFFFFC);
+  ASSERT_EQUAL(SEND_BUFFER_SIZE - 4, (int)(buf.tail & (SEND_BUFFER_SIZE - 1)));
+
+  ASSERT_EQUAL(8, (int)send_buffer_write(&buf, "abcdefgh", 8));
+  send_buffer_read(&buf, 0xFFFFFFFE, out, 4);
+  ASSERT_TRUE(memcmp(out, "cdef", 4) == 0);
+
+  send_buffer_ack(&buf, 2);
+  ASSERT_EQUAL(2, (int)buf.head);
+  ASSERT_EQUAL(2, (int)send_buffer_used(&buf));
+
+  return TEST_PASS;
+}
+
+// Test that a full buffer takes no more than it has room for
+int test_send_buffer_full()
+{
+  static send_buffer buf;
+  static char data[SEND_BUFFER_SIZE + 100];
+
+  memset(data, 'x', sizeof(data));
+  send_buffer_init(&buf, 0);
+
+  ASSERT_EQUAL(SEND_BUFFER_SIZE, (int)send_buffer_write(&buf, data, sizeof(data)));
+  ASSERT_EQUAL(0, (int)send_buffer_space(&buf));
+  ASSERT_EQUAL(0, (int)send_buffer_write(&buf, data, 1));
+
+  send_buffer_ack(&buf, 100);
+  ASSERT_EQUAL(100, (int)send_buffer_write(&buf, data, sizeof(data)));
+
+  return TEST_PASS;
+}
+
+// Test that sending returns once data is queued, without waiting for ACKs
+int test_send_returns_when_queued()
+{
+  int sock = create_test_socket(TEST_PORT_BASE + 24);
+  struct sockaddr_in peer_addr;
+  flow_control_state fc_state;
+  char data[10 * MAX_PAYLOAD_SIZE];
+
+  ASSERT_TRUE(sock >= 0);
+
+  // Nobody listens on the peer port
+  memset(&peer_addr, 0, sizeof(peer_addr));
+  peer_addr.sin_family = AF_INET;
+  peer_addr.sin_port = htons(TEST_PORT_BASE + 25);
+  peer_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  init_flow_control(&fc_state, sock, &peer_addr, TEST_PORT_BASE + 24, TEST_PORT_BASE + 25);
+  memset(data, 'q', sizeof(data));
+
+  uint64_t start = get_time_us();
+  ASSERT_EQUAL((int)sizeof(data), send_data_with_flow_control(&fc_state, data, sizeof(data)));
+  ASSERT_TRUE(get_time_us() - start < 100000);
+
+  // Everything is held for retransmission, the first segments are out
+  ASSERT_EQUAL((int)sizeof(data), (int)send_buffer_used(&fc_state.sndbuf));
+  ASSERT_TRUE(fc_state.segment_count > 0);
+  ASSERT_TRUE(fc_state.next_seq_num != fc_state.last_ack_received);
+
+  // Further writes append behind the unacknowledged data
+  ASSERT_EQUAL(4, send_data_with_flow_control(&fc_state, "more", 4));
+  ASSERT_EQUAL((int)sizeof(data) + 4, (int)send_buffer_used(&fc_state.sndbuf));
+
+  release_flow_control(&fc_state);
+  close(sock);
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_send_buffer_basic);
+  RUN_TEST(test_send_buffer_wrap);
+  RUN_TEST(test_send_buffer_full);
+  RUN_TEST(test_send_returns_when_queued);
+
+  printf("All send buffer tests passed!\n");
+  return TEST_PASS;
+}
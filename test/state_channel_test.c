@@ -0,0 +1,141 @@
+#include "test_utils.h"
+#include "state_channel.h"
+
+// Test that a newer value replaces one waiting behind a value in flight
+int test_state_conflation()
+{
+  state_channel ch;
+  state_channel_init(&ch);
+  ASSERT_TRUE(state_channel_due(&ch, 1000, 50000) == NULL);
+  ASSERT_EQUAL(0, (int)state_channel_next_timer(&ch, 50000));
+
+  ASSERT_EQUAL(0, state_channel_set(&ch, 7, "one", 3));
+  state_out *slot = state_channel_due(&ch, 1000, 50000);
+  ASSERT_TRUE(slot != NULL && slot->key == 7);
+  state_channel_sent(slot, 1000);
+  uint32_t first = slot->version;
+
+  // Nothing goes out while "one" is in flight, "three" replaces "two"
+  ASSERT_EQUAL(0, state_channel_set(&ch, 7, "two", 3));
+  ASSERT_EQUAL(0, state_channel_set(&ch, 7, "three", 5));
+  ASSERT_TRUE(state_channel_due(&ch, 2000, 50000) == NULL);
+  ASSERT_EQUAL(51000, (int)state_channel_next_timer(&ch, 50000));
+
+  state_channel_on_ack(&ch, 7, first);
+  slot = state_channel_due(&ch, 3000, 50000);
+  ASSERT_TRUE(slot != NULL);
+  ASSERT_EQUAL(5, (int)slot->len);
+  ASSERT_TRUE(memcmp(slot->value, "three", 5) == 0);
+  state_channel_sent(slot, 3000);
+  state_channel_on_ack(&ch, 7, slot->version);
+  ASSERT_TRUE(state_channel_due(&ch, 100000, 50000) == NULL);
+
+  ASSERT_EQUAL(-1, state_channel_set(&ch, 7, "x", STATE_MAX_VALUE + 1));
+  ASSERT_EQUAL(EMSGSIZE, errno);
+  return TEST_PASS;
+}
+
+// Test that a lost value is replaced by the latest one, with backoff
+int test_state_replace_on_loss()
+{
+  state_channel ch;
+  state_channel_init(&ch);
+
+  state_channel_set(&ch, 1, "typing", 6);
+  state_out *slot = state_channel_due(&ch, 0, 50000);
+  state_channel_sent(slot, 0);
+  int sends = 1;
+  state_channel_set(&ch, 1, "idle", 4);
+
+  // The first send is lost, the resend carries the latest value
+  ASSERT_TRUE(state_channel_due(&ch, 49999, 50000) == NULL);
+  slot = state_channel_due(&ch, 50000, 50000);
+  ASSERT_TRUE(slot != NULL);
+  ASSERT_TRUE(memcmp(slot->value, "idle", 4) == 0);
+  state_channel_sent(slot, 50000);
+  sends++;
+  ASSERT_EQUAL(1, slot->retries);
+  ASSERT_EQUAL(150000, (int)state_channel_next_timer(&ch, 50000));
+
+  // A late acknowledgment of the lost value does not settle the key
+  state_channel_on_ack(&ch, 1, slot->version - 1);
+  ASSERT_TRUE(state_channel_due(&ch, 149999, 50000) == NULL);
+  ASSERT_TRUE(state_channel_next_timer(&ch, 50000) != 0);
+
+  // A peer that never answers makes the key give up after
+  // STATE_MAX_RETRIES sends in all
+  uint64_t now = 150000;
+  while ((slot = state_channel_due(&ch, now, 50000)) != NULL)
+  {
+    state_channel_sent(slot, now);
+    sends++;
+    now += 50000ULL << slot->retries;
+  }
+  ASSERT_EQUAL(STATE_MAX_RETRIES, sends);
+  ASSERT_EQUAL(0, (int)state_channel_next_timer(&ch, 50000));
+  return TEST_PASS;
+}
+
+// Test that keys in flight are kept and settled ones make room
+int test_state_table_full()
+{
+  state_channel ch;
+  state_channel_init(&ch);
+
+  for (int key = 0; key < STATE_MAX_KEYS; key++)
+  {
+    ASSERT_EQUAL(0, state_channel_set(&ch, key, "v", 1));
+  }
+  ASSERT_EQUAL(-1, state_channel_set(&ch, 1000, "v", 1));
+  ASSERT_EQUAL(ENOSPC, errno);
+
+  state_out *slot = state_channel_due(&ch, 0, 50000);
+  state_channel_sent(slot, 0);
+  state_channel_on_ack(&ch, slot->key, slot->version);
+  ASSERT_EQUAL(0, state_channel_set(&ch, 1000, "v", 1));
+  return TEST_PASS;
+}
+
+// Test that the receiver keeps only the newest value of each key
+int test_state_receive()
+{
+  state_channel ch;
+  char buf[STATE_MAX_VALUE];
+  uint16_t key;
+  state_channel_init(&ch);
+
+  ASSERT_EQUAL(-1, (int)state_channel_take(&ch, &key, buf, sizeof(buf)));
+  ASSERT_EQUAL(EAGAIN, errno);
+
+  ASSERT_EQUAL(1, state_channel_on_value(&ch, 3, 5, "five", 4));
+  ASSERT_EQUAL(0, state_channel_on_value(&ch, 3, 4, "four", 4));
+  ASSERT_EQUAL(1, state_channel_on_value(&ch, 3, 6, "six", 3));
+  ASSERT_TRUE(state_channel_readable(&ch));
+  ASSERT_EQUAL(-1, (int)state_channel_take(&ch, &key, buf, 2));
+  ASSERT_EQUAL(EINVAL, errno);
+  ASSERT_EQUAL(3, (int)state_channel_take(&ch, &key, buf, sizeof(buf)));
+  ASSERT_EQUAL(3, (int)key);
+  ASSERT_TRUE(memcmp(buf, "six", 3) == 0);
+  ASSERT_TRUE(!state_channel_readable(&ch));
+
+  // Unread keys are kept, read ones make room
+  for (int k = 100; k < 100 + STATE_MAX_KEYS - 1; k++)
+  {
+    ASSERT_EQUAL(1, state_channel_on_value(&ch, k, 10, "v", 1));
+  }
+  ASSERT_EQUAL(1, state_channel_on_value(&ch, 500, 10, "v", 1));
+  ASSERT_EQUAL(-1, state_channel_on_value(&ch, 501, 10, "v", 1));
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_state_conflation);
+  RUN_TEST(test_state_replace_on_loss);
+  RUN_TEST(test_state_table_full);
+  RUN_TEST(test_state_receive);
+
+  printf("All state channel tests passed!\n");
+  return TEST_PASS;
+}
@@ -0,0 +1,80 @@
+#include "test_utils.h"
+#include "stream.h"
+
+// Test that runs of queued bytes map to stream offsets
+int test_stream_map_chunks()
+{
+  static stream_map map;
+  uint16_t stream_id;
+  uint32_t offset;
+
+  stream_map_init(&map);
+
+  // Consecutive writes to one stream share a chunk
+  ASSERT_EQUAL(10, (int)stream_map_add(&map, 0, 100, 10));
+  ASSERT_EQUAL(5, (int)stream_map_add(&map, 0, 110, 5));
+  ASSERT_EQUAL(1, map.count);
+
+  ASSERT_EQUAL(20, (int)stream_map_add(&map, 3, 115, 20));
+  ASSERT_EQUAL(4, (int)stream_map_add(&map, 0, 135, 4));
+  ASSERT_EQUAL(3, map.count);
+
+  ASSERT_EQUAL(3, (int)stream_map_lookup(&map, 112, &stream_id, &offset));
+  ASSERT_EQUAL(0, stream_id);
+  ASSERT_EQUAL(12, (int)offset);
+
+  ASSERT_EQUAL(15, (int)stream_map_lookup(&map, 120, &stream_id, &offset));
+  ASSERT_EQUAL(3, stream_id);
+  ASSERT_EQUAL(5, (int)offset);
+
+  // Stream 0 carries on where it left off
+  ASSERT_EQUAL(4, (int)stream_map_lookup(&map, 135, &stream_id, &offset));
+  ASSERT_EQUAL(0, stream_id);
+  ASSERT_EQUAL(15, (int)offset);
+  ASSERT_EQUAL(0, (int)stream_map_lookup(&map, 139, &stream_id, &offset));
+
+  // Chunks go once all of their bytes are acknowledged
+  stream_map_ack(&map, 120);
+  ASSERT_EQUAL(2, map.count);
+  stream_map_ack(&map, 139);
+  ASSERT_EQUAL(0, map.count);
+
+  return TEST_PASS;
+}
+
+// Test the limits on stream IDs and chunks
+int test_stream_map_full()
+{
+  static stream_map map;
+  uint32_t seq = 0xFFFFFF00;
+
+  stream_map_init(&map);
+  ASSERT_EQUAL(0, (int)stream_map_add(&map, MAX_STREAMS, seq, 10));
+
+  for (int i = 0; i < MAX_STREAM_CHUNKS; i++)
+  {
+    ASSERT_EQUAL(1, (int)stream_map_add(&map, i % 2, seq, 1));
+    seq++;
+  }
+
+  // A new chunk does not fit, extending the last one still does
+  ASSERT_EQUAL(0, (int)stream_map_add(&map, 0, seq, 1));
+  ASSERT_EQUAL(1, (int)stream_map_add(&map, 1, seq, 1));
+  ASSERT_EQUAL(MAX_STREAM_CHUNKS / 2 + 1, (int)map.snd_offset[1]);
+
+  // Acknowledgements across the wrap of the sequence space free chunks
+  stream_map_ack(&map, 0xFFFFFF00 + 10);
+  ASSERT_EQUAL(MAX_STREAM_CHUNKS - 10, map.count);
+
+  return TEST_PASS;
+}
+
+int main()
+{
+  // Run tests
+  RUN_TEST(test_stream_map_chunks);
+  RUN_TEST(test_stream_map_full);
+
+  printf("All stream tests passed!\n");
+  return TEST_PASS;
+}